@@ -0,0 +1,139 @@
+#include "aov.h"
+#include "../color/color.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int aov_buffers_init(aov_buffers_t *aov, int width, int height) {
+    if ((aov == NULL) || (width < 1) || (height < 1)) {
+        return -1;
+    }
+
+    size_t pixels = (size_t) width * height;
+
+    aov->width = width;
+    aov->height = height;
+    aov->normal = calloc(pixels * 3, sizeof(float));
+    aov->depth = calloc(pixels, sizeof(float));
+    aov->object_id = calloc(pixels, sizeof(uint32_t));
+
+    if ((aov->normal == NULL) || (aov->depth == NULL) || (aov->object_id == NULL)) {
+        aov_buffers_free(aov);
+        return -1;
+    }
+
+    return 0;
+}
+
+void aov_buffers_free(aov_buffers_t *aov) {
+    if (aov == NULL) {
+        return;
+    }
+
+    free(aov->normal);
+    free(aov->depth);
+    free(aov->object_id);
+
+    aov->normal = NULL;
+    aov->depth = NULL;
+    aov->object_id = NULL;
+}
+
+/**
+ * @brief Store the auxiliary data of one pixel.
+ * 
+ * @param aov The buffers to store into.
+ * @param x The pixel column, counted from the left.
+ * @param row The pixel row, counted from the top.
+ * @param normal The surface normal at the first hit, or a zero vector for the background.
+ * @param depth The distance from the camera to the first hit, or 0 for the background.
+ * @param object_id The ID of the object hit first, or 0 for the background.
+ */
+void aov_buffers_store(aov_buffers_t *aov, int x, int row, vec3_t normal, double depth, uint32_t object_id) {
+    size_t plane = (size_t) aov->width * aov->height;
+    size_t p = ((size_t) row * aov->width) + x;
+
+    aov->normal[p] = (float) normal.x;
+    aov->normal[plane + p] = (float) normal.y;
+    aov->normal[(2 * plane) + p] = (float) normal.z;
+    aov->depth[p] = (float) depth;
+    aov->object_id[p] = object_id;
+}
+
+static FILE *aov_open(const char *prefix, const char *suffix, int width, int height) {
+    char filename[FILENAME_MAX];
+
+    if (snprintf(filename, sizeof(filename), "%s%s", prefix, suffix) >= (int) sizeof(filename)) {
+        return NULL;
+    }
+
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file %s\n", filename);
+        return NULL;
+    }
+
+    fprintf(file, "P3\n%d %d\n255\n", width, height);
+
+    return file;
+}
+
+/**
+ * @brief Write the auxiliary buffers as PPM images named PREFIX_normal.ppm, PREFIX_depth.ppm
+ * and PREFIX_id.ppm. Normals are mapped from [-1, 1] to [0, 1] per component, depth is
+ * normalized by the largest depth in the image and IDs are shown as hashed colors.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int aov_buffers_write(const aov_buffers_t *aov, const char *prefix) {
+    if ((aov == NULL) || (prefix == NULL)) {
+        return -1;
+    }
+
+    size_t plane = (size_t) aov->width * aov->height;
+    float max_depth = 0.0f;
+
+    for (size_t p = 0; p < plane; p++) {
+        max_depth = (aov->depth[p] > max_depth) ? aov->depth[p] : max_depth;
+    }
+
+    FILE *normal_file = aov_open(prefix, "_normal.ppm", aov->width, aov->height);
+    FILE *depth_file = aov_open(prefix, "_depth.ppm", aov->width, aov->height);
+    FILE *id_file = aov_open(prefix, "_id.ppm", aov->width, aov->height);
+    int retval = 0;
+
+    if ((normal_file == NULL) || (depth_file == NULL) || (id_file == NULL)) {
+        retval = -1;
+    } else {
+        for (size_t p = 0; p < plane; p++) {
+            color_t n = {
+                .r = 0.5 * (aov->normal[p] + 1.0),
+                .g = 0.5 * (aov->normal[plane + p] + 1.0),
+                .b = 0.5 * (aov->normal[(2 * plane) + p] + 1.0)
+            };
+            write_color(normal_file, n);
+
+            double d = (max_depth > 0.0f) ? (aov->depth[p] / max_depth) : 0.0;
+            write_color(depth_file, (color_t) { d, d, d });
+
+            uint32_t h = aov->object_id[p] * 0x9E3779B1u;
+            unsigned char id_rgb[3] = { (unsigned char) (h >> 24), (unsigned char) (h >> 16), (unsigned char) (h >> 8) };
+            if (aov->object_id[p] == 0) {
+                memset(id_rgb, 0, sizeof(id_rgb));
+            }
+            write_color_bytes(id_file, id_rgb);
+        }
+    }
+
+    if (normal_file != NULL) {
+        fclose(normal_file);
+    }
+    if (depth_file != NULL) {
+        fclose(depth_file);
+    }
+    if (id_file != NULL) {
+        fclose(id_file);
+    }
+
+    return retval;
+}
@@ -0,0 +1,34 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include "../vec3/vec3.h"
+
+#include <stdint.h>
+
+// Auxiliary data of the first hit along a primary ray. prim is NULL if the ray escaped.
+typedef struct {
+    vec3_t normal;
+    double depth;
+    const void *prim;
+} aov_sample_t;
+
+// Planar auxiliary buffers (normal x, y and z planes, depth, object ID), with rows stored top
+// to bottom like the framebuffer. Object ID 0 marks the background.
+typedef struct {
+    int width;
+    int height;
+
+    float *normal;
+    float *depth;
+    uint32_t *object_id;
+} aov_buffers_t;
+
+int aov_buffers_init(aov_buffers_t *aov, int width, int height);
+
+void aov_buffers_free(aov_buffers_t *aov);
+
+void aov_buffers_store(aov_buffers_t *aov, int x, int row, vec3_t normal, double depth, uint32_t object_id);
+
+int aov_buffers_write(const aov_buffers_t *aov, const char *prefix);
+
+#endif
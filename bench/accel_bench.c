@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../sphere/sphere.h"
+#include "../grid/grid.h"
+#include "../cost/cost.h"
+#include "bench.h"
+
+// Keep the brute force pass at roughly this many sphere tests
+#define BRUTE_FORCE_TEST_BUDGET 200000000.0
+
+static int brute_force_hit(sphere_t *spheres, size_t count, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    for (size_t i = 0; i < count; i++) {
+        if (sphere_hit(&spheres[i], r, t_min, closest_so_far, rec) == 1) {
+            hit_anything = 1;
+            closest_so_far = rec->t;
+        }
+    }
+
+    return hit_anything;
+}
+
+static void bench_grid(const char *name, sphere_t *spheres, size_t count, ray_t *rays, size_t ray_count, grid_type_t type, const double *reference_t, size_t reference_count) {
+    grid_t grid;
+
+    double start = cost_seconds();
+    if (grid_build(&grid, spheres, count, type) != 0) {
+        fprintf(stderr, "Could not build %s\n", name);
+        return;
+    }
+    double build_time = cost_seconds() - start;
+
+    size_t hits = 0, mismatches = 0;
+    hit_record_t rec;
+
+    start = cost_seconds();
+    for (size_t i = 0; i < ray_count; i++) {
+        int hit = grid_hit(&grid, rays[i], 0.0, INFINITY, &rec);
+        hits += (hit == 1);
+
+        if (i < reference_count) {
+            double t = (hit == 1) ? rec.t : INFINITY;
+            mismatches += (t != reference_t[i]);
+        }
+    }
+    double trace_time = cost_seconds() - start;
+
+    size_t occluded = 0;
+
+    start = cost_seconds();
+    for (size_t i = 0; i < ray_count; i++) {
+        occluded += (grid_occluded(&grid, rays[i], 0.0, INFINITY) == 1);
+    }
+    double occluded_time = cost_seconds() - start;
+
+    printf("%-12s build %8.2f ms  trace %8.1f ns/ray  %6.2f Mrays/s  hits %zu  mismatches %zu  cells %zu\n",
+           name, build_time * 1e3, trace_time * 1e9 / ray_count, ray_count / trace_time * 1e-6, hits, mismatches, grid.cell_count);
+    printf("%-12s any-hit %6.1f ns/ray  occluded %zu\n", "", occluded_time * 1e9 / ray_count, occluded);
+
+    grid_free(&grid);
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 100000;
+    size_t ray_count = (argc > 2) ? strtoull(argv[2], NULL, 10) : 100000;
+
+    if ((count == 0) || (ray_count == 0)) {
+        fprintf(stderr, "Usage: accel_bench [SPHERES] [RAYS]\n");
+        return 1;
+    }
+
+    sphere_t *spheres = malloc(count * sizeof(sphere_t));
+    ray_t *rays = malloc(ray_count * sizeof(ray_t));
+    size_t brute_count = (size_t) fmin((double) ray_count, fmax(1.0, BRUTE_FORCE_TEST_BUDGET / count));
+    double *reference_t = malloc(brute_count * sizeof(double));
+
+    if ((spheres == NULL) || (rays == NULL) || (reference_t == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    bench_sphere_field(spheres, count);
+    bench_rays_into_cube(rays, ray_count);
+
+    printf("%zu spheres, %zu rays (%zu for brute force)\n", count, ray_count, brute_count);
+
+    hit_record_t rec;
+    size_t hits = 0;
+
+    double start = cost_seconds();
+    for (size_t i = 0; i < brute_count; i++) {
+        int hit = brute_force_hit(spheres, count, rays[i], 0.0, INFINITY, &rec);
+        hits += (hit == 1);
+        reference_t[i] = (hit == 1) ? rec.t : INFINITY;
+    }
+    double trace_time = cost_seconds() - start;
+
+    printf("%-12s build %8.2f ms  trace %8.1f ns/ray  %6.2f Mrays/s  hits %zu\n",
+           "brute force", 0.0, trace_time * 1e9 / brute_count, brute_count / trace_time * 1e-6, hits);
+
+    bench_grid("grid", spheres, count, rays, ray_count, GRID_UNIFORM, reference_t, brute_count);
+    bench_grid("hashgrid", spheres, count, rays, ray_count, GRID_HASHED, reference_t, brute_count);
+
+    free(reference_t);
+    free(rays);
+    free(spheres);
+
+    return 0;
+}
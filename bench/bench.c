@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include <math.h>
+#include "bench.h"
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+/**
+ * @brief Draw a uniform random number in [0, 1) from a fixed-seed xorshift64*, so that
+ * every run of a benchmark measures the same scene.
+ */
+double bench_random() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double) ((rng_state * 0x2545F4914F6CDD1Dull) >> 11) / 9007199254740992.0;
+}
+
+/**
+ * @brief Mean radius of count spheres filling about a tenth of the unit cube.
+ */
+double bench_sphere_radius(size_t count) {
+    return cbrt(0.1 * 3.0 / (4.0 * M_PI * count));
+}
+
+/**
+ * @brief Fill the unit cube with evenly distributed, similar-sized spheres covering about a
+ * tenth of its volume.
+ */
+void bench_sphere_field(sphere_t *spheres, size_t count) {
+    double radius = bench_sphere_radius(count);
+
+    for (size_t i = 0; i < count; i++) {
+        point3_t center = { bench_random(), bench_random(), bench_random() };
+        spheres[i] = sphere_init(center, radius * (0.75 + (0.5 * bench_random())));
+    }
+}
+
+/**
+ * @brief Generate rays from random points just outside the unit cube towards random points
+ * inside it.
+ */
+void bench_rays_into_cube(ray_t *rays, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        point3_t origin = { 3.0 * bench_random() - 1.0, 3.0 * bench_random() - 1.0, -1.0 };
+        point3_t target = { bench_random(), bench_random(), bench_random() };
+        rays[i] = (ray_t) { .origin = origin, .direction = vec3_sub(target, origin) };
+    }
+}
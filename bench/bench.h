@@ -0,0 +1,16 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include "../sphere/sphere.h"
+#include "../ray/ray.h"
+
+double bench_random();
+
+double bench_sphere_radius(size_t count);
+
+void bench_sphere_field(sphere_t *spheres, size_t count);
+
+void bench_rays_into_cube(ray_t *rays, size_t count);
+
+#endif
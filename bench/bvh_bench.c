@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../sphere/sphere.h"
+#include "../bvh/bvh.h"
+#include "../cost/cost.h"
+#include "bench.h"
+
+/**
+ * @brief Trace every ray through a built BVH and print build time, SAH cost and traversal
+ * speed. The first BVH traced fills reference_t, later ones are checked against it.
+ */
+static void bench_traverse(const char *name, bvh_t *bvh, double build_time, ray_t *rays, size_t ray_count, double *reference_t, int fill_reference) {
+    size_t hits = 0, mismatches = 0;
+    hit_record_t rec;
+
+    double start = cost_seconds();
+    for (size_t i = 0; i < ray_count; i++) {
+        int hit = bvh_hit(bvh, rays[i], 0.0, INFINITY, &rec);
+        double t = (hit == 1) ? rec.t : INFINITY;
+
+        hits += (hit == 1);
+
+        if (fill_reference) {
+            reference_t[i] = t;
+        } else {
+            mismatches += (t != reference_t[i]);
+        }
+    }
+    double trace_time = cost_seconds() - start;
+
+    printf("%-16s build %9.1f ms  SAH cost %7.2f  trace %7.1f ns/ray  %6.2f Mrays/s  hits %zu  mismatches %zu\n",
+           name, build_time * 1e3, bvh_sah_cost(bvh), trace_time * 1e9 / ray_count, ray_count / trace_time * 1e-6, hits, mismatches);
+}
+
+static int bench_linear(const char *name, sphere_t *spheres, size_t count, int threads, int morton_bits, int treelet_rounds, ray_t *rays, size_t ray_count, double *reference_t) {
+    bvh_build_settings_t settings = { .threads = threads, .morton_bits = morton_bits, .treelet_rounds = treelet_rounds };
+    bvh_t bvh;
+
+    double start = cost_seconds();
+    if (bvh_build_linear(&bvh, spheres, count, &settings) != 0) {
+        fprintf(stderr, "Could not build %s\n", name);
+        return -1;
+    }
+    double build_time = cost_seconds() - start;
+
+    bench_traverse(name, &bvh, build_time, rays, ray_count, reference_t, 0);
+    bvh_free(&bvh);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t ray_count = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1000000;
+    int threads = (argc > 3) ? atoi(argv[3]) : 0;
+
+    if ((count == 0) || (ray_count == 0) || (threads < 0)) {
+        fprintf(stderr, "Usage: bvh_bench [SPHERES] [RAYS] [THREADS]\n");
+        return 1;
+    }
+
+    sphere_t *spheres = malloc(count * sizeof(sphere_t));
+    ray_t *rays = malloc(ray_count * sizeof(ray_t));
+    double *reference_t = malloc(ray_count * sizeof(double));
+
+    if ((spheres == NULL) || (rays == NULL) || (reference_t == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    bench_sphere_field(spheres, count);
+    bench_rays_into_cube(rays, ray_count);
+
+    printf("%zu spheres, %zu rays, %s build threads\n", count, ray_count, (threads > 0) ? argv[3] : "all");
+
+    // The sequential top-down build is the reference for tree quality and hits
+    bvh_t bvh;
+
+    double start = cost_seconds();
+    if (bvh_build_sah(&bvh, spheres, count) != 0) {
+        fprintf(stderr, "Could not build SAH BVH\n");
+        return 1;
+    }
+    double build_time = cost_seconds() - start;
+
+    bench_traverse("sequential SAH", &bvh, build_time, rays, ray_count, reference_t, 1);
+    bvh_free(&bvh);
+
+    if ((bench_linear("LBVH 30-bit", spheres, count, threads, 30, 0, rays, ray_count, reference_t) != 0) ||
+        (bench_linear("LBVH 63-bit", spheres, count, threads, 63, 0, rays, ray_count, reference_t) != 0) ||
+        (bench_linear("LBVH 30 treelet", spheres, count, threads, 30, 3, rays, ray_count, reference_t) != 0) ||
+        (bench_linear("LBVH 1 thread", spheres, count, 1, 30, 3, rays, ray_count, reference_t) != 0)) {
+        return 1;
+    }
+
+    free(reference_t);
+    free(rays);
+    free(spheres);
+
+    return 0;
+}
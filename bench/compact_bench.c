@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "../sphere/sphere.h"
+#include "../bvh/bvh.h"
+#include "../compact/compact.h"
+#include "../cost/cost.h"
+#include "bench.h"
+
+/**
+ * @brief Trace every ray through a hittable and print memory, build time and traversal speed.
+ * The exact BVH traced first fills reference_t, compact scenes are compared against it by
+ * the rays they hit or miss differently, and those whose distance is off by more than 1e-4
+ * of it, mostly rays grazing a sphere that moved.
+ */
+static void bench_traverse(const char *name, hittable_t world, size_t bytes, size_t count, double build_time, const ray_t *rays, size_t ray_count, double *reference_t, int fill_reference) {
+    size_t hits = 0, disagreements = 0, off = 0;
+    hit_record_t rec;
+
+    double start = cost_seconds();
+    for (size_t i = 0; i < ray_count; i++) {
+        int hit = world.hit(world.ptr, rays[i], 0.0, INFINITY, &rec);
+        double t = (hit == 1) ? rec.t : INFINITY;
+
+        hits += (hit == 1);
+
+        if (fill_reference) {
+            reference_t[i] = t;
+        } else if (isinf(t) != isinf(reference_t[i])) {
+            disagreements++;
+        } else if (!isinf(t)) {
+            off += (fabs(t - reference_t[i]) > 1e-4 * reference_t[i]);
+        }
+    }
+    double trace_time = cost_seconds() - start;
+
+    printf("%-18s %6.2f B/sphere  build %8.1f ms  trace %7.1f ns/ray  hits %zu  disagreements %zu  off %zu\n",
+           name, (double) bytes / count, build_time * 1e3, trace_time * 1e9 / ray_count, hits, disagreements, off);
+}
+
+static int bench_exact(sphere_t *spheres, size_t count, const ray_t *rays, size_t ray_count, double *reference_t) {
+    bvh_build_settings_t settings;
+    bvh_t bvh;
+
+    bvh_default_build_settings(&settings);
+
+    double start = cost_seconds();
+    if (bvh_build_linear(&bvh, spheres, count, &settings) != 0) {
+        fprintf(stderr, "Could not build BVH\n");
+        return -1;
+    }
+    double build_time = cost_seconds() - start;
+
+    size_t bytes = (count * (sizeof(sphere_t) + sizeof(uint32_t))) + (bvh.node_count * sizeof(bvh_node_t));
+    bench_traverse("exact LBVH", bvh_to_hittable(&bvh), bytes, count, build_time, rays, ray_count, reference_t, 1);
+    bvh_free(&bvh);
+
+    return 0;
+}
+
+static int bench_compact(const char *name, const sphere_t *spheres, size_t count, compact_precision_t precision, const ray_t *rays, size_t ray_count, double *reference_t) {
+    compact_t compact;
+
+    double start = cost_seconds();
+    if (compact_build(&compact, spheres, count, precision) != 0) {
+        fprintf(stderr, "Could not build %s\n", name);
+        return -1;
+    }
+    double build_time = cost_seconds() - start;
+
+    bench_traverse(name, compact_to_hittable(&compact), compact_memory(&compact), count, build_time, rays, ray_count, reference_t, 0);
+    printf("%-18s max center error %.2e  max radius error %.2e  palette %zu radii\n", "", compact.max_center_error, compact.max_radius_error, compact.palette_size);
+    compact_free(&compact);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t ray_count = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1000000;
+
+    if ((count == 0) || (ray_count == 0)) {
+        fprintf(stderr, "Usage: compact_bench [SPHERES] [RAYS]\n");
+        return 1;
+    }
+
+    sphere_t *spheres = malloc(count * sizeof(sphere_t));
+    ray_t *rays = malloc(ray_count * sizeof(ray_t));
+    double *reference_t = malloc(ray_count * sizeof(double));
+
+    if ((spheres == NULL) || (rays == NULL) || (reference_t == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    bench_sphere_field(spheres, count);
+    bench_rays_into_cube(rays, ray_count);
+
+    printf("%zu spheres, %zu rays, 1 thread\n", count, ray_count);
+
+    printf("Continuous radii:\n");
+
+    if ((bench_exact(spheres, count, rays, ray_count, reference_t) != 0) ||
+        (bench_compact("compact 16-bit", spheres, count, COMPACT_PRECISION_16, rays, ray_count, reference_t) != 0) ||
+        (bench_compact("compact 21-bit", spheres, count, COMPACT_PRECISION_21, rays, ray_count, reference_t) != 0)) {
+        return 1;
+    }
+
+    // The same scene with radii from a handful of sizes, which the palette keeps exact
+    double radius = bench_sphere_radius(count);
+
+    for (size_t i = 0; i < count; i++) {
+        spheres[i] = sphere_init(spheres[i].center, radius * (0.75 + (0.0625 * (i % 8))));
+    }
+
+    printf("Eight radii:\n");
+
+    if ((bench_exact(spheres, count, rays, ray_count, reference_t) != 0) ||
+        (bench_compact("compact 16-bit", spheres, count, COMPACT_PRECISION_16, rays, ray_count, reference_t) != 0) ||
+        (bench_compact("compact 21-bit", spheres, count, COMPACT_PRECISION_21, rays, ray_count, reference_t) != 0)) {
+        return 1;
+    }
+
+    // The first sphere becomes a huge ground under the volume, which must not share a block
+    // with small spheres whose centers would then be rounded to its far coarser grid
+    spheres[0] = sphere_init((point3_t) { 0.5, -1e4, 0.5 }, 1e4);
+
+    printf("Mixed scales:\n");
+
+    if ((bench_exact(spheres, count, rays, ray_count, reference_t) != 0) ||
+        (bench_compact("compact 16-bit", spheres, count, COMPACT_PRECISION_16, rays, ray_count, reference_t) != 0) ||
+        (bench_compact("compact 21-bit", spheres, count, COMPACT_PRECISION_21, rays, ray_count, reference_t) != 0)) {
+        return 1;
+    }
+
+    free(reference_t);
+    free(rays);
+    free(spheres);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../rt/rt.h"
+#include "../compile/compile.h"
+#include "../cost/cost.h"
+
+// Linked with the translation unit rtcompile writes for bench/compile_bench.scene, see the
+// Makefile. The generic renderer traces the spheres the unit was compiled from.
+
+#define BENCH_WIDTH 640
+#define BENCH_HEIGHT 360
+
+static int bench_generic(const char *name, const rt_scene_t *scene, const rt_camera_t *camera, int runs, framebuffer_t *fb) {
+    rt_settings_t settings;
+    double best = 0.0;
+
+    rt_default_settings(&settings);
+    settings.threads = 1;
+
+    for (int run = 0; run < runs; run++) {
+        framebuffer_clear(fb);
+        double start = cost_seconds();
+
+        if (rt_render(scene, camera, &settings, fb) != 0) {
+            fprintf(stderr, "Could not render with %s\n", name);
+            return -1;
+        }
+
+        double seconds = cost_seconds() - start;
+        best = ((run == 0) || (seconds < best)) ? seconds : best;
+    }
+
+    printf("%-10s %8.2f ms  %7.2f Mrays/s\n", name, best * 1e3, (double) BENCH_WIDTH * BENCH_HEIGHT / best * 1e-6);
+
+    return 0;
+}
+
+static void bench_compiled(const rt_camera_t *camera, int runs, framebuffer_t *fb) {
+    double best = 0.0;
+
+    for (int run = 0; run < runs; run++) {
+        framebuffer_clear(fb);
+        double start = cost_seconds();
+
+        compiled_render(camera, fb);
+
+        double seconds = cost_seconds() - start;
+        best = ((run == 0) || (seconds < best)) ? seconds : best;
+    }
+
+    printf("%-10s %8.2f ms  %7.2f Mrays/s\n", "compiled", best * 1e3, (double) BENCH_WIDTH * BENCH_HEIGHT / best * 1e-6);
+}
+
+static size_t count_mismatches(const framebuffer_t *a, const framebuffer_t *b) {
+    size_t mismatches = 0;
+
+    for (size_t i = 0; i < (size_t) BENCH_WIDTH * BENCH_HEIGHT * 3; i++) {
+        mismatches += (a->rgb[i] != b->rgb[i]);
+    }
+
+    return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+    int runs = (argc > 1) ? atoi(argv[1]) : 5;
+
+    if (runs < 1) {
+        fprintf(stderr, "Usage: compile_bench [RUNS]\n");
+        return 1;
+    }
+
+    scene_desc_t desc;
+    scene_desc_init(&desc);
+
+    for (size_t i = 0; i < compiled_sphere_count; i++) {
+        if (scene_desc_add_sphere(&desc, compiled_spheres[i], SCENE_DEFAULT_MATERIAL) != 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    rt_scene_t list, grid;
+    rt_camera_t camera;
+    framebuffer_t list_fb, grid_fb, compiled_fb;
+
+    if ((rt_scene_init(&list, &desc, RT_ACCEL_NONE) != 0) ||
+        (rt_scene_init(&grid, &desc, RT_ACCEL_GRID) != 0) ||
+        (framebuffer_init(&list_fb, BENCH_WIDTH, BENCH_HEIGHT) != 0) ||
+        (framebuffer_init(&grid_fb, BENCH_WIDTH, BENCH_HEIGHT) != 0) ||
+        (framebuffer_init(&compiled_fb, BENCH_WIDTH, BENCH_HEIGHT) != 0)) {
+        fprintf(stderr, "Could not set up scene\n");
+        return 1;
+    }
+
+    rt_camera_default(&camera);
+
+    printf("%zu spheres, %dx%d, normals, 1 sample per pixel, 1 thread, best of %d\n", compiled_sphere_count, BENCH_WIDTH, BENCH_HEIGHT, runs);
+
+    if ((bench_generic("list", &list, &camera, runs, &list_fb) != 0) ||
+        (bench_generic("grid", &grid, &camera, runs, &grid_fb) != 0)) {
+        return 1;
+    }
+
+    bench_compiled(&camera, runs, &compiled_fb);
+
+    // The compiled tests do the same arithmetic as sphere_hit, in the order of the list
+    printf("Mismatching channels: %zu\n", count_mismatches(&list_fb, &compiled_fb));
+
+    framebuffer_free(&list_fb);
+    framebuffer_free(&grid_fb);
+    framebuffer_free(&compiled_fb);
+    rt_scene_free(&list);
+    rt_scene_free(&grid);
+    scene_desc_free(&desc);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../color/color.h"
+#include "../qoi/qoi.h"
+#include "../framebuffer/framebuffer.h"
+#include "../cost/cost.h"
+
+static void report(const char *name, double seconds, size_t pixels, FILE *file) {
+    long size = ftell(file);
+
+    printf("%-6s %8.2f ms  %8.1f MB/s of RGB input  %10ld bytes  %5.2f bits/pixel\n",
+           name, seconds * 1e3, (pixels * 3.0) / seconds * 1e-6, size, (size * 8.0) / pixels);
+}
+
+int main(int argc, char *argv[]) {
+    int width = (argc > 1) ? atoi(argv[1]) : 1920;
+    int height = (argc > 2) ? atoi(argv[2]) : 1080;
+
+    if ((width < 1) || (height < 1)) {
+        fprintf(stderr, "Usage: image_bench [WIDTH] [HEIGHT]\n");
+        return 1;
+    }
+
+    size_t pixels = (size_t) width * height;
+    color_t *image = malloc(pixels * sizeof(color_t));
+
+    if (image == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // A sky gradient with a normal-shaded disc, like the renderer's current output
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            double x = (2.0 * i / width) - 1.0;
+            double y = (2.0 * j / height) - 1.0;
+            double d = (x * x) + (y * y);
+            color_t c;
+
+            if (d < 0.25) {
+                double z = sqrt(0.25 - d) * 2.0;
+                c = (color_t) { 0.5 * (2.0 * x + 1.0), 0.5 * (2.0 * y + 1.0), 0.5 * (z + 1.0) };
+            } else {
+                double t = 0.5 * (1.0 - y);
+                c = add_color(scale_color((color_t) {1.0, 1.0, 1.0}, (1.0 - t)), scale_color((color_t) {0.5, 0.7, 1.0}, t));
+            }
+
+            image[((size_t) j * width) + i] = c;
+        }
+    }
+
+    printf("%dx%d image\n", width, height);
+
+    FILE *file = tmpfile();
+    if (file == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    double start = cost_seconds();
+    fprintf(file, "P3\n%d %d\n255\n", width, height);
+    for (size_t p = 0; p < pixels; p++) {
+        write_color(file, image[p]);
+    }
+    fflush(file);
+    report("ppm", cost_seconds() - start, pixels, file);
+    fclose(file);
+
+    file = tmpfile();
+    if (file == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    static qoi_encoder_t qoi;
+    unsigned char rgb[3];
+
+    start = cost_seconds();
+    qoi_begin(&qoi, file, width, height);
+    for (size_t p = 0; p < pixels; p++) {
+        color_to_bytes(image[p], rgb);
+        qoi_encode_pixel(&qoi, rgb[0], rgb[1], rgb[2]);
+    }
+    qoi_end(&qoi);
+    fflush(file);
+    report("qoi", cost_seconds() - start, pixels, file);
+    fclose(file);
+
+    // Quantization alone: the scalar per-pixel conversion against the buffered post-process
+    unsigned char *bytes = malloc(pixels * 3);
+    framebuffer_t fb;
+    static tonemap_t tonemap;
+
+    if ((bytes == NULL) || (framebuffer_init(&fb, width, height) != 0)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (int row = 0; row < height; row++) {
+        for (int i = 0; i < width; i++) {
+            framebuffer_add(&fb, i, row, image[((size_t) row * width) + i]);
+        }
+    }
+    fb.samples = 1;
+
+    start = cost_seconds();
+    for (size_t p = 0; p < pixels; p++) {
+        color_to_bytes(image[p], &bytes[p * 3]);
+    }
+    double seconds = cost_seconds() - start;
+    printf("%-8s %8.2f ms  %8.1f Mpixels/s\n", "scalar", seconds * 1e3, pixels / seconds * 1e-6);
+
+    const char *names[] = { "clamp", "reinhard", "aces" };
+
+    for (int op = TONEMAP_CLAMP; op <= TONEMAP_ACES; op++) {
+        tonemap_init(&tonemap, 1.0f, (tonemap_op_t) op);
+
+        start = cost_seconds();
+        framebuffer_resolve(&fb, &tonemap, bytes, 0, height);
+        seconds = cost_seconds() - start;
+        printf("%-8s %8.2f ms  %8.1f Mpixels/s\n", names[op], seconds * 1e3, pixels / seconds * 1e-6);
+    }
+
+    framebuffer_free(&fb);
+    free(bytes);
+    free(image);
+
+    return 0;
+}
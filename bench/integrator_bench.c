@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../rt/rt.h"
+#include "bench.h"
+
+#define BENCH_WIDTH 320
+#define BENCH_HEIGHT 180
+
+static int bench_integrator(const char *name, const rt_scene_t *scene, const rt_camera_t *camera, rt_integrator_t integrator, int rr_depth, int samples, framebuffer_t *fb) {
+    rt_settings_t settings;
+    rt_stats_t stats;
+
+    rt_default_settings(&settings);
+    settings.threads = 1;
+    settings.samples_per_pixel = samples;
+    settings.integrator = integrator;
+    settings.rr_depth = rr_depth;
+    settings.stats = &stats;
+
+    framebuffer_clear(fb);
+
+    if (rt_render(scene, camera, &settings, fb) != 0) {
+        fprintf(stderr, "Could not render with %s\n", name);
+        return -1;
+    }
+
+    // The mean radiance shows whether Russian roulette changes the estimate
+    size_t channels = (size_t) fb->width * fb->height * 3;
+    double sum = 0.0;
+
+    for (size_t i = 0; i < channels; i++) {
+        sum += fb->rgb[i];
+    }
+
+    double paths = (double) fb->width * fb->height * samples;
+    printf("%-10s %8.1f ms  %6.3f Mpaths/s  mean radiance %.4f\n", name, stats.trace_seconds * 1e3, paths / stats.trace_seconds * 1e-6, sum / ((double) channels * samples));
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 10000;
+    int samples = (argc > 2) ? atoi(argv[2]) : 4;
+
+    if ((count == 0) || (samples < 1)) {
+        fprintf(stderr, "Usage: integrator_bench [SPHERES] [SAMPLES]\n");
+        return 1;
+    }
+
+    scene_desc_t desc;
+    size_t materials[3];
+
+    // Bright materials, so that paths bounce around inside the cloud many times
+    scene_desc_init(&desc);
+
+    if ((scene_desc_add_material(&desc, material_diffuse((color_t) { 0.9, 0.85, 0.8 }), &materials[0]) != 0) ||
+        (scene_desc_add_material(&desc, material_metal((color_t) { 0.95, 0.95, 0.95 }, 0.2), &materials[1]) != 0) ||
+        (scene_desc_add_material(&desc, material_dielectric(1.5), &materials[2]) != 0)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // A cloud of spheres filling about a fifth of a box in front of the camera, so that paths
+    // bounce around inside it a few times before escaping
+    double radius = cbrt(0.2 * 3.0 / (4.0 * M_PI * count)) * 4.0;
+
+    for (size_t i = 0; i < count; i++) {
+        point3_t center = { (4.0 * bench_random()) - 2.0, (4.0 * bench_random()) - 2.0, -2.0 - (4.0 * bench_random()) };
+        sphere_t sphere = sphere_init(center, radius * (0.75 + (0.5 * bench_random())));
+
+        if (scene_desc_add_sphere(&desc, sphere, materials[i % 3]) != 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    rt_scene_t scene;
+    rt_camera_t camera;
+    framebuffer_t full, path, wavefront;
+
+    if ((rt_scene_init(&scene, &desc, RT_ACCEL_GRID) != 0) ||
+        (framebuffer_init(&full, BENCH_WIDTH, BENCH_HEIGHT) != 0) ||
+        (framebuffer_init(&path, BENCH_WIDTH, BENCH_HEIGHT) != 0) ||
+        (framebuffer_init(&wavefront, BENCH_WIDTH, BENCH_HEIGHT) != 0)) {
+        fprintf(stderr, "Could not set up scene\n");
+        return 1;
+    }
+
+    rt_camera_default(&camera);
+
+    printf("%zu spheres, %dx%d, %d samples per pixel, 1 thread\n", count, BENCH_WIDTH, BENCH_HEIGHT, samples);
+
+    if ((bench_integrator("full depth", &scene, &camera, RT_INTEGRATOR_PATH, RT_DEFAULT_MAX_DEPTH, samples, &full) != 0) ||
+        (bench_integrator("path", &scene, &camera, RT_INTEGRATOR_PATH, RT_DEFAULT_RR_DEPTH, samples, &path) != 0) ||
+        (bench_integrator("wavefront", &scene, &camera, RT_INTEGRATOR_WAVEFRONT, RT_DEFAULT_RR_DEPTH, samples, &wavefront) != 0)) {
+        return 1;
+    }
+
+    // Both trace the same paths with the same random numbers
+    size_t mismatches = 0;
+    for (size_t i = 0; i < (size_t) BENCH_WIDTH * BENCH_HEIGHT * 3; i++) {
+        mismatches += (path.rgb[i] != wavefront.rgb[i]);
+    }
+    printf("Mismatching channels: %zu\n", mismatches);
+
+    framebuffer_free(&full);
+    framebuffer_free(&path);
+    framebuffer_free(&wavefront);
+    rt_scene_free(&scene);
+    scene_desc_free(&desc);
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "../rt/rt.h"
+
+#define BENCH_WIDTH 160
+#define BENCH_HEIGHT 90
+
+// Samples per pixel of the light sampled reference image the others are compared to
+#define BENCH_REFERENCE_SAMPLES 256
+
+static int render(const rt_scene_t *scene, const rt_camera_t *camera, int light_sampling, int samples, uint32_t sample_offset, framebuffer_t *fb, double *seconds) {
+    rt_settings_t settings;
+    rt_stats_t stats;
+
+    rt_default_settings(&settings);
+    settings.threads = 1;
+    settings.samples_per_pixel = samples;
+    settings.sample_offset = sample_offset;
+    settings.integrator = RT_INTEGRATOR_PATH;
+    settings.light_sampling = light_sampling;
+    settings.stats = &stats;
+
+    framebuffer_clear(fb);
+
+    if (rt_render(scene, camera, &settings, fb) != 0) {
+        return -1;
+    }
+
+    *seconds = stats.trace_seconds;
+    return 0;
+}
+
+// Root mean square error per channel against the reference, and mean radiance
+static void compare(const framebuffer_t *fb, int samples, const framebuffer_t *reference, double *rmse, double *mean) {
+    size_t channels = (size_t) fb->width * fb->height * 3;
+    double squared = 0.0;
+    double sum = 0.0;
+
+    for (size_t i = 0; i < channels; i++) {
+        double value = fb->rgb[i] / samples;
+        double diff = value - (reference->rgb[i] / BENCH_REFERENCE_SAMPLES);
+
+        squared += diff * diff;
+        sum += value;
+    }
+
+    *rmse = sqrt(squared / channels);
+    *mean = sum / channels;
+}
+
+int main(int argc, char *argv[]) {
+    int samples = (argc > 1) ? atoi(argv[1]) : 16;
+
+    if (samples < 1) {
+        fprintf(stderr, "Usage: light_bench [SAMPLES]\n");
+        return 1;
+    }
+
+    // A closed room lit only by a small lamp, so that no light arrives from the sky
+    scene_desc_t desc;
+    size_t wall, red, lamp;
+
+    scene_desc_init(&desc);
+
+    if ((scene_desc_add_material(&desc, material_diffuse((color_t) { 0.7, 0.7, 0.7 }), &wall) != 0) ||
+        (scene_desc_add_material(&desc, material_diffuse((color_t) { 0.7, 0.2, 0.2 }), &red) != 0) ||
+        (scene_desc_add_material(&desc, material_emissive((color_t) { 40.0, 36.0, 30.0 }), &lamp) != 0) ||
+        (scene_desc_add_sphere(&desc, sphere_init((point3_t) { 0, 0, -3 }, 8), wall) != 0) ||
+        (scene_desc_add_sphere(&desc, sphere_init((point3_t) { 0, -1000.8, -3 }, 1000), wall) != 0) ||
+        (scene_desc_add_sphere(&desc, sphere_init((point3_t) { 0, 2.5, -3 }, 0.15), lamp) != 0) ||
+        (scene_desc_add_sphere(&desc, sphere_init((point3_t) { -0.9, -0.3, -2.2 }, 0.5), red) != 0) ||
+        (scene_desc_add_sphere(&desc, sphere_init((point3_t) { 0.9, -0.3, -2.2 }, 0.5), wall) != 0)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    rt_scene_t scene;
+    rt_camera_t camera;
+    framebuffer_t reference, fb;
+
+    if ((rt_scene_init(&scene, &desc, RT_ACCEL_NONE) != 0) ||
+        (framebuffer_init(&reference, BENCH_WIDTH, BENCH_HEIGHT) != 0) ||
+        (framebuffer_init(&fb, BENCH_WIDTH, BENCH_HEIGHT) != 0)) {
+        fprintf(stderr, "Could not set up scene\n");
+        return 1;
+    }
+
+    rt_camera_default(&camera);
+
+    // The reference traces other samples than the images compared to it
+    double seconds;
+
+    if (render(&scene, &camera, 1, BENCH_REFERENCE_SAMPLES, (uint32_t) samples, &reference, &seconds) != 0) {
+        fprintf(stderr, "Could not render reference\n");
+        return 1;
+    }
+
+    double reference_rmse, reference_mean;
+    compare(&reference, BENCH_REFERENCE_SAMPLES, &reference, &reference_rmse, &reference_mean);
+
+    printf("Room lit by one lamp, %dx%d, %d samples per pixel, 1 thread\n", BENCH_WIDTH, BENCH_HEIGHT, samples);
+    printf("Reference: %d samples per pixel, mean radiance %.4f\n", BENCH_REFERENCE_SAMPLES, reference_mean);
+
+    for (int light_sampling = 0; light_sampling <= 1; light_sampling++) {
+        double rmse, mean;
+        const char *name = light_sampling ? "light+bsdf" : "bsdf only";
+
+        if (render(&scene, &camera, light_sampling, samples, 0, &fb, &seconds) != 0) {
+            fprintf(stderr, "Could not render with %s\n", name);
+            return 1;
+        }
+
+        compare(&fb, samples, &reference, &rmse, &mean);
+        printf("%-10s %8.1f ms  RMSE %.4f  mean radiance %.4f\n", name, seconds * 1e3, rmse, mean);
+    }
+
+    framebuffer_free(&reference);
+    framebuffer_free(&fb);
+    rt_scene_free(&scene);
+    scene_desc_free(&desc);
+
+    return 0;
+}
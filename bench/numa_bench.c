@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../rt/rt.h"
+#include "bench.h"
+
+#define BENCH_WIDTH 480
+#define BENCH_HEIGHT 270
+
+static int render(const rt_scene_t *scene, const rt_camera_t *camera, const numa_topology_t *topology, int samples, framebuffer_t *fb, double *seconds) {
+    rt_settings_t settings;
+    rt_stats_t stats;
+
+    rt_default_settings(&settings);
+    settings.samples_per_pixel = samples;
+    settings.integrator = RT_INTEGRATOR_PATH;
+    settings.numa = topology;
+    settings.stats = &stats;
+
+    framebuffer_clear(fb);
+
+    if (rt_render(scene, camera, &settings, fb) != 0) {
+        return -1;
+    }
+
+    *seconds = stats.trace_seconds;
+    return 0;
+}
+
+static size_t mismatches(const framebuffer_t *a, const framebuffer_t *b) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < (size_t) a->width * a->height * 3; i++) {
+        count += (a->rgb[i] != b->rgb[i]);
+    }
+
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 20000;
+    int samples = (argc > 2) ? atoi(argv[2]) : 4;
+
+    if ((count == 0) || (samples < 1)) {
+        fprintf(stderr, "Usage: numa_bench [SPHERES] [SAMPLES]\n");
+        return 1;
+    }
+
+    scene_desc_t desc;
+    size_t materials[2];
+
+    scene_desc_init(&desc);
+
+    if ((scene_desc_add_material(&desc, material_diffuse((color_t) { 0.8, 0.6, 0.5 }), &materials[0]) != 0) ||
+        (scene_desc_add_material(&desc, material_metal((color_t) { 0.9, 0.9, 0.9 }, 0.1), &materials[1]) != 0)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // A large cloud, so that the scene does not fit into the caches and memory placement shows
+    double radius = cbrt(0.1 * 3.0 / (4.0 * M_PI * count)) * 4.0;
+
+    for (size_t i = 0; i < count; i++) {
+        point3_t center = { (4.0 * bench_random()) - 2.0, (4.0 * bench_random()) - 2.0, -2.0 - (4.0 * bench_random()) };
+
+        if (scene_desc_add_sphere(&desc, sphere_init(center, radius), materials[i % 2]) != 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    rt_scene_t scene;
+    rt_camera_t camera;
+    framebuffer_t reference, fb;
+    numa_topology_t detected;
+    double seconds;
+
+    if ((rt_scene_init(&scene, &desc, RT_ACCEL_GRID) != 0) ||
+        (framebuffer_init(&reference, BENCH_WIDTH, BENCH_HEIGHT) != 0) ||
+        (framebuffer_init(&fb, BENCH_WIDTH, BENCH_HEIGHT) != 0)) {
+        fprintf(stderr, "Could not set up scene\n");
+        return 1;
+    }
+
+    rt_camera_default(&camera);
+    numa_topology_detect(&detected);
+
+    if (render(&scene, &camera, NULL, samples, &reference, &seconds) != 0) {
+        fprintf(stderr, "Could not render\n");
+        return 1;
+    }
+
+    printf("%zu spheres, %dx%d, %d samples per pixel, %d node(s) detected\n", count, BENCH_WIDTH, BENCH_HEIGHT, samples, detected.node_count);
+    printf("%-28s %8.1f ms\n", "no placement", seconds * 1e3);
+
+    // Node counts the machine does not have are emulated by splitting its CPUs, which shows
+    // the scheduling cost but not the memory locality gain
+    int node_counts[] = { 1, 2, 4 };
+
+    for (size_t n = 0; n < sizeof(node_counts) / sizeof(node_counts[0]); n++) {
+        numa_topology_t topology = detected;
+        int emulated = topology.node_count != node_counts[n];
+
+        if (emulated && (numa_topology_emulate(&topology, node_counts[n]) != 0)) {
+            fprintf(stderr, "Could not emulate %d nodes\n", node_counts[n]);
+            return 1;
+        }
+
+        for (int replicate = 0; replicate <= 1; replicate++) {
+            rt_scene_t copy;
+            char name[64];
+
+            if ((rt_scene_init(&copy, &desc, RT_ACCEL_GRID) != 0) || (replicate && (rt_scene_replicate(&copy, &topology) != 0))) {
+                fprintf(stderr, "Could not set up scene\n");
+                return 1;
+            }
+
+            if (render(&copy, &camera, &topology, samples, &fb, &seconds) != 0) {
+                fprintf(stderr, "Could not render\n");
+                return 1;
+            }
+
+            snprintf(name, sizeof(name), "%d node(s)%s%s", node_counts[n], emulated ? " emulated" : "", replicate ? ", replicas" : "");
+            printf("%-28s %8.1f ms  mismatching channels: %zu\n", name, seconds * 1e3, mismatches(&fb, &reference));
+
+            rt_scene_free(&copy);
+        }
+    }
+
+    framebuffer_free(&reference);
+    framebuffer_free(&fb);
+    rt_scene_free(&scene);
+    scene_desc_free(&desc);
+
+    return 0;
+}
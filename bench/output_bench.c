@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../rt/rt.h"
+#include "../image/image.h"
+#include "../writer/writer.h"
+#include "../cost/cost.h"
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+
+// Bytes the slow sink takes per read
+#define SINK_CHUNK 65536
+
+// Far end of a pipe that takes data no faster than a given rate, like a file on a slow
+// network filesystem
+typedef struct {
+    int fd;
+    double bytes_per_second;
+    size_t total;
+} sink_t;
+
+static void *sink_run(void *arg) {
+    sink_t *sink = (sink_t*) arg;
+    static char buffer[SINK_CHUNK];
+    double start = 0.0;
+    ssize_t n;
+
+    while ((n = read(sink->fd, buffer, sizeof(buffer))) > 0) {
+        // The rate applies from the first byte on, an idle sink builds up no credit
+        if (sink->total == 0) {
+            start = cost_seconds();
+        }
+
+        sink->total += (size_t) n;
+
+        // Sleep until the data so far would have been written at the given rate
+        double due = start + (sink->total / sink->bytes_per_second) - cost_seconds();
+
+        if (due > 0.0) {
+            struct timespec wait = { .tv_sec = (time_t) due, .tv_nsec = (long) ((due - (time_t) due) * 1e9) };
+            nanosleep(&wait, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Render a frame and write it to a rate limited sink, either after rendering or
+ * streamed by a writer thread while rendering.
+ * 
+ * @return Returns the seconds from starting the render until the sink received everything,
+ * or a negative value on error.
+ */
+static double render_and_write(const rt_scene_t *scene, const rt_camera_t *camera, int samples, image_format_t format, int stream, double bytes_per_second, size_t *bytes) {
+    static image_writer_t writer;
+    static tonemap_t tonemap;
+    int fds[2];
+    pthread_t sink_thread;
+    framebuffer_t fb;
+    rt_settings_t settings;
+    uint8_t *image = malloc((size_t) BENCH_WIDTH * BENCH_HEIGHT * 3);
+
+    if ((image == NULL) || (framebuffer_init(&fb, BENCH_WIDTH, BENCH_HEIGHT) != 0) || (pipe(fds) != 0)) {
+        return -1.0;
+    }
+
+    sink_t sink = { .fd = fds[0], .bytes_per_second = bytes_per_second, .total = 0 };
+    FILE *file = fdopen(fds[1], "w");
+
+    if ((file == NULL) || (pthread_create(&sink_thread, NULL, sink_run, &sink) != 0)) {
+        return -1.0;
+    }
+
+    tonemap_init(&tonemap, 1.0f, TONEMAP_CLAMP);
+    rt_default_settings(&settings);
+    settings.samples_per_pixel = samples;
+    settings.integrator = RT_INTEGRATOR_PATH;
+
+    double start = cost_seconds();
+    int retval = 0;
+
+    if (stream) {
+        if (image_writer_start(&writer, file, format, &fb, (uint32_t) samples, &tonemap) != 0) {
+            return -1.0;
+        }
+
+        settings.rows_done = image_writer_rows_done;
+        settings.rows_done_user = &writer;
+        retval |= rt_render(scene, camera, &settings, &fb);
+        retval |= image_writer_finish(&writer);
+    } else {
+        retval |= rt_render(scene, camera, &settings, &fb);
+        framebuffer_resolve(&fb, &tonemap, image, 0, BENCH_HEIGHT);
+        retval |= image_write(file, format, image, BENCH_WIDTH, BENCH_HEIGHT);
+    }
+
+    // The sink has everything once it sees the end of the pipe
+    fclose(file);
+    pthread_join(sink_thread, NULL);
+    close(fds[0]);
+
+    double seconds = cost_seconds() - start;
+
+    *bytes = sink.total;
+    framebuffer_free(&fb);
+    free(image);
+
+    return (retval != 0) ? -1.0 : seconds;
+}
+
+int main(int argc, char *argv[]) {
+    double mb_per_second = (argc > 1) ? strtod(argv[1], NULL) : 20.0;
+    int samples = (argc > 2) ? atoi(argv[2]) : 2;
+
+    if ((mb_per_second <= 0.0) || (samples < 1)) {
+        fprintf(stderr, "Usage: output_bench [MB_PER_SECOND] [SAMPLES]\n");
+        return 1;
+    }
+
+    scene_desc_t desc;
+    rt_scene_t scene;
+    rt_camera_t camera;
+
+    if ((scene_desc_default(&desc) != 0) || (rt_scene_init(&scene, &desc, RT_ACCEL_NONE) != 0)) {
+        fprintf(stderr, "Could not set up scene\n");
+        return 1;
+    }
+
+    rt_camera_default(&camera);
+
+    printf("Default scene, %dx%d, %d samples per pixel, output limited to %.1f MB/s\n", BENCH_WIDTH, BENCH_HEIGHT, samples, mb_per_second);
+
+    image_format_t formats[] = { IMAGE_FORMAT_PPM, IMAGE_FORMAT_QOI };
+    const char *format_names[] = { "ppm", "qoi" };
+
+    for (int f = 0; f < 2; f++) {
+        for (int stream = 0; stream <= 1; stream++) {
+            size_t bytes;
+            double seconds = render_and_write(&scene, &camera, samples, formats[f], stream, mb_per_second * 1e6, &bytes);
+
+            if (seconds < 0.0) {
+                fprintf(stderr, "Could not render and write\n");
+                return 1;
+            }
+
+            printf("%s %-9s %8.1f ms  %10zu bytes\n", format_names[f], stream ? "streamed" : "after", seconds * 1e3, bytes);
+        }
+    }
+
+    rt_scene_free(&scene);
+    scene_desc_free(&desc);
+
+    return 0;
+}
@@ -0,0 +1,1238 @@
+#include "bvh.h"
+#include "../cost/cost.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Relative costs of visiting a node and of testing a sphere, for the surface area heuristic
+#define BVH_COST_TRAVERSE 1.0
+#define BVH_COST_INTERSECT 1.0
+
+// Key bits sorted per radix sort pass
+#define BVH_RADIX_BITS 8
+#define BVH_RADIX_BUCKETS (1 << BVH_RADIX_BITS)
+
+// Fewest spheres worth a thread of a linear build
+#define BVH_SPHERES_PER_THREAD 16384
+
+// Leaves of the treelets that are restructured
+#define BVH_TREELET_LEAVES 5
+#define BVH_TREELET_SUBSETS (1 << BVH_TREELET_LEAVES)
+
+// Bins per axis that the SAH builder evaluates splits between
+#define BVH_SAH_BINS 16
+
+typedef struct {
+    double min[3];
+    double max[3];
+} bvh_bounds_t;
+
+static void bvh_bounds_empty(bvh_bounds_t *bounds) {
+    for (int axis = 0; axis < 3; axis++) {
+        bounds->min[axis] = INFINITY;
+        bounds->max[axis] = -INFINITY;
+    }
+}
+
+static void bvh_bounds_grow(bvh_bounds_t *bounds, const bvh_bounds_t *other) {
+    for (int axis = 0; axis < 3; axis++) {
+        bounds->min[axis] = (other->min[axis] < bounds->min[axis]) ? other->min[axis] : bounds->min[axis];
+        bounds->max[axis] = (other->max[axis] > bounds->max[axis]) ? other->max[axis] : bounds->max[axis];
+    }
+}
+
+static double bvh_bounds_area(const bvh_bounds_t *bounds) {
+    double dx = bounds->max[0] - bounds->min[0];
+    double dy = bounds->max[1] - bounds->min[1];
+    double dz = bounds->max[2] - bounds->min[2];
+
+    return 2.0 * ((dx * dy) + (dy * dz) + (dz * dx));
+}
+
+static bvh_bounds_t bvh_sphere_bounds(const sphere_t *sphere) {
+    double radius = fabs(sphere->radius);
+
+    return (bvh_bounds_t) {
+        .min = { sphere->center.x - radius, sphere->center.y - radius, sphere->center.z - radius },
+        .max = { sphere->center.x + radius, sphere->center.y + radius, sphere->center.z + radius }
+    };
+}
+
+static bvh_bounds_t bvh_node_bounds(const bvh_node_t *node) {
+    bvh_bounds_t bounds;
+
+    memcpy(bounds.min, node->bounds_min, sizeof(bounds.min));
+    memcpy(bounds.max, node->bounds_max, sizeof(bounds.max));
+
+    return bounds;
+}
+
+static void bvh_node_set_bounds(bvh_node_t *node, const bvh_bounds_t *bounds) {
+    memcpy(node->bounds_min, bounds->min, sizeof(bounds->min));
+    memcpy(node->bounds_max, bounds->max, sizeof(bounds->max));
+}
+
+// Bounds of a child reference, a node or a single sphere
+static bvh_bounds_t bvh_child_bounds(const bvh_t *bvh, uint32_t child) {
+    if (child & BVH_LEAF) {
+        return bvh_sphere_bounds(&bvh->spheres[bvh->prim_indices[child & ~BVH_LEAF]]);
+    }
+
+    return bvh_node_bounds(&bvh->nodes[child]);
+}
+
+/**
+ * @brief Allocate the sphere order and interior nodes of a hierarchy over sphere_count spheres.
+ *
+ * @return Returns 0 on success, -1 if out of memory.
+ */
+static int bvh_alloc(bvh_t *bvh, sphere_t *spheres, size_t sphere_count) {
+    memset(bvh, 0, sizeof(bvh_t));
+    bvh->spheres = spheres;
+    bvh->sphere_count = sphere_count;
+    bvh->node_count = (sphere_count > 1) ? sphere_count - 1 : 0;
+    bvh->root = (sphere_count > 1) ? 0 : BVH_LEAF;
+    bvh->nodes = malloc(((bvh->node_count > 0) ? bvh->node_count : 1) * sizeof(bvh_node_t));
+    bvh->prim_indices = malloc(((sphere_count > 0) ? sphere_count : 1) * sizeof(uint32_t));
+
+    if ((bvh->nodes == NULL) || (bvh->prim_indices == NULL)) {
+        bvh_free(bvh);
+        return -1;
+    }
+
+    bvh->prim_indices[0] = 0;
+
+    return 0;
+}
+
+/**
+ * @brief Check that no leaf lies deeper than the traversal stack reaches.
+ *
+ * @return Returns 0 if the hierarchy can be traversed, -1 if it is too deep.
+ */
+static int bvh_check_depth(const bvh_t *bvh) {
+    struct {
+        uint32_t ref;
+        int depth;
+    } stack[BVH_MAX_DEPTH];
+    int top = 0;
+    uint32_t ref = bvh->root;
+    int depth = 1;
+
+    for (;;) {
+        if (depth > BVH_MAX_DEPTH) {
+            return -1;
+        }
+
+        if (!(ref & BVH_LEAF)) {
+            stack[top].ref = bvh->nodes[ref].child[1];
+            stack[top++].depth = depth + 1;
+            ref = bvh->nodes[ref].child[0];
+            depth++;
+            continue;
+        }
+
+        if (top == 0) {
+            return 0;
+        }
+
+        top--;
+        ref = stack[top].ref;
+        depth = stack[top].depth;
+    }
+}
+
+void bvh_default_build_settings(bvh_build_settings_t *settings) {
+    if (settings == NULL) {
+        return;
+    }
+
+    settings->threads = 0;
+    settings->morton_bits = 30;
+    settings->treelet_rounds = 3;
+}
+
+// Shared state of the threads of a linear build. Phases run one after another, each split
+// into a slot per thread.
+typedef struct bvh_builder {
+    bvh_t *bvh;
+    int threads;
+    int morton_bits;
+
+    // Centroid bounds of the spheres of every slot, and of all spheres
+    bvh_bounds_t *slot_bounds;
+    bvh_bounds_t centroid_bounds;
+
+    // Morton codes and sphere indices, sorted back and forth between the two buffers, with
+    // the sorted ones in buffer src
+    uint64_t *keys[2];
+    uint32_t *values[2];
+    int src;
+
+    // Digit counts of every slot, turned into the scatter offsets of the slot
+    size_t *histograms;
+    int shift;
+
+    // Build state of the interior nodes: the spheres below, the SAH cost of the subtree and
+    // the arrivals of bottom-up passes. Leaves keep a link to their parent node.
+    uint32_t *leaf_parents;
+    bvh_bounds_t *leaf_bounds;
+    uint32_t *leaf_counts;
+    double *costs;
+    atomic_uint *visits;
+    int optimize;
+
+    // Fewest spheres below a node for it to root a treelet in the current round
+    uint32_t treelet_min_spheres;
+
+    pthread_t *handles;
+} bvh_builder_t;
+
+// A phase of a linear build, run for every slot by as many threads as could be started
+typedef struct {
+    bvh_builder_t *builder;
+    void (*run) (bvh_builder_t*, int);
+    atomic_int next;
+} bvh_phase_t;
+
+static void *bvh_phase_worker(void *arg) {
+    bvh_phase_t *phase = (bvh_phase_t*) arg;
+    int slot;
+
+    while ((slot = atomic_fetch_add(&phase->next, 1)) < phase->builder->threads) {
+        phase->run(phase->builder, slot);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Run every slot of a phase and wait for all of them. The calling thread takes slots
+ * too, so a phase completes even if no thread could be started.
+ */
+static void bvh_run_phase(bvh_builder_t *builder, void (*run) (bvh_builder_t*, int)) {
+    bvh_phase_t phase = { .builder = builder, .run = run };
+    int started = 0;
+
+    atomic_init(&phase.next, 0);
+
+    for (int t = 1; t < builder->threads; t++) {
+        if (pthread_create(&builder->handles[started], NULL, bvh_phase_worker, &phase) == 0) {
+            started++;
+        }
+    }
+
+    bvh_phase_worker(&phase);
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(builder->handles[t], NULL);
+    }
+}
+
+// Range [begin, end) of count items that a slot works on
+static void bvh_slot_range(const bvh_builder_t *builder, size_t count, int slot, size_t *begin, size_t *end) {
+    *begin = (count * (size_t) slot) / (size_t) builder->threads;
+    *end = (count * ((size_t) slot + 1)) / (size_t) builder->threads;
+}
+
+static void bvh_phase_centroid_bounds(bvh_builder_t *builder, int slot) {
+    const sphere_t *spheres = builder->bvh->spheres;
+    bvh_bounds_t *bounds = &builder->slot_bounds[slot];
+    size_t begin, end;
+
+    bvh_slot_range(builder, builder->bvh->sphere_count, slot, &begin, &end);
+    bvh_bounds_empty(bounds);
+
+    for (size_t i = begin; i < end; i++) {
+        bvh_bounds_t centroid = { .min = { spheres[i].center.x, spheres[i].center.y, spheres[i].center.z } };
+        memcpy(centroid.max, centroid.min, sizeof(centroid.min));
+        bvh_bounds_grow(bounds, &centroid);
+    }
+}
+
+// Spread the low 21 bits of v out to every third bit
+static uint64_t bvh_spread_bits(uint64_t v) {
+    v &= 0x1fffffull;
+    v = (v | (v << 32)) & 0x1f00000000ffffull;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+    v = (v | (v << 8)) & 0x100f00f00f00f00full;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+
+    return v;
+}
+
+static void bvh_phase_morton_codes(bvh_builder_t *builder, int slot) {
+    const sphere_t *spheres = builder->bvh->spheres;
+    const bvh_bounds_t *bounds = &builder->centroid_bounds;
+    int axis_bits = builder->morton_bits / 3;
+    double cells = (double) ((1u << axis_bits) - 1);
+    double scale[3];
+    size_t begin, end;
+
+    for (int axis = 0; axis < 3; axis++) {
+        double extent = bounds->max[axis] - bounds->min[axis];
+        scale[axis] = (extent > 0.0) ? (cells / extent) : 0.0;
+    }
+
+    bvh_slot_range(builder, builder->bvh->sphere_count, slot, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        double centroid[3] = { spheres[i].center.x, spheres[i].center.y, spheres[i].center.z };
+        uint64_t key = 0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            double q = (centroid[axis] - bounds->min[axis]) * scale[axis];
+            uint64_t cell = (q < cells) ? (uint64_t) q : (uint64_t) cells;
+            key |= bvh_spread_bits(cell) << (2 - axis);
+        }
+
+        builder->keys[0][i] = key;
+        builder->values[0][i] = (uint32_t) i;
+    }
+}
+
+static void bvh_phase_radix_count(bvh_builder_t *builder, int slot) {
+    const uint64_t *keys = builder->keys[builder->src];
+    size_t *histogram = &builder->histograms[(size_t) slot * BVH_RADIX_BUCKETS];
+    size_t begin, end;
+
+    bvh_slot_range(builder, builder->bvh->sphere_count, slot, &begin, &end);
+    memset(histogram, 0, BVH_RADIX_BUCKETS * sizeof(size_t));
+
+    for (size_t i = begin; i < end; i++) {
+        histogram[(keys[i] >> builder->shift) & (BVH_RADIX_BUCKETS - 1)]++;
+    }
+}
+
+static void bvh_phase_radix_scatter(bvh_builder_t *builder, int slot) {
+    const uint64_t *keys = builder->keys[builder->src];
+    const uint32_t *values = builder->values[builder->src];
+    uint64_t *sorted_keys = builder->keys[builder->src ^ 1];
+    uint32_t *sorted_values = builder->values[builder->src ^ 1];
+    size_t *offsets = &builder->histograms[(size_t) slot * BVH_RADIX_BUCKETS];
+    size_t begin, end;
+
+    bvh_slot_range(builder, builder->bvh->sphere_count, slot, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        size_t to = offsets[(keys[i] >> builder->shift) & (BVH_RADIX_BUCKETS - 1)]++;
+        sorted_keys[to] = keys[i];
+        sorted_values[to] = values[i];
+    }
+}
+
+/**
+ * @brief Sort the Morton codes with their sphere indices, least significant digit first.
+ * Every pass counts digits per slot in parallel, turns the counts into offsets at which
+ * slots scatter their keys in order, and scatters in parallel. Passes over a digit that all
+ * keys share are skipped.
+ */
+static void bvh_radix_sort(bvh_builder_t *builder) {
+    size_t count = builder->bvh->sphere_count;
+
+    for (builder->shift = 0; builder->shift < builder->morton_bits; builder->shift += BVH_RADIX_BITS) {
+        bvh_run_phase(builder, bvh_phase_radix_count);
+
+        size_t offset = 0;
+        int skip = 0;
+
+        for (int digit = 0; digit < BVH_RADIX_BUCKETS; digit++) {
+            size_t digit_start = offset;
+
+            for (int slot = 0; slot < builder->threads; slot++) {
+                size_t *bucket = &builder->histograms[((size_t) slot * BVH_RADIX_BUCKETS) + digit];
+                size_t slot_count = *bucket;
+
+                *bucket = offset;
+                offset += slot_count;
+            }
+
+            skip |= (offset - digit_start == count);
+        }
+
+        if (!skip) {
+            bvh_run_phase(builder, bvh_phase_radix_scatter);
+            builder->src ^= 1;
+        }
+    }
+}
+
+// Length of the common prefix of the sorted keys i and j, with equal keys told apart by their
+// position, or -1 if j is out of range
+static int bvh_common_prefix(const uint64_t *keys, int64_t count, int64_t i, int64_t j) {
+    if ((j < 0) || (j >= count)) {
+        return -1;
+    }
+
+    uint64_t diff = keys[i] ^ keys[j];
+
+    return (diff != 0) ? __builtin_clzll(diff) : 64 + __builtin_clzll((uint64_t) (i ^ j));
+}
+
+/**
+ * @brief Emit interior node i of the hierarchy over the sorted keys, following Karras,
+ * "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees". Node i covers
+ * a range of keys starting or ending at key i, split where the common prefix of the range
+ * gets longer. Every node is found independently of the others.
+ */
+static void bvh_emit_node(bvh_builder_t *builder, int64_t i) {
+    const uint64_t *keys = builder->keys[builder->src];
+    int64_t count = (int64_t) builder->bvh->sphere_count;
+    bvh_node_t *nodes = builder->bvh->nodes;
+
+    // Direction of the range, towards the neighbour sharing the longer prefix
+    int64_t d = (bvh_common_prefix(keys, count, i, i + 1) > bvh_common_prefix(keys, count, i, i - 1)) ? 1 : -1;
+    int min_prefix = bvh_common_prefix(keys, count, i, i - d);
+
+    // Find the other end of the range with an exponential, then a binary search
+    int64_t max_len = 2;
+    while (bvh_common_prefix(keys, count, i, i + (max_len * d)) > min_prefix) {
+        max_len *= 2;
+    }
+
+    int64_t len = 0;
+    for (int64_t t = max_len / 2; t >= 1; t /= 2) {
+        if (bvh_common_prefix(keys, count, i, i + ((len + t) * d)) > min_prefix) {
+            len += t;
+        }
+    }
+
+    int64_t j = i + (len * d);
+    int node_prefix = bvh_common_prefix(keys, count, i, j);
+
+    // Binary search for the last key sharing more than the prefix of the range with key i
+    int64_t split = 0;
+    for (int64_t t = (len + 1) / 2; ; t = (t + 1) / 2) {
+        if (bvh_common_prefix(keys, count, i, i + ((split + t) * d)) > node_prefix) {
+            split += t;
+        }
+
+        if (t == 1) {
+            break;
+        }
+    }
+
+    int64_t gamma = i + (split * d) + ((d < 0) ? -1 : 0);
+    int64_t first = (d > 0) ? i : j;
+    int64_t last = (d > 0) ? j : i;
+
+    uint32_t left = (first == gamma) ? (BVH_LEAF | (uint32_t) gamma) : (uint32_t) gamma;
+    uint32_t right = (last == gamma + 1) ? (BVH_LEAF | (uint32_t) (gamma + 1)) : (uint32_t) (gamma + 1);
+
+    nodes[i].child[0] = left;
+    nodes[i].child[1] = right;
+
+    if (i == 0) {
+        nodes[i].parent = UINT32_MAX;
+    }
+
+    for (int c = 0; c < 2; c++) {
+        uint32_t child = nodes[i].child[c];
+
+        if (child & BVH_LEAF) {
+            builder->leaf_parents[child & ~BVH_LEAF] = (uint32_t) i;
+        } else {
+            nodes[child].parent = (uint32_t) i;
+        }
+    }
+}
+
+static void bvh_phase_emit(bvh_builder_t *builder, int slot) {
+    size_t begin, end;
+
+    bvh_slot_range(builder, builder->bvh->node_count, slot, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        bvh_emit_node(builder, (int64_t) i);
+        atomic_init(&builder->visits[i], 0);
+    }
+
+    bvh_slot_range(builder, builder->bvh->sphere_count, slot, &begin, &end);
+
+    // Gathered in leaf order, as the bottom-up passes would otherwise read spheres at random
+    for (size_t i = begin; i < end; i++) {
+        uint32_t prim = builder->values[builder->src][i];
+
+        builder->bvh->prim_indices[i] = prim;
+        builder->leaf_bounds[i] = bvh_sphere_bounds(&builder->bvh->spheres[prim]);
+    }
+}
+
+static uint32_t bvh_child_count(const bvh_builder_t *builder, uint32_t child) {
+    return (child & BVH_LEAF) ? 1 : builder->leaf_counts[child];
+}
+
+static bvh_bounds_t bvh_builder_child_bounds(const bvh_builder_t *builder, uint32_t child) {
+    return (child & BVH_LEAF) ? builder->leaf_bounds[child & ~BVH_LEAF] : bvh_node_bounds(&builder->bvh->nodes[child]);
+}
+
+static double bvh_child_cost(const bvh_builder_t *builder, uint32_t child) {
+    if (child & BVH_LEAF) {
+        return BVH_COST_INTERSECT * bvh_bounds_area(&builder->leaf_bounds[child & ~BVH_LEAF]);
+    }
+
+    return builder->costs[child];
+}
+
+// Set the bounds, sphere count and SAH cost of a node from its children
+static void bvh_refit_node(bvh_builder_t *builder, uint32_t node) {
+    bvh_node_t *n = &builder->bvh->nodes[node];
+    bvh_bounds_t bounds = bvh_builder_child_bounds(builder, n->child[0]);
+    bvh_bounds_t right = bvh_builder_child_bounds(builder, n->child[1]);
+
+    bvh_bounds_grow(&bounds, &right);
+    bvh_node_set_bounds(n, &bounds);
+
+    builder->leaf_counts[node] = bvh_child_count(builder, n->child[0]) + bvh_child_count(builder, n->child[1]);
+    builder->costs[node] = (BVH_COST_TRAVERSE * bvh_bounds_area(&bounds)) + bvh_child_cost(builder, n->child[0]) + bvh_child_cost(builder, n->child[1]);
+}
+
+// A treelet being restructured: its leaves, which are subtrees left as they are, and the
+// interior nodes above them, which are rearranged
+typedef struct {
+    int leaf_count;
+    uint32_t leaves[BVH_TREELET_LEAVES];
+    uint32_t interior[BVH_TREELET_LEAVES - 1];
+
+    // Bounds, lowest SAH cost and best split of every subset of the leaves
+    bvh_bounds_t bounds[BVH_TREELET_SUBSETS];
+    double cost[BVH_TREELET_SUBSETS];
+    unsigned split[BVH_TREELET_SUBSETS];
+} bvh_treelet_t;
+
+/**
+ * @brief Rebuild the part of a treelet covering a subset of its leaves with the best splits
+ * found, reusing its interior nodes in order.
+ *
+ * @return Returns the reference to the subtree.
+ */
+static uint32_t bvh_treelet_emit(bvh_builder_t *builder, const bvh_treelet_t *treelet, unsigned subset, uint32_t parent, int *next) {
+    bvh_node_t *nodes = builder->bvh->nodes;
+
+    if ((subset & (subset - 1)) == 0) {
+        uint32_t child = treelet->leaves[__builtin_ctz(subset)];
+
+        if (child & BVH_LEAF) {
+            builder->leaf_parents[child & ~BVH_LEAF] = parent;
+        } else {
+            nodes[child].parent = parent;
+        }
+
+        return child;
+    }
+
+    uint32_t node = treelet->interior[(*next)++];
+    unsigned split = treelet->split[subset];
+
+    nodes[node].parent = parent;
+    nodes[node].child[0] = bvh_treelet_emit(builder, treelet, split, node, next);
+    nodes[node].child[1] = bvh_treelet_emit(builder, treelet, subset ^ split, node, next);
+
+    bvh_node_set_bounds(&nodes[node], &treelet->bounds[subset]);
+    builder->costs[node] = treelet->cost[subset];
+    builder->leaf_counts[node] = bvh_child_count(builder, nodes[node].child[0]) + bvh_child_count(builder, nodes[node].child[1]);
+
+    return node;
+}
+
+/**
+ * @brief Restructure the treelet rooted at a node into the arrangement with the lowest SAH
+ * cost, following Karras and Aila, "Fast Parallel Construction of High-Quality Bounding Volume
+ * Hierarchies". The treelet grows from the node by repeatedly opening the leaf with the
+ * largest surface area, then the best split of every subset of its leaves is found by dynamic
+ * programming over subsets of increasing size.
+ */
+static void bvh_treelet_optimize(bvh_builder_t *builder, uint32_t root) {
+    const bvh_node_t *nodes = builder->bvh->nodes;
+    bvh_treelet_t treelet;
+
+    if (builder->leaf_counts[root] < builder->treelet_min_spheres) {
+        return;
+    }
+
+    treelet.leaf_count = 2;
+    treelet.leaves[0] = nodes[root].child[0];
+    treelet.leaves[1] = nodes[root].child[1];
+    treelet.interior[0] = root;
+
+    while (treelet.leaf_count < BVH_TREELET_LEAVES) {
+        int largest = -1;
+        double largest_area = -1.0;
+
+        for (int k = 0; k < treelet.leaf_count; k++) {
+            if (!(treelet.leaves[k] & BVH_LEAF)) {
+                bvh_bounds_t bounds = bvh_node_bounds(&nodes[treelet.leaves[k]]);
+                double area = bvh_bounds_area(&bounds);
+
+                if (area > largest_area) {
+                    largest = k;
+                    largest_area = area;
+                }
+            }
+        }
+
+        if (largest < 0) {
+            break;
+        }
+
+        uint32_t opened = treelet.leaves[largest];
+        treelet.interior[treelet.leaf_count - 1] = opened;
+        treelet.leaves[largest] = nodes[opened].child[0];
+        treelet.leaves[treelet.leaf_count++] = nodes[opened].child[1];
+    }
+
+    unsigned full = (1u << treelet.leaf_count) - 1;
+
+    for (int k = 0; k < treelet.leaf_count; k++) {
+        treelet.bounds[1u << k] = bvh_builder_child_bounds(builder, treelet.leaves[k]);
+        treelet.cost[1u << k] = bvh_child_cost(builder, treelet.leaves[k]);
+    }
+
+    // Every proper subset of a set is numerically smaller, so it is done before the set
+    for (unsigned subset = 1; subset <= full; subset++) {
+        unsigned lowest = subset & (~subset + 1);
+
+        if (subset == lowest) {
+            continue;
+        }
+
+        treelet.bounds[subset] = treelet.bounds[subset ^ lowest];
+        bvh_bounds_grow(&treelet.bounds[subset], &treelet.bounds[lowest]);
+
+        // Only partitions with the lowest leaf on the left, so that every split counts once:
+        // the lowest leaf joined by each proper subset of the others
+        unsigned rest = subset ^ lowest;
+        double best = INFINITY;
+
+        for (unsigned others = (rest - 1) & rest; ; others = (others - 1) & rest) {
+            unsigned part = others | lowest;
+            double cost = treelet.cost[part] + treelet.cost[subset ^ part];
+
+            if (cost < best) {
+                best = cost;
+                treelet.split[subset] = part;
+            }
+
+            if (others == 0) {
+                break;
+            }
+        }
+
+        treelet.cost[subset] = (BVH_COST_TRAVERSE * bvh_bounds_area(&treelet.bounds[subset])) + best;
+    }
+
+    // The current arrangement is among the candidates, so only clear improvements count
+    if (treelet.cost[full] < builder->costs[root] * (1.0 - 1e-9)) {
+        int next = 0;
+        bvh_treelet_emit(builder, &treelet, full, nodes[root].parent, &next);
+    }
+}
+
+/**
+ * @brief Walk from every leaf of a slot towards the root, handling each interior node once
+ * both of its subtrees are done. The first thread to reach a node stops there and leaves it
+ * to the thread finishing the other subtree.
+ */
+static void bvh_phase_bottom_up(bvh_builder_t *builder, int slot) {
+    size_t begin, end;
+
+    bvh_slot_range(builder, builder->bvh->sphere_count, slot, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        uint32_t node = builder->leaf_parents[i];
+
+        while ((node != UINT32_MAX) && (atomic_fetch_add(&builder->visits[node], 1) == 1)) {
+            if (builder->optimize) {
+                bvh_treelet_optimize(builder, node);
+            } else {
+                bvh_refit_node(builder, node);
+            }
+
+            node = builder->bvh->nodes[node].parent;
+        }
+    }
+}
+
+static void bvh_phase_reset_visits(bvh_builder_t *builder, int slot) {
+    size_t begin, end;
+
+    bvh_slot_range(builder, builder->bvh->node_count, slot, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        atomic_store_explicit(&builder->visits[i], 0, memory_order_relaxed);
+    }
+}
+
+static void bvh_builder_free(bvh_builder_t *builder) {
+    free(builder->slot_bounds);
+    free(builder->keys[0]);
+    free(builder->keys[1]);
+    free(builder->values[0]);
+    free(builder->values[1]);
+    free(builder->histograms);
+    free(builder->leaf_parents);
+    free(builder->leaf_bounds);
+    free(builder->leaf_counts);
+    free(builder->costs);
+    free(builder->visits);
+    free(builder->handles);
+}
+
+/**
+ * @brief Build a linear BVH over an array of spheres in parallel. Spheres are sorted along a
+ * Morton curve through their centers with a parallel radix sort, all interior nodes are
+ * emitted at once from the sorted codes, and bounds are fitted bottom-up. Optional rounds of
+ * treelet restructuring then lower the SAH cost towards that of a top-down build. The BVH
+ * only references the sphere array, which has to outlive it.
+ *
+ * @param bvh The BVH structure to initialize.
+ * @param spheres The spheres to build over.
+ * @param sphere_count The amount of spheres in the array.
+ * @param settings Threads, Morton code length and restructuring rounds of the build.
+ *
+ * @return Returns 0 on success, -1 on error, invalid argument or a hierarchy too deep to
+ * traverse.
+ */
+int bvh_build_linear(bvh_t *bvh, sphere_t *spheres, size_t sphere_count, const bvh_build_settings_t *settings) {
+    if ((bvh == NULL) || ((spheres == NULL) && (sphere_count > 0)) || (sphere_count >= BVH_LEAF) || (settings == NULL) ||
+        ((settings->morton_bits != 30) && (settings->morton_bits != 63)) || (settings->treelet_rounds < 0)) {
+        return -1;
+    }
+
+    if (bvh_alloc(bvh, spheres, sphere_count) != 0) {
+        return -1;
+    }
+
+    if (sphere_count < 2) {
+        return 0;
+    }
+
+    bvh_builder_t builder = { .bvh = bvh, .threads = settings->threads, .morton_bits = settings->morton_bits };
+
+#ifdef _SC_NPROCESSORS_ONLN
+    if (builder.threads < 1) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        builder.threads = (cpus > 0) ? (int) cpus : 1;
+    }
+#endif
+
+    size_t useful_threads = 1 + (sphere_count / BVH_SPHERES_PER_THREAD);
+    builder.threads = (builder.threads < 1) ? 1 : builder.threads;
+    builder.threads = ((size_t) builder.threads > useful_threads) ? (int) useful_threads : builder.threads;
+
+    builder.slot_bounds = malloc((size_t) builder.threads * sizeof(bvh_bounds_t));
+    builder.keys[0] = malloc(sphere_count * sizeof(uint64_t));
+    builder.keys[1] = malloc(sphere_count * sizeof(uint64_t));
+    builder.values[0] = malloc(sphere_count * sizeof(uint32_t));
+    builder.values[1] = malloc(sphere_count * sizeof(uint32_t));
+    builder.histograms = malloc((size_t) builder.threads * BVH_RADIX_BUCKETS * sizeof(size_t));
+    builder.leaf_parents = malloc(sphere_count * sizeof(uint32_t));
+    builder.leaf_bounds = malloc(sphere_count * sizeof(bvh_bounds_t));
+    builder.leaf_counts = malloc(bvh->node_count * sizeof(uint32_t));
+    builder.costs = malloc(bvh->node_count * sizeof(double));
+    builder.visits = malloc(bvh->node_count * sizeof(atomic_uint));
+    builder.handles = malloc((size_t) builder.threads * sizeof(pthread_t));
+
+    if ((builder.slot_bounds == NULL) || (builder.keys[0] == NULL) || (builder.keys[1] == NULL) ||
+        (builder.values[0] == NULL) || (builder.values[1] == NULL) || (builder.histograms == NULL) ||
+        (builder.leaf_parents == NULL) || (builder.leaf_bounds == NULL) || (builder.leaf_counts == NULL) || (builder.costs == NULL) ||
+        (builder.visits == NULL) || (builder.handles == NULL)) {
+        bvh_builder_free(&builder);
+        bvh_free(bvh);
+        return -1;
+    }
+
+    bvh_run_phase(&builder, bvh_phase_centroid_bounds);
+
+    bvh_bounds_empty(&builder.centroid_bounds);
+    for (int slot = 0; slot < builder.threads; slot++) {
+        bvh_bounds_grow(&builder.centroid_bounds, &builder.slot_bounds[slot]);
+    }
+
+    bvh_run_phase(&builder, bvh_phase_morton_codes);
+    bvh_radix_sort(&builder);
+    bvh_run_phase(&builder, bvh_phase_emit);
+    bvh_run_phase(&builder, bvh_phase_bottom_up);
+
+    // Later rounds only revisit the upper levels, which gain the most, as the lower ones have
+    // been settled by earlier rounds
+    builder.optimize = 1;
+    builder.treelet_min_spheres = BVH_TREELET_LEAVES;
+
+    for (int round = 0; round < settings->treelet_rounds; round++, builder.treelet_min_spheres *= 2) {
+        bvh_run_phase(&builder, bvh_phase_reset_visits);
+        bvh_run_phase(&builder, bvh_phase_bottom_up);
+    }
+
+    bvh_builder_free(&builder);
+
+    if (bvh_check_depth(bvh) != 0) {
+        bvh_free(bvh);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Spheres of a top-down SAH build, with their bounds and centroids computed once
+typedef struct {
+    bvh_t *bvh;
+    bvh_bounds_t *prim_bounds;
+    size_t next_node;
+} bvh_sah_builder_t;
+
+static double bvh_centroid(const bvh_bounds_t *bounds, int axis) {
+    return 0.5 * (bounds->min[axis] + bounds->max[axis]);
+}
+
+static int bvh_sah_bin(double centroid, double lo, double bin_scale) {
+    int bin = (int) ((centroid - lo) * bin_scale);
+    return (bin < 0) ? 0 : ((bin >= BVH_SAH_BINS) ? BVH_SAH_BINS - 1 : bin);
+}
+
+/**
+ * @brief Build the subtree over the spheres at positions [begin, end) of prim_indices,
+ * splitting where the binned surface area heuristic is lowest.
+ *
+ * @param handle Set to the reference to the subtree.
+ *
+ * @return Returns 0 on success, -1 if the subtree gets too deep to traverse.
+ */
+static int bvh_sah_build_range(bvh_sah_builder_t *builder, size_t begin, size_t end, uint32_t parent, int depth, uint32_t *handle) {
+    bvh_t *bvh = builder->bvh;
+    uint32_t *prims = bvh->prim_indices;
+
+    if (end - begin == 1) {
+        *handle = BVH_LEAF | (uint32_t) begin;
+        return 0;
+    }
+
+    if (depth >= BVH_MAX_DEPTH) {
+        return -1;
+    }
+
+    uint32_t node = (uint32_t) builder->next_node++;
+    bvh_bounds_t centroids;
+    bvh_bounds_empty(&centroids);
+
+    for (size_t i = begin; i < end; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            double c = bvh_centroid(&builder->prim_bounds[prims[i]], axis);
+            centroids.min[axis] = (c < centroids.min[axis]) ? c : centroids.min[axis];
+            centroids.max[axis] = (c > centroids.max[axis]) ? c : centroids.max[axis];
+        }
+    }
+
+    int best_axis = -1;
+    int best_split = 0;
+    double best_cost = INFINITY;
+
+    for (int axis = 0; axis < 3; axis++) {
+        double extent = centroids.max[axis] - centroids.min[axis];
+
+        if (!(extent > 0.0)) {
+            continue;
+        }
+
+        double bin_scale = BVH_SAH_BINS / extent;
+        size_t counts[BVH_SAH_BINS] = { 0 };
+        bvh_bounds_t bins[BVH_SAH_BINS];
+
+        for (int b = 0; b < BVH_SAH_BINS; b++) {
+            bvh_bounds_empty(&bins[b]);
+        }
+
+        for (size_t i = begin; i < end; i++) {
+            const bvh_bounds_t *bounds = &builder->prim_bounds[prims[i]];
+            int b = bvh_sah_bin(bvh_centroid(bounds, axis), centroids.min[axis], bin_scale);
+            counts[b]++;
+            bvh_bounds_grow(&bins[b], bounds);
+        }
+
+        // Sweep from the right to get the area and count right of every split, then from
+        // the left to price each split
+        double right_area[BVH_SAH_BINS];
+        size_t right_count[BVH_SAH_BINS];
+        bvh_bounds_t sweep;
+        size_t swept = 0;
+        bvh_bounds_empty(&sweep);
+
+        for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+            bvh_bounds_grow(&sweep, &bins[b]);
+            swept += counts[b];
+            right_area[b] = (swept > 0) ? bvh_bounds_area(&sweep) : 0.0;
+            right_count[b] = swept;
+        }
+
+        bvh_bounds_empty(&sweep);
+        swept = 0;
+
+        for (int b = 0; b < BVH_SAH_BINS - 1; b++) {
+            bvh_bounds_grow(&sweep, &bins[b]);
+            swept += counts[b];
+
+            if ((swept == 0) || (right_count[b + 1] == 0)) {
+                continue;
+            }
+
+            double cost = (swept * bvh_bounds_area(&sweep)) + (right_count[b + 1] * right_area[b + 1]);
+
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    size_t mid = begin + ((end - begin) / 2);
+
+    // Spheres with coinciding centers are split in half
+    if (best_axis >= 0) {
+        double bin_scale = BVH_SAH_BINS / (centroids.max[best_axis] - centroids.min[best_axis]);
+        size_t i = begin;
+        size_t j = end;
+
+        while (i < j) {
+            if (bvh_sah_bin(bvh_centroid(&builder->prim_bounds[prims[i]], best_axis), centroids.min[best_axis], bin_scale) <= best_split) {
+                i++;
+            } else {
+                uint32_t tmp = prims[i];
+                prims[i] = prims[--j];
+                prims[j] = tmp;
+            }
+        }
+
+        mid = i;
+    }
+
+    bvh->nodes[node].parent = parent;
+
+    if ((bvh_sah_build_range(builder, begin, mid, node, depth + 1, &bvh->nodes[node].child[0]) != 0) ||
+        (bvh_sah_build_range(builder, mid, end, node, depth + 1, &bvh->nodes[node].child[1]) != 0)) {
+        return -1;
+    }
+
+    bvh_bounds_t bounds = bvh_child_bounds(bvh, bvh->nodes[node].child[0]);
+    bvh_bounds_t right = bvh_child_bounds(bvh, bvh->nodes[node].child[1]);
+    bvh_bounds_grow(&bounds, &right);
+    bvh_node_set_bounds(&bvh->nodes[node], &bounds);
+
+    *handle = node;
+
+    return 0;
+}
+
+/**
+ * @brief Build a BVH over an array of spheres top-down on the calling thread, splitting every
+ * node where the surface area heuristic evaluated at binned centroid positions is lowest.
+ * Slower to build than bvh_build_linear, but the reference for the quality of its trees.
+ * The BVH only references the sphere array, which has to outlive it.
+ *
+ * @return Returns 0 on success, -1 on error, invalid argument or a hierarchy too deep to
+ * traverse.
+ */
+int bvh_build_sah(bvh_t *bvh, sphere_t *spheres, size_t sphere_count) {
+    if ((bvh == NULL) || ((spheres == NULL) && (sphere_count > 0)) || (sphere_count >= BVH_LEAF)) {
+        return -1;
+    }
+
+    if (bvh_alloc(bvh, spheres, sphere_count) != 0) {
+        return -1;
+    }
+
+    if (sphere_count < 2) {
+        return 0;
+    }
+
+    bvh_sah_builder_t builder = { .bvh = bvh, .next_node = 0 };
+    builder.prim_bounds = malloc(sphere_count * sizeof(bvh_bounds_t));
+
+    if (builder.prim_bounds == NULL) {
+        bvh_free(bvh);
+        return -1;
+    }
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        builder.prim_bounds[i] = bvh_sphere_bounds(&spheres[i]);
+        bvh->prim_indices[i] = (uint32_t) i;
+    }
+
+    uint32_t root;
+    int retval = bvh_sah_build_range(&builder, 0, sphere_count, UINT32_MAX, 1, &root);
+
+    free(builder.prim_bounds);
+
+    if (retval != 0) {
+        bvh_free(bvh);
+        return -1;
+    }
+
+    return 0;
+}
+
+void bvh_free(bvh_t *bvh) {
+    if (bvh == NULL) {
+        return;
+    }
+
+    free(bvh->nodes);
+    free(bvh->prim_indices);
+
+    bvh->nodes = NULL;
+    bvh->prim_indices = NULL;
+    bvh->node_count = 0;
+}
+
+static double bvh_subtree_cost(const bvh_t *bvh, uint32_t ref) {
+    bvh_bounds_t bounds = bvh_child_bounds(bvh, ref);
+
+    if (ref & BVH_LEAF) {
+        return BVH_COST_INTERSECT * bvh_bounds_area(&bounds);
+    }
+
+    return (BVH_COST_TRAVERSE * bvh_bounds_area(&bounds)) + bvh_subtree_cost(bvh, bvh->nodes[ref].child[0]) + bvh_subtree_cost(bvh, bvh->nodes[ref].child[1]);
+}
+
+/**
+ * @brief Estimate the cost of tracing a ray through a BVH with the surface area heuristic: the
+ * expected node visits and sphere tests of a ray passing through the root bounds.
+ *
+ * @return Returns the cost, 0 for an empty or invalid BVH.
+ */
+double bvh_sah_cost(const bvh_t *bvh) {
+    if ((bvh == NULL) || (bvh->sphere_count == 0)) {
+        return 0.0;
+    }
+
+    bvh_bounds_t bounds = bvh_child_bounds(bvh, bvh->root);
+    double area = bvh_bounds_area(&bounds);
+
+    return (area > 0.0) ? (bvh_subtree_cost(bvh, bvh->root) / area) : 0.0;
+}
+
+/**
+ * @brief Clip a ray against the bounds of a node (slab test).
+ *
+ * @param t_enter Set to the distance at which the ray enters the bounds.
+ *
+ * @return Returns 1 if the ray passes through the bounds within [t_min, t_max], 0 otherwise.
+ */
+static int bvh_node_enter(const bvh_node_t *node, const double origin[3], const double inv_dir[3], double t_min, double t_max, double *t_enter) {
+    for (int axis = 0; axis < 3; axis++) {
+        double t0 = (node->bounds_min[axis] - origin[axis]) * inv_dir[axis];
+        double t1 = (node->bounds_max[axis] - origin[axis]) * inv_dir[axis];
+
+        if (t0 > t1) {
+            double tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+
+        t_min = (t0 > t_min) ? t0 : t_min;
+        t_max = (t1 < t_max) ? t1 : t_max;
+    }
+
+    *t_enter = t_min;
+
+    return t_min <= t_max;
+}
+
+// A subtree left for later during traversal, with the distance the ray enters it at
+typedef struct {
+    uint32_t ref;
+    double t;
+} bvh_stack_entry_t;
+
+/**
+ * @brief Find the closest intersection of a ray with the spheres in a BVH. The nearer of two
+ * children is visited first, and subtrees left for later are skipped once a closer hit has
+ * been found.
+ *
+ * @param ptr A pointer to a valid BVH, cast to raw_hittable_data.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * @param rec The structure to populate with data of the closest hit.
+ *
+ * @return Returns 0 if the ray does not intersect any sphere in the BVH, 1 if it does, -1 on
+ * error or invalid argument.
+ */
+int bvh_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    if ((ptr == NULL) || (rec == NULL)) {
+        return -1;
+    }
+
+    bvh_t *bvh = (bvh_t*) ptr;
+
+    if (bvh->sphere_count == 0) {
+        return 0;
+    }
+
+    if (bvh->root & BVH_LEAF) {
+        cost_counter.tests++;
+        return sphere_hit(&bvh->spheres[bvh->prim_indices[0]], r, t_min, t_max, rec) == 1;
+    }
+
+    double origin[3] = { r.origin.x, r.origin.y, r.origin.z };
+    double inv_dir[3] = { 1.0 / r.direction.x, 1.0 / r.direction.y, 1.0 / r.direction.z };
+    double t_enter;
+
+    if (!bvh_node_enter(&bvh->nodes[bvh->root], origin, inv_dir, t_min, t_max, &t_enter)) {
+        return 0;
+    }
+
+    bvh_stack_entry_t stack[BVH_MAX_DEPTH];
+    int top = 0;
+    uint32_t ref = bvh->root;
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    // Sphere tests are tallied locally and added to the thread's counter once
+    uint64_t tests = 0;
+
+    for (;;) {
+        const bvh_node_t *node = &bvh->nodes[ref];
+        uint32_t next[2];
+        double t_next[2];
+        int next_count = 0;
+
+        cost_counter.steps++;
+
+        for (int c = 0; c < 2; c++) {
+            uint32_t child = node->child[c];
+
+            if (child & BVH_LEAF) {
+                tests++;
+
+                if (sphere_hit(&bvh->spheres[bvh->prim_indices[child & ~BVH_LEAF]], r, t_min, closest_so_far, rec) == 1) {
+                    hit_anything = 1;
+                    closest_so_far = rec->t;
+                }
+            } else if (bvh_node_enter(&bvh->nodes[child], origin, inv_dir, t_min, closest_so_far, &t_next[next_count])) {
+                next[next_count++] = child;
+            }
+        }
+
+        if (next_count == 2) {
+            int near = t_next[1] < t_next[0];
+
+            stack[top++] = (bvh_stack_entry_t) { .ref = next[!near], .t = t_next[!near] };
+            ref = next[near];
+            continue;
+        }
+
+        if (next_count == 1) {
+            ref = next[0];
+            continue;
+        }
+
+        while ((top > 0) && (stack[top - 1].t > closest_so_far)) {
+            top--;
+        }
+
+        if (top == 0) {
+            break;
+        }
+
+        ref = stack[--top].ref;
+    }
+
+    cost_counter.tests += tests;
+
+    return hit_anything;
+}
+
+/**
+ * @brief Check whether any sphere in a BVH blocks a ray between t_min and t_max. Returns on
+ * the first intersection found.
+ *
+ * @param ptr A pointer to a valid BVH, cast to raw_hittable_data.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ *
+ * @return Returns 0 if the ray is unobstructed, 1 if it is, -1 on error or invalid argument.
+ */
+int bvh_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max) {
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    bvh_t *bvh = (bvh_t*) ptr;
+
+    if (bvh->sphere_count == 0) {
+        return 0;
+    }
+
+    if (bvh->root & BVH_LEAF) {
+        cost_counter.tests++;
+        return sphere_occluded(&bvh->spheres[bvh->prim_indices[0]], r, t_min, t_max) == 1;
+    }
+
+    double origin[3] = { r.origin.x, r.origin.y, r.origin.z };
+    double inv_dir[3] = { 1.0 / r.direction.x, 1.0 / r.direction.y, 1.0 / r.direction.z };
+    double t_enter;
+
+    if (!bvh_node_enter(&bvh->nodes[bvh->root], origin, inv_dir, t_min, t_max, &t_enter)) {
+        return 0;
+    }
+
+    uint32_t stack[BVH_MAX_DEPTH];
+    int top = 0;
+    uint32_t ref = bvh->root;
+    uint64_t tests = 0;
+
+    for (;;) {
+        const bvh_node_t *node = &bvh->nodes[ref];
+        uint32_t next[2];
+        int next_count = 0;
+
+        cost_counter.steps++;
+
+        for (int c = 0; c < 2; c++) {
+            uint32_t child = node->child[c];
+
+            if (child & BVH_LEAF) {
+                tests++;
+
+                if (sphere_occluded(&bvh->spheres[bvh->prim_indices[child & ~BVH_LEAF]], r, t_min, t_max) == 1) {
+                    cost_counter.tests += tests;
+                    return 1;
+                }
+            } else if (bvh_node_enter(&bvh->nodes[child], origin, inv_dir, t_min, t_max, &t_enter)) {
+                next[next_count++] = child;
+            }
+        }
+
+        if (next_count == 2) {
+            stack[top++] = next[1];
+        }
+
+        if (next_count > 0) {
+            ref = next[0];
+        } else if (top > 0) {
+            ref = stack[--top];
+        } else {
+            cost_counter.tests += tests;
+            return 0;
+        }
+    }
+}
+
+hittable_t bvh_to_hittable(bvh_t *bvh) {
+    if (bvh == NULL) {
+        return (hittable_t) { .ptr = NULL, .size = 0, .hit = NULL, .occluded = NULL };
+    }
+
+    return (hittable_t) {
+        .ptr = bvh,
+        .size = sizeof(bvh_t),
+        .hit = &bvh_hit,
+        .occluded = &bvh_occluded
+    };
+}
@@ -0,0 +1,67 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "../hittable.h"
+#include "../sphere/sphere.h"
+
+#include <stdint.h>
+
+// Child references with this bit set are leaves, holding the position of one sphere in
+// prim_indices instead of the index of a node
+#define BVH_LEAF 0x80000000u
+
+// Deepest hierarchy the traversal stack holds. Builds producing a deeper one fail.
+#define BVH_MAX_DEPTH 256
+
+// An interior node. Leaves hold a single sphere and are not stored, their bounds are the
+// bounds of the sphere.
+typedef struct {
+    double bounds_min[3];
+    double bounds_max[3];
+    uint32_t child[2];
+    uint32_t parent;    // UINT32_MAX for the root
+} bvh_node_t;
+
+typedef struct {
+    // Threads building in parallel, 0 for one per online CPU
+    int threads;
+
+    // Length of the Morton codes spheres are sorted by, 30 (10 bits per axis) or 63 (21 bits
+    // per axis). Longer codes tell more spheres apart in large scenes but sort twice as long.
+    int morton_bits;
+
+    // Rounds of treelet restructuring after the linear build, 0 to skip it
+    int treelet_rounds;
+} bvh_build_settings_t;
+
+typedef struct {
+    sphere_t *spheres;
+    size_t sphere_count;
+
+    // sphere_count - 1 interior nodes, or none for fewer than two spheres. The root is
+    // node 0, or a leaf reference if there are no interior nodes.
+    bvh_node_t *nodes;
+    size_t node_count;
+    uint32_t root;
+
+    // Spheres in the order the leaves refer to them
+    uint32_t *prim_indices;
+} bvh_t;
+
+void bvh_default_build_settings(bvh_build_settings_t *settings);
+
+int bvh_build_linear(bvh_t *bvh, sphere_t *spheres, size_t sphere_count, const bvh_build_settings_t *settings);
+
+int bvh_build_sah(bvh_t *bvh, sphere_t *spheres, size_t sphere_count);
+
+void bvh_free(bvh_t *bvh);
+
+double bvh_sah_cost(const bvh_t *bvh);
+
+int bvh_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec);
+
+int bvh_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max);
+
+hittable_t bvh_to_hittable(bvh_t *bvh);
+
+#endif
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../utils.h"
+#include "../serve/serve.h"
+#include "../cost/cost.h"
+
+// Command line client of "raytracer --serve", mainly for trying out and timing a server locally
+
+static void print_client_usage() {
+    printf( "Usage:\n\t"
+            "rtclient [OPTIONS] SOCKET SCENE FILE\n\t"
+            "Where SCENE is \"" SERVE_DEFAULT_SCENE "\" or the path of a scene file as seen by the server,\n\t"
+            "and FILE is a filename ending with .ppm or .qoi\n"
+            "Options:\n\t"
+            "--width N\t\t\tImage width in pixels (default: 1080)\n\t"
+            "--height N\t\t\tImage height in pixels (default: 607)\n\t"
+            "--samples N\t\t\tSamples per pixel (default: 1)\n\t"
+            "--origin X,Y,Z\t\t\tCamera position (default: 0,0,0)\n\t"
+            "--repeat N\t\t\tSend the job N times in a row and report each round trip (default: 1)\n"
+          );
+}
+
+/**
+ * @brief Send one job to the server and stream the image it sends back into a file.
+ * 
+ * @return Returns 0 on success, -1 on error.
+ */
+static int run_job(const char *socket_path, const char *line, const char *filename) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long\n");
+        return -1;
+    }
+
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if ((fd < 0) || (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)) {
+        perror("Could not connect to server");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    FILE *stream = fdopen(fd, "r+");
+
+    if (stream == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    char status[SERVE_REQUEST_MAX];
+
+    if ((fputs(line, stream) == EOF) || (fflush(stream) == EOF) || (fgets(status, sizeof(status), stream) == NULL)) {
+        fprintf(stderr, "Server closed the connection\n");
+        fclose(stream);
+        return -1;
+    }
+
+    if (strcmp(status, "OK\n") != 0) {
+        fprintf(stderr, "Server error: %s", status);
+        fclose(stream);
+        return -1;
+    }
+
+    FILE *output_file = fopen(filename, "wb");
+
+    if (output_file == NULL) {
+        perror("Could not open output file");
+        fclose(stream);
+        return -1;
+    }
+
+    char buffer[1 << 16];
+    size_t got;
+    int retval = 0;
+
+    while ((got = fread(buffer, 1, sizeof(buffer), stream)) > 0) {
+        if (fwrite(buffer, 1, got, output_file) != got) {
+            retval = -1;
+            break;
+        }
+    }
+
+    if (ferror(stream)) {
+        retval = -1;
+    }
+
+    if (fclose(output_file) != 0) {
+        retval = -1;
+    }
+
+    fclose(stream);
+
+    return retval;
+}
+
+int main(int argc, char *argv[]) {
+    serve_request_t request = {
+        .width = 1080,
+        .height = 607,
+        .samples = 1,
+        .camera = { .origin = { 0, 0, 0 }, .viewport_height = 2.0, .focal_len = 1.0, .aspect_ratio = 0.0 }
+    };
+    int repeat = 1;
+    const char *positional[3] = { NULL, NULL, NULL };
+    int positional_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int *value = NULL;
+
+        if (strcmp(argv[i], "--width") == 0) {
+            value = &request.width;
+        } else if (strcmp(argv[i], "--height") == 0) {
+            value = &request.height;
+        } else if (strcmp(argv[i], "--samples") == 0) {
+            value = &request.samples;
+        } else if (strcmp(argv[i], "--repeat") == 0) {
+            value = &repeat;
+        } else if (strcmp(argv[i], "--origin") == 0) {
+            if ((++i >= argc) || (sscanf(argv[i], "%lf,%lf,%lf", &request.camera.origin.x, &request.camera.origin.y, &request.camera.origin.z) != 3)) {
+                fprintf(stderr, "Missing or invalid value for --origin. See usage below:\n");
+                print_client_usage();
+                exit(1);
+            }
+            continue;
+        } else if (positional_count < 3) {
+            positional[positional_count++] = argv[i];
+            continue;
+        } else {
+            fprintf(stderr, "Invalid arguments supplied. See usage below:\n");
+            print_client_usage();
+            exit(1);
+        }
+
+        if ((++i >= argc) || ((*value = atoi(argv[i])) < 1)) {
+            fprintf(stderr, "Missing or invalid value for %s. See usage below:\n", argv[i - 1]);
+            print_client_usage();
+            exit(1);
+        }
+    }
+
+    if (positional_count != 3) {
+        fprintf(stderr, "Invalid or no arguments supplied. See usage below:\n");
+        print_client_usage();
+        exit(1);
+    }
+
+    const char *filename = positional[2];
+    request.format = validate_filename(filename);
+
+    if ((request.format == IMAGE_FORMAT_INVALID) || (strlen(positional[1]) >= sizeof(request.scene))) {
+        fprintf(stderr, "Invalid scene or filename argument supplied. See usage below:\n");
+        print_client_usage();
+        exit(1);
+    }
+
+    strcpy(request.scene, positional[1]);
+
+    char line[SERVE_REQUEST_MAX];
+
+    if ((serve_format_request(&request, line, sizeof(line)) != 0) || (serve_parse_request(line, &request) != 0)) {
+        fprintf(stderr, "Invalid job parameters\n");
+        exit(1);
+    }
+
+    for (int r = 0; r < repeat; r++) {
+        double start = cost_seconds();
+
+        if (run_job(positional[0], line, filename) != 0) {
+            exit(1);
+        }
+
+        printf("Round trip %d: %.2f ms\n", r + 1, (cost_seconds() - start) * 1e3);
+    }
+}
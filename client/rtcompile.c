@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../scene/scene.h"
+#include "../compile/compile.h"
+
+// Compiles a scene into a C translation unit with its spheres as constants, which builds into
+// a renderer specialized to that scene with "make specialized"
+
+static void print_compile_usage() {
+    printf( "Usage:\n\t"
+            "rtcompile [OPTIONS] FILE\n\t"
+            "Where FILE is the C file to write\n"
+            "Options:\n\t"
+            "--scene FILE\t\t\tCompile the scene in FILE instead of the default scene\n"
+          );
+}
+
+int main(int argc, char *argv[]) {
+    const char *scene_filename = NULL;
+    const char *out_filename = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scene") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing value for --scene. See usage below:\n");
+                print_compile_usage();
+                exit(1);
+            }
+            scene_filename = argv[i];
+        } else if (out_filename == NULL) {
+            out_filename = argv[i];
+        } else {
+            fprintf(stderr, "Invalid arguments supplied. See usage below:\n");
+            print_compile_usage();
+            exit(1);
+        }
+    }
+
+    if (out_filename == NULL) {
+        fprintf(stderr, "Invalid or no arguments supplied. See usage below:\n");
+        print_compile_usage();
+        exit(1);
+    }
+
+    scene_desc_t desc;
+
+    if (((scene_filename != NULL) ? scene_desc_load(&desc, scene_filename) : scene_desc_default(&desc)) != 0) {
+        fprintf(stderr, "Could not load scene\n");
+        exit(1);
+    }
+
+    if (desc.sphere_count > COMPILE_MAX_SPHERES) {
+        fprintf(stderr, "Scene has %zu spheres, at most %d can be compiled\n", desc.sphere_count, COMPILE_MAX_SPHERES);
+        scene_desc_free(&desc);
+        exit(1);
+    }
+
+    FILE *out = fopen(out_filename, "w");
+
+    if (out == NULL) {
+        fprintf(stderr, "Could not open %s\n", out_filename);
+        scene_desc_free(&desc);
+        exit(1);
+    }
+
+    int retval = compile_scene(&desc, (scene_filename != NULL) ? scene_filename : "the default scene", out);
+
+    if ((fclose(out) != 0) || (retval != 0)) {
+        fprintf(stderr, "Could not compile scene to %s\n", out_filename);
+        remove(out_filename);
+        scene_desc_free(&desc);
+        exit(1);
+    }
+
+    scene_desc_free(&desc);
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../scene/scene.h"
+#include "../procgen/procgen.h"
+
+// Writes a generated benchmark scene to a scene file, so that it can be loaded with --scene,
+// served or compiled like any other
+
+static void print_gen_usage() {
+    printf( "Usage:\n\t"
+            "rtgen [OPTIONS] KIND COUNT FILE\n\t"
+            "Where KIND is cover, cloud, clusters or huge, COUNT the amount of spheres and FILE the\n\t"
+            "scene file to write\n"
+            "Options:\n\t"
+            "--seed SEED\t\t\tSeed of the random numbers placing the spheres (default: %d)\n",
+            PROCGEN_DEFAULT_SEED
+          );
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long seed = PROCGEN_DEFAULT_SEED;
+    const char *positional[3] = { NULL, NULL, NULL };
+    int positional_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0) {
+            if ((++i >= argc) || (sscanf(argv[i], "%llu", &seed) != 1)) {
+                fprintf(stderr, "Missing or invalid value for --seed. See usage below:\n");
+                print_gen_usage();
+                exit(1);
+            }
+        } else if (positional_count < 3) {
+            positional[positional_count++] = argv[i];
+        } else {
+            fprintf(stderr, "Invalid arguments supplied. See usage below:\n");
+            print_gen_usage();
+            exit(1);
+        }
+    }
+
+    procgen_kind_t kind;
+    size_t count = 0;
+
+    if ((positional_count != 3) || (procgen_parse_kind(positional[0], &kind) != 0) ||
+        (sscanf(positional[1], "%zu", &count) != 1) || (count == 0)) {
+        fprintf(stderr, "Invalid or no arguments supplied. See usage below:\n");
+        print_gen_usage();
+        exit(1);
+    }
+
+    scene_desc_t desc;
+
+    if (procgen_scene(&desc, kind, count, seed) != 0) {
+        fprintf(stderr, "Could not generate scene\n");
+        exit(1);
+    }
+
+    if (scene_desc_save(&desc, positional[2]) != 0) {
+        fprintf(stderr, "Could not write %s\n", positional[2]);
+        scene_desc_free(&desc);
+        exit(1);
+    }
+
+    printf("Wrote %zu spheres and %zu materials to %s\n", desc.sphere_count, desc.material_count, positional[2]);
+    scene_desc_free(&desc);
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../utils.h"
+#include "../live/live.h"
+
+// Snapshots the shared memory framebuffer of "raytracer --live" into an image, once or every
+// few seconds until the render is done
+
+static void print_snap_usage() {
+    printf( "Usage:\n\t"
+            "rtsnap [OPTIONS] /NAME FILE\n\t"
+            "Where /NAME is the name passed to raytracer --live and FILE is a filename ending with .ppm or .qoi\n"
+            "Options:\n\t"
+            "--interval SECONDS\t\tRewrite FILE every SECONDS until the render is done\n\t"
+            "--exposure X\t\t\tScale pixel values by X before tone mapping (default: 1)\n"
+          );
+}
+
+/**
+ * @brief Write a snapshot of a live framebuffer, through a temporary file that is renamed
+ * over the output so that image viewers never see a partial file.
+ * 
+ * @return Returns 0 on success, -1 on error.
+ */
+static int write_snapshot(const live_t *live, framebuffer_t *snapshot, const tonemap_t *tonemap, uint8_t *image, const char *filename, image_format_t format) {
+    char tmp_filename[FILENAME_MAX];
+
+    if ((live_snapshot(live, snapshot) != 0) ||
+        (snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename) >= (int) sizeof(tmp_filename))) {
+        return -1;
+    }
+
+    framebuffer_resolve(snapshot, tonemap, image, 0, snapshot->height);
+
+    if ((image_write_file(tmp_filename, format, image, snapshot->width, snapshot->height) != 0) || (rename(tmp_filename, filename) != 0)) {
+        remove(tmp_filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    double interval = 0.0;
+    float exposure = 1.0f;
+    const char *positional[2] = { NULL, NULL };
+    int positional_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0) {
+            if ((++i >= argc) || ((interval = strtod(argv[i], NULL)) <= 0.0)) {
+                fprintf(stderr, "Missing or invalid value for --interval. See usage below:\n");
+                print_snap_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--exposure") == 0) {
+            if ((++i >= argc) || ((exposure = strtof(argv[i], NULL)) <= 0.0f)) {
+                fprintf(stderr, "Missing or invalid value for --exposure. See usage below:\n");
+                print_snap_usage();
+                exit(1);
+            }
+        } else if (positional_count < 2) {
+            positional[positional_count++] = argv[i];
+        } else {
+            fprintf(stderr, "Invalid arguments supplied. See usage below:\n");
+            print_snap_usage();
+            exit(1);
+        }
+    }
+
+    if (positional_count != 2) {
+        fprintf(stderr, "Invalid or no arguments supplied. See usage below:\n");
+        print_snap_usage();
+        exit(1);
+    }
+
+    const char *filename = positional[1];
+    image_format_t format = validate_filename(filename);
+
+    if (format == IMAGE_FORMAT_INVALID) {
+        fprintf(stderr, "Invalid filename argument supplied. See usage below:\n");
+        print_snap_usage();
+        exit(1);
+    }
+
+    live_t live;
+
+    if (live_open(&live, positional[0]) != 0) {
+        fprintf(stderr, "Could not open live framebuffer %s\n", positional[0]);
+        exit(1);
+    }
+
+    static tonemap_t tonemap;
+    tonemap_init(&tonemap, exposure, TONEMAP_CLAMP);
+
+    framebuffer_t snapshot;
+    uint8_t *image = malloc((size_t) live.header->width * live.header->height * 3);
+
+    if ((image == NULL) || (framebuffer_init(&snapshot, live.header->width, live.header->height) != 0)) {
+        fprintf(stderr, "Could not allocate framebuffer\n");
+        exit(1);
+    }
+
+    struct timespec wait = { .tv_sec = (time_t) interval, .tv_nsec = (long) ((interval - (time_t) interval) * 1e9) };
+    int done;
+
+    do {
+        done = atomic_load(&live.header->state) == LIVE_DONE;
+
+        if (write_snapshot(&live, &snapshot, &tonemap, image, filename, format) != 0) {
+            fprintf(stderr, "Could not write snapshot to %s\n", filename);
+            exit(1);
+        }
+
+        printf("\r%s: %u samples per pixel%s   ", positional[0], atomic_load(&live.header->samples), done ? ", done" : "");
+        fflush(stdout);
+    } while ((interval > 0.0) && !done && (nanosleep(&wait, NULL) == 0));
+
+    printf("\n");
+
+    framebuffer_free(&snapshot);
+    free(image);
+    live_close(&live);
+
+    return 0;
+}
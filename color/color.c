@@ -7,13 +7,32 @@ void write_color(FILE* file, color_t pixel_color) {
         return;
     }
 
-    fprintf(
-            file,
-            "%d %d %d\n", 
-            ((int) (255.999 * pixel_color.r)),
-            ((int) (255.999 * pixel_color.g)),
-            ((int) (255.999 * pixel_color.b))
-            );
+    unsigned char rgb[3];
+    color_to_bytes(pixel_color, rgb);
+
+    fprintf(file, "%d %d %d\n", rgb[0], rgb[1], rgb[2]);
+}
+
+/**
+ * @brief Convert a color with components in [0, 1] to 8 bits per channel, the same way
+ * write_color does, for binary image encoders.
+ */
+void color_to_bytes(color_t pixel_color, unsigned char rgb[3]) {
+    rgb[0] = (unsigned char) (int) (255.999 * pixel_color.r);
+    rgb[1] = (unsigned char) (int) (255.999 * pixel_color.g);
+    rgb[2] = (unsigned char) (int) (255.999 * pixel_color.b);
+}
+
+/**
+ * @brief Write an already quantized pixel in PPM (P3) format.
+ */
+void write_color_bytes(FILE* file, const unsigned char rgb[3]) {
+    if (file == NULL) {
+        fprintf(stderr, "Error: invalid file passed to \"write_color_bytes\"");
+        return;
+    }
+
+    fprintf(file, "%d %d %d\n", rgb[0], rgb[1], rgb[2]);
 }
 
 color_t scale_color(color_t c, double s) {
@@ -35,3 +54,13 @@ color_t add_color(color_t c1, color_t c2) {
 
     return retval;
 }
+
+color_t mul_color(color_t c1, color_t c2) {
+    color_t retval = {
+        .r = c1.r * c2.r,
+        .g = c1.g * c2.g,
+        .b = c1.b * c2.b,
+    };
+
+    return retval;
+}
@@ -11,8 +11,14 @@ typedef struct {
 
 void write_color(FILE* file, color_t pixel_color);
 
+void color_to_bytes(color_t pixel_color, unsigned char rgb[3]);
+
+void write_color_bytes(FILE* file, const unsigned char rgb[3]);
+
 color_t scale_color(color_t c, double s);
 
 color_t add_color(color_t c1, color_t c2);
 
+color_t mul_color(color_t c1, color_t c2);
+
 #endif
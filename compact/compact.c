@@ -0,0 +1,930 @@
+#include "compact.h"
+#include "../cost/cost.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Key bits sorted per radix sort pass
+#define COMPACT_RADIX_BITS 8
+#define COMPACT_RADIX_BUCKETS (1 << COMPACT_RADIX_BITS)
+
+// Slots of the tables counting distinct materials and radii, twice the most entries kept
+#define COMPACT_TABLE_BITS 17
+
+// Deepest the balanced tree over the blocks can get
+#define COMPACT_MAX_DEPTH 64
+
+// Steps of the grid group boxes are placed on
+#define COMPACT_GROUP_STEPS 255
+
+// Blocks end before their centers spread so far that a grid step exceeds this share of their
+// smallest radius, or before their largest radius exceeds this many times their smallest,
+// below which float16 radii stay within 2^-11 of their value
+#define COMPACT_MAX_STEP_SHARE (1.0 / 512.0)
+#define COMPACT_MAX_RADIUS_RATIO 16384.0
+
+// Spheres with a radius more than this many times the mean radius are left out of the bounds
+// the Morton codes are taken over
+#define COMPACT_OUTLIER_SCALE 4.0
+
+_Static_assert(sizeof(compact_header_t) == 64, "compact header must stay 64 bytes");
+_Static_assert(sizeof(compact_block_t) == COMPACT_BLOCK_SIZE, "compact blocks must fill their alignment");
+
+typedef struct {
+    int bits;
+    size_t entry_words;     // 16-bit words per sphere
+    size_t capacity;        // Spheres per block
+    size_t entries_offset;  // Bytes from the start of a block to its first sphere
+} compact_layout_t;
+
+static const compact_layout_t compact_layouts[] = {
+    [COMPACT_PRECISION_16] = { .bits = 16, .entry_words = 4, .capacity = 114, .entries_offset = sizeof(compact_header_t) + (8 * 6) },
+    [COMPACT_PRECISION_21] = { .bits = 21, .entry_words = 5, .capacity = 92, .entries_offset = sizeof(compact_header_t) + (6 * 6) }
+};
+
+// Distinct 64-bit values numbered in the order they were first added
+typedef struct {
+    uint64_t *keys;
+    uint32_t *ids;      // 0 for empty slots, id + 1 otherwise
+    size_t count;
+} compact_table_t;
+
+static int compact_table_init(compact_table_t *table) {
+    table->keys = malloc(((size_t) 1 << COMPACT_TABLE_BITS) * sizeof(uint64_t));
+    table->ids = calloc((size_t) 1 << COMPACT_TABLE_BITS, sizeof(uint32_t));
+    table->count = 0;
+
+    if ((table->keys == NULL) || (table->ids == NULL)) {
+        free(table->keys);
+        free(table->ids);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void compact_table_free(compact_table_t *table) {
+    free(table->keys);
+    free(table->ids);
+}
+
+/**
+ * @brief Look up the id of a value, adding it if it is new and the table has room.
+ *
+ * @return Returns the id, or -1 if the value is new and COMPACT_PALETTE_SIZE values are
+ * already in the table.
+ */
+static int64_t compact_table_insert(compact_table_t *table, uint64_t key) {
+    size_t mask = ((size_t) 1 << COMPACT_TABLE_BITS) - 1;
+    size_t slot = (size_t) ((key * 0x9E3779B97F4A7C15ull) >> (64 - COMPACT_TABLE_BITS));
+
+    while (table->ids[slot] != 0) {
+        if (table->keys[slot] == key) {
+            return table->ids[slot] - 1;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    if (table->count == COMPACT_PALETTE_SIZE) {
+        return -1;
+    }
+
+    table->keys[slot] = key;
+    table->ids[slot] = (uint32_t) ++table->count;
+
+    return (int64_t) table->count - 1;
+}
+
+static uint64_t compact_double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/**
+ * @brief Round a value to float16, nearest and ties to even. Values of 2 or more saturate to
+ * the largest float16 below 2, radii are scaled by their block to stay under that.
+ */
+static uint16_t compact_half_from_double(double value) {
+    uint16_t sign = signbit(value) ? 0x8000 : 0;
+    double magnitude = fabs(value);
+
+    if (!(magnitude >= 0x1p-25)) {
+        return sign;
+    }
+
+    if (magnitude >= 2.0) {
+        return sign | 0x3FFF;
+    }
+
+    int exponent;
+    double mantissa = frexp(magnitude, &exponent);
+    int biased = exponent - 1 + 15;
+
+    // Subnormals are multiples of 2^-24, carrying into the smallest normal by themselves
+    if (biased < 1) {
+        return sign | (uint16_t) nearbyint(ldexp(magnitude, 24));
+    }
+
+    uint32_t fraction = (uint32_t) nearbyint(((2.0 * mantissa) - 1.0) * 1024.0);
+
+    if (fraction == 1024) {
+        fraction = 0;
+        biased++;
+    }
+
+    return (biased > 15) ? (sign | 0x3FFF) : (sign | (uint16_t) ((biased << 10) | fraction));
+}
+
+static double compact_half_to_double(uint16_t half) {
+    int biased = (half >> 10) & 0x1F;
+    int fraction = half & 0x3FF;
+    double magnitude = (biased == 0) ? ldexp(fraction, -24) : ldexp(1024 + fraction, biased - 25);
+
+    return (half & 0x8000) ? -magnitude : magnitude;
+}
+
+static uint64_t compact_spread_bits(uint64_t v) {
+    // Two zero bits after each of the lowest 21 bits
+    v &= 0x1FFFFF;
+    v = (v | (v << 32)) & 0x1F00000000FFFFull;
+    v = (v | (v << 16)) & 0x1F0000FF0000FFull;
+    v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+    v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+}
+
+/**
+ * @brief Sort keys in ascending order along with their sphere indices, by bytes from the
+ * least significant one up. Bytes that are the same in every key are skipped.
+ *
+ * @return Returns 0 on success, -1 if out of memory.
+ */
+static int compact_radix_sort(uint64_t *keys, uint32_t *indices, size_t count) {
+    uint64_t *key_buffer = malloc(count * sizeof(uint64_t));
+    uint32_t *index_buffer = malloc(count * sizeof(uint32_t));
+
+    if ((key_buffer == NULL) || (index_buffer == NULL)) {
+        free(key_buffer);
+        free(index_buffer);
+        return -1;
+    }
+
+    uint64_t *src_keys = keys, *dst_keys = key_buffer;
+    uint32_t *src_indices = indices, *dst_indices = index_buffer;
+
+    for (int shift = 0; shift < 64; shift += COMPACT_RADIX_BITS) {
+        size_t offsets[COMPACT_RADIX_BUCKETS] = { 0 };
+
+        for (size_t i = 0; i < count; i++) {
+            offsets[(src_keys[i] >> shift) & (COMPACT_RADIX_BUCKETS - 1)]++;
+        }
+
+        if (offsets[(src_keys[0] >> shift) & (COMPACT_RADIX_BUCKETS - 1)] == count) {
+            continue;
+        }
+
+        size_t sum = 0;
+
+        for (int bucket = 0; bucket < COMPACT_RADIX_BUCKETS; bucket++) {
+            size_t size = offsets[bucket];
+            offsets[bucket] = sum;
+            sum += size;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            size_t position = offsets[(src_keys[i] >> shift) & (COMPACT_RADIX_BUCKETS - 1)]++;
+            dst_keys[position] = src_keys[i];
+            dst_indices[position] = src_indices[i];
+        }
+
+        uint64_t *swap_keys = src_keys;
+        src_keys = dst_keys;
+        dst_keys = swap_keys;
+
+        uint32_t *swap_indices = src_indices;
+        src_indices = dst_indices;
+        dst_indices = swap_indices;
+    }
+
+    if (src_keys != keys) {
+        memcpy(keys, src_keys, count * sizeof(uint64_t));
+        memcpy(indices, src_indices, count * sizeof(uint32_t));
+    }
+
+    free(key_buffer);
+    free(index_buffer);
+
+    return 0;
+}
+
+static const uint16_t *compact_entries(const compact_block_t *block) {
+    return (const uint16_t*) ((const unsigned char*) block + compact_layouts[block->header.precision].entries_offset);
+}
+
+/**
+ * @brief Decode a stored sphere, leaving inv_radius unset.
+ */
+static sphere_t compact_decode_entry(const compact_header_t *header, const uint16_t *entry) {
+    uint64_t q[3];
+    uint16_t radius_bits;
+
+    if (header->precision == COMPACT_PRECISION_16) {
+        q[0] = entry[0];
+        q[1] = entry[1];
+        q[2] = entry[2];
+        radius_bits = entry[3];
+    } else {
+        uint64_t packed = entry[0] | ((uint64_t) entry[1] << 16) | ((uint64_t) entry[2] << 32) | ((uint64_t) entry[3] << 48);
+        q[0] = packed & 0x1FFFFF;
+        q[1] = (packed >> 21) & 0x1FFFFF;
+        q[2] = (packed >> 42) & 0x1FFFFF;
+        radius_bits = entry[4];
+    }
+
+    double radius = (header->radius_palette != NULL) ? header->radius_palette[radius_bits] : compact_half_to_double(radius_bits) * header->radius_unit;
+
+    return (sphere_t) {
+        .center = {
+            .x = header->origin[0] + ((double) q[0] * header->step),
+            .y = header->origin[1] + ((double) q[1] * header->step),
+            .z = header->origin[2] + ((double) q[2] * header->step)
+        },
+        .radius = radius,
+        .material = header->material
+    };
+}
+
+/**
+ * @brief Position of a side of a group box on the grid over the bounds of its block. The
+ * ends of the grid are the bounds themselves, so every group fits some grid box.
+ */
+static double compact_group_coord(const compact_node_t *node, int axis, int q) {
+    double lo = node->bounds_min[axis];
+    double hi = node->bounds_max[axis];
+
+    return (q == COMPACT_GROUP_STEPS) ? hi : lo + ((hi - lo) * (q * (1.0 / COMPACT_GROUP_STEPS)));
+}
+
+static uint8_t compact_group_floor(const compact_node_t *node, int axis, double value) {
+    double lo = node->bounds_min[axis];
+    double hi = node->bounds_max[axis];
+    double estimate = (hi > lo) ? floor((value - lo) / (hi - lo) * COMPACT_GROUP_STEPS) : 0.0;
+    int q = (estimate < 0.0) ? 0 : ((estimate > COMPACT_GROUP_STEPS) ? COMPACT_GROUP_STEPS : (int) estimate);
+
+    while ((q > 0) && (compact_group_coord(node, axis, q) > value)) {
+        q--;
+    }
+
+    while ((q < COMPACT_GROUP_STEPS) && (compact_group_coord(node, axis, q + 1) <= value)) {
+        q++;
+    }
+
+    return (uint8_t) q;
+}
+
+static uint8_t compact_group_ceil(const compact_node_t *node, int axis, double value) {
+    double lo = node->bounds_min[axis];
+    double hi = node->bounds_max[axis];
+    double estimate = (hi > lo) ? ceil((value - lo) / (hi - lo) * COMPACT_GROUP_STEPS) : 0.0;
+    int q = (estimate < 0.0) ? 0 : ((estimate > COMPACT_GROUP_STEPS) ? COMPACT_GROUP_STEPS : (int) estimate);
+
+    while ((q < COMPACT_GROUP_STEPS) && (compact_group_coord(node, axis, q) < value)) {
+        q++;
+    }
+
+    while ((q > 0) && (compact_group_coord(node, axis, q - 1) >= value)) {
+        q--;
+    }
+
+    return (uint8_t) q;
+}
+
+static float compact_float_down(double value) {
+    float rounded = (float) value;
+    return ((double) rounded > value) ? nextafterf(rounded, -INFINITY) : rounded;
+}
+
+static float compact_float_up(double value) {
+    float rounded = (float) value;
+    return ((double) rounded < value) ? nextafterf(rounded, INFINITY) : rounded;
+}
+
+/**
+ * @brief Store a run of spheres sharing a material in a block, and compute the bounds of
+ * the decoded spheres.
+ *
+ * @param compact The scene being built, for its precision and radius palette.
+ * @param block The block to fill.
+ * @param leaf Receives the bounds of the block.
+ * @param spheres The spheres of the scene.
+ * @param indices The spheres of the block.
+ * @param count The amount of spheres of the block, at most the capacity of a block.
+ * @param radius_ids The palette index of every sphere, NULL without a palette.
+ */
+static void compact_encode_block(compact_t *compact, compact_block_t *block, compact_node_t *leaf, const sphere_t *spheres, const uint32_t *indices, size_t count, const uint16_t *radius_ids) {
+    const compact_layout_t *layout = &compact_layouts[compact->precision];
+    compact_header_t *header = &block->header;
+    double center_min[3] = { INFINITY, INFINITY, INFINITY };
+    double center_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    double largest_radius = 0.0;
+
+    for (size_t i = 0; i < count; i++) {
+        const sphere_t *sphere = &spheres[indices[i]];
+        double center[3] = { sphere->center.x, sphere->center.y, sphere->center.z };
+
+        for (int axis = 0; axis < 3; axis++) {
+            center_min[axis] = (center[axis] < center_min[axis]) ? center[axis] : center_min[axis];
+            center_max[axis] = (center[axis] > center_max[axis]) ? center[axis] : center_max[axis];
+        }
+
+        largest_radius = (fabs(sphere->radius) > largest_radius) ? fabs(sphere->radius) : largest_radius;
+    }
+
+    double extent = 0.0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        extent = (center_max[axis] - center_min[axis] > extent) ? center_max[axis] - center_min[axis] : extent;
+    }
+
+    double steps = (double) (((uint64_t) 1 << layout->bits) - 1);
+
+    memset(block, 0, sizeof(compact_block_t));
+    memcpy(header->origin, center_min, sizeof(center_min));
+    header->step = extent / steps;
+    header->radius_unit = ((compact->radius_palette == NULL) && (largest_radius > 0.0) && isfinite(largest_radius)) ? ldexp(1.0, ilogb(largest_radius)) : 0.0;
+    header->radius_palette = compact->radius_palette;
+    header->material = (count > 0) ? spheres[indices[0]].material : NULL;
+    header->count = (uint32_t) count;
+    header->precision = (uint32_t) compact->precision;
+
+    uint16_t *entries = (uint16_t*) ((unsigned char*) block + layout->entries_offset);
+    double bounds_min[3] = { INFINITY, INFINITY, INFINITY };
+    double bounds_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+    for (size_t i = 0; i < count; i++) {
+        const sphere_t *sphere = &spheres[indices[i]];
+        double center[3] = { sphere->center.x, sphere->center.y, sphere->center.z };
+        uint64_t q[3];
+
+        for (int axis = 0; axis < 3; axis++) {
+            double position = (header->step > 0.0) ? nearbyint((center[axis] - header->origin[axis]) / header->step) : 0.0;
+            q[axis] = (position < 0.0) ? 0 : ((position > steps) ? (uint64_t) steps : (uint64_t) position);
+        }
+
+        uint16_t radius_bits = (radius_ids != NULL) ? radius_ids[indices[i]] : ((header->radius_unit > 0.0) ? compact_half_from_double(sphere->radius / header->radius_unit) : 0);
+        uint16_t *entry = &entries[i * layout->entry_words];
+
+        if (compact->precision == COMPACT_PRECISION_16) {
+            entry[0] = (uint16_t) q[0];
+            entry[1] = (uint16_t) q[1];
+            entry[2] = (uint16_t) q[2];
+            entry[3] = radius_bits;
+        } else {
+            uint64_t packed = q[0] | (q[1] << 21) | (q[2] << 42);
+            entry[0] = (uint16_t) packed;
+            entry[1] = (uint16_t) (packed >> 16);
+            entry[2] = (uint16_t) (packed >> 32);
+            entry[3] = (uint16_t) (packed >> 48);
+            entry[4] = radius_bits;
+        }
+
+        // Everything from here on follows the sphere as it will be decoded
+        sphere_t decoded = compact_decode_entry(header, entry);
+        double decoded_center[3] = { decoded.center.x, decoded.center.y, decoded.center.z };
+        double radius = fabs(decoded.radius);
+
+        for (int axis = 0; axis < 3; axis++) {
+            double error = fabs(decoded_center[axis] - center[axis]);
+            compact->max_center_error = (error > compact->max_center_error) ? error : compact->max_center_error;
+            bounds_min[axis] = (decoded_center[axis] - radius < bounds_min[axis]) ? decoded_center[axis] - radius : bounds_min[axis];
+            bounds_max[axis] = (decoded_center[axis] + radius > bounds_max[axis]) ? decoded_center[axis] + radius : bounds_max[axis];
+        }
+
+        double radius_error = fabs(decoded.radius - sphere->radius);
+        compact->max_radius_error = (radius_error > compact->max_radius_error) ? radius_error : compact->max_radius_error;
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        leaf->bounds_min[axis] = compact_float_down(bounds_min[axis]);
+        leaf->bounds_max[axis] = compact_float_up(bounds_max[axis]);
+    }
+
+    uint8_t *groups = (uint8_t*) block + sizeof(compact_header_t);
+
+    for (size_t first = 0; first < count; first += COMPACT_GROUP_SPHERES) {
+        size_t last = (first + COMPACT_GROUP_SPHERES < count) ? first + COMPACT_GROUP_SPHERES : count;
+        double group_min[3] = { INFINITY, INFINITY, INFINITY };
+        double group_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+        for (size_t i = first; i < last; i++) {
+            sphere_t decoded = compact_decode_entry(header, &entries[i * layout->entry_words]);
+            double decoded_center[3] = { decoded.center.x, decoded.center.y, decoded.center.z };
+            double radius = fabs(decoded.radius);
+
+            for (int axis = 0; axis < 3; axis++) {
+                group_min[axis] = (decoded_center[axis] - radius < group_min[axis]) ? decoded_center[axis] - radius : group_min[axis];
+                group_max[axis] = (decoded_center[axis] + radius > group_max[axis]) ? decoded_center[axis] + radius : group_max[axis];
+            }
+        }
+
+        uint8_t *box = &groups[(first / COMPACT_GROUP_SPHERES) * 6];
+
+        for (int axis = 0; axis < 3; axis++) {
+            box[axis] = compact_group_floor(leaf, axis, group_min[axis]);
+            box[3 + axis] = compact_group_ceil(leaf, axis, group_max[axis]);
+        }
+    }
+}
+
+/**
+ * @brief Lay out the tree over the blocks [lo, hi) from node index onwards, with the leaf
+ * bounds already stored at the first node of every leaf span.
+ */
+static void compact_build_nodes(compact_node_t *nodes, const compact_node_t *leaves, size_t index, size_t lo, size_t hi) {
+    compact_node_t *node = &nodes[index];
+
+    if (hi - lo == 1) {
+        *node = leaves[lo];
+        return;
+    }
+
+    size_t mid = lo + ((hi - lo) / 2);
+    size_t left = index + 1;
+    size_t right = index + (2 * (mid - lo));
+
+    compact_build_nodes(nodes, leaves, left, lo, mid);
+    compact_build_nodes(nodes, leaves, right, mid, hi);
+
+    for (int axis = 0; axis < 3; axis++) {
+        node->bounds_min[axis] = fminf(nodes[left].bounds_min[axis], nodes[right].bounds_min[axis]);
+        node->bounds_max[axis] = fmaxf(nodes[left].bounds_max[axis], nodes[right].bounds_max[axis]);
+    }
+}
+
+/**
+ * @brief Find where the block starting at sorted sphere first ends: when it is full, when the
+ * material changes, or when the next sphere would coarsen the grid of the block past its
+ * smallest radius or spread its radii too widely, as a huge sphere among small ones would.
+ *
+ * @return Returns the sorted index one past the last sphere of the block.
+ */
+static size_t compact_block_end(const sphere_t *spheres, const uint32_t *indices, size_t first, size_t sphere_count, compact_precision_t precision) {
+    const compact_layout_t *layout = &compact_layouts[precision];
+    double max_spread = (double) (((uint64_t) 1 << layout->bits) - 1) * COMPACT_MAX_STEP_SHARE;
+    const sphere_t *sphere = &spheres[indices[first]];
+    double center_min[3] = { sphere->center.x, sphere->center.y, sphere->center.z };
+    double center_max[3] = { sphere->center.x, sphere->center.y, sphere->center.z };
+    double smallest_radius = fabs(sphere->radius);
+    double largest_radius = smallest_radius;
+    size_t end = first + 1;
+
+    for (; (end < sphere_count) && (end - first < layout->capacity); end++) {
+        sphere = &spheres[indices[end]];
+
+        if (sphere->material != spheres[indices[first]].material) {
+            break;
+        }
+
+        double center[3] = { sphere->center.x, sphere->center.y, sphere->center.z };
+        double smallest = fmin(smallest_radius, fabs(sphere->radius));
+        double largest = fmax(largest_radius, fabs(sphere->radius));
+        double spread = 0.0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            spread = fmax(spread, fmax(center_max[axis], center[axis]) - fmin(center_min[axis], center[axis]));
+        }
+
+        if ((spread > max_spread * smallest) || (largest > COMPACT_MAX_RADIUS_RATIO * smallest)) {
+            break;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            center_min[axis] = fmin(center_min[axis], center[axis]);
+            center_max[axis] = fmax(center_max[axis], center[axis]);
+        }
+
+        smallest_radius = smallest;
+        largest_radius = largest;
+    }
+
+    return end;
+}
+
+/**
+ * @brief Store spheres in quantized blocks, in Morton order within runs of the same
+ * material, and build the tree over the blocks. The radii are kept in a palette if there
+ * are at most COMPACT_PALETTE_SIZE distinct ones. The materials of the spheres are referred
+ * to, not copied.
+ *
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int compact_build(compact_t *compact, const sphere_t *spheres, size_t sphere_count, compact_precision_t precision) {
+    if ((compact == NULL) || ((spheres == NULL) && (sphere_count > 0)) || (sphere_count > UINT32_MAX) ||
+        ((precision != COMPACT_PRECISION_16) && (precision != COMPACT_PRECISION_21))) {
+        return -1;
+    }
+
+    memset(compact, 0, sizeof(compact_t));
+    compact->precision = precision;
+    compact->sphere_count = sphere_count;
+
+    if (sphere_count == 0) {
+        return 0;
+    }
+
+    compact_table_t materials, radii;
+    uint64_t *keys = malloc(sphere_count * sizeof(uint64_t));
+    uint32_t *indices = malloc(sphere_count * sizeof(uint32_t));
+    uint16_t *radius_ids = malloc(sphere_count * sizeof(uint16_t));
+
+    if ((keys == NULL) || (indices == NULL) || (radius_ids == NULL) || (compact_table_init(&materials) != 0)) {
+        free(keys);
+        free(indices);
+        free(radius_ids);
+        return -1;
+    }
+
+    if (compact_table_init(&radii) != 0) {
+        compact_table_free(&materials);
+        free(keys);
+        free(indices);
+        free(radius_ids);
+        return -1;
+    }
+
+    double scene_min[3] = { INFINITY, INFINITY, INFINITY };
+    double scene_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    double radius_sum = 0.0;
+    int palette = 1;
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        radius_sum += fabs(spheres[i].radius);
+    }
+
+    // The Morton codes span the centers of all but spheres far larger than the mean, which
+    // would otherwise squeeze the rest into a few codes and scatter them over the blocks
+    double outlier_radius = COMPACT_OUTLIER_SCALE * radius_sum / (double) sphere_count;
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        double center[3] = { spheres[i].center.x, spheres[i].center.y, spheres[i].center.z };
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (fabs(spheres[i].radius) <= outlier_radius) {
+                scene_min[axis] = (center[axis] < scene_min[axis]) ? center[axis] : scene_min[axis];
+                scene_max[axis] = (center[axis] > scene_max[axis]) ? center[axis] : scene_max[axis];
+            }
+        }
+
+        if (palette) {
+            int64_t id = compact_table_insert(&radii, compact_double_bits(spheres[i].radius));
+            palette = (id >= 0);
+            radius_ids[i] = (uint16_t) id;
+        }
+    }
+
+    // Runs of a material are sorted apart, so that blocks are rarely cut short by a change of
+    // material. Past the size of the table, materials share the last rank, which only costs
+    // shorter blocks.
+    for (size_t i = 0; i < sphere_count; i++) {
+        double center[3] = { spheres[i].center.x, spheres[i].center.y, spheres[i].center.z };
+        uint64_t code = 0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            double extent = scene_max[axis] - scene_min[axis];
+            double position = (extent > 0.0) ? (center[axis] - scene_min[axis]) / extent * 65535.0 : 0.0;
+            position = (position < 65535.0) ? position : 65535.0;
+            code |= compact_spread_bits((position > 0.0) ? (uint64_t) position : 0) << axis;
+        }
+
+        int64_t rank = compact_table_insert(&materials, (uint64_t) (uintptr_t) spheres[i].material);
+        keys[i] = ((uint64_t) ((rank >= 0) ? rank : COMPACT_PALETTE_SIZE - 1) << 48) | code;
+        indices[i] = (uint32_t) i;
+    }
+
+    compact_table_free(&materials);
+
+    if (palette) {
+        compact->palette_size = radii.count;
+        compact->radius_palette = malloc(radii.count * sizeof(double));
+
+        for (size_t slot = 0; (compact->radius_palette != NULL) && (slot < ((size_t) 1 << COMPACT_TABLE_BITS)); slot++) {
+            if (radii.ids[slot] != 0) {
+                memcpy(&compact->radius_palette[radii.ids[slot] - 1], &radii.keys[slot], sizeof(double));
+            }
+        }
+    }
+
+    compact_table_free(&radii);
+
+    if ((palette && (compact->radius_palette == NULL)) || (compact_radix_sort(keys, indices, sphere_count) != 0)) {
+        free(keys);
+        free(indices);
+        free(radius_ids);
+        compact_free(compact);
+        return -1;
+    }
+
+    free(keys);
+
+    size_t block_count = 0;
+
+    for (size_t i = 0; i < sphere_count; i = compact_block_end(spheres, indices, i, sphere_count, precision)) {
+        block_count++;
+    }
+
+    compact->block_count = block_count;
+    compact->blocks = aligned_alloc(COMPACT_BLOCK_SIZE, block_count * sizeof(compact_block_t));
+    compact->nodes = malloc(((2 * block_count) - 1) * sizeof(compact_node_t));
+    compact_node_t *leaves = malloc(block_count * sizeof(compact_node_t));
+
+    if ((compact->blocks == NULL) || (compact->nodes == NULL) || (leaves == NULL)) {
+        free(leaves);
+        free(indices);
+        free(radius_ids);
+        compact_free(compact);
+        return -1;
+    }
+
+    for (size_t i = 0, block = 0; i < sphere_count; block++) {
+        size_t end = compact_block_end(spheres, indices, i, sphere_count, precision);
+
+        compact_encode_block(compact, &compact->blocks[block], &leaves[block], spheres, &indices[i], end - i, palette ? radius_ids : NULL);
+        i = end;
+    }
+
+    compact_build_nodes(compact->nodes, leaves, 0, 0, block_count);
+
+    free(leaves);
+    free(indices);
+    free(radius_ids);
+
+    return 0;
+}
+
+void compact_free(compact_t *compact) {
+    if (compact == NULL) {
+        return;
+    }
+
+    free(compact->blocks);
+    free(compact->nodes);
+    free(compact->radius_palette);
+
+    compact->blocks = NULL;
+    compact->block_count = 0;
+    compact->sphere_count = 0;
+    compact->nodes = NULL;
+    compact->radius_palette = NULL;
+    compact->palette_size = 0;
+}
+
+/**
+ * @brief Count the bytes a compact scene takes, including its tree and palette.
+ */
+size_t compact_memory(const compact_t *compact) {
+    if (compact == NULL) {
+        return 0;
+    }
+
+    size_t node_count = (compact->block_count > 0) ? (2 * compact->block_count) - 1 : 0;
+
+    return sizeof(compact_t) + (compact->block_count * sizeof(compact_block_t)) + (node_count * sizeof(compact_node_t)) + (compact->palette_size * sizeof(double));
+}
+
+static const compact_block_t *compact_block_of(const void *prim) {
+    return (const compact_block_t*) ((uintptr_t) prim & ~(uintptr_t) (COMPACT_BLOCK_SIZE - 1));
+}
+
+/**
+ * @brief Decode the sphere a hit recorded by compact_hit refers to.
+ *
+ * @param prim The prim of the hit record, pointing at the stored sphere.
+ */
+sphere_t compact_decode(const void *prim) {
+    sphere_t sphere = compact_decode_entry(&compact_block_of(prim)->header, (const uint16_t*) prim);
+    sphere.inv_radius = 1.0 / sphere.radius;
+    return sphere;
+}
+
+/**
+ * @brief Number a sphere of a hit recorded by compact_hit. Numbers follow the order the
+ * spheres are stored in and are below block_count times the capacity of a block, but
+ * unlike indices they may skip the unused ends of blocks.
+ */
+size_t compact_sphere_index(const compact_t *compact, const void *prim) {
+    const compact_block_t *block = compact_block_of(prim);
+    const compact_layout_t *layout = &compact_layouts[compact->precision];
+    size_t offset = (size_t) ((const unsigned char*) prim - (const unsigned char*) block) - layout->entries_offset;
+
+    return ((size_t) (block - compact->blocks) * layout->capacity) + (offset / (layout->entry_words * sizeof(uint16_t)));
+}
+
+static int compact_box_enter(const double bounds_min[3], const double bounds_max[3], const double origin[3], const double inv_dir[3], double t_min, double t_max, double *t_enter) {
+    for (int axis = 0; axis < 3; axis++) {
+        double t0 = (bounds_min[axis] - origin[axis]) * inv_dir[axis];
+        double t1 = (bounds_max[axis] - origin[axis]) * inv_dir[axis];
+
+        if (t0 > t1) {
+            double tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+
+        t_min = (t0 > t_min) ? t0 : t_min;
+        t_max = (t1 < t_max) ? t1 : t_max;
+    }
+
+    *t_enter = t_min;
+
+    return t_min <= t_max;
+}
+
+static int compact_node_enter(const compact_node_t *node, const double origin[3], const double inv_dir[3], double t_min, double t_max, double *t_enter) {
+    double bounds_min[3] = { node->bounds_min[0], node->bounds_min[1], node->bounds_min[2] };
+    double bounds_max[3] = { node->bounds_max[0], node->bounds_max[1], node->bounds_max[2] };
+
+    return compact_box_enter(bounds_min, bounds_max, origin, inv_dir, t_min, t_max, t_enter);
+}
+
+/**
+ * @brief Test the spheres of a block whose group box the ray enters before t_max, decoding
+ * them one at a time.
+ *
+ * @param any Return at the first hit instead of the closest one.
+ *
+ * @return Returns 1 if a sphere was hit, with t_max lowered to the hit, 0 otherwise.
+ */
+static int compact_block_hit(const compact_block_t *block, const compact_node_t *leaf, ray_t r, const double origin[3], const double inv_dir[3], double t_min, double *t_max, hit_record_t *rec, int any) {
+    const compact_header_t *header = &block->header;
+    size_t entry_words = compact_layouts[header->precision].entry_words;
+    const uint8_t *groups = (const uint8_t*) block + sizeof(compact_header_t);
+    const uint16_t *entries = compact_entries(block);
+    int hit_anything = 0;
+
+    for (size_t first = 0; first < header->count; first += COMPACT_GROUP_SPHERES) {
+        const uint8_t *box = &groups[(first / COMPACT_GROUP_SPHERES) * 6];
+        double bounds_min[3], bounds_max[3], t_enter;
+
+        for (int axis = 0; axis < 3; axis++) {
+            bounds_min[axis] = compact_group_coord(leaf, axis, box[axis]);
+            bounds_max[axis] = compact_group_coord(leaf, axis, box[3 + axis]);
+        }
+
+        if (!compact_box_enter(bounds_min, bounds_max, origin, inv_dir, t_min, *t_max, &t_enter)) {
+            continue;
+        }
+
+        size_t last = (first + COMPACT_GROUP_SPHERES < header->count) ? first + COMPACT_GROUP_SPHERES : header->count;
+        cost_counter.tests += last - first;
+
+        for (size_t i = first; i < last; i++) {
+            const uint16_t *entry = &entries[i * entry_words];
+            sphere_t sphere = compact_decode_entry(header, entry);
+
+            if (sphere_hit(&sphere, r, t_min, *t_max, rec) == 1) {
+                rec->prim = entry;
+                rec->finalize = &compact_finalize;
+                *t_max = rec->t;
+                hit_anything = 1;
+
+                if (any) {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return hit_anything;
+}
+
+// A span of blocks left for later during traversal, with its node and the distance the ray
+// enters it at
+typedef struct {
+    size_t node;
+    size_t lo;
+    size_t hi;
+    double t;
+} compact_stack_entry_t;
+
+static int compact_traverse(const compact_t *compact, ray_t r, double t_min, double t_max, hit_record_t *rec, int any) {
+    double origin[3] = { r.origin.x, r.origin.y, r.origin.z };
+    double inv_dir[3] = { 1.0 / r.direction.x, 1.0 / r.direction.y, 1.0 / r.direction.z };
+    double t_enter;
+
+    if ((compact->block_count == 0) || !compact_node_enter(&compact->nodes[0], origin, inv_dir, t_min, t_max, &t_enter)) {
+        return 0;
+    }
+
+    compact_stack_entry_t stack[COMPACT_MAX_DEPTH];
+    compact_stack_entry_t current = { .node = 0, .lo = 0, .hi = compact->block_count, .t = t_enter };
+    int top = 0;
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    for (;;) {
+        cost_counter.steps++;
+
+        if (current.hi - current.lo == 1) {
+            if (compact_block_hit(&compact->blocks[current.lo], &compact->nodes[current.node], r, origin, inv_dir, t_min, &closest_so_far, rec, any)) {
+                hit_anything = 1;
+
+                if (any) {
+                    return 1;
+                }
+            }
+        } else {
+            size_t mid = current.lo + ((current.hi - current.lo) / 2);
+            compact_stack_entry_t next[2] = {
+                { .node = current.node + 1, .lo = current.lo, .hi = mid },
+                { .node = current.node + (2 * (mid - current.lo)), .lo = mid, .hi = current.hi }
+            };
+            int enter[2];
+
+            for (int c = 0; c < 2; c++) {
+                enter[c] = compact_node_enter(&compact->nodes[next[c].node], origin, inv_dir, t_min, closest_so_far, &next[c].t);
+            }
+
+            if (enter[0] && enter[1]) {
+                int near = next[1].t < next[0].t;
+
+                stack[top++] = next[!near];
+                current = next[near];
+                continue;
+            }
+
+            if (enter[0] || enter[1]) {
+                current = next[enter[1]];
+                continue;
+            }
+        }
+
+        while ((top > 0) && (stack[top - 1].t > closest_so_far)) {
+            top--;
+        }
+
+        if (top == 0) {
+            return hit_anything;
+        }
+
+        current = stack[--top];
+    }
+}
+
+/**
+ * @brief Find the closest hit among the spheres of a compact scene. Only the distance and
+ * the stored sphere are recorded, the record is completed by compact_finalize through
+ * hit_record_finalize.
+ *
+ * @param ptr A pointer to a built compact scene, cast to raw_hittable_data.
+ *
+ * @return Returns 0 if no sphere is hit, 1 if one is, -1 on error or invalid argument.
+ */
+int compact_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    if ((ptr == NULL) || (rec == NULL)) {
+        return -1;
+    }
+
+    return compact_traverse((const compact_t*) ptr, r, t_min, t_max, rec, 0);
+}
+
+/**
+ * @brief Compute the hit point, normal, facing and material of a hit recorded by
+ * compact_hit, from the sphere decoded again.
+ *
+ * @param prim A pointer to the stored sphere that was hit.
+ */
+void compact_finalize(const void *prim, ray_t r, hit_record_t *rec) {
+    sphere_t sphere = compact_decode(prim);
+    sphere_finalize(&sphere, r, rec);
+}
+
+/**
+ * @brief Check whether a ray hits any sphere of a compact scene between t_min and t_max.
+ *
+ * @return Returns 0 if no sphere is hit, 1 if one is, -1 on error or invalid argument.
+ */
+int compact_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max) {
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    hit_record_t rec;
+
+    return compact_traverse((const compact_t*) ptr, r, t_min, t_max, &rec, 1);
+}
+
+hittable_t compact_to_hittable(compact_t *compact) {
+    if (compact == NULL) {
+        return (hittable_t) { .ptr = NULL, .size = 0, .hit = NULL, .occluded = NULL };
+    }
+
+    return (hittable_t) {
+        .ptr = compact,
+        .size = sizeof(compact_t),
+        .hit = &compact_hit,
+        .occluded = &compact_occluded
+    };
+}
@@ -0,0 +1,97 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "../hittable.h"
+#include "../sphere/sphere.h"
+
+#include <stdint.h>
+
+// Spheres are stored in blocks of this many bytes, aligned to their size so that the block of
+// a sphere follows from its address alone
+#define COMPACT_BLOCK_SIZE 1024
+
+// Spheres of a block are tested in groups of this many, skipping groups whose box is missed
+#define COMPACT_GROUP_SPHERES 16
+
+// Most distinct radii kept exactly in a palette. Scenes with more store float16 radii.
+#define COMPACT_PALETTE_SIZE 65536
+
+// Precision: the centers of a block are rounded to a grid with 2^16 - 1 or 2^21 - 1 steps
+// along the longest side of the box around them, so every coordinate is off by at most half
+// a step, that side over 131070 or 4194302. Blocks end early rather than take a sphere that
+// would make that more than 2^-10 of their smallest radius, or their largest radius more than
+// 2^14 times their smallest, so a huge sphere never coarsens the grid of small ones. Radii are
+// exact if they fit the palette. Otherwise they are float16 multiples of a power of two per
+// block, off by at most 2^-11 of their value. Bounds, hits and normals all follow the decoded
+// spheres, so a compact scene is a slightly moved exact one.
+typedef enum {
+    // 16 bits per axis, 8 bytes per sphere, 114 spheres per block
+    COMPACT_PRECISION_16,
+
+    // 21 bits per axis, 10 bytes per sphere, 92 spheres per block
+    COMPACT_PRECISION_21
+} compact_precision_t;
+
+// Decoding parameters at the start of every block
+typedef struct {
+    double origin[3];       // Center at the lowest grid position
+    double step;            // Grid spacing along every axis
+    double radius_unit;     // Scale of float16 radii, 0 with a palette
+    const double *radius_palette;   // Radii the spheres index, NULL for float16 radii
+    const struct material *material;    // Shared by all spheres of the block
+    uint32_t count;
+    uint32_t precision;     // compact_precision_t
+} compact_header_t;
+
+// The header is followed by a box per group of spheres, six bytes placing its sides on a grid
+// of 255 steps over the bounds of the block, and then by the spheres
+typedef struct {
+    compact_header_t header;
+    unsigned char data[COMPACT_BLOCK_SIZE - sizeof(compact_header_t)];
+} compact_block_t;
+
+// Bounds rounded outwards to floats
+typedef struct {
+    float bounds_min[3];
+    float bounds_max[3];
+} compact_node_t;
+
+typedef struct {
+    compact_block_t *blocks;
+    size_t block_count;
+    size_t sphere_count;
+    compact_precision_t precision;
+
+    // A balanced tree over the blocks in Morton order, block_count * 2 - 1 nodes in depth
+    // first order: the left child of a node follows it, the right child follows the left
+    // subtree. Spans of one block are leaves with the bounds of the block.
+    compact_node_t *nodes;
+
+    // The distinct radii of the scene, NULL if there are more than COMPACT_PALETTE_SIZE
+    double *radius_palette;
+    size_t palette_size;
+
+    // Largest difference between a given and a stored center coordinate, and radius
+    double max_center_error;
+    double max_radius_error;
+} compact_t;
+
+int compact_build(compact_t *compact, const sphere_t *spheres, size_t sphere_count, compact_precision_t precision);
+
+void compact_free(compact_t *compact);
+
+size_t compact_memory(const compact_t *compact);
+
+sphere_t compact_decode(const void *prim);
+
+size_t compact_sphere_index(const compact_t *compact, const void *prim);
+
+int compact_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec);
+
+void compact_finalize(const void *prim, ray_t r, hit_record_t *rec);
+
+int compact_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max);
+
+hittable_t compact_to_hittable(compact_t *compact);
+
+#endif
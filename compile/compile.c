@@ -0,0 +1,187 @@
+#include "compile.h"
+
+// Start of every translation unit, up to the sphere table
+static const char *compile_prologue =
+    "#include \"compile/compile.h\"\n"
+    "#include \"camera/camera.h\"\n"
+    "#include \"integrator/integrator.h\"\n"
+    "#include <math.h>\n"
+    "\n";
+
+// Intersection state shared by the unrolled sphere tests of compiled_hit. a and lo follow
+// sphere_nearest_root, hi is rescaled whenever a closer hit shrinks the range.
+static const char *compile_hit_prologue =
+    "/**\n"
+    " * @brief Find the closest sphere a ray hits within [t_min, t_max]. Every sphere is tested\n"
+    " * by its own code with its center and radius as constants, in scene order, with the same\n"
+    " * operations as sphere_hit, so hits match the generic renderer bit for bit.\n"
+    " * \n"
+    " * @return Returns 1 and fills rec if there is a hit, 0 otherwise.\n"
+    " */\n"
+    "int compiled_hit(ray_t r, double t_min, double t_max, hit_record_t *rec) {\n"
+    "    double a = (r.direction.x * r.direction.x) + (r.direction.y * r.direction.y) + (r.direction.z * r.direction.z);\n"
+    "    double lo = t_min * a;\n"
+    "    double closest = t_max;\n"
+    "    int hit = -1;\n"
+    "\n"
+    "    vec3_t oc;\n"
+    "    double half_b, c, discriminant, sqrtd, hi, numerator;\n"
+    "    vec3_t center;\n"
+    "    double inv_radius;\n";
+
+// Shading and the render loop, which only depend on compiled_hit
+static const char *compile_epilogue =
+    "/**\n"
+    " * @brief Shade the first hit along a ray by its surface normal, or the sky if there is none,\n"
+    " * like integrator_normals.\n"
+    " */\n"
+    "color_t compiled_normals(ray_t r) {\n"
+    "    hit_record_t rec;\n"
+    "\n"
+    "    if (compiled_hit(r, 0, INFINITY, &rec) == 1) {\n"
+    "        return scale_color((color_t) { .r = rec.normal.x + 1.0, .g = rec.normal.y + 1.0, .b = rec.normal.z + 1.0 }, 0.5);\n"
+    "    }\n"
+    "\n"
+    "    return integrator_sky(r);\n"
+    "}\n"
+    "\n"
+    "/**\n"
+    " * @brief Add one sample per pixel of the compiled scene, shaded by normals, to a full frame\n"
+    " * framebuffer on the calling thread. Rays are the ones rt_render traces for the first sample.\n"
+    " * \n"
+    " * @return Returns 0 on success, -1 on invalid argument.\n"
+    " */\n"
+    "int compiled_render(const rt_camera_t *camera, framebuffer_t *fb) {\n"
+    "    if ((camera == NULL) || (fb == NULL) || (fb->width < 2) || (fb->height < 2)) {\n"
+    "        return -1;\n"
+    "    }\n"
+    "\n"
+    "    int width = fb->width;\n"
+    "    int height = fb->height;\n"
+    "\n"
+    "    camera_t cam;\n"
+    "    cam.aspect_ratio = (camera->aspect_ratio > 0.0) ? camera->aspect_ratio : ((double) width / height);\n"
+    "    cam.viewport_height = camera->viewport_height;\n"
+    "    cam.viewport_width = cam.aspect_ratio * cam.viewport_height;\n"
+    "    cam.focal_len = camera->focal_len;\n"
+    "    cam.origin = camera->origin;\n"
+    "    cam.horizontal = (vec3_t) { .x = cam.viewport_width, .y = 0, .z = 0 };\n"
+    "    cam.vertical = (vec3_t) { .x = 0, .y = cam.viewport_height, .z = 0 };\n"
+    "    cam.lower_left_corner = calculate_lower_left_corner(cam.origin, cam.horizontal, cam.vertical, cam.focal_len);\n"
+    "\n"
+    "    for (int row = 0; row < height; row++) {\n"
+    "        int j = height - 1 - row;\n"
+    "\n"
+    "        for (int x = 0; x < width; x++) {\n"
+    "            ray_t r = get_ray(cam, ((double) x / (width - 1)), ((double) j / (height - 1)));\n"
+    "            framebuffer_add(fb, x, row, compiled_normals(r));\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    fb->samples += 1;\n"
+    "\n"
+    "    return 0;\n"
+    "}\n";
+
+/**
+ * @brief Write the intersection test of one sphere, updating the closest hit of compiled_hit.
+ * Constants are written as hexadecimal floating point, so they keep every bit.
+ */
+static void compile_emit_test(FILE *out, size_t index, const sphere_t *sphere) {
+    fprintf(out,
+        "\n"
+        "    // Sphere %zu, center (%g, %g, %g), radius %g\n"
+        "    oc = (vec3_t) { r.origin.x - (%a), r.origin.y - (%a), r.origin.z - (%a) };\n"
+        "    half_b = (oc.x * r.direction.x) + (oc.y * r.direction.y) + (oc.z * r.direction.z);\n"
+        "    c = ((oc.x * oc.x) + (oc.y * oc.y) + (oc.z * oc.z)) - (%a * %a);\n"
+        "    discriminant = (half_b * half_b) - (a * c);\n"
+        "\n"
+        "    if (!(discriminant < 0)) {\n"
+        "        sqrtd = sqrt(discriminant);\n"
+        "        hi = closest * a;\n"
+        "        numerator = -half_b - sqrtd;\n"
+        "\n"
+        "        if ((numerator < lo) || (hi < numerator)) {\n"
+        "            numerator = -half_b + sqrtd;\n"
+        "        }\n"
+        "\n"
+        "        if (!((numerator < lo) || (hi < numerator))) {\n"
+        "            closest = numerator / a;\n"
+        "            hit = %zu;\n"
+        "        }\n"
+        "    }\n",
+        index, sphere->center.x, sphere->center.y, sphere->center.z, sphere->radius,
+        sphere->center.x, sphere->center.y, sphere->center.z,
+        sphere->radius, sphere->radius,
+        index);
+}
+
+/**
+ * @brief Write the translation unit of a scene: its spheres as constants, an intersection
+ * function testing each of them with its own code instead of looping over hittables, and a
+ * renderer shading hits by their normal on top of it. The unit includes the renderer headers
+ * by their path from the repository root, and is linked against librt.a.
+ *
+ * Materials are not compiled, since normal shading does not use them.
+ *
+ * @param desc The scene to compile, with at most COMPILE_MAX_SPHERES spheres.
+ * @param source_name Where the scene came from, for the comment heading the unit.
+ * @param out The file to write the unit to.
+ *
+ * @return Returns 0 on success, -1 on invalid argument, a scene too large or a write error.
+ */
+int compile_scene(const scene_desc_t *desc, const char *source_name, FILE *out) {
+    if ((desc == NULL) || (source_name == NULL) || (out == NULL) ||
+        (desc->sphere_count == 0) || (desc->sphere_count > COMPILE_MAX_SPHERES)) {
+        return -1;
+    }
+
+    fprintf(out, "// Generated by rtcompile from %s, %zu spheres. Do not edit.\n", source_name, desc->sphere_count);
+    fputs(compile_prologue, out);
+
+    fprintf(out, "const size_t compiled_sphere_count = %zu;\n\n", desc->sphere_count);
+    fprintf(out, "const sphere_t compiled_spheres[] = {\n");
+
+    for (size_t i = 0; i < desc->sphere_count; i++) {
+        const sphere_t *sphere = &desc->spheres[i];
+
+        fprintf(out, "    { .center = { %a, %a, %a }, .radius = %a, .inv_radius = %a, .material = NULL },\n",
+            sphere->center.x, sphere->center.y, sphere->center.z, sphere->radius, sphere->inv_radius);
+    }
+
+    fprintf(out, "};\n\n");
+    fputs(compile_hit_prologue, out);
+
+    for (size_t i = 0; i < desc->sphere_count; i++) {
+        compile_emit_test(out, i, &desc->spheres[i]);
+    }
+
+    // Only the closest hit is completed, with the center and reciprocal radius of its sphere
+    fprintf(out, "\n    switch (hit) {\n");
+
+    for (size_t i = 0; i < desc->sphere_count; i++) {
+        const sphere_t *sphere = &desc->spheres[i];
+
+        fprintf(out, "    case %zu:\n        center = (vec3_t) { %a, %a, %a };\n        inv_radius = %a;\n        break;\n",
+            i, sphere->center.x, sphere->center.y, sphere->center.z, sphere->inv_radius);
+    }
+
+    fprintf(out,
+        "    default:\n"
+        "        return 0;\n"
+        "    }\n"
+        "\n"
+        "    rec->t = closest;\n"
+        "    rec->p = ray_at(r, closest);\n"
+        "    hit_record_set_face_normal(rec, r, vec3_scalar_mul(vec3_sub(rec->p, center), inv_radius));\n"
+        "    rec->material = NULL;\n"
+        "    rec->prim = NULL;\n"
+        "    rec->finalize = NULL;\n"
+        "\n"
+        "    return 1;\n"
+        "}\n\n");
+
+    fputs(compile_epilogue, out);
+
+    return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,29 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include "../scene/scene.h"
+#include "../rt/rt.h"
+#include "../framebuffer/framebuffer.h"
+#include "../hittable.h"
+#include "../color/color.h"
+
+#include <stdio.h>
+
+// Most spheres a scene may have to be compiled, since every sphere adds its own intersection
+// code to the translation unit
+#define COMPILE_MAX_SPHERES 1024
+
+int compile_scene(const scene_desc_t *desc, const char *source_name, FILE *out);
+
+// Defined by a translation unit written by compile_scene. The spheres are the ones it was
+// compiled from, for comparing against the generic renderer; the code does not read them.
+extern const size_t compiled_sphere_count;
+extern const sphere_t compiled_spheres[];
+
+int compiled_hit(ray_t r, double t_min, double t_max, hit_record_t *rec);
+
+color_t compiled_normals(ray_t r);
+
+int compiled_render(const rt_camera_t *camera, framebuffer_t *fb);
+
+#endif
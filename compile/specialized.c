@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../utils.h"
+#include "compile.h"
+#include "../cost/cost.h"
+
+// Renderer specialized to the scene of the translation unit written by rtcompile that it is
+// linked with, built by "make specialized". It renders what "raytracer --scene SCENE FILE"
+// renders with the default settings.
+
+#define ASPECT_RATIO (16.0 / 9.0)
+#define DEFAULT_IMG_WIDTH 1080
+
+static void print_specialized_usage() {
+    printf( "Usage:\n\t"
+            "specialized [OPTIONS] FILE\n\t"
+            "Where FILE is a filename ending with .ppm or .qoi\n"
+            "Options:\n\t"
+            "--width WIDTH\t\t\tImage width in pixels (default: %d)\n",
+            DEFAULT_IMG_WIDTH
+          );
+}
+
+int main(int argc, char *argv[]) {
+    int width = DEFAULT_IMG_WIDTH;
+    const char *filename = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--width") == 0) {
+            if ((++i >= argc) || ((width = atoi(argv[i])) < 2)) {
+                fprintf(stderr, "Missing or invalid value for --width. See usage below:\n");
+                print_specialized_usage();
+                exit(1);
+            }
+        } else if (filename == NULL) {
+            filename = argv[i];
+        } else {
+            fprintf(stderr, "Invalid arguments supplied. See usage below:\n");
+            print_specialized_usage();
+            exit(1);
+        }
+    }
+
+    image_format_t format = (filename != NULL) ? validate_filename(filename) : IMAGE_FORMAT_INVALID;
+
+    if (format == IMAGE_FORMAT_INVALID) {
+        fprintf(stderr, "Invalid or no filename argument supplied. See usage below:\n");
+        print_specialized_usage();
+        exit(1);
+    }
+
+    int height = (int) (width / ASPECT_RATIO);
+    rt_camera_t camera;
+    framebuffer_t fb;
+    uint8_t *image = malloc((size_t) width * height * 3);
+
+    if ((height < 2) || (image == NULL) || (framebuffer_init(&fb, width, height) != 0)) {
+        fprintf(stderr, "Could not allocate framebuffer\n");
+        exit(1);
+    }
+
+    // The image is rounded down to the nominal aspect ratio, as by raytracer
+    rt_camera_default(&camera);
+    camera.aspect_ratio = ASPECT_RATIO;
+
+    double start = cost_seconds();
+
+    compiled_render(&camera, &fb);
+
+    printf("Traced %zu compiled spheres in %.1f ms\n", compiled_sphere_count, (cost_seconds() - start) * 1e3);
+
+    static tonemap_t tonemap;
+    tonemap_init(&tonemap, 1.0f, TONEMAP_CLAMP);
+    framebuffer_resolve(&fb, &tonemap, image, 0, height);
+
+    if (image_write_file(filename, format, image, width, height) != 0) {
+        fprintf(stderr, "Could not write %s\n", filename);
+        exit(1);
+    }
+
+    framebuffer_free(&fb);
+    free(image);
+
+    return 0;
+}
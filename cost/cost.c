@@ -0,0 +1,188 @@
+#include "cost.h"
+#include "../color/color.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+_Thread_local cost_counter_t cost_counter;
+
+// Stops of the heatmap palette, from cheapest to most expensive
+static const color_t heat_stops[] = {
+    { 0.0, 0.0, 0.0 },
+    { 0.3, 0.0, 0.6 },
+    { 0.9, 0.1, 0.2 },
+    { 1.0, 0.7, 0.0 },
+    { 1.0, 1.0, 1.0 }
+};
+
+#define HEAT_STOP_COUNT (sizeof(heat_stops) / sizeof(heat_stops[0]))
+
+/**
+ * @brief Read a cheap, monotonic per-core timestamp. On x86 this is the time stamp counter,
+ * elsewhere nanoseconds of the monotonic clock.
+ */
+uint64_t cost_timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ull) + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Read the monotonic clock in seconds, for timing phases of a program. Only
+ * differences between readings are meaningful.
+ */
+double cost_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+int cost_buffers_init(cost_buffers_t *cost, int width, int height) {
+    if ((cost == NULL) || (width < 1) || (height < 1)) {
+        return -1;
+    }
+
+    size_t pixels = (size_t) width * height;
+
+    cost->width = width;
+    cost->height = height;
+    cost->tests = calloc(pixels, sizeof(uint64_t));
+    cost->steps = calloc(pixels, sizeof(uint64_t));
+    cost->cycles = calloc(pixels, sizeof(uint64_t));
+
+    if ((cost->tests == NULL) || (cost->steps == NULL) || (cost->cycles == NULL)) {
+        cost_buffers_free(cost);
+        return -1;
+    }
+
+    return 0;
+}
+
+void cost_buffers_free(cost_buffers_t *cost) {
+    if (cost == NULL) {
+        return;
+    }
+
+    free(cost->tests);
+    free(cost->steps);
+    free(cost->cycles);
+
+    cost->tests = NULL;
+    cost->steps = NULL;
+    cost->cycles = NULL;
+}
+
+/**
+ * @brief Add the cost of tracing samples of one pixel. Every pixel is written by one thread
+ * at a time.
+ * 
+ * @param x The pixel column, counted from the left.
+ * @param row The pixel row, counted from the top.
+ */
+void cost_buffers_add(cost_buffers_t *cost, int x, int row, uint64_t tests, uint64_t steps, uint64_t cycles) {
+    size_t p = ((size_t) row * cost->width) + x;
+
+    cost->tests[p] += tests;
+    cost->steps[p] += steps;
+    cost->cycles[p] += cycles;
+}
+
+static color_t heat_color(double t) {
+    double scaled = t * (HEAT_STOP_COUNT - 1);
+    size_t stop = (size_t) scaled;
+
+    if (stop >= HEAT_STOP_COUNT - 1) {
+        return heat_stops[HEAT_STOP_COUNT - 1];
+    }
+
+    double f = scaled - stop;
+    return add_color(scale_color(heat_stops[stop], 1.0 - f), scale_color(heat_stops[stop + 1], f));
+}
+
+static int cost_write_heatmap(const cost_buffers_t *cost, const char *filename) {
+    size_t pixels = (size_t) cost->width * cost->height;
+    uint64_t lo = UINT64_MAX;
+    uint64_t hi = 0;
+
+    for (size_t p = 0; p < pixels; p++) {
+        lo = ((cost->cycles[p] > 0) && (cost->cycles[p] < lo)) ? cost->cycles[p] : lo;
+        hi = (cost->cycles[p] > hi) ? cost->cycles[p] : hi;
+    }
+
+    FILE *file = fopen(filename, "w");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "P3\n%d %d\n255\n", cost->width, cost->height);
+
+    // Costs span orders of magnitude, so the palette follows their logarithm
+    double log_lo = (hi > 0) ? log((double) lo) : 0.0;
+    double log_range = (hi > lo) ? (log((double) hi) - log_lo) : 1.0;
+
+    for (size_t p = 0; p < pixels; p++) {
+        double t = (cost->cycles[p] > 0) ? ((log((double) cost->cycles[p]) - log_lo) / log_range) : 0.0;
+        write_color(file, heat_color(t));
+    }
+
+    int retval = ferror(file) ? -1 : 0;
+    return (fclose(file) != 0) ? -1 : retval;
+}
+
+static int cost_write_raw(const cost_buffers_t *cost, const char *filename) {
+    size_t pixels = (size_t) cost->width * cost->height;
+    FILE *file = fopen(filename, "wb");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "RTCOST 1\n%d %d\n", cost->width, cost->height);
+
+    for (size_t p = 0; p < pixels; p++) {
+        uint64_t record[3] = { cost->tests[p], cost->steps[p], cost->cycles[p] };
+        fwrite(record, sizeof(uint64_t), 3, file);
+    }
+
+    int retval = ferror(file) ? -1 : 0;
+    return (fclose(file) != 0) ? -1 : retval;
+}
+
+/**
+ * @brief Write a cost map as a false color heatmap of the cycles per pixel, and as a raw dump
+ * of all counters. The dump starts with the text lines "RTCOST 1" and "WIDTH HEIGHT",
+ * followed by three native endian 64-bit values per pixel (sphere tests, traversal steps,
+ * cycles), with rows from the top.
+ * 
+ * @param cost The cost buffers.
+ * @param heatmap_filename Where to write the heatmap, as a PPM image.
+ * @param raw_filename Where to write the raw dump, may be NULL to skip it.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int cost_buffers_write(const cost_buffers_t *cost, const char *heatmap_filename, const char *raw_filename) {
+    if ((cost == NULL) || (heatmap_filename == NULL)) {
+        return -1;
+    }
+
+    if (cost_write_heatmap(cost, heatmap_filename) != 0) {
+        return -1;
+    }
+
+    if ((raw_filename != NULL) && (cost_write_raw(cost, raw_filename) != 0)) {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef COST_H
+#define COST_H
+
+#include <stdint.h>
+
+// Intersection work done by the calling thread. Traversal routines add to it once per cell,
+// candidate list or group of spheres, or tally sphere tests locally and add them once per
+// ray, but never once per sphere tested, so that counting stays cheap enough to be always
+// on. Cost maps attribute the work to pixels by taking differences.
+typedef struct {
+    // Ray-sphere tests
+    uint64_t tests;
+
+    // Acceleration structure cells and tile bins visited
+    uint64_t steps;
+} cost_counter_t;
+
+extern _Thread_local cost_counter_t cost_counter;
+
+// Per-pixel cost of a render, with rows stored top to bottom like the framebuffer. Every
+// traced sample adds to its pixel.
+typedef struct {
+    int width;
+    int height;
+
+    uint64_t *tests;
+    uint64_t *steps;
+    uint64_t *cycles;
+} cost_buffers_t;
+
+uint64_t cost_timestamp();
+
+double cost_seconds();
+
+int cost_buffers_init(cost_buffers_t *cost, int width, int height);
+
+void cost_buffers_free(cost_buffers_t *cost);
+
+void cost_buffers_add(cost_buffers_t *cost, int x, int row, uint64_t tests, uint64_t steps, uint64_t cycles);
+
+int cost_buffers_write(const cost_buffers_t *cost, const char *heatmap_filename, const char *raw_filename);
+
+#endif
@@ -0,0 +1,339 @@
+#include "denoise.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// B3 spline, the 1D kernel of the a-trous wavelet transform
+static const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+typedef struct {
+    int width;
+    int height;
+
+    const float *src[3];
+    float *dst[3];
+    const float *normal[3];
+    const float *depth;
+    const float *inv_depth;
+    const uint32_t *object_id;
+
+    int step;
+    float inv_sigma_color;
+    float inv_sigma_normal;
+    float inv_sigma_depth;
+} denoise_pass_t;
+
+typedef struct {
+    const denoise_pass_t *pass;
+    int row_begin;
+    int row_end;
+} denoise_job_t;
+
+void denoise_default_settings(denoise_settings_t *settings) {
+    if (settings == NULL) {
+        return;
+    }
+
+    settings->iterations = 5;
+    settings->sigma_color = 0.6f;
+    settings->sigma_normal = 0.3f;
+    settings->sigma_depth = 0.1f;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    settings->threads = (cpus > 0) ? (int) cpus : 1;
+#else
+    settings->threads = 1;
+#endif
+}
+
+#ifdef __SSE2__
+// e^x for x <= 0, from 2^x = 2^floor(x) * 2^fract(x) with a polynomial for the fraction
+static __m128 exp_neg_ps(__m128 x) {
+    __m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-87.0f)), _mm_set1_ps(1.44269504f));
+
+    __m128i i = _mm_cvttps_epi32(t);
+    __m128 fi = _mm_cvtepi32_ps(i);
+    __m128 too_big = _mm_cmpgt_ps(fi, t);
+    fi = _mm_sub_ps(fi, _mm_and_ps(too_big, _mm_set1_ps(1.0f)));
+    i = _mm_add_epi32(i, _mm_castps_si128(too_big));
+
+    __m128 f = _mm_sub_ps(t, fi);
+    __m128 p = _mm_set1_ps(1.3333558e-3f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.6181291e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.5504109e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.4022651e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.9314718e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+    __m128i scale = _mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23);
+
+    return _mm_mul_ps(p, _mm_castsi128_ps(scale));
+}
+#endif
+
+// Weight of tap q for center pixel p, zero if they belong to different objects
+static float denoise_weight(const denoise_pass_t *pass, size_t p, size_t q, float h) {
+    if (pass->object_id[p] != pass->object_id[q]) {
+        return 0.0f;
+    }
+
+    float dc2 = 0.0f, dn2 = 0.0f;
+
+    for (int c = 0; c < 3; c++) {
+        float dc = pass->src[c][p] - pass->src[c][q];
+        float dn = pass->normal[c][p] - pass->normal[c][q];
+        dc2 += dc * dc;
+        dn2 += dn * dn;
+    }
+
+    float dz = (pass->depth[p] - pass->depth[q]) * pass->inv_depth[p];
+
+    return h * expf(-((dc2 * pass->inv_sigma_color) + (dn2 * pass->inv_sigma_normal) + (dz * dz * pass->inv_sigma_depth)));
+}
+
+// Filter a single pixel, skipping taps that fall outside the image
+static void denoise_pixel(const denoise_pass_t *pass, int x, int y) {
+    size_t p = ((size_t) y * pass->width) + x;
+    float acc[3] = { 0.0f, 0.0f, 0.0f };
+    float acc_w = 0.0f;
+
+    for (int ky = -2; ky <= 2; ky++) {
+        int qy = y + (ky * pass->step);
+
+        if ((qy < 0) || (qy >= pass->height)) {
+            continue;
+        }
+
+        for (int kx = -2; kx <= 2; kx++) {
+            int qx = x + (kx * pass->step);
+
+            if ((qx < 0) || (qx >= pass->width)) {
+                continue;
+            }
+
+            size_t q = ((size_t) qy * pass->width) + qx;
+            float w = denoise_weight(pass, p, q, kernel[ky + 2] * kernel[kx + 2]);
+
+            acc[0] += w * pass->src[0][q];
+            acc[1] += w * pass->src[1][q];
+            acc[2] += w * pass->src[2][q];
+            acc_w += w;
+        }
+    }
+
+    // The center tap always contributes, so the weight sum is never zero
+    for (int c = 0; c < 3; c++) {
+        pass->dst[c][p] = acc[c] / acc_w;
+    }
+}
+
+#ifdef __SSE2__
+// Filter four horizontally adjacent pixels whose taps all lie within the image columns
+static void denoise_pixels_sse2(const denoise_pass_t *pass, int x, int y) {
+    size_t p = ((size_t) y * pass->width) + x;
+
+    __m128 pr = _mm_loadu_ps(&pass->src[0][p]);
+    __m128 pg = _mm_loadu_ps(&pass->src[1][p]);
+    __m128 pb = _mm_loadu_ps(&pass->src[2][p]);
+    __m128 pnx = _mm_loadu_ps(&pass->normal[0][p]);
+    __m128 pny = _mm_loadu_ps(&pass->normal[1][p]);
+    __m128 pnz = _mm_loadu_ps(&pass->normal[2][p]);
+    __m128 pz = _mm_loadu_ps(&pass->depth[p]);
+    __m128 piz = _mm_loadu_ps(&pass->inv_depth[p]);
+    __m128i pid = _mm_loadu_si128((const __m128i*) &pass->object_id[p]);
+
+    __m128 v_isc = _mm_set1_ps(pass->inv_sigma_color);
+    __m128 v_isn = _mm_set1_ps(pass->inv_sigma_normal);
+    __m128 v_isz = _mm_set1_ps(pass->inv_sigma_depth);
+
+    __m128 acc_r = _mm_setzero_ps();
+    __m128 acc_g = _mm_setzero_ps();
+    __m128 acc_b = _mm_setzero_ps();
+    __m128 acc_w = _mm_setzero_ps();
+
+    for (int ky = -2; ky <= 2; ky++) {
+        int qy = y + (ky * pass->step);
+
+        if ((qy < 0) || (qy >= pass->height)) {
+            continue;
+        }
+
+        for (int kx = -2; kx <= 2; kx++) {
+            size_t q = ((size_t) qy * pass->width) + x + (kx * pass->step);
+
+            __m128 qr = _mm_loadu_ps(&pass->src[0][q]);
+            __m128 qg = _mm_loadu_ps(&pass->src[1][q]);
+            __m128 qb = _mm_loadu_ps(&pass->src[2][q]);
+
+            __m128 d0 = _mm_sub_ps(pr, qr);
+            __m128 d1 = _mm_sub_ps(pg, qg);
+            __m128 d2 = _mm_sub_ps(pb, qb);
+            __m128 dc2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1)), _mm_mul_ps(d2, d2));
+
+            d0 = _mm_sub_ps(pnx, _mm_loadu_ps(&pass->normal[0][q]));
+            d1 = _mm_sub_ps(pny, _mm_loadu_ps(&pass->normal[1][q]));
+            d2 = _mm_sub_ps(pnz, _mm_loadu_ps(&pass->normal[2][q]));
+            __m128 dn2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1)), _mm_mul_ps(d2, d2));
+
+            __m128 dz = _mm_mul_ps(_mm_sub_ps(pz, _mm_loadu_ps(&pass->depth[q])), piz);
+
+            __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dc2, v_isc), _mm_mul_ps(dn2, v_isn)), _mm_mul_ps(_mm_mul_ps(dz, dz), v_isz));
+            __m128 w = _mm_mul_ps(_mm_set1_ps(kernel[ky + 2] * kernel[kx + 2]), exp_neg_ps(_mm_sub_ps(_mm_setzero_ps(), e)));
+
+            __m128i same = _mm_cmpeq_epi32(pid, _mm_loadu_si128((const __m128i*) &pass->object_id[q]));
+            w = _mm_and_ps(w, _mm_castsi128_ps(same));
+
+            acc_r = _mm_add_ps(acc_r, _mm_mul_ps(w, qr));
+            acc_g = _mm_add_ps(acc_g, _mm_mul_ps(w, qg));
+            acc_b = _mm_add_ps(acc_b, _mm_mul_ps(w, qb));
+            acc_w = _mm_add_ps(acc_w, w);
+        }
+    }
+
+    _mm_storeu_ps(&pass->dst[0][p], _mm_div_ps(acc_r, acc_w));
+    _mm_storeu_ps(&pass->dst[1][p], _mm_div_ps(acc_g, acc_w));
+    _mm_storeu_ps(&pass->dst[2][p], _mm_div_ps(acc_b, acc_w));
+}
+#endif
+
+static void *denoise_rows(void *arg) {
+    denoise_job_t *job = (denoise_job_t*) arg;
+    const denoise_pass_t *pass = job->pass;
+    int reach = 2 * pass->step;
+
+    for (int y = job->row_begin; y < job->row_end; y++) {
+        int x = 0;
+
+#ifdef __SSE2__
+        // Columns close to the left and right edge need their out of range taps skipped
+        for (; x < reach && x < pass->width; x++) {
+            denoise_pixel(pass, x, y);
+        }
+
+        for (; (x + 3 + reach) < pass->width; x += 4) {
+            denoise_pixels_sse2(pass, x, y);
+        }
+#endif
+
+        for (; x < pass->width; x++) {
+            denoise_pixel(pass, x, y);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Filter the framebuffer with an edge-avoiding a-trous wavelet filter. Every
+ * iteration applies a 5x5 B3 spline kernel with its taps spread twice as far apart as in the
+ * previous one, weighting each tap by how closely its color, normal and depth match the
+ * center pixel. Taps on a different object never contribute. Each iteration is split into
+ * bands of rows, one per thread.
+ * 
+ * @param fb The framebuffer to filter in place. Its sample count is kept.
+ * @param aov The auxiliary buffers guiding the filter, with the same size as fb.
+ * @param settings The filter settings.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int denoise_framebuffer(framebuffer_t *fb, const aov_buffers_t *aov, const denoise_settings_t *settings) {
+    if ((fb == NULL) || (fb->rgb == NULL) || (aov == NULL) || (settings == NULL) ||
+        (aov->width != fb->width) || (aov->height != fb->height)) {
+        return -1;
+    }
+
+    int width = fb->width;
+    int height = fb->height;
+    size_t plane = (size_t) width * height;
+    int threads = (settings->threads < 1) ? 1 : ((settings->threads > height) ? height : settings->threads);
+
+    float *planes = malloc(plane * 7 * sizeof(float));
+    pthread_t *handles = malloc((size_t) threads * sizeof(pthread_t));
+    denoise_job_t *jobs = malloc((size_t) threads * sizeof(denoise_job_t));
+
+    if ((planes == NULL) || (handles == NULL) || (jobs == NULL)) {
+        free(planes);
+        free(handles);
+        free(jobs);
+        return -1;
+    }
+
+    // Two sets of planar color buffers to ping-pong between, plus the inverse depth
+    float *color[2][3] = {
+        { planes, &planes[plane], &planes[2 * plane] },
+        { &planes[3 * plane], &planes[4 * plane], &planes[5 * plane] }
+    };
+    float *inv_depth = &planes[6 * plane];
+    float inv_samples = 1.0f / (float) ((fb->samples > 0) ? fb->samples : 1);
+
+    for (size_t p = 0; p < plane; p++) {
+        for (int c = 0; c < 3; c++) {
+            color[0][c][p] = fb->rgb[(p * 3) + c] * inv_samples;
+        }
+        inv_depth[p] = (aov->depth[p] > 0.0f) ? (1.0f / aov->depth[p]) : 0.0f;
+    }
+
+    int current = 0;
+
+    for (int iteration = 0; iteration < settings->iterations; iteration++) {
+        float sigma_color = settings->sigma_color / (float) (1 << iteration);
+
+        denoise_pass_t pass = {
+            .width = width,
+            .height = height,
+            .src = { color[current][0], color[current][1], color[current][2] },
+            .dst = { color[!current][0], color[!current][1], color[!current][2] },
+            .normal = { aov->normal, &aov->normal[plane], &aov->normal[2 * plane] },
+            .depth = aov->depth,
+            .inv_depth = inv_depth,
+            .object_id = aov->object_id,
+            .step = 1 << iteration,
+            .inv_sigma_color = 1.0f / (sigma_color * sigma_color),
+            .inv_sigma_normal = 1.0f / (settings->sigma_normal * settings->sigma_normal),
+            .inv_sigma_depth = 1.0f / (settings->sigma_depth * settings->sigma_depth)
+        };
+
+        int started = 0;
+
+        for (int t = 0; t < threads; t++) {
+            jobs[t] = (denoise_job_t) {
+                .pass = &pass,
+                .row_begin = (int) (((long) height * t) / threads),
+                .row_end = (int) (((long) height * (t + 1)) / threads)
+            };
+
+            if ((t < threads - 1) && (pthread_create(&handles[started], NULL, denoise_rows, &jobs[t]) == 0)) {
+                started++;
+            } else {
+                // The last band runs on the calling thread, as does any band whose thread failed to start
+                denoise_rows(&jobs[t]);
+            }
+        }
+
+        for (int t = 0; t < started; t++) {
+            pthread_join(handles[t], NULL);
+        }
+
+        current = !current;
+    }
+
+    float samples = (float) ((fb->samples > 0) ? fb->samples : 1);
+
+    for (size_t p = 0; p < plane; p++) {
+        for (int c = 0; c < 3; c++) {
+            fb->rgb[(p * 3) + c] = color[current][c][p] * samples;
+        }
+    }
+
+    free(planes);
+    free(handles);
+    free(jobs);
+
+    return 0;
+}
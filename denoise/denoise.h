@@ -0,0 +1,23 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "../framebuffer/framebuffer.h"
+#include "../aov/aov.h"
+
+typedef struct {
+    int iterations;
+
+    // Edge-stopping widths: color difference (halved every iteration), normal difference and
+    // depth difference relative to the center pixel's depth
+    float sigma_color;
+    float sigma_normal;
+    float sigma_depth;
+
+    int threads;
+} denoise_settings_t;
+
+void denoise_default_settings(denoise_settings_t *settings);
+
+int denoise_framebuffer(framebuffer_t *fb, const aov_buffers_t *aov, const denoise_settings_t *settings);
+
+#endif
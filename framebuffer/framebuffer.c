@@ -0,0 +1,159 @@
+#include "framebuffer.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Coefficients of the ACES fit: (x * (a * x + b)) / (x * (c * x + d) + e)
+#define ACES_A 2.51f
+#define ACES_B 0.03f
+#define ACES_C 2.43f
+#define ACES_D 0.59f
+#define ACES_E 0.14f
+
+int framebuffer_init(framebuffer_t *fb, int width, int height) {
+    if ((fb == NULL) || (width < 1) || (height < 1)) {
+        return -1;
+    }
+
+    fb->width = width;
+    fb->height = height;
+    fb->samples = 0;
+    fb->rgb = calloc((size_t) width * height * 3, sizeof(float));
+
+    return (fb->rgb == NULL) ? -1 : 0;
+}
+
+void framebuffer_free(framebuffer_t *fb) {
+    if (fb == NULL) {
+        return;
+    }
+
+    free(fb->rgb);
+    fb->rgb = NULL;
+}
+
+void framebuffer_clear(framebuffer_t *fb) {
+    if ((fb == NULL) || (fb->rgb == NULL)) {
+        return;
+    }
+
+    memset(fb->rgb, 0, (size_t) fb->width * fb->height * 3 * sizeof(float));
+    fb->samples = 0;
+}
+
+/**
+ * @brief Add a sample to the accumulated value of a pixel.
+ * 
+ * @param fb The framebuffer to accumulate into.
+ * @param x The pixel column, counted from the left.
+ * @param row The pixel row, counted from the top.
+ * @param c The sample's color.
+ */
+void framebuffer_add(framebuffer_t *fb, int x, int row, color_t c) {
+    float *px = &fb->rgb[(((size_t) row * fb->width) + x) * 3];
+
+    px[0] += (float) c.r;
+    px[1] += (float) c.g;
+    px[2] += (float) c.b;
+}
+
+static double linear_to_srgb(double v) {
+    return (v <= 0.0031308) ? (12.92 * v) : ((1.055 * pow(v, 1.0 / 2.4)) - 0.055);
+}
+
+/**
+ * @brief Set up post-process settings, precomputing the sRGB gamma and quantization table.
+ * 
+ * @param tm The settings to initialize.
+ * @param exposure Linear scale applied to pixel values before tone mapping.
+ * @param op The tone mapping operator.
+ */
+void tonemap_init(tonemap_t *tm, float exposure, tonemap_op_t op) {
+    if (tm == NULL) {
+        return;
+    }
+
+    tm->exposure = exposure;
+    tm->op = op;
+
+    for (int i = 0; i < TONEMAP_LUT_SIZE; i++) {
+        double v = linear_to_srgb((double) i / (TONEMAP_LUT_SIZE - 1));
+        tm->lut[i] = (uint8_t) ((v * 255.0) + 0.5);
+    }
+}
+
+static float tonemap_scalar(tonemap_op_t op, float v) {
+    v = (v > 0.0f) ? v : 0.0f;
+
+    if (op == TONEMAP_REINHARD) {
+        v = v / (1.0f + v);
+    } else if (op == TONEMAP_ACES) {
+        v = (v * ((ACES_A * v) + ACES_B)) / ((v * ((ACES_C * v) + ACES_D)) + ACES_E);
+    }
+
+    return (v < 1.0f) ? v : 1.0f;
+}
+
+/**
+ * @brief Convert a range of framebuffer rows to 8-bit sRGB. Every value is divided by the
+ * sample count, scaled by the exposure, tone mapped, clamped to [0, 1] and quantized through
+ * the gamma table. Four channel values are processed at once where SSE2 is available.
+ * 
+ * @param fb The framebuffer to convert.
+ * @param tm The post-process settings.
+ * @param out Destination for 3 bytes per pixel, laid out like the framebuffer rows starting
+ * at row_begin.
+ * @param row_begin The first row to convert.
+ * @param row_end The row after the last one to convert.
+ */
+void framebuffer_resolve(const framebuffer_t *fb, const tonemap_t *tm, uint8_t *out, int row_begin, int row_end) {
+    if ((fb == NULL) || (fb->rgb == NULL) || (tm == NULL) || (out == NULL) || (row_begin >= row_end)) {
+        return;
+    }
+
+    const float *src = &fb->rgb[(size_t) row_begin * fb->width * 3];
+    size_t n = (size_t) (row_end - row_begin) * fb->width * 3;
+    float scale = tm->exposure / (float) ((fb->samples > 0) ? fb->samples : 1);
+    float lut_max = (float) (TONEMAP_LUT_SIZE - 1);
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128 v_scale = _mm_set1_ps(scale);
+    __m128 v_zero = _mm_setzero_ps();
+    __m128 v_one = _mm_set1_ps(1.0f);
+    __m128 v_lut_max = _mm_set1_ps(lut_max);
+    int32_t idx[4];
+
+    for (; (i + 4) <= n; i += 4) {
+        // max_ps returns its second operand for NaN, which flushes NaN to zero
+        __m128 v = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i]), v_scale), v_zero);
+
+        if (tm->op == TONEMAP_REINHARD) {
+            v = _mm_div_ps(v, _mm_add_ps(v_one, v));
+        } else if (tm->op == TONEMAP_ACES) {
+            __m128 num = _mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(ACES_A)), _mm_set1_ps(ACES_B)));
+            __m128 den = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(ACES_C)), _mm_set1_ps(ACES_D))), _mm_set1_ps(ACES_E));
+            v = _mm_div_ps(num, den);
+        }
+
+        v = _mm_min_ps(v, v_one);
+        _mm_storeu_si128((__m128i*) idx, _mm_cvtps_epi32(_mm_mul_ps(v, v_lut_max)));
+
+        out[i] = tm->lut[idx[0]];
+        out[i + 1] = tm->lut[idx[1]];
+        out[i + 2] = tm->lut[idx[2]];
+        out[i + 3] = tm->lut[idx[3]];
+    }
+#endif
+
+    for (; i < n; i++) {
+        float v = tonemap_scalar(tm->op, src[i] * scale);
+        // lrintf rounds half to even like _mm_cvtps_epi32, so a value maps to the same entry
+        // whichever path it takes
+        out[i] = tm->lut[lrintf(v * lut_max)];
+    }
+}
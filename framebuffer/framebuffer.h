@@ -0,0 +1,48 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "../color/color.h"
+
+#include <stdint.h>
+
+// Resolution of the linear-to-sRGB lookup table, fine enough to stay below half an 8-bit step
+#define TONEMAP_LUT_SIZE 8192
+
+typedef enum {
+    TONEMAP_CLAMP,      // Values above 1 saturate
+    TONEMAP_REINHARD,   // x / (1 + x)
+    TONEMAP_ACES        // Narkowicz's fit of the ACES filmic curve
+} tonemap_op_t;
+
+// Post-process settings, turning accumulated radiance into display values
+typedef struct {
+    float exposure;
+    tonemap_op_t op;
+
+    // Linear [0, 1] to 8-bit sRGB, sampled at TONEMAP_LUT_SIZE evenly spaced points
+    uint8_t lut[TONEMAP_LUT_SIZE];
+} tonemap_t;
+
+// Float RGB accumulation buffer. Rows are stored top to bottom, in the order images are
+// written, and hold the sum of all samples traced for each pixel.
+typedef struct {
+    int width;
+    int height;
+    uint32_t samples;
+
+    float *rgb;
+} framebuffer_t;
+
+int framebuffer_init(framebuffer_t *fb, int width, int height);
+
+void framebuffer_free(framebuffer_t *fb);
+
+void framebuffer_clear(framebuffer_t *fb);
+
+void framebuffer_add(framebuffer_t *fb, int x, int row, color_t c);
+
+void tonemap_init(tonemap_t *tm, float exposure, tonemap_op_t op);
+
+void framebuffer_resolve(const framebuffer_t *fb, const tonemap_t *tm, uint8_t *out, int row_begin, int row_end);
+
+#endif
@@ -0,0 +1,504 @@
+#include "grid.h"
+#include "../cost/cost.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Average amount of cells per primitive for the uniform grid
+#define GRID_DENSITY 4.0
+#define GRID_MAX_RES 1024
+#define GRID_MAX_CELLS ((size_t) 1 << 26)
+
+// Spheres with a radius more than this many times the mean radius stay out of the cells
+#define GRID_OUTLIER_SCALE 4.0
+
+// The hashed grid uses cells twice the mean sphere diameter wide and keeps about two
+// buckets per primitive, independent of how much empty space the bounding box holds
+#define HASHED_GRID_CELL_SCALE 2.0
+#define HASHED_GRID_MAX_RES (1 << 20)
+#define HASHED_GRID_BUCKETS_PER_PRIM 2
+
+static size_t grid_cell_key(const grid_t *grid, int x, int y, int z) {
+    if (grid->type == GRID_HASHED) {
+        uint64_t h = ((uint64_t) x * 73856093u) ^ ((uint64_t) y * 19349663u) ^ ((uint64_t) z * 83492791u);
+        return (size_t) (h & (grid->cell_count - 1));
+    }
+
+    return (((size_t) z * grid->res[1]) + y) * grid->res[0] + x;
+}
+
+static int grid_clamp_cell(const grid_t *grid, int axis, double coord) {
+    int cell = (int) floor((coord - grid->bounds_min[axis]) * grid->inv_cell_size[axis]);
+
+    if (cell < 0) {
+        return 0;
+    }
+
+    if (cell >= grid->res[axis]) {
+        return grid->res[axis] - 1;
+    }
+
+    return cell;
+}
+
+static void grid_sphere_cell_range(const grid_t *grid, const sphere_t *sphere, int lo[3], int hi[3]) {
+    double center[3] = { sphere->center.x, sphere->center.y, sphere->center.z };
+
+    for (int axis = 0; axis < 3; axis++) {
+        lo[axis] = grid_clamp_cell(grid, axis, center[axis] - sphere->radius);
+        hi[axis] = grid_clamp_cell(grid, axis, center[axis] + sphere->radius);
+    }
+}
+
+// Whether a sphere is an outlier or overlaps more than GRID_MAX_SPHERE_CELLS cells, counted
+// from its clamped cell range before any of them is visited
+static int grid_sphere_is_large(const grid_t *grid, const sphere_t *sphere, double outlier_radius) {
+    int lo[3], hi[3];
+
+    if (fabs(sphere->radius) > outlier_radius) {
+        return 1;
+    }
+
+    grid_sphere_cell_range(grid, sphere, lo, hi);
+
+    size_t cells = (size_t) (hi[0] - lo[0] + 1) * (size_t) (hi[1] - lo[1] + 1) * (size_t) (hi[2] - lo[2] + 1);
+    return cells > GRID_MAX_SPHERE_CELLS;
+}
+
+static void grid_choose_resolution(grid_t *grid, double mean_radius) {
+    double extent[3];
+    double volume = 1.0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        extent[axis] = grid->bounds_max[axis] - grid->bounds_min[axis];
+        volume *= extent[axis];
+    }
+
+    double cell_len;
+    int max_res;
+
+    if (grid->type == GRID_HASHED) {
+        cell_len = HASHED_GRID_CELL_SCALE * 2.0 * mean_radius;
+        max_res = HASHED_GRID_MAX_RES;
+    } else {
+        cell_len = cbrt(volume / (GRID_DENSITY * (double) grid->sphere_count));
+        max_res = GRID_MAX_RES;
+    }
+
+    size_t total = 1;
+
+    for (int axis = 0; axis < 3; axis++) {
+        double res = (cell_len > 0.0) ? ceil(extent[axis] / cell_len) : 1.0;
+        grid->res[axis] = (res < 1.0) ? 1 : ((res > max_res) ? max_res : (int) res);
+        total *= (size_t) grid->res[axis];
+    }
+
+    // Coarsen the dense grid evenly until the cell array fits
+    while ((grid->type == GRID_UNIFORM) && (total > GRID_MAX_CELLS)) {
+        total = 1;
+        for (int axis = 0; axis < 3; axis++) {
+            grid->res[axis] = (grid->res[axis] + 1) / 2;
+            total *= (size_t) grid->res[axis];
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        grid->cell_size[axis] = extent[axis] / grid->res[axis];
+        grid->inv_cell_size[axis] = 1.0 / grid->cell_size[axis];
+    }
+
+    if (grid->type == GRID_HASHED) {
+        size_t buckets = 1;
+        while (buckets < HASHED_GRID_BUCKETS_PER_PRIM * grid->sphere_count) {
+            buckets <<= 1;
+        }
+        grid->cell_count = buckets;
+    } else {
+        grid->cell_count = total;
+    }
+}
+
+/**
+ * @brief Build a uniform or hashed grid over an array of spheres. The grid only references
+ * the sphere array, which has to outlive it.
+ * 
+ * @param grid The grid structure to initialize.
+ * @param spheres The spheres to place in the grid.
+ * @param sphere_count The amount of spheres in the array.
+ * @param type Whether to store cells densely or hash them into a bucket table.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int grid_build(grid_t *grid, sphere_t *spheres, size_t sphere_count, grid_type_t type) {
+    if ((grid == NULL) || ((spheres == NULL) && (sphere_count > 0)) || (sphere_count >= UINT32_MAX)) {
+        return -1;
+    }
+
+    memset(grid, 0, sizeof(grid_t));
+    grid->type = type;
+    grid->spheres = spheres;
+    grid->sphere_count = sphere_count;
+
+    if (sphere_count == 0) {
+        return 0;
+    }
+
+    double radius_sum = 0.0;
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        radius_sum += fabs(spheres[i].radius);
+    }
+
+    // Spheres far larger than the mean are left out of the bounds and the cell size, so that
+    // one huge sphere does not stretch the grid over empty space or coarsen it for the rest
+    double outlier_radius = GRID_OUTLIER_SCALE * radius_sum / (double) sphere_count;
+    double typical_sum = 0.0;
+    size_t typical_count = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        grid->bounds_min[axis] = INFINITY;
+        grid->bounds_max[axis] = -INFINITY;
+    }
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        double center[3] = { spheres[i].center.x, spheres[i].center.y, spheres[i].center.z };
+        double radius = fabs(spheres[i].radius);
+
+        if (radius > outlier_radius) {
+            continue;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            grid->bounds_min[axis] = fmin(grid->bounds_min[axis], center[axis] - radius);
+            grid->bounds_max[axis] = fmax(grid->bounds_max[axis], center[axis] + radius);
+        }
+
+        typical_sum += radius;
+        typical_count++;
+    }
+
+    // Pad the bounds so that flat scenes still get a non-zero cell size on every axis
+    for (int axis = 0; axis < 3; axis++) {
+        double pad = 1e-6 * (1.0 + grid->bounds_max[axis] - grid->bounds_min[axis]);
+        grid->bounds_min[axis] -= pad;
+        grid->bounds_max[axis] += pad;
+    }
+
+    // The smallest sphere is never an outlier, so typical_count is at least 1
+    double mean_radius = typical_sum / (double) typical_count;
+
+    grid_choose_resolution(grid, mean_radius);
+
+    grid->cell_start = calloc(grid->cell_count + 1, sizeof(uint32_t));
+    if (grid->cell_start == NULL) {
+        return -1;
+    }
+
+    // First pass: count the references of every cell into its own slot, and set aside the
+    // spheres overlapping too many cells, before walking their cells
+    size_t ref_count = 0;
+    int lo[3], hi[3];
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        if (grid_sphere_is_large(grid, &spheres[i], outlier_radius)) {
+            grid->large_count++;
+            continue;
+        }
+
+        grid_sphere_cell_range(grid, &spheres[i], lo, hi);
+
+        for (int z = lo[2]; z <= hi[2]; z++) {
+            for (int y = lo[1]; y <= hi[1]; y++) {
+                for (int x = lo[0]; x <= hi[0]; x++) {
+                    grid->cell_start[grid_cell_key(grid, x, y, z)]++;
+                    ref_count++;
+                }
+            }
+        }
+    }
+
+    if (ref_count >= UINT32_MAX) {
+        grid_free(grid);
+        return -1;
+    }
+
+    // Inclusive prefix sum, leaving the end offset of every cell in its slot
+    for (size_t k = 1; k < grid->cell_count; k++) {
+        grid->cell_start[k] += grid->cell_start[k - 1];
+    }
+    grid->cell_start[grid->cell_count] = (uint32_t) ref_count;
+
+    grid->prim_indices = malloc(((ref_count > 0) ? ref_count : 1) * sizeof(uint32_t));
+    grid->large_indices = malloc(((grid->large_count > 0) ? grid->large_count : 1) * sizeof(uint32_t));
+    if ((grid->prim_indices == NULL) || (grid->large_indices == NULL)) {
+        grid_free(grid);
+        return -1;
+    }
+
+    // Second pass: fill back to front, which turns every end offset into a start offset
+    size_t large_left = grid->large_count;
+
+    for (size_t i = sphere_count; i-- > 0;) {
+        if (grid_sphere_is_large(grid, &spheres[i], outlier_radius)) {
+            grid->large_indices[--large_left] = (uint32_t) i;
+            continue;
+        }
+
+        grid_sphere_cell_range(grid, &spheres[i], lo, hi);
+
+        for (int z = lo[2]; z <= hi[2]; z++) {
+            for (int y = lo[1]; y <= hi[1]; y++) {
+                for (int x = lo[0]; x <= hi[0]; x++) {
+                    grid->prim_indices[--grid->cell_start[grid_cell_key(grid, x, y, z)]] = (uint32_t) i;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+void grid_free(grid_t *grid) {
+    if (grid == NULL) {
+        return;
+    }
+
+    free(grid->cell_start);
+    free(grid->prim_indices);
+    free(grid->large_indices);
+
+    grid->cell_start = NULL;
+    grid->prim_indices = NULL;
+    grid->large_indices = NULL;
+    grid->cell_count = 0;
+    grid->large_count = 0;
+}
+
+// State of a 3D-DDA walk through the cells a ray passes through
+typedef struct {
+    int cell[3];
+    int step[3];
+    int end[3];
+    double t_next[3];
+    double t_delta[3];
+    double t_exit;
+} grid_walk_t;
+
+/**
+ * @brief Clip a ray against the grid bounds and set up a walk starting in the first cell it
+ * enters within [t_min, t_max].
+ * 
+ * @return Returns 1 if the ray passes through the grid, 0 otherwise.
+ */
+static int grid_walk_begin(const grid_t *grid, ray_t r, double t_min, double t_max, grid_walk_t *walk) {
+    double origin[3] = { r.origin.x, r.origin.y, r.origin.z };
+    double dir[3] = { r.direction.x, r.direction.y, r.direction.z };
+
+    // Clip the ray against the grid bounds (slab test)
+    double t_enter = t_min;
+    double t_exit = t_max;
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (dir[axis] == 0.0) {
+            if ((origin[axis] < grid->bounds_min[axis]) || (origin[axis] > grid->bounds_max[axis])) {
+                return 0;
+            }
+            continue;
+        }
+
+        double inv_dir = 1.0 / dir[axis];
+        double t0 = (grid->bounds_min[axis] - origin[axis]) * inv_dir;
+        double t1 = (grid->bounds_max[axis] - origin[axis]) * inv_dir;
+
+        if (t0 > t1) {
+            double tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+
+        t_enter = fmax(t_enter, t0);
+        t_exit = fmin(t_exit, t1);
+
+        if (t_enter > t_exit) {
+            return 0;
+        }
+    }
+
+    walk->t_exit = t_exit;
+
+    for (int axis = 0; axis < 3; axis++) {
+        walk->cell[axis] = grid_clamp_cell(grid, axis, origin[axis] + (dir[axis] * t_enter));
+
+        if (dir[axis] > 0.0) {
+            walk->step[axis] = 1;
+            walk->end[axis] = grid->res[axis];
+            walk->t_next[axis] = (grid->bounds_min[axis] + ((walk->cell[axis] + 1) * grid->cell_size[axis]) - origin[axis]) / dir[axis];
+            walk->t_delta[axis] = grid->cell_size[axis] / dir[axis];
+        } else if (dir[axis] < 0.0) {
+            walk->step[axis] = -1;
+            walk->end[axis] = -1;
+            walk->t_next[axis] = (grid->bounds_min[axis] + (walk->cell[axis] * grid->cell_size[axis]) - origin[axis]) / dir[axis];
+            walk->t_delta[axis] = -grid->cell_size[axis] / dir[axis];
+        } else {
+            walk->step[axis] = 0;
+            walk->end[axis] = -1;
+            walk->t_next[axis] = INFINITY;
+            walk->t_delta[axis] = INFINITY;
+        }
+    }
+
+    return 1;
+}
+
+// Distance at which the ray leaves the current cell, and the axis it leaves it through
+static double grid_walk_cell_exit(const grid_walk_t *walk, int *axis) {
+    *axis = (walk->t_next[0] < walk->t_next[1]) ? ((walk->t_next[0] < walk->t_next[2]) ? 0 : 2) : ((walk->t_next[1] < walk->t_next[2]) ? 1 : 2);
+
+    return walk->t_next[*axis];
+}
+
+/**
+ * @brief Step the walk into the next cell along the ray.
+ * 
+ * @return Returns 1 if the next cell lies within the grid and the clipped ray, 0 otherwise.
+ */
+static int grid_walk_next(grid_walk_t *walk) {
+    int axis;
+
+    if (grid_walk_cell_exit(walk, &axis) > walk->t_exit) {
+        return 0;
+    }
+
+    walk->cell[axis] += walk->step[axis];
+    if (walk->cell[axis] == walk->end[axis]) {
+        return 0;
+    }
+
+    walk->t_next[axis] += walk->t_delta[axis];
+
+    return 1;
+}
+
+/**
+ * @brief Find the closest intersection of a ray with the spheres in a grid by walking the
+ * cells the ray passes through in order (3D-DDA). The walk stops as soon as a hit lies
+ * within the cell being visited, since no later cell can hold a closer one. Spheres too
+ * large for the cells are tested up front, so that their hits end the walk the same way.
+ * 
+ * @param ptr A pointer to a valid grid, cast to raw_hittable_data.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * @param rec The structure to populate with data of the closest hit.
+ * 
+ * @return Returns 0 if the ray does not intersect any sphere in the grid, 1 if it does, -1 on
+ * error or invalid argument.
+ */
+int grid_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    if ((ptr == NULL) || (rec == NULL)) {
+        return -1;
+    }
+
+    grid_t *grid = (grid_t*) ptr;
+    grid_walk_t walk;
+
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    cost_counter.tests += grid->large_count;
+
+    for (size_t i = 0; i < grid->large_count; i++) {
+        if (sphere_hit(&grid->spheres[grid->large_indices[i]], r, t_min, closest_so_far, rec) == 1) {
+            hit_anything = 1;
+            closest_so_far = rec->t;
+        }
+    }
+
+    if ((grid->sphere_count == grid->large_count) || !grid_walk_begin(grid, r, t_min, closest_so_far, &walk)) {
+        return hit_anything;
+    }
+
+    do {
+        size_t key = grid_cell_key(grid, walk.cell[0], walk.cell[1], walk.cell[2]);
+
+        cost_counter.steps++;
+        cost_counter.tests += grid->cell_start[key + 1] - grid->cell_start[key];
+
+        for (uint32_t i = grid->cell_start[key]; i < grid->cell_start[key + 1]; i++) {
+            if (sphere_hit(&grid->spheres[grid->prim_indices[i]], r, t_min, closest_so_far, rec) == 1) {
+                hit_anything = 1;
+                closest_so_far = rec->t;
+            }
+        }
+
+        int axis;
+        if (hit_anything && (closest_so_far <= grid_walk_cell_exit(&walk, &axis))) {
+            break;
+        }
+    } while (grid_walk_next(&walk));
+
+    return hit_anything;
+}
+
+/**
+ * @brief Check whether any sphere in a grid blocks a ray between t_min and t_max. Returns
+ * on the first intersection found, in whatever cell it lies.
+ * 
+ * @param ptr A pointer to a valid grid, cast to raw_hittable_data.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * 
+ * @return Returns 0 if the ray is unobstructed, 1 if it is, -1 on error or invalid argument.
+ */
+int grid_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max) {
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    grid_t *grid = (grid_t*) ptr;
+    grid_walk_t walk;
+
+    for (size_t i = 0; i < grid->large_count; i++) {
+        if (sphere_occluded(&grid->spheres[grid->large_indices[i]], r, t_min, t_max) == 1) {
+            cost_counter.tests += i + 1;
+            return 1;
+        }
+    }
+
+    cost_counter.tests += grid->large_count;
+
+    if ((grid->sphere_count == grid->large_count) || !grid_walk_begin(grid, r, t_min, t_max, &walk)) {
+        return 0;
+    }
+
+    do {
+        size_t key = grid_cell_key(grid, walk.cell[0], walk.cell[1], walk.cell[2]);
+
+        cost_counter.steps++;
+
+        for (uint32_t i = grid->cell_start[key]; i < grid->cell_start[key + 1]; i++) {
+            if (sphere_occluded(&grid->spheres[grid->prim_indices[i]], r, t_min, t_max) == 1) {
+                cost_counter.tests += i - grid->cell_start[key] + 1;
+                return 1;
+            }
+        }
+
+        cost_counter.tests += grid->cell_start[key + 1] - grid->cell_start[key];
+    } while (grid_walk_next(&walk));
+
+    return 0;
+}
+
+hittable_t grid_to_hittable(grid_t *grid) {
+    if (grid == NULL) {
+        return (hittable_t) { .ptr = NULL, .size = 0, .hit = NULL, .occluded = NULL };
+    }
+
+    return (hittable_t) {
+        .ptr = grid,
+        .size = sizeof(grid_t),
+        .hit = &grid_hit,
+        .occluded = &grid_occluded
+    };
+}
@@ -0,0 +1,51 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "../hittable.h"
+#include "../sphere/sphere.h"
+
+#include <stdint.h>
+
+// Most cells a sphere is referenced from, larger spheres are tested by every ray instead
+#define GRID_MAX_SPHERE_CELLS 512
+
+typedef enum {
+    GRID_UNIFORM,   // Dense cell array, one slot per cell of the bounding box
+    GRID_HASHED     // Cells hashed into a bucket table sized by primitive count
+} grid_type_t;
+
+typedef struct {
+    grid_type_t type;
+
+    sphere_t *spheres;
+    size_t sphere_count;
+
+    double bounds_min[3];
+    double bounds_max[3];
+    double cell_size[3];
+    double inv_cell_size[3];
+    int res[3];
+
+    // Compact cell-to-primitive mapping: the spheres overlapping cell (or bucket) k are
+    // prim_indices[cell_start[k]] up to, but excluding, prim_indices[cell_start[k + 1]]
+    size_t cell_count;
+    uint32_t *cell_start;
+    uint32_t *prim_indices;
+
+    // Spheres far larger than the mean or overlapping more than GRID_MAX_SPHERE_CELLS cells,
+    // kept out of the cells and the bounds and tested by every ray
+    size_t large_count;
+    uint32_t *large_indices;
+} grid_t;
+
+int grid_build(grid_t *grid, sphere_t *spheres, size_t sphere_count, grid_type_t type);
+
+void grid_free(grid_t *grid);
+
+int grid_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec);
+
+int grid_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max);
+
+hittable_t grid_to_hittable(grid_t *grid);
+
+#endif
@@ -0,0 +1,51 @@
+#include "hittable.h"
+
+void hit_record_set_face_normal(hit_record_t *hit, ray_t r, vec3_t outward_normal) {
+    if (hit == NULL) {
+        return;
+    }
+
+    hit->front_face = vec3_dot(r.direction, outward_normal) < 0;
+    hit->normal = hit->front_face ? outward_normal : vec3_scalar_mul(outward_normal, -1);    
+}
+
+/**
+ * @brief Complete a hit record returned by a hit function by computing the hit point, normal
+ * and facing of the recorded primitive. Should be called once, after traversal has settled
+ * on the closest hit.
+ * 
+ * @param hit The hit record to complete.
+ * @param r The ray the hit was found with.
+ */
+void hit_record_finalize(hit_record_t *hit, ray_t r) {
+    if ((hit == NULL) || (hit->finalize == NULL)) {
+        return;
+    }
+
+    hit->finalize(hit->prim, r, hit);
+}
+
+/**
+ * @brief Check whether anything blocks a ray between t_min and t_max. Meant for visibility
+ * queries such as shadow rays, which only need a yes/no answer and can stop at the first
+ * intersection found. Hittables without an occluded function are queried through hit.
+ * 
+ * @param hittable The hittable to check against.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * 
+ * @return Returns 0 if the ray is unobstructed, 1 if it is, -1 on error or invalid argument.
+ */
+int hittable_occluded(const hittable_t *hittable, ray_t r, double t_min, double t_max) {
+    if ((hittable == NULL) || (hittable->hit == NULL)) {
+        return -1;
+    }
+
+    if (hittable->occluded != NULL) {
+        return hittable->occluded(hittable->ptr, r, t_min, t_max);
+    }
+
+    hit_record_t rec;
+    return hittable->hit(hittable->ptr, r, t_min, t_max, &rec);
+}
@@ -4,15 +4,27 @@
 #include "./ray/ray.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef void* raw_hittable_data;
 
-typedef struct {
+struct material;
+
+// Hits are recorded in two phases. During traversal, hit functions only store the distance t
+// and a handle to the primitive hit, along with the function that completes the record for it.
+// The remaining fields are filled in once, for the closest hit, by hit_record_finalize.
+typedef struct hit_record {
     point3_t p;
     vec3_t normal;
     double t;
 
     bool front_face;
+
+    // Surface material, NULL for the default diffuse material
+    const struct material *material;
+
+    const void *prim;
+    void (*finalize) (const void*, ray_t, struct hit_record*);
 } hit_record_t;
 
 typedef struct {
@@ -20,14 +32,15 @@ typedef struct {
     size_t size;
 
     int (*hit) (raw_hittable_data, ray_t, double, double, hit_record_t*);
+
+    // Any-hit visibility query, may be NULL to fall back to hit
+    int (*occluded) (raw_hittable_data, ray_t, double, double);
 } hittable_t;
 
-void hit_record_set_face_normal(hit_record_t *hit, ray_t r, vec3_t outward_normal) {
-    if (hit == NULL) {
-        return;
-    }
+void hit_record_set_face_normal(hit_record_t *hit, ray_t r, vec3_t outward_normal);
+
+void hit_record_finalize(hit_record_t *hit, ray_t r);
+
+int hittable_occluded(const hittable_t *hittable, ray_t r, double t_min, double t_max);
 
-    hit->front_face = vec3_dot(r.direction, outward_normal) < 0;
-    hit->normal = hit->front_face ? outward_normal : vec3_scalar_mul(outward_normal, -1);    
-}
 #endif
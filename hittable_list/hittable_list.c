@@ -0,0 +1,87 @@
+#include "hittable_list.h"
+#include "../cost/cost.h"
+
+/**
+ * @brief Find the closest intersection of a ray with any hittable in a list. Every hittable
+ * is tested, with the maximum distance shrinking to the closest hit found so far.
+ * 
+ * @param ptr A pointer to a valid hittable list, cast to raw_hittable_data.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * @param rec The structure to populate with data of the closest hit.
+ * 
+ * @return Returns 0 if the ray does not intersect any hittable in the list, 1 if it does, -1 on
+ * error or invalid argument.
+ */
+int hittable_list_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    if ((ptr == NULL) || (rec == NULL)) {
+        return -1;
+    }
+
+    hittable_list_t *list = (hittable_list_t*) ptr;
+
+    hit_record_t temp_rec;
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    cost_counter.tests += list->amount;
+
+    for (size_t i = 0; i < list->amount; i++) {
+        hittable_t *object = &list->hittables[i];
+
+        if (object->hit == NULL) {
+            continue;
+        }
+
+        if (object->hit(object->ptr, r, t_min, closest_so_far, &temp_rec) == 1) {
+            hit_anything = 1;
+            closest_so_far = temp_rec.t;
+            *rec = temp_rec;
+        }
+    }
+
+    return hit_anything;
+}
+
+/**
+ * @brief Check whether any hittable in a list blocks a ray between t_min and t_max. Returns
+ * on the first intersection found.
+ * 
+ * @param ptr A pointer to a valid hittable list, cast to raw_hittable_data.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * 
+ * @return Returns 0 if the ray is unobstructed, 1 if it is, -1 on error or invalid argument.
+ */
+int hittable_list_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max) {
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    hittable_list_t *list = (hittable_list_t*) ptr;
+
+    for (size_t i = 0; i < list->amount; i++) {
+        if (hittable_occluded(&list->hittables[i], r, t_min, t_max) == 1) {
+            cost_counter.tests += i + 1;
+            return 1;
+        }
+    }
+
+    cost_counter.tests += list->amount;
+    return 0;
+}
+
+hittable_t hittable_list_to_hittable(hittable_list_t *list) {
+    if (list == NULL) {
+        return (hittable_t) { .ptr = NULL, .size = 0, .hit = NULL, .occluded = NULL };
+    }
+
+    return (hittable_t) {
+        .ptr = list,
+        .size = sizeof(hittable_list_t),
+        .hit = &hittable_list_hit,
+        .occluded = &hittable_list_occluded
+    };
+}
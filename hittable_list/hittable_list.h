@@ -0,0 +1,17 @@
+#ifndef HITTABLE_LIST
+#define HITTABLE_LIST
+
+#include "../hittable.h"
+
+typedef struct {
+    hittable_t *hittables;
+    size_t amount;
+} hittable_list_t;
+
+int hittable_list_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec);
+
+int hittable_list_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max);
+
+hittable_t hittable_list_to_hittable(hittable_list_t *list);
+
+#endif
@@ -0,0 +1,126 @@
+#include "image.h"
+#include "../color/color.h"
+#include <stdlib.h>
+
+/**
+ * @brief Start encoding an image to an open file by writing its header. Pixels then follow
+ * through image_stream_write in row-major order, from the top left.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int image_stream_begin(image_stream_t *stream, FILE *file, image_format_t format, int width, int height) {
+    if ((stream == NULL) || (file == NULL) || (width < 1) || (height < 1)) {
+        return -1;
+    }
+
+    stream->file = file;
+    stream->format = format;
+    stream->qoi = NULL;
+
+    if (format == IMAGE_FORMAT_QOI) {
+        stream->qoi = malloc(sizeof(qoi_encoder_t));
+
+        if ((stream->qoi == NULL) || (qoi_begin(stream->qoi, file, width, height) != 0)) {
+            free(stream->qoi);
+            stream->qoi = NULL;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    if (format == IMAGE_FORMAT_PPM) {
+        fprintf(file, "P3\n%d %d\n255\n", width, height);
+        return ferror(file) ? -1 : 0;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Encode the next pixels of an image.
+ * 
+ * @param pixels 3 bytes per pixel.
+ * 
+ * @return Returns 0 on success, -1 on error.
+ */
+int image_stream_write(image_stream_t *stream, const uint8_t *pixels, size_t pixel_count) {
+    if (stream->format == IMAGE_FORMAT_QOI) {
+        int retval = 0;
+
+        for (size_t p = 0; (p < pixel_count) && (retval == 0); p++) {
+            retval = qoi_encode_pixel(stream->qoi, pixels[p * 3], pixels[(p * 3) + 1], pixels[(p * 3) + 2]);
+        }
+
+        return retval;
+    }
+
+    for (size_t p = 0; p < pixel_count; p++) {
+        write_color_bytes(stream->file, &pixels[p * 3]);
+    }
+
+    return ferror(stream->file) ? -1 : 0;
+}
+
+/**
+ * @brief Finish an image, flushing what the encoder still holds. The file stays open.
+ * 
+ * @return Returns 0 on success, -1 on error.
+ */
+int image_stream_end(image_stream_t *stream) {
+    int retval = 0;
+
+    if (stream->qoi != NULL) {
+        retval = qoi_end(stream->qoi);
+        free(stream->qoi);
+        stream->qoi = NULL;
+    }
+
+    return ((retval != 0) || ferror(stream->file)) ? -1 : 0;
+}
+
+/**
+ * @brief Encode an 8-bit RGB image, stored row by row from the top, to an open file.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int image_write(FILE *file, image_format_t format, const uint8_t *image, int width, int height) {
+    image_stream_t stream;
+
+    if ((image == NULL) || (image_stream_begin(&stream, file, format, width, height) != 0)) {
+        return -1;
+    }
+
+    int retval = image_stream_write(&stream, image, (size_t) width * height);
+
+    if (image_stream_end(&stream) != 0) {
+        retval = -1;
+    }
+
+    return retval;
+}
+
+/**
+ * @brief Encode an 8-bit RGB image into a new file, replacing any existing one.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int image_write_file(const char *filename, image_format_t format, const uint8_t *image, int width, int height) {
+    if (filename == NULL) {
+        return -1;
+    }
+
+    FILE *file = fopen(filename, (format == IMAGE_FORMAT_QOI) ? "wb" : "w");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    int retval = image_write(file, format, image, width, height);
+
+    if (fclose(file) != 0) {
+        retval = -1;
+    }
+
+    return retval;
+}
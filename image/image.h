@@ -0,0 +1,33 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "../qoi/qoi.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum {
+    IMAGE_FORMAT_INVALID = 0,
+    IMAGE_FORMAT_PPM,
+    IMAGE_FORMAT_QOI
+} image_format_t;
+
+// An image being encoded in row-major pieces, for writers that get rows as they are finished
+typedef struct {
+    FILE *file;
+    image_format_t format;
+    qoi_encoder_t *qoi;
+} image_stream_t;
+
+int image_stream_begin(image_stream_t *stream, FILE *file, image_format_t format, int width, int height);
+
+int image_stream_write(image_stream_t *stream, const uint8_t *pixels, size_t pixel_count);
+
+int image_stream_end(image_stream_t *stream);
+
+int image_write(FILE *file, image_format_t format, const uint8_t *image, int width, int height);
+
+int image_write_file(const char *filename, image_format_t format, const uint8_t *image, int width, int height);
+
+#endif
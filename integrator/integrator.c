@@ -0,0 +1,231 @@
+#include "integrator.h"
+#include <math.h>
+
+static void set_aov(aov_sample_t *aov, const hit_record_t *rec, ray_t r) {
+    if (aov == NULL) {
+        return;
+    }
+
+    if (rec == NULL) {
+        *aov = (aov_sample_t) { .normal = { 0, 0, 0 }, .depth = 0.0, .prim = NULL };
+        return;
+    }
+
+    aov->normal = rec->normal;
+    aov->depth = rec->t * vec3_len(r.direction);
+    aov->prim = rec->prim;
+}
+
+/**
+ * @brief Get the color of the sky seen along a ray, a vertical white to blue gradient.
+ */
+color_t integrator_sky(ray_t r) {
+    vec3_t unit_direction = vec3_unit_vec(r.direction);
+    double t = 0.5 * (unit_direction.y + 1.0);
+    return add_color(scale_color((color_t) {1.0, 1.0, 1.0}, (1.0 - t)), scale_color((color_t) {0.5, 0.7, 1.0}, t));
+}
+
+/**
+ * @brief Shade the first hit along a ray by its surface normal, or the sky if there is none.
+ * 
+ * @param aov Receives the first hit, may be NULL.
+ */
+color_t integrator_normals(ray_t r, hittable_t world, aov_sample_t *aov) {
+    hit_record_t rec;
+
+    if (world.hit(world.ptr, r, 0, INFINITY, &rec) == 1) {
+        hit_record_finalize(&rec, r);
+        set_aov(aov, &rec, r);
+
+        return scale_color((color_t) { .r = rec.normal.x + 1.0, .g = rec.normal.y + 1.0, .b = rec.normal.z + 1.0 }, 0.5);
+    }
+
+    set_aov(aov, NULL, r);
+    return integrator_sky(r);
+}
+
+/**
+ * @brief Randomly end a path with a probability that grows as its throughput drops, and
+ * scale the throughput of surviving paths up to make up for the ones ended. The expected
+ * throughput stays the same, so the estimate stays unbiased.
+ * 
+ * @param throughput The throughput of the path, rescaled if it survives.
+ * @param rng The generator of the path.
+ * 
+ * @return Returns 1 if the path survives, 0 if it ends.
+ */
+int integrator_russian_roulette(color_t *throughput, rng_t *rng) {
+    double survival = fmax(throughput->r, fmax(throughput->g, throughput->b));
+
+    if (survival > INTEGRATOR_RR_MAX_SURVIVAL) {
+        survival = INTEGRATOR_RR_MAX_SURVIVAL;
+    }
+
+    if (random_double(rng) >= survival) {
+        return 0;
+    }
+
+    *throughput = scale_color(*throughput, 1.0 / survival);
+    return 1;
+}
+
+// Power heuristic weight of a strategy sampling with density pdf against one with density other
+static double power_heuristic(double pdf, double other) {
+    return (pdf * pdf) / ((pdf * pdf) + (other * other));
+}
+
+/**
+ * @brief Get the solid angle density with which a material scattered a ray, for weighting
+ * it against light sampling.
+ * 
+ * @return Returns the cosine density of diffuse surfaces, or 0 for the specular ones, whose
+ * bounces are never weighted.
+ */
+double integrator_bsdf_pdf(const material_t *material, const hit_record_t *rec, ray_t scattered) {
+    if (material->type != MATERIAL_DIFFUSE) {
+        return 0.0;
+    }
+
+    double cosine = vec3_dot(vec3_unit_vec(scattered.direction), rec->normal);
+    return (cosine > 0.0) ? (cosine / M_PI) : 0.0;
+}
+
+/**
+ * @brief Get the light a surface emits along a ray that hit it, weighted against the
+ * chance that light sampling at the previous bounce found the same light.
+ * 
+ * @param lights The lights sampled at diffuse bounces, may be NULL.
+ * @param material The material of the surface hit.
+ * @param r The ray that hit the surface, starting at the previous bounce.
+ * @param rec The finalized hit record.
+ * @param bsdf_pdf The density r was scattered with, 0 for camera rays and specular bounces.
+ * 
+ * @return Returns the weighted emitted radiance.
+ */
+color_t integrator_emission(const light_set_t *lights, const material_t *material, ray_t r, const hit_record_t *rec, double bsdf_pdf) {
+    color_t emitted = material_emitted(material, rec);
+
+    // Only emissive hits are lights, and only they are sure to be on exact spheres
+    if ((bsdf_pdf <= 0.0) || (material == NULL) || (material->type != MATERIAL_EMISSIVE)) {
+        return emitted;
+    }
+
+    double light_pdf = light_set_pdf(lights, (const sphere_t*) rec->prim, r.origin);
+    return scale_color(emitted, power_heuristic(bsdf_pdf, light_pdf));
+}
+
+/**
+ * @brief Next-event estimation at a diffuse surface. Samples a direction towards a light
+ * picked by power, and computes the light it would carry if nothing blocks it, weighted
+ * against the chance of the diffuse bounce finding the same light.
+ * 
+ * @param lights The lights to sample, may be NULL.
+ * @param material The material of the surface.
+ * @param rec The finalized hit record.
+ * @param rng The generator of the path.
+ * @param shadow Receives the ray towards the light.
+ * @param t_max Receives the distance up to which shadow must be unoccluded.
+ * @param contribution Receives the light carried, before the throughput of the path.
+ * 
+ * @return Returns 1 if a shadow ray needs to be traced, 0 otherwise.
+ */
+int integrator_sample_light(const light_set_t *lights, const material_t *material, const hit_record_t *rec, rng_t *rng, ray_t *shadow, double *t_max, color_t *contribution) {
+    if ((lights == NULL) || (lights->count == 0) || (material->type != MATERIAL_DIFFUSE)) {
+        return 0;
+    }
+
+    light_sample_t sample;
+
+    if (light_set_sample(lights, rec->p, rng, &sample) == 0) {
+        return 0;
+    }
+
+    double cosine = vec3_dot(rec->normal, sample.direction);
+
+    if ((cosine <= 0.0) || (sample.distance <= (2.0 * INTEGRATOR_T_MIN))) {
+        return 0;
+    }
+
+    double weight = power_heuristic(sample.pdf, cosine / M_PI);
+
+    *shadow = (ray_t) { .origin = rec->p, .direction = sample.direction };
+    *t_max = sample.distance - INTEGRATOR_T_MIN;
+    *contribution = scale_color(mul_color(material->albedo, sample.emission), (cosine / M_PI) * weight / sample.pdf);
+
+    return 1;
+}
+
+/**
+ * @brief Trace a path bounce by bounce, scattering off the material of every surface it
+ * hits, until it escapes to the sky, is absorbed or max_depth bounces have been traced.
+ * At diffuse surfaces, light sampling adds the direct light of the lights through shadow
+ * rays. After rr_depth bounces, Russian roulette ends paths that carry little light.
+ * 
+ * @param r The ray to trace.
+ * @param primary The hittable to intersect r with.
+ * @param world The hittable to intersect bounced rays and shadow rays with.
+ * @param lights The lights to sample, NULL to only find lights by bouncing into them.
+ * @param max_depth The most bounces to trace.
+ * @param rr_depth The bounces traced before Russian roulette starts, max_depth or more to
+ * disable it.
+ * @param rng The generator of the path.
+ * @param aov Receives the first hit, may be NULL.
+ * 
+ * @return Returns the light arriving along r.
+ */
+color_t integrator_path(ray_t r, hittable_t primary, hittable_t world, const light_set_t *lights, int max_depth, int rr_depth, rng_t *rng, aov_sample_t *aov) {
+    color_t radiance = { 0, 0, 0 };
+    color_t throughput = { 1.0, 1.0, 1.0 };
+    double bsdf_pdf = 0.0;
+    hittable_t target = primary;
+
+    set_aov(aov, NULL, r);
+
+    for (int depth = 0; depth < max_depth; depth++) {
+        hit_record_t rec;
+
+        if (target.hit(target.ptr, r, INTEGRATOR_T_MIN, INFINITY, &rec) != 1) {
+            return add_color(radiance, mul_color(throughput, integrator_sky(r)));
+        }
+
+        hit_record_finalize(&rec, r);
+
+        if (depth == 0) {
+            set_aov(aov, &rec, r);
+        }
+
+        const material_t *material = material_or_default(rec.material);
+
+        if (material->type == MATERIAL_EMISSIVE) {
+            return add_color(radiance, mul_color(throughput, integrator_emission(lights, material, r, &rec, bsdf_pdf)));
+        }
+
+        ray_t shadow;
+        double t_max;
+        color_t contribution;
+
+        if ((integrator_sample_light(lights, material, &rec, rng, &shadow, &t_max, &contribution) == 1) &&
+            (hittable_occluded(&world, shadow, INTEGRATOR_T_MIN, t_max) == 0)) {
+            radiance = add_color(radiance, mul_color(throughput, contribution));
+        }
+
+        color_t attenuation;
+        ray_t scattered;
+
+        if (material_scatter(material, r, &rec, rng, &attenuation, &scattered) == 0) {
+            break;
+        }
+
+        bsdf_pdf = integrator_bsdf_pdf(material, &rec, scattered);
+        throughput = mul_color(throughput, attenuation);
+
+        if ((depth >= rr_depth) && (integrator_russian_roulette(&throughput, rng) == 0)) {
+            break;
+        }
+
+        r = scattered;
+        target = world;
+    }
+
+    return radiance;
+}
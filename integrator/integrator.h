@@ -0,0 +1,33 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "../hittable.h"
+#include "../color/color.h"
+#include "../random/random.h"
+#include "../aov/aov.h"
+#include "../material/material.h"
+#include "../light/light.h"
+
+// Bounced rays ignore hits closer than this, so they do not hit the surface they leave
+// because of rounding errors
+#define INTEGRATOR_T_MIN 0.001
+
+// Highest probability Russian roulette lets a path survive with, so that paths through
+// white surfaces still end
+#define INTEGRATOR_RR_MAX_SURVIVAL 0.95
+
+color_t integrator_sky(ray_t r);
+
+color_t integrator_normals(ray_t r, hittable_t world, aov_sample_t *aov);
+
+int integrator_russian_roulette(color_t *throughput, rng_t *rng);
+
+double integrator_bsdf_pdf(const material_t *material, const hit_record_t *rec, ray_t scattered);
+
+color_t integrator_emission(const light_set_t *lights, const material_t *material, ray_t r, const hit_record_t *rec, double bsdf_pdf);
+
+int integrator_sample_light(const light_set_t *lights, const material_t *material, const hit_record_t *rec, rng_t *rng, ray_t *shadow, double *t_max, color_t *contribution);
+
+color_t integrator_path(ray_t r, hittable_t primary, hittable_t world, const light_set_t *lights, int max_depth, int rr_depth, rng_t *rng, aov_sample_t *aov);
+
+#endif
@@ -0,0 +1,238 @@
+#include "light.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double luminance(color_t c) {
+    return (0.2126 * c.r) + (0.7152 * c.g) + (0.0722 * c.b);
+}
+
+/**
+ * @brief Get 1 - cos of the half angle of the cone a sphere covers seen from a point,
+ * without the cancellation of subtracting from 1 for small or distant spheres.
+ * 
+ * @return Returns the value, or 0 if the point lies inside the sphere.
+ */
+static double cone_one_minus_cos(const sphere_t *sphere, double dist_squared) {
+    double sin_squared = (sphere->radius * sphere->radius) / dist_squared;
+
+    if (sin_squared >= 1.0) {
+        return 0.0;
+    }
+
+    return sin_squared / (1.0 + sqrt(1.0 - sin_squared));
+}
+
+/**
+ * @brief Get the power a sphere emits, 0 for spheres without an emissive material.
+ */
+double light_power(const sphere_t *sphere) {
+    const material_t *material = sphere->material;
+
+    if ((material == NULL) || (material->type != MATERIAL_EMISSIVE)) {
+        return 0.0;
+    }
+
+    // Radiance times area times pi for a surface emitting the same radiance in all directions
+    return luminance(material->emission) * 4.0 * M_PI * sphere->radius * sphere->radius * M_PI;
+}
+
+/**
+ * @brief Collect the spheres that emit light and build the alias table picking them by power.
+ * The set refers to the spheres, which must outlive it.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int light_set_build(light_set_t *lights, const sphere_t *spheres, size_t sphere_count) {
+    if ((lights == NULL) || ((spheres == NULL) && (sphere_count > 0))) {
+        return -1;
+    }
+
+    memset(lights, 0, sizeof(light_set_t));
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        lights->count += light_power(&spheres[i]) > 0.0;
+    }
+
+    if (lights->count == 0) {
+        return 0;
+    }
+
+    if (lights->count > UINT32_MAX) {
+        return -1;
+    }
+
+    size_t n = lights->count;
+    double *scaled = malloc(n * sizeof(double));
+    uint32_t *small = malloc(n * sizeof(uint32_t));
+    uint32_t *large = malloc(n * sizeof(uint32_t));
+
+    lights->spheres = malloc(n * sizeof(const sphere_t*));
+    lights->keep = malloc(n * sizeof(double));
+    lights->alias = malloc(n * sizeof(uint32_t));
+
+    if ((scaled == NULL) || (small == NULL) || (large == NULL) ||
+        (lights->spheres == NULL) || (lights->keep == NULL) || (lights->alias == NULL)) {
+        free(scaled);
+        free(small);
+        free(large);
+        light_set_free(lights);
+        return -1;
+    }
+
+    size_t k = 0;
+    for (size_t i = 0; i < sphere_count; i++) {
+        double power = light_power(&spheres[i]);
+
+        if (power > 0.0) {
+            lights->spheres[k] = &spheres[i];
+            scaled[k] = power;
+            lights->total_power += power;
+            k++;
+        }
+    }
+
+    // Vose's method: pair every light below the mean power with one above it, which fills
+    // the rest of its slot
+    size_t small_count = 0;
+    size_t large_count = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        scaled[i] *= (double) n / lights->total_power;
+
+        if (scaled[i] < 1.0) {
+            small[small_count++] = (uint32_t) i;
+        } else {
+            large[large_count++] = (uint32_t) i;
+        }
+    }
+
+    while ((small_count > 0) && (large_count > 0)) {
+        uint32_t s = small[--small_count];
+        uint32_t l = large[--large_count];
+
+        lights->keep[s] = scaled[s];
+        lights->alias[s] = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+
+        if (scaled[l] < 1.0) {
+            small[small_count++] = l;
+        } else {
+            large[large_count++] = l;
+        }
+    }
+
+    // Whatever is left is full up to rounding errors
+    while (large_count > 0) {
+        uint32_t l = large[--large_count];
+        lights->keep[l] = 1.0;
+        lights->alias[l] = l;
+    }
+
+    while (small_count > 0) {
+        uint32_t s = small[--small_count];
+        lights->keep[s] = 1.0;
+        lights->alias[s] = s;
+    }
+
+    free(scaled);
+    free(small);
+    free(large);
+
+    return 0;
+}
+
+void light_set_free(light_set_t *lights) {
+    if (lights == NULL) {
+        return;
+    }
+
+    free(lights->spheres);
+    free(lights->keep);
+    free(lights->alias);
+
+    memset(lights, 0, sizeof(light_set_t));
+}
+
+/**
+ * @brief Pick a light by power and sample a direction towards it from a point, uniformly
+ * over the cone of directions in which the light is seen.
+ * 
+ * @param lights The light set.
+ * @param p The point to sample from.
+ * @param rng The generator of the path.
+ * @param sample Receives the sampled direction.
+ * 
+ * @return Returns 1 if a direction was sampled, 0 if there are no lights or p lies inside
+ * the picked one.
+ */
+int light_set_sample(const light_set_t *lights, point3_t p, rng_t *rng, light_sample_t *sample) {
+    if ((lights == NULL) || (lights->count == 0)) {
+        return 0;
+    }
+
+    double u = random_double(rng) * lights->count;
+    size_t slot = (size_t) u;
+
+    if (slot >= lights->count) {
+        slot = lights->count - 1;
+    }
+
+    const sphere_t *sphere = lights->spheres[((u - slot) < lights->keep[slot]) ? slot : lights->alias[slot]];
+
+    double r1 = random_double(rng);
+    double r2 = random_double(rng);
+
+    vec3_t oc = vec3_sub(sphere->center, p);
+    double dist_squared = vec3_len_squared(oc);
+    double one_minus_cos_max = cone_one_minus_cos(sphere, dist_squared);
+
+    if (one_minus_cos_max <= 0.0) {
+        return 0;
+    }
+
+    // Orthonormal basis around the direction to the center of the light
+    vec3_t w = vec3_scalar_mul(oc, 1.0 / sqrt(dist_squared));
+    vec3_t a = (fabs(w.x) > 0.9) ? (vec3_t) { 0, 1, 0 } : (vec3_t) { 1, 0, 0 };
+    vec3_t v = vec3_unit_vec(vec3_cross(w, a));
+    vec3_t t = vec3_cross(w, v);
+
+    double one_minus_cos = r1 * one_minus_cos_max;
+    double cos_theta = 1.0 - one_minus_cos;
+    double sin_theta = sqrt(fmax(0.0, one_minus_cos * (2.0 - one_minus_cos)));
+    double phi = 2.0 * M_PI * r2;
+
+    vec3_t direction = vec3_add(vec3_add(vec3_scalar_mul(t, cos(phi) * sin_theta), vec3_scalar_mul(v, sin(phi) * sin_theta)), vec3_scalar_mul(w, cos_theta));
+
+    // Nearest intersection with the light, the direction misses it only by rounding errors
+    double b = vec3_dot(direction, oc);
+    double discriminant = (sphere->radius * sphere->radius) - (dist_squared - (b * b));
+
+    sample->direction = direction;
+    sample->distance = b - sqrt(fmax(0.0, discriminant));
+    sample->emission = sphere->material->emission;
+    sample->pdf = (light_power(sphere) / lights->total_power) / (2.0 * M_PI * one_minus_cos_max);
+
+    return 1;
+}
+
+/**
+ * @brief Get the density with which light_set_sample picks a direction from origin that
+ * hits the given sphere.
+ * 
+ * @return Returns the solid angle density, 0 if the sphere is no light or covers origin.
+ */
+double light_set_pdf(const light_set_t *lights, const sphere_t *sphere, point3_t origin) {
+    if ((lights == NULL) || (lights->count == 0) || (sphere == NULL)) {
+        return 0.0;
+    }
+
+    double power = light_power(sphere);
+    double one_minus_cos_max = cone_one_minus_cos(sphere, vec3_len_squared(vec3_sub(sphere->center, origin)));
+
+    if ((power <= 0.0) || (one_minus_cos_max <= 0.0)) {
+        return 0.0;
+    }
+
+    return (power / lights->total_power) / (2.0 * M_PI * one_minus_cos_max);
+}
@@ -0,0 +1,47 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "../sphere/sphere.h"
+#include "../material/material.h"
+#include "../color/color.h"
+#include "../random/random.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The emissive spheres of a scene. Next-event estimation picks one with a probability
+// proportional to its emitted power, drawn in constant time from an alias table.
+typedef struct {
+    const sphere_t **spheres;
+    size_t count;
+    double total_power;
+
+    // Slot i of the alias table yields light i with probability keep[i], else light alias[i]
+    double *keep;
+    uint32_t *alias;
+} light_set_t;
+
+// A direction towards a light, sampled uniformly over the cone the light covers
+typedef struct {
+    vec3_t direction;
+
+    // Distance along the unit direction to the surface of the light
+    double distance;
+
+    color_t emission;
+
+    // Solid angle density of the direction, including the probability of picking the light
+    double pdf;
+} light_sample_t;
+
+int light_set_build(light_set_t *lights, const sphere_t *spheres, size_t sphere_count);
+
+void light_set_free(light_set_t *lights);
+
+double light_power(const sphere_t *sphere);
+
+int light_set_sample(const light_set_t *lights, point3_t p, rng_t *rng, light_sample_t *sample);
+
+double light_set_pdf(const light_set_t *lights, const sphere_t *sphere, point3_t origin);
+
+#endif
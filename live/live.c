@@ -0,0 +1,318 @@
+#include "live.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Reads of a row a snapshot tries before giving up on it. Waiting for rows to finish would
+// make a snapshot chase the render threads down the image.
+#define LIVE_SNAPSHOT_TRIES 4
+#define LIVE_SNAPSHOT_RETRY_NS 100000L
+
+static size_t live_align(size_t offset) {
+    return (offset + 63) & ~(size_t) 63;
+}
+
+static int live_layout(int width, int height, uint32_t *rows_offset, uint32_t *pixels_offset, size_t *size) {
+    if ((width < 1) || (height < 1)) {
+        return -1;
+    }
+
+    size_t rows = live_align(sizeof(live_header_t));
+    size_t pixels = live_align(rows + ((size_t) height * sizeof(live_row_t)));
+
+    if (pixels > UINT32_MAX) {
+        return -1;
+    }
+
+    *rows_offset = (uint32_t) rows;
+    *pixels_offset = (uint32_t) pixels;
+    *size = pixels + ((size_t) width * height * 3 * sizeof(float));
+
+    return 0;
+}
+
+static void live_map_parts(live_t *live) {
+    live->rows = (live_row_t*) ((char*) live->header + live->header->rows_offset);
+    live->rgb = (float*) ((char*) live->header + live->header->pixels_offset);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+/**
+ * @brief Create a live framebuffer in POSIX shared memory, replacing any left over under the
+ * same name. It starts out black, with no rows traced and in the rendering state.
+ * 
+ * @param name The shared memory object name, starting with a slash.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int live_create(live_t *live, const char *name, int width, int height) {
+    uint32_t rows_offset, pixels_offset;
+    size_t size;
+
+    if ((live == NULL) || (name == NULL) || (name[0] != '/') || (strlen(name) >= sizeof(live->name)) ||
+        (live_layout(width, height, &rows_offset, &pixels_offset, &size) != 0)) {
+        return -1;
+    }
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Truncating first zeroes a stale object of the same size
+    if ((ftruncate(fd, 0) != 0) || (ftruncate(fd, (off_t) size) != 0)) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name);
+        return -1;
+    }
+
+    strcpy(live->name, name);
+    live->owner = 1;
+    live->size = size;
+    live->header = (live_header_t*) mapping;
+    live->header->rows_offset = rows_offset;
+    live->header->pixels_offset = pixels_offset;
+    live->header->width = width;
+    live->header->height = height;
+    atomic_store(&live->header->state, LIVE_RENDERING);
+    live_map_parts(live);
+
+    // Readers only look further once the magic is in place
+    atomic_thread_fence(memory_order_release);
+    memcpy(live->header->magic, LIVE_MAGIC, sizeof(live->header->magic));
+
+    return 0;
+}
+
+/**
+ * @brief Map a live framebuffer created by another process, read only.
+ * 
+ * @return Returns 0 on success, -1 on error, invalid argument or if the object is not a
+ * complete live framebuffer.
+ */
+int live_open(live_t *live, const char *name) {
+    struct stat st;
+
+    if ((live == NULL) || (name == NULL) || (strlen(name) >= sizeof(live->name))) {
+        return -1;
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if ((fstat(fd, &st) != 0) || ((size_t) st.st_size < sizeof(live_header_t))) {
+        close(fd);
+        return -1;
+    }
+
+    void *mapping = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+
+    live_header_t *header = (live_header_t*) mapping;
+    uint32_t rows_offset, pixels_offset;
+    size_t size;
+
+    if ((memcmp(header->magic, LIVE_MAGIC, sizeof(header->magic)) != 0) ||
+        (live_layout(header->width, header->height, &rows_offset, &pixels_offset, &size) != 0) ||
+        (header->rows_offset != rows_offset) || (header->pixels_offset != pixels_offset) || ((size_t) st.st_size < size)) {
+        munmap(mapping, (size_t) st.st_size);
+        return -1;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+
+    strcpy(live->name, name);
+    live->owner = 0;
+    live->size = (size_t) st.st_size;
+    live->header = header;
+    live_map_parts(live);
+
+    return 0;
+}
+
+/**
+ * @brief Unmap a live framebuffer. The creator also removes its name, processes that still
+ * have it mapped keep their view of it.
+ */
+void live_close(live_t *live) {
+    if ((live == NULL) || (live->header == NULL)) {
+        return;
+    }
+
+    munmap(live->header, live->size);
+
+    if (live->owner) {
+        shm_unlink(live->name);
+    }
+
+    live->header = NULL;
+    live->rows = NULL;
+    live->rgb = NULL;
+}
+
+#else
+
+int live_create(live_t *live, const char *name, int width, int height) {
+    (void) live;
+    (void) name;
+    (void) width;
+    (void) height;
+    return -1;
+}
+
+int live_open(live_t *live, const char *name) {
+    (void) live;
+    (void) name;
+    return -1;
+}
+
+void live_close(live_t *live) {
+    (void) live;
+}
+
+#endif
+
+/**
+ * @brief Make a framebuffer accumulate straight into the shared pixels of a live framebuffer.
+ * It must not be passed to framebuffer_free.
+ */
+void live_framebuffer(const live_t *live, framebuffer_t *fb) {
+    fb->width = live->header->width;
+    fb->height = live->header->height;
+    fb->samples = 0;
+    fb->rgb = live->rgb;
+}
+
+/**
+ * @brief Mark a row as being written, before any sample is added to it. Every row is
+ * written by one thread at a time.
+ */
+void live_row_begin(live_t *live, int row) {
+    atomic_fetch_add_explicit(&live->rows[row].sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * @brief Mark a row as complete after all samples have been added to it.
+ * 
+ * @param samples The samples its traced pixels now hold.
+ * @param block The progressive block size it was traced at, 1 for every pixel.
+ */
+void live_row_end(live_t *live, int row, uint32_t samples, uint32_t block) {
+    atomic_store_explicit(&live->rows[row].samples, samples, memory_order_relaxed);
+    atomic_store_explicit(&live->rows[row].block, block, memory_order_relaxed);
+    atomic_fetch_add_explicit(&live->rows[row].sequence, 1, memory_order_release);
+}
+
+/**
+ * @brief Publish the sample count of the whole framebuffer and the render state.
+ */
+void live_publish(live_t *live, uint32_t samples, live_state_t state) {
+    atomic_fetch_add_explicit(&live->header->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&live->header->samples, samples, memory_order_relaxed);
+    atomic_store_explicit(&live->header->state, (unsigned) state, memory_order_relaxed);
+    atomic_fetch_add_explicit(&live->header->sequence, 1, memory_order_release);
+}
+
+/**
+ * @brief Copy one row under its seqlock, retrying a few times if render threads are writing
+ * to it.
+ * 
+ * @return Returns the block size the row was traced at, 0 if it has not been completed yet or
+ * is still being written.
+ */
+static uint32_t live_copy_row(const live_t *live, int row, float *dst, uint32_t *samples) {
+    live_row_t *state = &live->rows[row];
+    size_t floats = (size_t) live->header->width * 3;
+    struct timespec retry = { .tv_sec = 0, .tv_nsec = LIVE_SNAPSHOT_RETRY_NS };
+
+    for (int attempt = 0; attempt < LIVE_SNAPSHOT_TRIES; attempt++) {
+        unsigned before = atomic_load_explicit(&state->sequence, memory_order_acquire);
+
+        memcpy(dst, &live->rgb[(size_t) row * floats], floats * sizeof(float));
+        *samples = atomic_load_explicit(&state->samples, memory_order_relaxed);
+        uint32_t block = atomic_load_explicit(&state->block, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+
+        if (((before & 1) == 0) && (atomic_load_explicit(&state->sequence, memory_order_relaxed) == before)) {
+            return (*samples > 0) ? block : 0;
+        }
+
+        nanosleep(&retry, NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Take a consistent snapshot of the mean radiance of a live framebuffer. Pixels a
+ * progressive render has not reached yet take the value of the top left corner of their
+ * block, and rows that have not been completed or are being written repeat the row above or
+ * stay black.
+ * 
+ * @param out A framebuffer of the same size, set to hold one sample per pixel.
+ * 
+ * @return Returns 0 on success, -1 on invalid argument.
+ */
+int live_snapshot(const live_t *live, framebuffer_t *out) {
+    if ((live == NULL) || (live->header == NULL) || (out == NULL) || (out->rgb == NULL) ||
+        (out->width != live->header->width) || (out->height != live->header->height)) {
+        return -1;
+    }
+
+    size_t floats = (size_t) out->width * 3;
+
+    for (int row = 0; row < out->height; row++) {
+        float *dst = &out->rgb[(size_t) row * floats];
+        uint32_t samples = 0;
+        uint32_t block = live_copy_row(live, row, dst, &samples);
+
+        if (block == 0) {
+            if (row > 0) {
+                memcpy(dst, dst - floats, floats * sizeof(float));
+            } else {
+                memset(dst, 0, floats * sizeof(float));
+            }
+            continue;
+        }
+
+        // Right to left, so that block corners are scaled after the pixels copying them
+        for (size_t x = (size_t) out->width; x-- > 0; ) {
+            size_t src = (x - (x % block)) * 3;
+
+            dst[(x * 3)] = dst[src] / samples;
+            dst[(x * 3) + 1] = dst[src + 1] / samples;
+            dst[(x * 3) + 2] = dst[src + 2] / samples;
+        }
+    }
+
+    out->samples = 1;
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+#include "../framebuffer/framebuffer.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LIVE_MAGIC "RTLIVE1"
+
+typedef enum {
+    LIVE_RENDERING = 1,
+    LIVE_DONE = 2
+} live_state_t;
+
+// Start of a live framebuffer. It is followed by one live_row_t per row at rows_offset and
+// the accumulated float RGB of all pixels, rows from the top, at pixels_offset. The fields
+// after sequence are published with seqlock semantics: the writer makes sequence odd, updates
+// them and makes it even again, and readers retry if it was odd or changed while they read.
+typedef struct {
+    char magic[8];
+    uint32_t rows_offset;
+    uint32_t pixels_offset;
+    int32_t width;
+    int32_t height;
+
+    atomic_uint sequence;
+    atomic_uint samples;
+    atomic_uint state;
+    uint32_t reserved;
+} live_header_t;
+
+// Completion of a row under its own seqlock. sequence is odd while render threads add to the
+// row, so a reader that saw the same even value before and after copying the row has all
+// samples of it. samples is the sample count the traced pixels of the row then hold, and block
+// the finest progressive block size the row was traced at, 1 outside progressive renders.
+typedef struct {
+    atomic_uint sequence;
+    atomic_uint samples;
+    atomic_uint block;
+    uint32_t reserved;
+} live_row_t;
+
+// A live framebuffer mapped into this process, either created by the renderer or opened by
+// a viewer
+typedef struct {
+    char name[256];
+    int owner;
+    size_t size;
+
+    live_header_t *header;
+    live_row_t *rows;
+    float *rgb;
+} live_t;
+
+int live_create(live_t *live, const char *name, int width, int height);
+
+int live_open(live_t *live, const char *name);
+
+void live_close(live_t *live);
+
+void live_framebuffer(const live_t *live, framebuffer_t *fb);
+
+void live_row_begin(live_t *live, int row);
+
+void live_row_end(live_t *live, int row, uint32_t samples, uint32_t block);
+
+void live_publish(live_t *live, uint32_t samples, live_state_t state);
+
+int live_snapshot(const live_t *live, framebuffer_t *out);
+
+#endif
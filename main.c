@@ -1,72 +1,803 @@
-#include <stdio.h>
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "utils.h"
-#include "vec3/vec3.h"
-#include "color/color.h"
-#include "ray/ray.h"
-#include "camera/camera.h"
+#include "rt/rt.h"
 #include "sphere/sphere.h"
+#include "framebuffer/framebuffer.h"
+#include "aov/aov.h"
+#include "denoise/denoise.h"
+#include "image/image.h"
+#include "scene/scene.h"
+#include "procgen/procgen.h"
+#include "serve/serve.h"
+#include "random/random.h"
+#include "perf/perf.h"
+#include "trace/trace.h"
+#include "numa/numa.h"
+#include "live/live.h"
+#include "writer/writer.h"
+#include "cost/cost.h"
 
 #define ASPECT_RATIO (16.0 / 9.0)
-#define IMG_WIDTH 1080
-#define IMG_HEIGHT ((int) (IMG_WIDTH / ASPECT_RATIO))
+#define DEFAULT_IMG_WIDTH 1080
+
+#define DEFAULT_SCENE_CACHE_SIZE 8
+
+// Sample cap of time budgeted renders without --samples
+#define TIME_BUDGET_MAX_SAMPLES 65536
+
+// Rows of the strip timed to estimate how long finishing a time budgeted image takes, and
+// the margin added to the estimate
+#define FINALIZE_PROBE_ROWS 16
+#define FINALIZE_PROBE_MARGIN 1.5
+
+// Events every thread keeps for --trace, enough for a row batch per row of a few passes
+#define TRACE_EVENTS_PER_LANE 16384
+
+// Phases of a render measured with --perf, counted on the main thread except for tracing
+typedef enum {
+    PHASE_SETUP,
+    PHASE_TRACE,
+    PHASE_POSTPROCESS,
+    PHASE_OUTPUT,
+    PHASE_COUNT
+} phase_t;
+
+static const char *phase_names[PHASE_COUNT] = { "setup", "trace", "post-process", "output" };
+
+// Where and how progressive previews are written
+typedef struct {
+    const char *filename;
+    image_format_t format;
+    const tonemap_t *tonemap;
+    uint8_t *image;
+} snapshot_target_t;
+
+/**
+ * @brief Snapshot callback of progressive renders. The preview is written to a temporary
+ * file and renamed over the output, so readers never see a partial file.
+ */
+static void write_snapshot(void *user, const framebuffer_t *preview) {
+    snapshot_target_t *target = (snapshot_target_t*) user;
+
+    printf("\rWriting preview   ");
+    fflush(stdout);
+
+    framebuffer_resolve(preview, target->tonemap, target->image, 0, preview->height);
+
+    char tmp_filename[FILENAME_MAX];
+    if (snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", target->filename) >= (int) sizeof(tmp_filename)) {
+        return;
+    }
+
+    if ((image_write_file(tmp_filename, target->format, target->image, preview->width, preview->height) != 0) || (rename(tmp_filename, target->filename) != 0)) {
+        fprintf(stderr, "\nCould not write snapshot to %s\n", target->filename);
+        remove(tmp_filename);
+    }
+}
+
+/**
+ * @brief Estimate how long denoising, resolving and encoding the final image will take, by
+ * timing these steps on a strip of the image filled with noise and scaling to the full height.
+ * 
+ * @return Returns the estimate in seconds, or 0 if the strip could not be set up.
+ */
+static double estimate_finalize_seconds(int width, int height, image_format_t format, int denoise, const denoise_settings_t *denoise_settings, const tonemap_t *tonemap) {
+    int rows = (height < FINALIZE_PROBE_ROWS) ? height : FINALIZE_PROBE_ROWS;
+    framebuffer_t strip;
+    aov_buffers_t aov = { .normal = NULL };
+    uint8_t *image = malloc((size_t) width * rows * 3);
+    FILE *sink = tmpfile();
+
+    if ((image == NULL) || (sink == NULL) || (framebuffer_init(&strip, width, rows) != 0)) {
+        free(image);
+        if (sink != NULL) {
+            fclose(sink);
+        }
+        return 0.0;
+    }
+
+    rng_t rng = rng_seed(width);
+
+    for (size_t i = 0; i < (size_t) width * rows * 3; i++) {
+        strip.rgb[i] = (float) random_double(&rng);
+    }
+    strip.samples = 1;
+
+    double start = cost_seconds();
+
+    if (denoise && (aov_buffers_init(&aov, width, rows) == 0)) {
+        for (int row = 0; row < rows; row++) {
+            for (int x = 0; x < width; x++) {
+                aov_buffers_store(&aov, x, row, (vec3_t) { 0, 0, 1 }, 1.0 + random_double(&rng), 1);
+            }
+        }
+
+        start = cost_seconds();
+        denoise_framebuffer(&strip, &aov, denoise_settings);
+        aov_buffers_free(&aov);
+    }
 
-#define HITTABLE_AMOUNT 2
+    framebuffer_resolve(&strip, tonemap, image, 0, rows);
+    image_write(sink, format, image, width, rows);
+    fflush(sink);
+
+    double elapsed = cost_seconds() - start;
+
+    fclose(sink);
+    framebuffer_free(&strip);
+    free(image);
+
+    return elapsed * ((double) height / rows) * FINALIZE_PROBE_MARGIN;
+}
+
+/**
+ * @brief Print the hardware counters of every phase, with IPC and, for tracing, events per path.
+ */
+static void print_counters(const perf_counts_t counts[PHASE_COUNT], double paths) {
+    printf("%-13s %6s", "Phase", "IPC");
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        printf(" %14s", perf_event_name((perf_event_t) e));
+    }
+    printf("\n");
+
+    for (int phase = 0; phase <= PHASE_COUNT; phase++) {
+        // The trace phase gets a second line with its events per path
+        const perf_counts_t *c = &counts[(phase == PHASE_COUNT) ? PHASE_TRACE : phase];
+        double divisor = (phase == PHASE_COUNT) ? paths : 1.0;
+        unsigned ipc_events = (1u << PERF_CYCLES) | (1u << PERF_INSTRUCTIONS);
+
+        printf("%-13s", (phase == PHASE_COUNT) ? "trace / path" : phase_names[phase]);
+
+        if (((c->available & ipc_events) == ipc_events) && (c->value[PERF_CYCLES] > 0)) {
+            printf(" %6.2f", (double) c->value[PERF_INSTRUCTIONS] / c->value[PERF_CYCLES]);
+        } else {
+            printf(" %6s", "-");
+        }
+
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (c->available & (1u << e)) {
+                printf(" %14.6g", c->value[e] / divisor);
+            } else {
+                printf(" %14s", "-");
+            }
+        }
+        printf("\n");
+    }
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
+    rt_accel_t accel = RT_ACCEL_NONE;
+    rt_settings_t settings;
+    rt_stats_t stats;
+    int width = DEFAULT_IMG_WIDTH;
+    int height = 0;
+    float exposure = 1.0f;
+    tonemap_op_t tonemap_op = TONEMAP_CLAMP;
+    int denoise = 0;
+    const char *aov_prefix = NULL;
+    denoise_settings_t denoise_settings;
+    const char *filename = NULL;
+    const char *scene_filename = NULL;
+    procgen_kind_t generate_kind = PROCGEN_COVER;
+    size_t generate_count = 0;
+    unsigned long long generate_seed = PROCGEN_DEFAULT_SEED;
+    const char *serve_path = NULL;
+    size_t scene_cache_size = DEFAULT_SCENE_CACHE_SIZE;
+    double time_budget = 0.0;
+    int crop_full = 0;
+    int samples_given = 0;
+    int perf = 0;
+    int numa = 0;
+    static numa_topology_t topology;
+    const char *cost_filename = NULL;
+    const char *trace_filename = NULL;
+    const char *live_name = NULL;
+    int sync_output = 0;
+    live_t live;
+    trace_recorder_t recorder;
+    perf_group_t phase_group;
+    perf_counts_t phase_counts[PHASE_COUNT];
+    double budget_start = cost_seconds();
+
+    rt_default_settings(&settings);
+    denoise_default_settings(&denoise_settings);
+    settings.threads = denoise_settings.threads;
+    settings.stats = &stats;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--accel") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing value for --accel. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+
+            if (strcmp(argv[i], "none") == 0) {
+                accel = RT_ACCEL_NONE;
+            } else if (strcmp(argv[i], "grid") == 0) {
+                accel = RT_ACCEL_GRID;
+            } else if (strcmp(argv[i], "hashgrid") == 0) {
+                accel = RT_ACCEL_HASHGRID;
+            } else if (strcmp(argv[i], "bvh") == 0) {
+                accel = RT_ACCEL_BVH;
+            } else if (strcmp(argv[i], "compact") == 0) {
+                accel = RT_ACCEL_COMPACT;
+            } else if (strcmp(argv[i], "compact21") == 0) {
+                accel = RT_ACCEL_COMPACT_21;
+            } else {
+                fprintf(stderr, "Unknown accelerator %s. See usage below:\n", argv[i]);
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--integrator") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing value for --integrator. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+
+            if (strcmp(argv[i], "normals") == 0) {
+                settings.integrator = RT_INTEGRATOR_NORMALS;
+            } else if (strcmp(argv[i], "path") == 0) {
+                settings.integrator = RT_INTEGRATOR_PATH;
+            } else if (strcmp(argv[i], "wavefront") == 0) {
+                settings.integrator = RT_INTEGRATOR_WAVEFRONT;
+            } else {
+                fprintf(stderr, "Unknown integrator %s. See usage below:\n", argv[i]);
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--max-depth") == 0) {
+            if ((++i >= argc) || ((settings.max_depth = atoi(argv[i])) < 1)) {
+                fprintf(stderr, "Missing or invalid value for --max-depth. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--rr-depth") == 0) {
+            if ((++i >= argc) || ((settings.rr_depth = atoi(argv[i])) < 0)) {
+                fprintf(stderr, "Missing or invalid value for --rr-depth. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--no-light-sampling") == 0) {
+            settings.light_sampling = 0;
+        } else if (strcmp(argv[i], "--tile-bins") == 0) {
+            if ((++i >= argc) || ((settings.tile_size = atoi(argv[i])) < 1)) {
+                fprintf(stderr, "Missing or invalid tile size for --tile-bins. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--width") == 0) {
+            if ((++i >= argc) || ((width = atoi(argv[i])) < 2)) {
+                fprintf(stderr, "Missing or invalid value for --width. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--height") == 0) {
+            if ((++i >= argc) || ((height = atoi(argv[i])) < 2)) {
+                fprintf(stderr, "Missing or invalid value for --height. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--samples") == 0) {
+            if ((++i >= argc) || ((settings.samples_per_pixel = atoi(argv[i])) < 1)) {
+                fprintf(stderr, "Missing or invalid sample count for --samples. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            samples_given = 1;
+        } else if (strcmp(argv[i], "--time-budget") == 0) {
+            if ((++i >= argc) || ((time_budget = strtod(argv[i], NULL) * 1e-3) <= 0.0)) {
+                fprintf(stderr, "Missing or invalid value for --time-budget. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--exposure") == 0) {
+            if ((++i >= argc) || ((exposure = strtof(argv[i], NULL)) <= 0.0f)) {
+                fprintf(stderr, "Missing or invalid value for --exposure. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--tonemap") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing value for --tonemap. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+
+            if (strcmp(argv[i], "clamp") == 0) {
+                tonemap_op = TONEMAP_CLAMP;
+            } else if (strcmp(argv[i], "reinhard") == 0) {
+                tonemap_op = TONEMAP_REINHARD;
+            } else if (strcmp(argv[i], "aces") == 0) {
+                tonemap_op = TONEMAP_ACES;
+            } else {
+                fprintf(stderr, "Unknown tone mapping operator %s. See usage below:\n", argv[i]);
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--sync-output") == 0) {
+            sync_output = 1;
+        } else if (strcmp(argv[i], "--denoise") == 0) {
+            denoise = 1;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            perf = 1;
+        } else if (strcmp(argv[i], "--aovs") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing file prefix for --aovs. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            aov_prefix = argv[i];
+        } else if (strcmp(argv[i], "--cost-map") == 0) {
+            if ((++i >= argc) || (validate_filename(argv[i]) != IMAGE_FORMAT_PPM)) {
+                fprintf(stderr, "Missing or invalid .ppm file for --cost-map. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            cost_filename = argv[i];
+        } else if (strcmp(argv[i], "--live") == 0) {
+            if ((++i >= argc) || (argv[i][0] != '/')) {
+                fprintf(stderr, "Missing or invalid shared memory name for --live, it has to start with a slash. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            live_name = argv[i];
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing file for --trace. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            trace_filename = argv[i];
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            if ((++i >= argc) || ((settings.threads = atoi(argv[i])) < 1)) {
+                fprintf(stderr, "Missing or invalid thread count for --threads. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            denoise_settings.threads = settings.threads;
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            numa = (numa > 1) ? numa : 1;
+        } else if (strcmp(argv[i], "--numa-replicate") == 0) {
+            numa = 2;
+        } else if (strcmp(argv[i], "--progressive") == 0) {
+            settings.progressive = 1;
+        } else if (strcmp(argv[i], "--snapshot-interval") == 0) {
+            if ((++i >= argc) || ((settings.snapshot_interval = strtod(argv[i], NULL)) <= 0.0)) {
+                fprintf(stderr, "Missing or invalid value for --snapshot-interval. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--crop") == 0) {
+            rt_window_t *crop = &settings.crop;
+
+            if ((++i >= argc) || (sscanf(argv[i], "%d,%d,%d,%d", &crop->x0, &crop->y0, &crop->x1, &crop->y1) != 4) ||
+                (crop->x0 < 0) || (crop->y0 < 0) || (crop->x1 <= crop->x0) || (crop->y1 <= crop->y0)) {
+                fprintf(stderr, "Missing or invalid window for --crop. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--crop-full") == 0) {
+            crop_full = 1;
+        } else if (strcmp(argv[i], "--scene") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing file for --scene. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            scene_filename = argv[i];
+        } else if (strcmp(argv[i], "--generate") == 0) {
+            char kind_name[16];
+
+            if ((++i >= argc) || (sscanf(argv[i], "%15[^,],%zu,%llu", kind_name, &generate_count, &generate_seed) < 2) ||
+                (procgen_parse_kind(kind_name, &generate_kind) != 0) || (generate_count == 0)) {
+                fprintf(stderr, "Missing or invalid scene for --generate. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Missing socket path for --serve. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            serve_path = argv[i];
+        } else if (strcmp(argv[i], "--scene-cache") == 0) {
+            int size;
+
+            if ((++i >= argc) || ((size = atoi(argv[i])) < 1)) {
+                fprintf(stderr, "Missing or invalid size for --scene-cache. See usage below:\n");
+                print_usage();
+                exit(1);
+            }
+            scene_cache_size = (size_t) size;
+        } else if (filename == NULL) {
+            filename = argv[i];
+        } else {
+            fprintf(stderr, "Invalid or no arguments supplied. See usage below:\n");
+            print_usage();
+            exit(1);
+        }
+    }
+
+    if (serve_path != NULL) {
+        serve_settings_t serve_settings = {
+            .socket_path = serve_path,
+            .workers = settings.threads,
+            .scene_cache_size = scene_cache_size,
+            .accel = accel,
+            .tile_size = settings.tile_size
+        };
+
+        if (serve_run(&serve_settings) != 0) {
+            fprintf(stderr, "Could not serve on %s\n", serve_path);
+            perror(NULL);
+            exit(1);
+        }
+
+        return 0;
+    }
+
+    if ((time_budget > 0.0) && settings.progressive) {
+        fprintf(stderr, "--time-budget cannot be combined with --progressive. See usage below:\n");
+        print_usage();
+        exit(1);
+    }
+
+    if (filename == NULL) {
         fprintf(stderr, "Invalid or no arguments supplied. See usage below:\n");
         print_usage();
         exit(1);
     }
 
-    if (!validate_filename(argv[1])) {
+    if ((cost_filename != NULL) && (settings.integrator == RT_INTEGRATOR_WAVEFRONT)) {
+        fprintf(stderr, "--cost-map needs a per-pixel integrator, the wavefront integrator traces many pixels at once\n");
+        exit(1);
+    }
+
+    image_format_t format = validate_filename(filename);
+
+    if (format == IMAGE_FORMAT_INVALID) {
         fprintf(stderr, "Invalid filename argument supplied. See usage below:\n");
         print_usage();
         exit(1);
     }
 
-    FILE *output_file = fopen(argv[1], "w");
+    // Fail before rendering if the output cannot be written, the image itself is written at the end
+    FILE *output_file = fopen(filename, (format == IMAGE_FORMAT_QOI) ? "wb" : "w");
 
     if (output_file == NULL) {
-        fprintf(stderr, "Could not open file %s\n", argv[1]);
+        fprintf(stderr, "Could not open file %s\n", filename);
         perror(NULL);
         exit(1);
     }
 
-    camera_t camera;
+    fclose(output_file);
+
+    // The main thread records to the first lane, render threads to one lane each after it
+    if (trace_filename != NULL) {
+        if (trace_init(&recorder, settings.threads + 1, TRACE_EVENTS_PER_LANE) != 0) {
+            fprintf(stderr, "Could not allocate trace buffers\n");
+            exit(1);
+        }
+
+        trace_attach(trace_get_lane(&recorder, 0, "main"));
+        settings.trace = &recorder;
+    }
+
+    // Counters are optional, renders go ahead without them
+    memset(phase_counts, 0, sizeof(phase_counts));
 
-    camera.aspect_ratio = ASPECT_RATIO;
-    camera.viewport_height = 2.0;
-    camera.viewport_width = camera.aspect_ratio * camera.viewport_height;
-    camera.focal_len = 1.0;
+    if (perf) {
+        if (perf_group_open(&phase_group) == 0) {
+            settings.perf_counters = 1;
+        } else {
+            fprintf(stderr, "Hardware counters unavailable: %s\n", strerror(errno));
+            perf = 0;
+        }
+    }
 
-    camera.origin = (point3_t) { 0, 0, 0 };
+    if (perf) {
+        perf_group_start(&phase_group);
+    }
 
-    camera.horizontal = (vec3_t) { .x = camera.viewport_width, .y = 0, .z = 0 };
-    camera.vertical = (vec3_t) { .x = 0, .y = camera.viewport_height, .z = 0 };
-    camera.lower_left_corner = calculate_lower_left_corner(camera.origin, camera.horizontal, camera.vertical, camera.focal_len);
+    uint64_t span = trace_begin();
+    scene_desc_t desc;
 
-    fprintf(output_file, "P3\n%d %d\n255\n", IMG_WIDTH, IMG_HEIGHT);
+    if ((generate_count > 0) && (scene_filename != NULL)) {
+        fprintf(stderr, "Only one of --scene and --generate may be given. See usage below:\n");
+        print_usage();
+        exit(1);
+    }
 
-    hittable_t hittable_array[HITTABLE_AMOUNT] = {0};
+    if (generate_count > 0) {
+        if (procgen_scene(&desc, generate_kind, generate_count, generate_seed) != 0) {
+            fprintf(stderr, "Could not generate scene\n");
+            exit(1);
+        }
+    } else if (scene_filename != NULL) {
+        if (scene_desc_load(&desc, scene_filename) != 0) {
+            fprintf(stderr, "Could not load scene %s\n", scene_filename);
+            exit(1);
+        }
+    } else if (scene_desc_default(&desc) != 0) {
+        fprintf(stderr, "Could not build the default scene\n");
+        exit(1);
+    }
+
+    trace_end("setup", "load scene", span, 0);
 
-    for (int j = IMG_HEIGHT - 1; j >= 0; j--) {
-        printf("\rScanlines remaining: %d ", j);
-        for (int i = 0; i < IMG_WIDTH; i++) {
-            double u = ((double) i / (IMG_WIDTH - 1));
-            double v = ((double) j / (IMG_HEIGHT - 1));
+    rt_scene_t scene;
+    rt_camera_t camera;
+
+    span = trace_begin();
+    if (rt_scene_init(&scene, &desc, accel) != 0) {
+        fprintf(stderr, "Could not build scene\n");
+        exit(1);
+    }
+    trace_end("setup", "build scene", span, (int64_t) (scene.sphere_count + scene.compact.sphere_count));
 
-            ray_t r = get_ray(camera, u, v);
+    scene_desc_free(&desc);
 
-            color_t pixel_color = ray_color(r);
+    // Placement is set up with the scene, so that replicas count towards setup
+    if (numa) {
+        numa_topology_detect(&topology);
+        settings.numa = &topology;
 
-            write_color(output_file, pixel_color);
+        span = trace_begin();
+        if ((numa > 1) && (rt_scene_replicate(&scene, &topology) != 0)) {
+            fprintf(stderr, "Could not replicate scene, rendering without replicas\n");
         }
+        trace_end("setup", "replicate scene", span, topology.node_count);
+    }
+
+    if (perf) {
+        perf_group_stop(&phase_group, &phase_counts[PHASE_SETUP]);
+    }
+
+    rt_camera_default(&camera);
+
+    // Without an explicit height the image is rounded down to the nominal aspect ratio
+    if (height == 0) {
+        height = (int) (width / ASPECT_RATIO);
+        camera.aspect_ratio = ASPECT_RATIO;
+    }
+
+    // The written image is either the crop window alone or the full frame with only the window traced
+    int cropped = settings.crop.x1 > 0;
+    int out_width = width;
+    int out_height = height;
+
+    if (cropped) {
+        if ((settings.crop.x1 > width) || (settings.crop.y1 > height)) {
+            fprintf(stderr, "Crop window does not fit into the %dx%d image\n", width, height);
+            exit(1);
+        }
+
+        if (!crop_full) {
+            settings.frame_width = width;
+            settings.frame_height = height;
+            out_width = settings.crop.x1 - settings.crop.x0;
+            out_height = settings.crop.y1 - settings.crop.y0;
+        }
+    }
+
+    framebuffer_t fb;
+    uint8_t *image = malloc((size_t) out_width * out_height * 3);
+
+    if (image == NULL) {
+        fprintf(stderr, "Could not allocate framebuffer\n");
+        exit(1);
+    }
+
+    // A live framebuffer is accumulated into in place, so that viewers see every finished row
+    if (live_name != NULL) {
+        if (live_create(&live, live_name, out_width, out_height) != 0) {
+            fprintf(stderr, "Could not create shared memory framebuffer %s\n", live_name);
+            perror(NULL);
+            exit(1);
+        }
+
+        live_framebuffer(&live, &fb);
+        settings.live = &live;
+    } else if (framebuffer_init(&fb, out_width, out_height) != 0) {
+        fprintf(stderr, "Could not allocate framebuffer\n");
+        exit(1);
+    }
+
+    aov_buffers_t aov;
+    int use_aovs = denoise || (aov_prefix != NULL);
+
+    if (use_aovs) {
+        if (aov_buffers_init(&aov, out_width, out_height) != 0) {
+            fprintf(stderr, "Could not allocate auxiliary buffers\n");
+            exit(1);
+        }
+        settings.aov = &aov;
+    }
+
+    cost_buffers_t cost;
+
+    if (cost_filename != NULL) {
+        if (cost_buffers_init(&cost, out_width, out_height) != 0) {
+            fprintf(stderr, "Could not allocate cost buffers\n");
+            exit(1);
+        }
+        settings.cost = &cost;
+    }
+
+    static tonemap_t tonemap;
+    tonemap_init(&tonemap, exposure, tonemap_op);
+
+    snapshot_target_t snapshot_target = { .filename = filename, .format = format, .tonemap = &tonemap, .image = image };
+
+    if (settings.progressive) {
+        settings.snapshot = write_snapshot;
+        settings.snapshot_user = &snapshot_target;
+    }
+
+    // Unless the whole image is needed at once, finished rows are encoded and written by a
+    // writer thread while rendering goes on. Progressive previews replace the output file and
+    // time budgeted renders do not know which pass is the last.
+    static image_writer_t writer;
+    FILE *stream_file = NULL;
+    int stream = !sync_output && !settings.progressive && (time_budget <= 0.0) && !denoise && !(cropped && crop_full);
+
+    if (stream) {
+        stream_file = fopen(filename, (format == IMAGE_FORMAT_QOI) ? "wb" : "w");
+
+        if ((stream_file == NULL) || (image_writer_start(&writer, stream_file, format, &fb, (uint32_t) settings.samples_per_pixel, &tonemap) != 0)) {
+            fprintf(stderr, "Could not write to file %s\n", filename);
+            exit(1);
+        }
+
+        settings.rows_done = image_writer_rows_done;
+        settings.rows_done_user = &writer;
+    }
+
+    if (cropped) {
+        printf("Rendering [%d, %d) x [%d, %d) of %dx%d with %d thread(s)", settings.crop.x0, settings.crop.x1, settings.crop.y0, settings.crop.y1, width, height, settings.threads);
+    } else {
+        printf("Rendering %dx%d with %d thread(s)", width, height, settings.threads);
+    }
+
+    if (numa) {
+        printf(" on %d NUMA node(s)", topology.node_count);
+    }
+    fflush(stdout);
+
+    int rendered;
+    span = trace_begin();
+
+    if (time_budget > 0.0) {
+        if (!samples_given) {
+            settings.samples_per_pixel = TIME_BUDGET_MAX_SAMPLES;
+        }
+
+        // Rendering stops early enough for the finished image to be written within the budget
+        double finalize = estimate_finalize_seconds(out_width, out_height, format, denoise, &denoise_settings, &tonemap);
+        double render_budget = time_budget - (cost_seconds() - budget_start) - finalize;
+
+        rendered = rt_render_budget(&scene, &camera, &settings, &fb, (render_budget > 1e-6) ? render_budget : 1e-6);
+    } else {
+        rendered = rt_render(&scene, &camera, &settings, &fb);
+    }
+
+    trace_end("render", "render", span, settings.threads);
+
+    if (rendered != 0) {
+        fprintf(stderr, "\nCould not render image\n");
+        exit(1);
+    }
+
+    printf("\rRendered in %.2f ms            ", stats.trace_seconds * 1e3);
+
+    if (perf) {
+        phase_counts[PHASE_TRACE] = stats.counters;
+        perf_group_start(&phase_group);
+    }
+
+    if (denoise) {
+        double start = cost_seconds();
+
+        span = trace_begin();
+        if (denoise_framebuffer(&fb, &aov, &denoise_settings) != 0) {
+            fprintf(stderr, "\nCould not denoise image\n");
+        }
+        trace_end("post-process", "denoise", span, 0);
+
+        printf("\nDenoised in %.2f ms", (cost_seconds() - start) * 1e3);
+    }
+
+    span = trace_begin();
+    if ((aov_prefix != NULL) && (aov_buffers_write(&aov, aov_prefix) != 0)) {
+        fprintf(stderr, "\nCould not write auxiliary buffers\n");
+    }
+
+    if (cost_filename != NULL) {
+        // The raw dump sits next to the heatmap, with .raw in place of .ppm
+        char raw_filename[FILENAME_MAX];
+        snprintf(raw_filename, sizeof(raw_filename), "%.*s.raw", (int) (strlen(cost_filename) - strlen(".ppm")), cost_filename);
+
+        if (cost_buffers_write(&cost, cost_filename, raw_filename) != 0) {
+            fprintf(stderr, "\nCould not write cost map\n");
+        }
+
+        cost_buffers_free(&cost);
+    }
+
+    trace_end("output", "write extra outputs", span, 0);
+
+    if (!stream) {
+        span = trace_begin();
+        framebuffer_resolve(&fb, &tonemap, image, 0, out_height);
+        trace_end("post-process", "resolve", span, 0);
+    }
+
+    if (perf) {
+        perf_group_stop(&phase_group, &phase_counts[PHASE_POSTPROCESS]);
+        perf_group_start(&phase_group);
+    }
+
+    span = trace_begin();
+    if (stream) {
+        // Only rows the writer has not caught up with yet are left
+        int finished = image_writer_finish(&writer);
+
+        if ((fclose(stream_file) != 0) || (finished != 0)) {
+            fprintf(stderr, "\nCould not write to file %s\n", filename);
+        }
+    } else if (image_write_file(filename, format, image, out_width, out_height) != 0) {
+        fprintf(stderr, "\nCould not write to file %s\n", filename);
+    }
+    trace_end("output", "write image", span, 0);
+
+    if (perf) {
+        perf_group_stop(&phase_group, &phase_counts[PHASE_OUTPUT]);
+        perf_group_close(&phase_group);
+    }
+
+    if (use_aovs) {
+        aov_buffers_free(&aov);
+    }
+
+    if (live_name != NULL) {
+        live_publish(&live, fb.samples, LIVE_DONE);
+        live_close(&live);
+    } else {
+        framebuffer_free(&fb);
+    }
+
+    free(image);
+
+    if (trace_filename != NULL) {
+        trace_attach(NULL);
+
+        if (trace_write(&recorder, trace_filename) != 0) {
+            fprintf(stderr, "Could not write trace to %s\n", trace_filename);
+        }
+
+        trace_free(&recorder);
     }
 
     printf("\nDone.\n");
-    fflush(output_file);
-    fclose(output_file);
+
+    if (time_budget > 0.0) {
+        printf("Samples per pixel: %d in %d pass(es), deadline slack: %.2f ms\n", stats.samples_per_pixel, stats.passes, (time_budget - (cost_seconds() - budget_start)) * 1e3);
+    }
+
+    printf("Mean sphere tests per primary ray: %.2f of %zu\n", stats.mean_primary_tests, scene.sphere_count + scene.compact.sphere_count);
+
+    if (perf) {
+        int samples = (time_budget > 0.0) ? stats.samples_per_pixel : settings.samples_per_pixel;
+        double pixels = (cropped ? (double) (settings.crop.x1 - settings.crop.x0) * (settings.crop.y1 - settings.crop.y0) : (double) width * height);
+
+        print_counters(phase_counts, pixels * samples);
+    }
+
+    rt_scene_free(&scene);
 }
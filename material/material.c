@@ -0,0 +1,172 @@
+#include "material.h"
+#include <math.h>
+
+// Directions shorter than this are treated as zero
+#define MATERIAL_NEAR_ZERO 1e-8
+
+static const material_t default_material = {
+    .type = MATERIAL_DIFFUSE,
+    .albedo = { MATERIAL_DEFAULT_ALBEDO, MATERIAL_DEFAULT_ALBEDO, MATERIAL_DEFAULT_ALBEDO },
+    .fuzz = 0.0,
+    .ior = 1.0,
+    .emission = { 0, 0, 0 }
+};
+
+static vec3_t random_in_unit_sphere(rng_t *rng) {
+    for (;;) {
+        vec3_t v = {
+            .x = (2.0 * random_double(rng)) - 1.0,
+            .y = (2.0 * random_double(rng)) - 1.0,
+            .z = (2.0 * random_double(rng)) - 1.0
+        };
+
+        if (vec3_len_squared(v) <= 1.0) {
+            return v;
+        }
+    }
+}
+
+static vec3_t random_unit_vector(rng_t *rng) {
+    for (;;) {
+        vec3_t v = random_in_unit_sphere(rng);
+        double len_squared = vec3_len_squared(v);
+
+        if (len_squared > 1e-160) {
+            return vec3_scalar_mul(v, 1.0 / sqrt(len_squared));
+        }
+    }
+}
+
+// Schlick's approximation of the share of light a dielectric reflects
+static double reflectance(double cosine, double ref_idx) {
+    double r0 = (1.0 - ref_idx) / (1.0 + ref_idx);
+    r0 = r0 * r0;
+    return r0 + ((1.0 - r0) * pow((1.0 - cosine), 5));
+}
+
+material_t material_diffuse(color_t albedo) {
+    return (material_t) { .type = MATERIAL_DIFFUSE, .albedo = albedo, .fuzz = 0.0, .ior = 1.0, .emission = { 0, 0, 0 } };
+}
+
+material_t material_metal(color_t albedo, double fuzz) {
+    return (material_t) { .type = MATERIAL_METAL, .albedo = albedo, .fuzz = (fuzz < 1.0) ? fuzz : 1.0, .ior = 1.0, .emission = { 0, 0, 0 } };
+}
+
+material_t material_dielectric(double ior) {
+    return (material_t) { .type = MATERIAL_DIELECTRIC, .albedo = { 1.0, 1.0, 1.0 }, .fuzz = 0.0, .ior = ior, .emission = { 0, 0, 0 } };
+}
+
+material_t material_emissive(color_t emission) {
+    return (material_t) { .type = MATERIAL_EMISSIVE, .albedo = { 0, 0, 0 }, .fuzz = 0.0, .ior = 1.0, .emission = emission };
+}
+
+/**
+ * @brief Resolve the material of a hit record, surfaces without one use a diffuse grey.
+ */
+const material_t *material_or_default(const material_t *material) {
+    return (material != NULL) ? material : &default_material;
+}
+
+/**
+ * @brief Get the radiance a surface emits towards the ray that hit it. Emissive surfaces
+ * only emit from their front face.
+ */
+color_t material_emitted(const material_t *material, const hit_record_t *rec) {
+    if ((material == NULL) || (material->type != MATERIAL_EMISSIVE) || !rec->front_face) {
+        return (color_t) { 0, 0, 0 };
+    }
+
+    return material->emission;
+}
+
+/**
+ * @brief Bounce a ray off a diffuse surface, with directions following a cosine distribution
+ * around the normal.
+ * 
+ * @return Returns 1, diffuse surfaces always scatter.
+ */
+int material_scatter_diffuse(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered) {
+    (void) r_in;
+
+    vec3_t direction = vec3_add(rec->normal, random_unit_vector(rng));
+
+    // The random vector may cancel out the normal
+    if (vec3_len_squared(direction) < (MATERIAL_NEAR_ZERO * MATERIAL_NEAR_ZERO)) {
+        direction = rec->normal;
+    }
+
+    *scattered = (ray_t) { .origin = rec->p, .direction = direction };
+    *attenuation = material->albedo;
+
+    return 1;
+}
+
+/**
+ * @brief Reflect a ray off a metal surface, perturbed by the fuzz of the material.
+ * 
+ * @return Returns 1 if the ray was reflected, 0 if the perturbation sent it into the surface.
+ */
+int material_scatter_metal(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered) {
+    vec3_t reflected = vec3_reflect(vec3_unit_vec(r_in.direction), rec->normal);
+    vec3_t direction = vec3_add(reflected, vec3_scalar_mul(random_in_unit_sphere(rng), material->fuzz));
+
+    *scattered = (ray_t) { .origin = rec->p, .direction = direction };
+    *attenuation = material->albedo;
+
+    return vec3_dot(direction, rec->normal) > 0.0;
+}
+
+/**
+ * @brief Refract a ray into or out of a dielectric, or reflect it off the surface with the
+ * probability given by Schlick's approximation and always on total internal reflection.
+ * 
+ * @return Returns 1, dielectrics always scatter.
+ */
+int material_scatter_dielectric(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered) {
+    double refraction_ratio = rec->front_face ? (1.0 / material->ior) : material->ior;
+    vec3_t unit_direction = vec3_unit_vec(r_in.direction);
+
+    double cos_theta = fmin(-vec3_dot(unit_direction, rec->normal), 1.0);
+    double sin_theta = sqrt(1.0 - (cos_theta * cos_theta));
+
+    int cannot_refract = (refraction_ratio * sin_theta) > 1.0;
+    vec3_t direction;
+
+    if (cannot_refract || (reflectance(cos_theta, refraction_ratio) > random_double(rng))) {
+        direction = vec3_reflect(unit_direction, rec->normal);
+    } else {
+        direction = vec3_refract(unit_direction, rec->normal, refraction_ratio);
+    }
+
+    *scattered = (ray_t) { .origin = rec->p, .direction = direction };
+    *attenuation = material->albedo;
+
+    return 1;
+}
+
+/**
+ * @brief Scatter a ray off the surface recorded in a finalized hit record.
+ * 
+ * @param material The material of the surface, NULL for the default material.
+ * @param r_in The ray that hit the surface.
+ * @param rec The finalized hit record.
+ * @param rng The generator of the path.
+ * @param attenuation Receives the share of light carried along the scattered ray.
+ * @param scattered Receives the scattered ray.
+ * 
+ * @return Returns 1 if the ray was scattered, 0 if it was absorbed.
+ */
+int material_scatter(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered) {
+    material = material_or_default(material);
+
+    switch (material->type) {
+        case MATERIAL_METAL:
+            return material_scatter_metal(material, r_in, rec, rng, attenuation, scattered);
+        case MATERIAL_DIELECTRIC:
+            return material_scatter_dielectric(material, r_in, rec, rng, attenuation, scattered);
+        case MATERIAL_EMISSIVE:
+            return 0;
+        default:
+            return material_scatter_diffuse(material, r_in, rec, rng, attenuation, scattered);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "../hittable.h"
+#include "../color/color.h"
+#include "../random/random.h"
+
+typedef enum {
+    MATERIAL_DIFFUSE,
+    MATERIAL_METAL,
+    MATERIAL_DIELECTRIC,
+    MATERIAL_EMISSIVE
+} material_type_t;
+
+typedef struct material {
+    material_type_t type;
+
+    // Share of light reflected per channel, unused by dielectrics which absorb nothing
+    color_t albedo;
+
+    // Radius of the sphere metal reflections are perturbed within, 0 for a perfect mirror
+    double fuzz;
+
+    // Index of refraction of dielectrics
+    double ior;
+
+    // Radiance emitted from the front face of emissive surfaces, which scatter nothing
+    color_t emission;
+} material_t;
+
+// Albedo of the diffuse material used for surfaces without one
+#define MATERIAL_DEFAULT_ALBEDO 0.5
+
+material_t material_diffuse(color_t albedo);
+
+material_t material_metal(color_t albedo, double fuzz);
+
+material_t material_dielectric(double ior);
+
+material_t material_emissive(color_t emission);
+
+const material_t *material_or_default(const material_t *material);
+
+color_t material_emitted(const material_t *material, const hit_record_t *rec);
+
+int material_scatter_diffuse(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered);
+
+int material_scatter_metal(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered);
+
+int material_scatter_dielectric(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered);
+
+int material_scatter(const material_t *material, ray_t r_in, const hit_record_t *rec, rng_t *rng, color_t *attenuation, ray_t *scattered);
+
+#endif
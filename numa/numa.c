@@ -0,0 +1,272 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "numa.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define NUMA_SYSFS_NODES "/sys/devices/system/node"
+
+static int numa_has_cpu(const uint64_t *mask, int cpu) {
+    return (mask[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+static void numa_add_cpu(numa_topology_t *topology, int node, int cpu) {
+    if (!numa_has_cpu(topology->cpus[node], cpu)) {
+        topology->cpus[node][cpu / 64] |= (uint64_t) 1 << (cpu % 64);
+        topology->cpu_count[node]++;
+    }
+}
+
+/**
+ * @brief Parse a kernel CPU or node list such as "0-3,8,10-11" into a bit mask. Entries past
+ * NUMA_MAX_CPUS are ignored.
+ * 
+ * @return Returns 0 on success, -1 if the list is malformed.
+ */
+static int numa_parse_list(const char *list, uint64_t mask[NUMA_MAX_CPUS / 64]) {
+    memset(mask, 0, (NUMA_MAX_CPUS / 64) * sizeof(uint64_t));
+
+    while ((*list != '\0') && (*list != '\n')) {
+        int first, last, consumed;
+
+        if (sscanf(list, "%d%n", &first, &consumed) != 1) {
+            return -1;
+        }
+
+        list += consumed;
+        last = first;
+
+        if ((*list == '-') && (sscanf(list + 1, "%d%n", &last, &consumed) == 1)) {
+            list += consumed + 1;
+        }
+
+        for (int i = first; (i <= last) && (i < NUMA_MAX_CPUS); i++) {
+            if (i >= 0) {
+                mask[i / 64] |= (uint64_t) 1 << (i % 64);
+            }
+        }
+
+        if (*list == ',') {
+            list++;
+        }
+    }
+
+    return 0;
+}
+
+static int numa_read_list(const char *path, uint64_t mask[NUMA_MAX_CPUS / 64]) {
+    char line[4096];
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    int retval = (fgets(line, sizeof(line), file) != NULL) ? numa_parse_list(line, mask) : -1;
+    fclose(file);
+
+    return retval;
+}
+
+/**
+ * @brief Find the CPUs the process may run on and the memory nodes they belong to, from
+ * sysfs. Without NUMA information, all CPUs end up in a single node.
+ * 
+ * @return Returns 0 on success, -1 on invalid argument.
+ */
+int numa_topology_detect(numa_topology_t *topology) {
+    if (topology == NULL) {
+        return -1;
+    }
+
+    uint64_t allowed[NUMA_MAX_CPUS / 64];
+    uint64_t nodes[NUMA_MAX_CPUS / 64];
+    uint64_t node_cpus[NUMA_MAX_CPUS / 64];
+
+    memset(topology, 0, sizeof(numa_topology_t));
+    memset(allowed, 0, sizeof(allowed));
+
+#ifdef __linux__
+    cpu_set_t affinity;
+
+    if (sched_getaffinity(0, sizeof(affinity), &affinity) == 0) {
+        for (int cpu = 0; (cpu < NUMA_MAX_CPUS) && (cpu < CPU_SETSIZE); cpu++) {
+            if (CPU_ISSET(cpu, &affinity)) {
+                allowed[cpu / 64] |= (uint64_t) 1 << (cpu % 64);
+            }
+        }
+    }
+#endif
+
+    // Without an affinity mask, every online CPU is allowed
+    int any_allowed = 0;
+
+    for (int i = 0; i < NUMA_MAX_CPUS / 64; i++) {
+        any_allowed |= allowed[i] != 0;
+    }
+
+    if (!any_allowed) {
+        long online = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+        online = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+        for (long cpu = 0; (cpu < online) && (cpu < NUMA_MAX_CPUS); cpu++) {
+            allowed[cpu / 64] |= (uint64_t) 1 << (cpu % 64);
+        }
+    }
+
+    if (numa_read_list(NUMA_SYSFS_NODES "/online", nodes) == 0) {
+        for (int node = 0; (node < NUMA_MAX_CPUS) && (topology->node_count < NUMA_MAX_NODES); node++) {
+            char path[64];
+
+            if (!numa_has_cpu(nodes, node)) {
+                continue;
+            }
+
+            snprintf(path, sizeof(path), NUMA_SYSFS_NODES "/node%d/cpulist", node);
+
+            if (numa_read_list(path, node_cpus) != 0) {
+                continue;
+            }
+
+            for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++) {
+                if (numa_has_cpu(node_cpus, cpu) && numa_has_cpu(allowed, cpu)) {
+                    numa_add_cpu(topology, topology->node_count, cpu);
+                }
+            }
+
+            // Memory-only nodes and nodes outside the affinity mask get no threads
+            if (topology->cpu_count[topology->node_count] > 0) {
+                topology->node_count++;
+            }
+        }
+    }
+
+    if (topology->node_count == 0) {
+        memset(topology, 0, sizeof(numa_topology_t));
+        topology->node_count = 1;
+
+        for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++) {
+            if (numa_has_cpu(allowed, cpu)) {
+                numa_add_cpu(topology, 0, cpu);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Regroup the CPUs of a topology into the given amount of nodes of consecutive CPUs,
+ * to exercise placement on machines with fewer nodes than the ones it is tuned for. Memory
+ * stays where it is, so this only emulates the scheduling side. With fewer CPUs than nodes,
+ * nodes share CPUs.
+ * 
+ * @return Returns 0 on success, -1 on invalid argument.
+ */
+int numa_topology_emulate(numa_topology_t *topology, int node_count) {
+    if ((topology == NULL) || (node_count < 1) || (node_count > NUMA_MAX_NODES)) {
+        return -1;
+    }
+
+    int cpus[NUMA_MAX_CPUS];
+    int total = 0;
+
+    for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++) {
+        for (int node = 0; node < topology->node_count; node++) {
+            if (numa_has_cpu(topology->cpus[node], cpu)) {
+                cpus[total++] = cpu;
+                break;
+            }
+        }
+    }
+
+    if (total == 0) {
+        return -1;
+    }
+
+    memset(topology, 0, sizeof(numa_topology_t));
+    topology->node_count = node_count;
+
+    if (total >= node_count) {
+        for (int i = 0; i < total; i++) {
+            numa_add_cpu(topology, (int) (((long) i * node_count) / total), cpus[i]);
+        }
+    } else {
+        for (int node = 0; node < node_count; node++) {
+            numa_add_cpu(topology, node, cpus[node % total]);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Spread threads over the nodes of a topology in proportion to their CPU counts,
+ * keeping consecutive threads on the same node.
+ * 
+ * @return Returns the node of the thread.
+ */
+int numa_node_of_thread(const numa_topology_t *topology, int thread, int thread_count) {
+    int total = 0;
+
+    for (int node = 0; node < topology->node_count; node++) {
+        total += topology->cpu_count[node];
+    }
+
+    long position = ((long) thread * total) / ((thread_count > 0) ? thread_count : 1);
+
+    for (int node = 0; node < topology->node_count; node++) {
+        if (position < topology->cpu_count[node]) {
+            return node;
+        }
+        position -= topology->cpu_count[node];
+    }
+
+    return topology->node_count - 1;
+}
+
+#ifdef __linux__
+
+/**
+ * @brief Restrict the calling thread to the CPUs of a node. Memory it touches first is then
+ * allocated on that node by the kernel's default policy.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int numa_bind_thread(const numa_topology_t *topology, int node) {
+    if ((topology == NULL) || (node < 0) || (node >= topology->node_count)) {
+        return -1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (int cpu = 0; (cpu < NUMA_MAX_CPUS) && (cpu < CPU_SETSIZE); cpu++) {
+        if (numa_has_cpu(topology->cpus[node], cpu)) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    return (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) ? 0 : -1;
+}
+
+#else
+
+int numa_bind_thread(const numa_topology_t *topology, int node) {
+    (void) topology;
+    (void) node;
+    return -1;
+}
+
+#endif
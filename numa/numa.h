@@ -0,0 +1,25 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdint.h>
+
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 1024
+
+// The CPUs the process may run on, grouped by the memory node they are attached to. Nodes
+// without usable CPUs are left out, so node indices are not necessarily kernel node numbers.
+typedef struct {
+    int node_count;
+    int cpu_count[NUMA_MAX_NODES];
+    uint64_t cpus[NUMA_MAX_NODES][NUMA_MAX_CPUS / 64];
+} numa_topology_t;
+
+int numa_topology_detect(numa_topology_t *topology);
+
+int numa_topology_emulate(numa_topology_t *topology, int node_count);
+
+int numa_node_of_thread(const numa_topology_t *topology, int thread, int thread_count);
+
+int numa_bind_thread(const numa_topology_t *topology, int node);
+
+#endif
@@ -0,0 +1,193 @@
+#include "perf.h"
+#include <errno.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char *event_names[PERF_EVENT_COUNT] = {
+    "cycles",
+    "instructions",
+    "L1D misses",
+    "LLC misses",
+    "branch misses"
+};
+
+const char *perf_event_name(perf_event_t event) {
+    return ((event >= 0) && (event < PERF_EVENT_COUNT)) ? event_names[event] : "unknown";
+}
+
+/**
+ * @brief Add the counts of src to dst, keeping the events available in either.
+ */
+void perf_counts_add(perf_counts_t *dst, const perf_counts_t *src) {
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        dst->value[e] += src->value[e];
+    }
+
+    dst->available |= src->available;
+}
+
+#ifdef __linux__
+
+static void event_attr(perf_event_t event, struct perf_event_attr *attr) {
+    memset(attr, 0, sizeof(struct perf_event_attr));
+    attr->size = sizeof(struct perf_event_attr);
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->type = PERF_TYPE_HARDWARE;
+
+    switch (event) {
+        case PERF_CYCLES:
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_LLC_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+/**
+ * @brief Open a counter group for the calling thread, counting user space only. The first
+ * event that opens leads the group, events that fail to open are skipped. The counters
+ * start disabled.
+ * 
+ * @return Returns 0 if at least one event is counted, -1 with errno set if counters are
+ * unavailable, for instance because the kernel or a container forbids perf_event_open.
+ */
+int perf_group_open(perf_group_t *group) {
+    if (group == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int error = 0;
+
+    group->leader = -1;
+
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        struct perf_event_attr attr;
+
+        event_attr((perf_event_t) e, &attr);
+
+        if (group->leader < 0) {
+            attr.disabled = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        }
+
+        group->fd[e] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, group->leader, 0);
+
+        if (group->fd[e] < 0) {
+            error = (error != 0) ? error : errno;
+        } else if (group->leader < 0) {
+            group->leader = group->fd[e];
+        }
+    }
+
+    if (group->leader < 0) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+void perf_group_close(perf_group_t *group) {
+    if ((group == NULL) || (group->leader < 0)) {
+        return;
+    }
+
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (group->fd[e] >= 0) {
+            close(group->fd[e]);
+        }
+        group->fd[e] = -1;
+    }
+
+    group->leader = -1;
+}
+
+/**
+ * @brief Reset the counters of a group and start counting.
+ */
+void perf_group_start(const perf_group_t *group) {
+    if ((group == NULL) || (group->leader < 0)) {
+        return;
+    }
+
+    ioctl(group->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/**
+ * @brief Stop counting and add the counts since perf_group_start to counts. If the kernel
+ * had to multiplex the group with others, the counts are scaled up to the full time.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int perf_group_stop(const perf_group_t *group, perf_counts_t *counts) {
+    if ((group == NULL) || (group->leader < 0) || (counts == NULL)) {
+        return -1;
+    }
+
+    ioctl(group->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // Layout of a group read: nr, time enabled, time running, then one value per member
+    uint64_t data[3 + PERF_EVENT_COUNT];
+    ssize_t size = read(group->leader, data, sizeof(data));
+
+    if ((size < (ssize_t) (3 * sizeof(uint64_t))) || (data[0] > PERF_EVENT_COUNT)) {
+        return -1;
+    }
+
+    double scale = ((data[2] > 0) && (data[2] < data[1])) ? ((double) data[1] / data[2]) : 1.0;
+    uint64_t member = 0;
+
+    // Members are read back in the order they joined the group
+    for (int e = 0; (e < PERF_EVENT_COUNT) && (member < data[0]); e++) {
+        if (group->fd[e] >= 0) {
+            counts->value[e] += (uint64_t) (data[3 + member++] * scale);
+            counts->available |= 1u << e;
+        }
+    }
+
+    return 0;
+}
+
+#else
+
+int perf_group_open(perf_group_t *group) {
+    (void) group;
+    errno = ENOSYS;
+    return -1;
+}
+
+void perf_group_close(perf_group_t *group) {
+    (void) group;
+}
+
+void perf_group_start(const perf_group_t *group) {
+    (void) group;
+}
+
+int perf_group_stop(const perf_group_t *group, perf_counts_t *counts) {
+    (void) group;
+    (void) counts;
+    return -1;
+}
+
+#endif
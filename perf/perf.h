@@ -0,0 +1,40 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+} perf_event_t;
+
+// Hardware event counts. Bit i of available is set if event i could be counted, events the
+// CPU or kernel does not offer are left out rather than failing the whole group.
+typedef struct {
+    uint64_t value[PERF_EVENT_COUNT];
+    unsigned available;
+} perf_counts_t;
+
+// A group of counters for the calling thread, which the kernel schedules onto the PMU together
+typedef struct {
+    int leader;
+    int fd[PERF_EVENT_COUNT];
+} perf_group_t;
+
+int perf_group_open(perf_group_t *group);
+
+void perf_group_close(perf_group_t *group);
+
+void perf_group_start(const perf_group_t *group);
+
+int perf_group_stop(const perf_group_t *group, perf_counts_t *counts);
+
+void perf_counts_add(perf_counts_t *dst, const perf_counts_t *src);
+
+const char *perf_event_name(perf_event_t event);
+
+#endif
@@ -0,0 +1,305 @@
+#include "procgen.h"
+#include "../random/random.h"
+#include <math.h>
+#include <string.h>
+
+// Materials the spheres of the cover scene pick from, instead of one per sphere as in the book
+#define PROCGEN_COVER_DIFFUSE 64
+#define PROCGEN_COVER_METAL 16
+
+// Materials of the other scenes, picked at random for every sphere
+#define PROCGEN_PALETTE_SIZE 8
+
+// Share of the volume of the cloud and of every cluster taken up by spheres
+#define PROCGEN_FILL 0.1
+
+static const char *procgen_kind_names[] = {
+    [PROCGEN_COVER] = "cover",
+    [PROCGEN_CLOUD] = "cloud",
+    [PROCGEN_CLUSTERS] = "clusters",
+    [PROCGEN_HUGE] = "huge"
+};
+
+/**
+ * @brief Look up a kind of generated scene by its name, one of cover, cloud, clusters and huge.
+ *
+ * @return Returns 0 on success, -1 on an unknown name or invalid argument.
+ */
+int procgen_parse_kind(const char *name, procgen_kind_t *kind) {
+    if ((name == NULL) || (kind == NULL)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(procgen_kind_names) / sizeof(procgen_kind_names[0]); i++) {
+        if (strcmp(name, procgen_kind_names[i]) == 0) {
+            *kind = (procgen_kind_t) i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static double random_range(rng_t *rng, double lo, double hi) {
+    return lo + ((hi - lo) * random_double(rng));
+}
+
+static double random_gaussian(rng_t *rng) {
+    // Box-Muller, 1 - u keeps the logarithm finite
+    double u = 1.0 - random_double(rng);
+    double v = random_double(rng);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static int procgen_add(scene_desc_t *desc, double x, double y, double z, double radius, size_t material) {
+    return scene_desc_add_sphere(desc, sphere_init((point3_t) { x, y, z }, radius), material);
+}
+
+/**
+ * @brief Add a palette of diffuse materials with random albedos.
+ *
+ * @return Returns 0 on success, -1 on error.
+ */
+static int procgen_add_palette(scene_desc_t *desc, rng_t *rng, size_t *first) {
+    *first = desc->material_count;
+
+    for (int i = 0; i < PROCGEN_PALETTE_SIZE; i++) {
+        color_t albedo = { random_range(rng, 0.1, 0.9), random_range(rng, 0.1, 0.9), random_range(rng, 0.1, 0.9) };
+
+        if (scene_desc_add_material(desc, material_diffuse(albedo), NULL) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Height at which a sphere of a given radius rests on a ground sphere, above the point
+ * (x, z).
+ */
+static double procgen_rest(const sphere_t *ground, double x, double z, double radius) {
+    double dx = x - ground->center.x;
+    double dz = z - ground->center.z;
+    return ground->center.y + sqrt((ground->radius * ground->radius) - (dx * dx) - (dz * dz)) + radius;
+}
+
+static int procgen_cover(scene_desc_t *desc, size_t sphere_count, rng_t *rng) {
+    // Unit cells of the field in rows of side cells going away from the camera, with room
+    // for the cells the large spheres take. The ground grows with the field so that its
+    // curvature stays mild.
+    size_t side = (size_t) ceil(sqrt((double) sphere_count)) + 2;
+    double half = (double) side / 2.0;
+    double ground_radius = (10.0 * side > 1000.0) ? 10.0 * side : 1000.0;
+    sphere_t ground = sphere_init((point3_t) { 0, -1.0 - ground_radius, 0 }, ground_radius);
+    size_t ground_material, glass, diffuse, metal, large_diffuse, large_metal;
+
+    if ((scene_desc_add_material(desc, material_diffuse((color_t) { 0.5, 0.5, 0.5 }), &ground_material) != 0) ||
+        (scene_desc_add_material(desc, material_dielectric(1.5), &glass) != 0) ||
+        (scene_desc_add_material(desc, material_diffuse((color_t) { 0.4, 0.2, 0.1 }), &large_diffuse) != 0) ||
+        (scene_desc_add_material(desc, material_metal((color_t) { 0.7, 0.6, 0.5 }, 0.0), &large_metal) != 0)) {
+        return -1;
+    }
+
+    diffuse = desc->material_count;
+
+    for (int i = 0; i < PROCGEN_COVER_DIFFUSE; i++) {
+        color_t albedo = { random_double(rng) * random_double(rng), random_double(rng) * random_double(rng), random_double(rng) * random_double(rng) };
+
+        if (scene_desc_add_material(desc, material_diffuse(albedo), NULL) != 0) {
+            return -1;
+        }
+    }
+
+    metal = desc->material_count;
+
+    for (int i = 0; i < PROCGEN_COVER_METAL; i++) {
+        color_t albedo = { random_range(rng, 0.5, 1.0), random_range(rng, 0.5, 1.0), random_range(rng, 0.5, 1.0) };
+
+        if (scene_desc_add_material(desc, material_metal(albedo, random_range(rng, 0.0, 0.5)), NULL) != 0) {
+            return -1;
+        }
+    }
+
+    double large_z = -6.0;
+    double large_x[3] = { 0.0, -4.0, 4.0 };
+    size_t large_material[3] = { glass, large_diffuse, large_metal };
+
+    if (procgen_add(desc, ground.center.x, ground.center.y, ground.center.z, ground.radius, ground_material) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; (i < 3) && (desc->sphere_count < sphere_count); i++) {
+        if (procgen_add(desc, large_x[i], procgen_rest(&ground, large_x[i], large_z, 1.0), large_z, 1.0, large_material[i]) != 0) {
+            return -1;
+        }
+    }
+
+    for (size_t row = 0; (row < side) && (desc->sphere_count < sphere_count); row++) {
+        for (size_t column = 0; (column < side) && (desc->sphere_count < sphere_count); column++) {
+            double x = (double) column - half + (0.9 * random_double(rng));
+            double z = -2.0 - (double) row - (0.9 * random_double(rng));
+            double choose = random_double(rng);
+            size_t material = (choose < 0.8) ? diffuse + (rng_next(rng) % PROCGEN_COVER_DIFFUSE) :
+                              ((choose < 0.95) ? metal + (rng_next(rng) % PROCGEN_COVER_METAL) : glass);
+            int clear = 1;
+
+            for (int i = 0; i < 3; i++) {
+                clear &= (((x - large_x[i]) * (x - large_x[i])) + ((z - large_z) * (z - large_z))) > 1.3 * 1.3;
+            }
+
+            if (clear && (procgen_add(desc, x, procgen_rest(&ground, x, z, 0.2), z, 0.2, material) != 0)) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int procgen_cloud(scene_desc_t *desc, size_t sphere_count, rng_t *rng) {
+    size_t palette;
+
+    if (procgen_add_palette(desc, rng, &palette) != 0) {
+        return -1;
+    }
+
+    // A cube with sides of 2 centered 3 units in front of the camera
+    double radius = cbrt(PROCGEN_FILL * 8.0 * 3.0 / (4.0 * M_PI * sphere_count));
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        double x = random_range(rng, -1.0, 1.0);
+        double y = random_range(rng, -1.0, 1.0);
+        double z = random_range(rng, -4.0, -2.0);
+        size_t material = palette + (rng_next(rng) % PROCGEN_PALETTE_SIZE);
+
+        if (procgen_add(desc, x, y, z, radius * random_range(rng, 0.75, 1.25), material) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int procgen_clusters(scene_desc_t *desc, size_t sphere_count, rng_t *rng) {
+    size_t palette;
+
+    if (procgen_add_palette(desc, rng, &palette) != 0) {
+        return -1;
+    }
+
+    size_t cluster_count = (size_t) cbrt((double) sphere_count);
+    double total_weight = 0.0;
+
+    for (size_t k = 0; k < cluster_count; k++) {
+        total_weight += 1.0 / (double) (k + 1);
+    }
+
+    // Clusters take their share of the spheres left in rank order, the last one the rest
+    size_t left = sphere_count;
+    double weight_left = total_weight;
+
+    for (size_t k = 0; (k < cluster_count) && (left > 0); k++) {
+        double weight = 1.0 / (double) (k + 1);
+        size_t count = (k + 1 == cluster_count) ? left : (size_t) llround((double) left * weight / weight_left);
+        count = (count < left) ? count : left;
+        double cx = random_range(rng, -3.0, 3.0);
+        double cy = random_range(rng, -2.0, 2.0);
+        double cz = random_range(rng, -9.0, -3.0);
+        double u = random_double(rng);
+        double spread = 0.02 + (0.6 * u * u * u);
+
+        // Most spheres lie within two spreads of the center
+        double radius = (count > 0) ? 2.0 * spread * cbrt(PROCGEN_FILL / (double) count) : 0.0;
+
+        for (size_t i = 0; i < count; i++) {
+            double x = cx + (spread * random_gaussian(rng));
+            double y = cy + (spread * random_gaussian(rng));
+            double z = cz + (spread * random_gaussian(rng));
+            size_t material = palette + (rng_next(rng) % PROCGEN_PALETTE_SIZE);
+
+            if (procgen_add(desc, x, y, z, radius * exp(random_range(rng, -0.7, 0.7)), material) != 0) {
+                return -1;
+            }
+        }
+
+        left -= count;
+        weight_left -= weight;
+    }
+
+    return 0;
+}
+
+static int procgen_huge(scene_desc_t *desc, size_t sphere_count, rng_t *rng) {
+    size_t palette;
+
+    if (procgen_add_palette(desc, rng, &palette) != 0) {
+        return -1;
+    }
+
+    sphere_t huge = sphere_init((point3_t) { 0, -1e4 - 1.0, -3 }, 1e4);
+
+    if (procgen_add(desc, huge.center.x, huge.center.y, huge.center.z, huge.radius, palette) != 0) {
+        return -1;
+    }
+
+    // The rest cover about a third of a 4 by 4 patch of its top in front of the camera
+    double radius = sqrt(16.0 / (3.0 * M_PI * ((sphere_count > 1) ? sphere_count - 1 : 1)));
+
+    for (size_t i = 1; i < sphere_count; i++) {
+        double x = random_range(rng, -2.0, 2.0);
+        double z = random_range(rng, -5.0, -1.0);
+        double r = radius * random_range(rng, 0.5, 1.0);
+        size_t material = palette + (rng_next(rng) % PROCGEN_PALETTE_SIZE);
+
+        if (procgen_add(desc, x, procgen_rest(&huge, x, z, r), z, r, material) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Fill a scene description with a generated benchmark scene. The same kind, count and
+ * seed always give the same scene.
+ *
+ * @param desc The scene description to fill.
+ * @param kind The kind of scene.
+ * @param sphere_count The amount of spheres, exact but for the cover scene, which has fewer
+ * if the large spheres leave no room for some of the field.
+ * @param seed The seed of the random numbers placing the spheres.
+ *
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int procgen_scene(scene_desc_t *desc, procgen_kind_t kind, size_t sphere_count, uint64_t seed) {
+    if ((desc == NULL) || (sphere_count == 0)) {
+        return -1;
+    }
+
+    rng_t rng = rng_seed(seed);
+    int retval = -1;
+
+    scene_desc_init(desc);
+
+    switch (kind) {
+        case PROCGEN_COVER:
+            retval = procgen_cover(desc, sphere_count, &rng);
+            break;
+        case PROCGEN_CLOUD:
+            retval = procgen_cloud(desc, sphere_count, &rng);
+            break;
+        case PROCGEN_CLUSTERS:
+            retval = procgen_clusters(desc, sphere_count, &rng);
+            break;
+        case PROCGEN_HUGE:
+            retval = procgen_huge(desc, sphere_count, &rng);
+            break;
+    }
+
+    if (retval != 0) {
+        scene_desc_free(desc);
+    }
+
+    return retval;
+}
@@ -0,0 +1,32 @@
+#ifndef PROCGEN_H
+#define PROCGEN_H
+
+#include "../scene/scene.h"
+
+#include <stdint.h>
+
+// Benchmark scenes generated from a seed, all in front of the default camera
+typedef enum {
+    // The random spheres of the cover of Ray Tracing in One Weekend: a field of small spheres
+    // of random materials around three large ones, on a huge ground sphere
+    PROCGEN_COVER,
+
+    // Similar-sized spheres spread evenly through a cube, filling about a tenth of it
+    PROCGEN_CLOUD,
+
+    // Gaussian clusters of spheres, with cluster sizes falling off as 1 / rank and spreads
+    // and sphere sizes varying widely between clusters
+    PROCGEN_CLUSTERS,
+
+    // One sphere far larger than the rest, whose bounds cover the whole scene while the small
+    // spheres resting on it take up a tiny part
+    PROCGEN_HUGE
+} procgen_kind_t;
+
+#define PROCGEN_DEFAULT_SEED 1
+
+int procgen_parse_kind(const char *name, procgen_kind_t *kind);
+
+int procgen_scene(scene_desc_t *desc, procgen_kind_t kind, size_t sphere_count, uint64_t seed);
+
+#endif
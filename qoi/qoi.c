@@ -0,0 +1,167 @@
+#include "qoi.h"
+#include <string.h>
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+
+#define QOI_MAX_RUN 62
+
+// Pixels are packed as 0xRRGGBBAA, alpha is always opaque
+#define QOI_PACK(r, g, b) (((uint32_t) (r) << 24) | ((uint32_t) (g) << 16) | ((uint32_t) (b) << 8) | 0xff)
+#define QOI_HASH(r, g, b) ((((r) * 3) + ((g) * 5) + ((b) * 7) + (255 * 11)) % 64)
+
+static int qoi_flush(qoi_encoder_t *enc) {
+    if (enc->buffer_len == 0) {
+        return 0;
+    }
+
+    size_t written = fwrite(enc->buffer, 1, enc->buffer_len, enc->file);
+    size_t len = enc->buffer_len;
+    enc->buffer_len = 0;
+
+    // A short write (full disk, closed pipe) would leave a corrupt image behind
+    return (written != len) ? -1 : 0;
+}
+
+// Make room for at least n more bytes in the output buffer
+static int qoi_reserve(qoi_encoder_t *enc, size_t n) {
+    if ((enc->buffer_len + n) > QOI_BUFFER_SIZE) {
+        return qoi_flush(enc);
+    }
+
+    return 0;
+}
+
+static void qoi_put_u32(qoi_encoder_t *enc, uint32_t v) {
+    enc->buffer[enc->buffer_len++] = (uint8_t) (v >> 24);
+    enc->buffer[enc->buffer_len++] = (uint8_t) (v >> 16);
+    enc->buffer[enc->buffer_len++] = (uint8_t) (v >> 8);
+    enc->buffer[enc->buffer_len++] = (uint8_t) v;
+}
+
+/**
+ * @brief Start a QOI image by writing its header. Pixels then have to be passed to
+ * qoi_encode_pixel in row-major order, starting from the top left.
+ * 
+ * @param enc The encoder to initialize.
+ * @param file The file to write to, opened in binary mode.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int qoi_begin(qoi_encoder_t *enc, FILE *file, uint32_t width, uint32_t height) {
+    if ((enc == NULL) || (file == NULL) || (width == 0) || (height == 0)) {
+        return -1;
+    }
+
+    memset(enc->index, 0, sizeof(enc->index));
+    enc->file = file;
+    enc->prev = QOI_PACK(0, 0, 0);
+    enc->run = 0;
+    enc->buffer_len = 0;
+
+    memcpy(enc->buffer, "qoif", 4);
+    enc->buffer_len = 4;
+    qoi_put_u32(enc, width);
+    qoi_put_u32(enc, height);
+    enc->buffer[enc->buffer_len++] = 3;     // RGB channels
+    enc->buffer[enc->buffer_len++] = 0;     // sRGB with linear alpha
+
+    return 0;
+}
+
+/**
+ * @brief Encode the next pixel of the image.
+ * 
+ * @return Returns 0 on success, -1 on write error or invalid argument.
+ */
+int qoi_encode_pixel(qoi_encoder_t *enc, uint8_t r, uint8_t g, uint8_t b) {
+    if (enc == NULL) {
+        return -1;
+    }
+
+    uint32_t px = QOI_PACK(r, g, b);
+
+    if (px == enc->prev) {
+        if (++enc->run == QOI_MAX_RUN) {
+            if (qoi_reserve(enc, 1) != 0) {
+                return -1;
+            }
+            enc->buffer[enc->buffer_len++] = QOI_OP_RUN | (enc->run - 1);
+            enc->run = 0;
+        }
+        return 0;
+    }
+
+    // A run, an index and a full RGB chunk take at most 5 bytes
+    if (qoi_reserve(enc, 5) != 0) {
+        return -1;
+    }
+
+    if (enc->run > 0) {
+        enc->buffer[enc->buffer_len++] = QOI_OP_RUN | (enc->run - 1);
+        enc->run = 0;
+    }
+
+    int hash = QOI_HASH(r, g, b);
+
+    if (enc->index[hash] == px) {
+        enc->buffer[enc->buffer_len++] = QOI_OP_INDEX | hash;
+    } else {
+        enc->index[hash] = px;
+
+        signed char vr = (signed char) (r - (uint8_t) (enc->prev >> 24));
+        signed char vg = (signed char) (g - (uint8_t) (enc->prev >> 16));
+        signed char vb = (signed char) (b - (uint8_t) (enc->prev >> 8));
+        signed char vg_r = (signed char) (vr - vg);
+        signed char vg_b = (signed char) (vb - vg);
+
+        if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+            enc->buffer[enc->buffer_len++] = QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+        } else if ((vg_r > -9) && (vg_r < 8) && (vg > -33) && (vg < 32) && (vg_b > -9) && (vg_b < 8)) {
+            enc->buffer[enc->buffer_len++] = QOI_OP_LUMA | (vg + 32);
+            enc->buffer[enc->buffer_len++] = ((vg_r + 8) << 4) | (vg_b + 8);
+        } else {
+            enc->buffer[enc->buffer_len++] = QOI_OP_RGB;
+            enc->buffer[enc->buffer_len++] = r;
+            enc->buffer[enc->buffer_len++] = g;
+            enc->buffer[enc->buffer_len++] = b;
+        }
+    }
+
+    enc->prev = px;
+
+    return 0;
+}
+
+/**
+ * @brief Finish a QOI image by terminating any pending run, writing the end marker and
+ * flushing the output buffer. The file is not closed.
+ * 
+ * @return Returns 0 on success, -1 on write error or invalid argument.
+ */
+int qoi_end(qoi_encoder_t *enc) {
+    static const uint8_t end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+    if (enc == NULL) {
+        return -1;
+    }
+
+    if (qoi_reserve(enc, 1 + sizeof(end_marker)) != 0) {
+        return -1;
+    }
+
+    if (enc->run > 0) {
+        enc->buffer[enc->buffer_len++] = QOI_OP_RUN | (enc->run - 1);
+        enc->run = 0;
+    }
+
+    memcpy(&enc->buffer[enc->buffer_len], end_marker, sizeof(end_marker));
+    enc->buffer_len += sizeof(end_marker);
+
+    return qoi_flush(enc);
+}
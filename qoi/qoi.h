@@ -0,0 +1,29 @@
+#ifndef QOI_H
+#define QOI_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define QOI_BUFFER_SIZE 65536
+
+// Streaming encoder for the "Quite OK Image" format (https://qoiformat.org). Pixels are
+// encoded as they arrive, so only the 64 entry color index and a small output buffer are
+// kept in memory, never the whole image.
+typedef struct {
+    FILE *file;
+
+    uint32_t index[64];
+    uint32_t prev;
+    int run;
+
+    size_t buffer_len;
+    uint8_t buffer[QOI_BUFFER_SIZE];
+} qoi_encoder_t;
+
+int qoi_begin(qoi_encoder_t *enc, FILE *file, uint32_t width, uint32_t height);
+
+int qoi_encode_pixel(qoi_encoder_t *enc, uint8_t r, uint8_t g, uint8_t b);
+
+int qoi_end(qoi_encoder_t *enc);
+
+#endif
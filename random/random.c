@@ -0,0 +1,42 @@
+#include "random.h"
+
+// splitmix64 finalizer, turns structured input (indices, counters) into well mixed bits
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+rng_t rng_seed(uint64_t seed) {
+    rng_t retval = { .state = mix64(seed + 0x9E3779B97F4A7C15ull) };
+
+    // xorshift must never be seeded with zero
+    if (retval.state == 0) {
+        retval.state = 0x9E3779B97F4A7C15ull;
+    }
+
+    return retval;
+}
+
+/**
+ * @brief Create the generator for one sample of one pixel. Every (pixel, sample) pair gets its
+ * own stream, so a sample draws the same numbers no matter which thread or pass traces it.
+ */
+rng_t rng_for_sample(uint64_t pixel, uint64_t sample) {
+    return rng_seed(mix64(pixel) ^ (sample * 0xD1B54A32D192ED03ull));
+}
+
+uint64_t rng_next(rng_t *rng) {
+    // xorshift64*
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * @brief Get a uniformly distributed random number in [0, 1).
+ */
+double random_double(rng_t *rng) {
+    return (double) (rng_next(rng) >> 11) / 9007199254740992.0;
+}
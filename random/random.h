@@ -0,0 +1,18 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t state;
+} rng_t;
+
+rng_t rng_seed(uint64_t seed);
+
+rng_t rng_for_sample(uint64_t pixel, uint64_t sample);
+
+uint64_t rng_next(rng_t *rng);
+
+double random_double(rng_t *rng);
+
+#endif
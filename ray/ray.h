@@ -11,8 +11,4 @@ typedef struct {
 
 point3_t ray_at(ray_t r, double t);
 
-double hit_sphere(point3_t center, double radius, ray_t r);
-
-color_t ray_color(ray_t r);
-
 #endif
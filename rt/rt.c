@@ -0,0 +1,1087 @@
+#include "rt.h"
+#include "../camera/camera.h"
+#include "../tile_bin/tile_bin.h"
+#include "../random/random.h"
+#include "../integrator/integrator.h"
+#include "../wavefront/wavefront.h"
+#include "../cost/cost.h"
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Share of the estimated time left that the next pass of a time budgeted render may take,
+// leaving room for passes running slower than the ones before
+#define RT_BUDGET_SAFETY 0.85
+
+// Paths a wavefront worker keeps in flight
+#define RT_WAVEFRONT_CAPACITY (1 << 14)
+
+// How often the calling thread checks whether a progressive snapshot is due
+#define RT_SNAPSHOT_POLL_NS 10000000L
+
+// Floats of a framebuffer row apart that first touch writes to, one per 4 KiB page
+#define RT_TOUCH_STRIDE 1024
+
+// Rows of a level owned by one NUMA node. Its threads take rows from the front of their own
+// band first, and from the bands of other nodes once it is empty.
+typedef struct {
+    atomic_int next;
+    int end;
+} rt_band_t;
+
+// State shared by the threads rendering one frame
+typedef struct {
+    const rt_scene_t *scene;
+    camera_t camera;
+    const tile_bins_t *bins;
+    int samples_per_pixel;
+    uint32_t sample_offset;
+    int jitter;
+    rt_integrator_t integrator;
+    int max_depth;
+    int rr_depth;
+    int light_sampling;
+    int perf_counters;
+    const numa_topology_t *numa;
+    pthread_t caller;
+
+    // The full frame the camera maps onto, and the window of it being traced. Pixels are
+    // addressed relative to the window, which lands at (fb_x, fb_y) in the framebuffer.
+    int frame_width;
+    int frame_height;
+    int x0;
+    int y0;
+    int width;
+    int height;
+    int fb_x;
+    int fb_y;
+
+    framebuffer_t *fb;
+    aov_buffers_t *aov;
+    cost_buffers_t *cost;
+    live_t *live;
+    void (*rows_done_callback) (void*, int, int);
+    void *rows_done_user;
+
+    // Rows of the current level are handed out from one band per NUMA node, or a single band
+    // without placement. In progressive renders, only every block-th row and column is traced
+    // per level, and every row records the finest block size it has been completed at. In
+    // the touch run before the first level, threads write once to every page of their band.
+    int progressive;
+    int block;
+    int touch;
+    int rows_per_fetch;
+    int band_count;
+    rt_band_t bands[NUMA_MAX_NODES];
+    atomic_int rows_done;
+    atomic_int *row_block;
+
+    // Parameters of the wavefront integrator, shared by all workers
+    wavefront_params_t wavefront;
+} rt_job_t;
+
+// A thread rendering a job, with the node it runs on and the scene copy it traces, the working
+// set of the wavefront integrator if it is used, the hardware events it counted and the
+// timeline lane it records to
+typedef struct {
+    rt_job_t *job;
+    int node;
+    const rt_scene_t *scene;
+    const light_set_t *lights;
+    wavefront_params_t wavefront;
+    wavefront_t wf;
+    wavefront_pixel_t *pixels;
+    perf_counts_t counts;
+    trace_lane_t *lane;
+
+    // Primary rays traced outside the wavefront integrator, and the sphere tests they took
+    uint64_t primary_rays;
+    uint64_t primary_tests;
+} rt_worker_t;
+
+// The hittable primary rays are traced against, counting the rays and the sphere tests
+typedef struct {
+    hittable_t target;
+    uint64_t rays;
+    uint64_t tests;
+} rt_primary_t;
+
+/**
+ * @brief Store the first hit of a pixel in the auxiliary buffers. Object IDs are sphere
+ * indices plus one, counted in the scene copy the sphere belongs to, since tile bins hold
+ * spheres of the original scene while workers may trace a replica. Quantized spheres of
+ * compact scenes, which have neither, are numbered after the exact ones.
+ */
+static void rt_store_aov(const rt_job_t *job, const rt_worker_t *worker, int fb_x, int fb_y, const aov_sample_t *sample) {
+    uintptr_t prim = (uintptr_t) sample->prim;
+    uintptr_t first = (uintptr_t) worker->scene->spheres;
+    int exact = (prim >= first) && (prim < (uintptr_t) (worker->scene->spheres + worker->scene->sphere_count));
+    const sphere_t *spheres = exact ? worker->scene->spheres : job->scene->spheres;
+    uint32_t id = 0;
+
+    if ((sample->prim != NULL) && !exact && (worker->scene->compact.block_count > 0)) {
+        id = (uint32_t) (worker->scene->sphere_count + compact_sphere_index(&worker->scene->compact, sample->prim) + 1);
+    } else if (sample->prim != NULL) {
+        id = (uint32_t) (((const sphere_t*) sample->prim - spheres) + 1);
+    }
+
+    aov_buffers_store(job->aov, fb_x, fb_y, sample->normal, sample->depth, id);
+}
+
+static int rt_primary_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    rt_primary_t *primary = (rt_primary_t*) ptr;
+    uint64_t tests = cost_counter.tests;
+    int hit = primary->target.hit(primary->target.ptr, r, t_min, t_max, rec);
+
+    primary->rays++;
+    primary->tests += cost_counter.tests - tests;
+
+    return hit;
+}
+
+/**
+ * @brief Trace all samples of a pixel and accumulate them into the framebuffer.
+ * 
+ * @param job The frame being rendered.
+ * @param worker The thread tracing the pixel.
+ * @param wx The pixel column in the window, counted from the left.
+ * @param wrow The pixel row in the window, counted from the top.
+ */
+static void rt_trace_pixel(const rt_job_t *job, rt_worker_t *worker, int wx, int wrow) {
+    int width = job->frame_width;
+    int height = job->frame_height;
+    int x = job->x0 + wx;
+    int j = height - 1 - (job->y0 + wrow);
+    tile_bin_t bin;
+    rt_primary_t tally = { .target = worker->scene->world, .rays = 0, .tests = 0 };
+    hittable_t primary = { .ptr = &tally, .size = sizeof(rt_primary_t), .hit = &rt_primary_hit, .occluded = NULL };
+
+    // Cost maps take the work done by this thread while tracing the pixel
+    cost_counter_t counted = cost_counter;
+    uint64_t start = (job->cost != NULL) ? cost_timestamp() : 0;
+
+    if (job->bins != NULL) {
+        bin = tile_bins_lookup(job->bins, x, j);
+        tally.target = tile_bin_to_hittable(&bin);
+    }
+
+    for (int s = 0; s < job->samples_per_pixel; s++) {
+        rng_t rng = rng_for_sample(((uint64_t) j * width) + x, job->sample_offset + s);
+
+        double du = job->jitter ? random_double(&rng) : 0.0;
+        double dv = job->jitter ? random_double(&rng) : 0.0;
+
+        double u = ((x + du) / (width - 1));
+        double v = ((j + dv) / (height - 1));
+
+        ray_t r = get_ray(job->camera, u, v);
+
+        // Auxiliary buffers hold the first hit of the first sample
+        aov_sample_t aov_sample;
+        aov_sample_t *aov = ((job->aov != NULL) && (job->sample_offset + s == 0)) ? &aov_sample : NULL;
+        color_t color;
+
+        if (job->integrator == RT_INTEGRATOR_NORMALS) {
+            color = integrator_normals(r, primary, aov);
+        } else {
+            color = integrator_path(r, primary, worker->scene->world, worker->lights, job->max_depth, job->rr_depth, &rng, aov);
+        }
+
+        framebuffer_add(job->fb, job->fb_x + wx, job->fb_y + wrow, color);
+
+        if (aov != NULL) {
+            rt_store_aov(job, worker, job->fb_x + wx, job->fb_y + wrow, aov);
+        }
+    }
+
+    if (job->cost != NULL) {
+        cost_buffers_add(job->cost, job->fb_x + wx, job->fb_y + wrow, cost_counter.tests - counted.tests,
+                         cost_counter.steps - counted.steps, cost_timestamp() - start);
+    }
+    worker->primary_rays += tally.rays;
+    worker->primary_tests += tally.tests;
+}
+
+/**
+ * @brief Trace all samples of a list of pixels with the wavefront integrator, in batches of
+ * as many paths as the worker keeps in flight, and accumulate them into the framebuffer in
+ * the same order as rt_trace_pixel would.
+ */
+static void rt_trace_wavefront(const rt_job_t *job, rt_worker_t *worker, size_t pixel_count) {
+    size_t spp = (size_t) job->samples_per_pixel;
+    size_t path_count = pixel_count * spp;
+
+    for (size_t begin = 0; begin < path_count; begin += worker->wf.capacity) {
+        size_t end = ((path_count - begin) > worker->wf.capacity) ? (begin + worker->wf.capacity) : path_count;
+
+        wavefront_trace(&worker->wf, &worker->wavefront, worker->pixels, begin, end);
+
+        for (size_t p = begin; p < end; p++) {
+            const wavefront_pixel_t *pixel = &worker->pixels[p / spp];
+            int fb_x = job->fb_x + (pixel->x - job->x0);
+            int fb_y = job->fb_y + ((job->frame_height - 1 - pixel->j) - job->y0);
+
+            framebuffer_add(job->fb, fb_x, fb_y, worker->wf.radiance[p - begin]);
+
+            if ((job->aov != NULL) && (job->sample_offset + (p % spp) == 0)) {
+                rt_store_aov(job, worker, fb_x, fb_y, &worker->wf.aov[p - begin]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Take the next rows of the current level, from the band of the given node first and,
+ * if stealing, from the bands of the following nodes once it is empty.
+ * 
+ * @param first Set to the first level row taken.
+ * 
+ * @return Returns the amount of level rows taken, 0 once there are none left.
+ */
+static int rt_fetch_rows(rt_job_t *job, int node, int steal, int *first) {
+    int tries = steal ? job->band_count : 1;
+
+    for (int i = 0; i < tries; i++) {
+        rt_band_t *band = &job->bands[(node + i) % job->band_count];
+
+        // Drained bands are skipped without bumping their counter
+        if (atomic_load_explicit(&band->next, memory_order_relaxed) >= band->end) {
+            continue;
+        }
+
+        int start = atomic_fetch_add(&band->next, job->rows_per_fetch);
+
+        if (start < band->end) {
+            *first = start;
+            return ((band->end - start) < job->rows_per_fetch) ? (band->end - start) : job->rows_per_fetch;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write once to every page of a framebuffer row, so that the kernel places pages not
+ * yet touched on the node of the calling thread. Values are written back unchanged.
+ */
+static void rt_touch_row(const rt_job_t *job, int row) {
+    size_t floats = (size_t) job->fb->width * 3;
+    volatile float *rgb = &job->fb->rgb[(size_t) (job->fb_y + row) * floats];
+
+    for (size_t i = 0; i < floats; i += RT_TOUCH_STRIDE) {
+        rgb[i] = rgb[i];
+    }
+    rgb[floats - 1] = rgb[floats - 1];
+}
+
+static void *rt_worker(void *arg) {
+    rt_worker_t *worker = (rt_worker_t*) arg;
+    rt_job_t *job = worker->job;
+    int block = job->block;
+    int coarser = 2 * block;
+    int wavefront = job->integrator == RT_INTEGRATOR_WAVEFRONT;
+    int level_rows;
+
+    // The calling thread keeps its affinity when it has to render itself
+    if ((job->numa != NULL) && !pthread_equal(pthread_self(), job->caller)) {
+        numa_bind_thread(job->numa, worker->node);
+    }
+
+    if (job->touch) {
+        for (int first; (level_rows = rt_fetch_rows(job, worker->node, 0, &first)) > 0; ) {
+            for (int row = first; row < first + level_rows; row++) {
+                rt_touch_row(job, row);
+            }
+        }
+
+        return NULL;
+    }
+
+    perf_group_t counters;
+    int counting = job->perf_counters && (perf_group_open(&counters) == 0);
+    trace_lane_t *caller_lane = trace_attach(worker->lane);
+
+    if (counting) {
+        perf_group_start(&counters);
+    }
+
+    for (;;) {
+        uint64_t batch = trace_begin();
+        int level_first;
+        size_t pixel_count = 0;
+
+        if ((level_rows = rt_fetch_rows(job, worker->node, 1, &level_first)) == 0) {
+            break;
+        }
+
+        int first = level_first * block;
+        int end = (level_first + level_rows) * block;
+
+        if (end > job->height) {
+            end = job->height;
+        }
+
+        for (int row = first; (job->live != NULL) && (row < end); row += block) {
+            live_row_begin(job->live, job->fb_y + row);
+        }
+
+        for (int row = first; row < end; row += block) {
+            for (int x = 0; x < job->width; x += block) {
+                // Corners of coarser blocks were traced by an earlier level
+                if (job->progressive && (block < RT_PROGRESSIVE_START_BLOCK) && ((row % coarser) == 0) && ((x % coarser) == 0)) {
+                    continue;
+                }
+
+                if (wavefront) {
+                    worker->pixels[pixel_count++] = (wavefront_pixel_t) { .x = job->x0 + x, .j = job->frame_height - 1 - (job->y0 + row) };
+                } else {
+                    rt_trace_pixel(job, worker, x, row);
+                }
+            }
+        }
+
+        if (pixel_count > 0) {
+            rt_trace_wavefront(job, worker, pixel_count);
+        }
+
+        for (int row = first; row < end; row += block) {
+            if (job->row_block != NULL) {
+                atomic_store_explicit(&job->row_block[row], block, memory_order_release);
+            }
+            if (job->live != NULL) {
+                live_row_end(job->live, job->fb_y + row, job->fb->samples + (uint32_t) job->samples_per_pixel, (uint32_t) block);
+            }
+            atomic_fetch_add(&job->rows_done, 1);
+        }
+
+        // Rows are final once the finest level has traced them
+        if ((job->rows_done_callback != NULL) && (block == 1)) {
+            job->rows_done_callback(job->rows_done_user, job->fb_y + first, job->fb_y + end);
+        }
+
+        trace_end("render", "rows", batch, first);
+    }
+
+    if (counting) {
+        perf_group_stop(&counters, &worker->counts);
+        perf_group_close(&counters);
+    }
+
+    trace_attach(caller_lane);
+
+    return NULL;
+}
+
+/**
+ * @brief Build an upsampled preview of a progressive render in progress. Every pixel takes
+ * the value of the top left corner of its block, trying the finest block size whose corner
+ * row has been completed first. Pixels without any traced corner stay black, and pixels
+ * outside the traced window keep their framebuffer value.
+ */
+static void rt_preview(const rt_job_t *job, framebuffer_t *preview) {
+    const framebuffer_t *fb = job->fb;
+
+    memcpy(preview->rgb, fb->rgb, (size_t) fb->width * fb->height * 3 * sizeof(float));
+
+    for (int row = 0; row < job->height; row++) {
+        for (int x = 0; x < job->width; x++) {
+            size_t dst = ((((size_t) (job->fb_y + row)) * fb->width) + job->fb_x + x) * 3;
+            preview->rgb[dst] = preview->rgb[dst + 1] = preview->rgb[dst + 2] = 0.0f;
+
+            for (int b = job->block; b <= RT_PROGRESSIVE_START_BLOCK; b *= 2) {
+                int anchor_row = row - (row % b);
+
+                if (atomic_load_explicit(&job->row_block[anchor_row], memory_order_acquire) <= b) {
+                    size_t src = ((((size_t) (job->fb_y + anchor_row)) * fb->width) + job->fb_x + (x - (x % b))) * 3;
+                    memcpy(&preview->rgb[dst], &fb->rgb[src], 3 * sizeof(float));
+                    break;
+                }
+            }
+        }
+    }
+
+    preview->samples = fb->samples + job->samples_per_pixel;
+}
+
+/**
+ * @brief Trace every row of the current level, split across the given amount of threads.
+ * Unless interval snapshots are requested, the calling thread renders along with the others.
+ * Otherwise it waits for them and hands a preview to the snapshot callback every interval.
+ */
+static void rt_run_level(rt_job_t *job, const rt_settings_t *settings, pthread_t *handles, rt_worker_t *workers, framebuffer_t *preview) {
+    int rows = (job->height + job->block - 1) / job->block;
+    int supervise = !job->touch && job->progressive && (settings->snapshot_interval > 0.0) && (settings->snapshot != NULL);
+    int spawn = (supervise || (job->numa != NULL)) ? settings->threads : (settings->threads - 1);
+    int started = 0;
+    uint64_t level = trace_begin();
+
+    // Wavefront workers take as many rows at once as fill their queues
+    job->rows_per_fetch = 1;
+
+    if (job->integrator == RT_INTEGRATOR_WAVEFRONT) {
+        size_t row_paths = (size_t) ((job->width + job->block - 1) / job->block) * job->samples_per_pixel;
+        size_t fetch = RT_WAVEFRONT_CAPACITY / row_paths;
+        job->rows_per_fetch = (fetch > 1) ? (int) ((fetch < (size_t) rows) ? fetch : (size_t) rows) : 1;
+    }
+
+    // Band boundaries fall on the same pixel rows in every level, so that nodes trace the rows
+    // they touched first
+    job->band_count = (job->numa != NULL) ? job->numa->node_count : 1;
+
+    for (int b = 0; b < job->band_count; b++) {
+        int pixel_row = (int) (((long) job->height * b) / job->band_count);
+        int next_pixel_row = (int) (((long) job->height * (b + 1)) / job->band_count);
+
+        atomic_store(&job->bands[b].next, (pixel_row + job->block - 1) / job->block);
+        job->bands[b].end = (next_pixel_row + job->block - 1) / job->block;
+    }
+
+    atomic_store(&job->rows_done, 0);
+
+    for (int t = 0; t < spawn; t++) {
+        if (pthread_create(&handles[started], NULL, rt_worker, &workers[started]) == 0) {
+            started++;
+        }
+    }
+
+    if (supervise && (started > 0)) {
+        double last_snapshot = cost_seconds();
+        struct timespec poll = { .tv_sec = 0, .tv_nsec = RT_SNAPSHOT_POLL_NS };
+
+        while (atomic_load(&job->rows_done) < rows) {
+            nanosleep(&poll, NULL);
+
+            if ((cost_seconds() - last_snapshot) >= settings->snapshot_interval) {
+                uint64_t snapshot = trace_begin();
+
+                rt_preview(job, preview);
+                settings->snapshot(settings->snapshot_user, preview);
+                last_snapshot = cost_seconds();
+                trace_end("output", "snapshot", snapshot, job->block);
+            }
+        }
+    } else if ((spawn < settings->threads) || (started == 0)) {
+        rt_worker(&workers[settings->threads - 1]);
+    }
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(handles[t], NULL);
+    }
+
+    trace_end("render", job->touch ? "first touch" : "level", level, job->block);
+}
+
+/**
+ * @brief Move the spheres of a scene that emit no light into quantized storage, leaving the
+ * emissive ones exact in scene->spheres. Lights are sampled by their geometry, and hits are
+ * only looked up as spheres if they are emissive.
+ * 
+ * @return Returns 0 on success, -1 on error.
+ */
+static int rt_scene_compact(rt_scene_t *scene) {
+    size_t light_count = 0;
+
+    for (size_t i = 0; i < scene->sphere_count; i++) {
+        light_count += (scene->spheres[i].material != NULL) && (scene->spheres[i].material->type == MATERIAL_EMISSIVE);
+    }
+
+    sphere_t *lights = malloc(((light_count > 0) ? light_count : 1) * sizeof(sphere_t));
+
+    if (lights == NULL) {
+        return -1;
+    }
+
+    size_t stored = 0;
+    light_count = 0;
+
+    for (size_t i = 0; i < scene->sphere_count; i++) {
+        if ((scene->spheres[i].material != NULL) && (scene->spheres[i].material->type == MATERIAL_EMISSIVE)) {
+            lights[light_count++] = scene->spheres[i];
+        } else {
+            scene->spheres[stored++] = scene->spheres[i];
+        }
+    }
+
+    compact_precision_t precision = (scene->accel == RT_ACCEL_COMPACT_21) ? COMPACT_PRECISION_21 : COMPACT_PRECISION_16;
+
+    if (compact_build(&scene->compact, scene->spheres, stored, precision) != 0) {
+        free(lights);
+        return -1;
+    }
+
+    free(scene->spheres);
+    scene->spheres = lights;
+    scene->sphere_count = light_count;
+
+    return 0;
+}
+
+/**
+ * @brief Copy the spheres and materials of a scene description into a new scene and build
+ * the chosen acceleration structure over them.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int rt_scene_init(rt_scene_t *scene, const scene_desc_t *desc, rt_accel_t accel) {
+    if ((scene == NULL) || (desc == NULL) || ((desc->spheres == NULL) && (desc->sphere_count > 0))) {
+        return -1;
+    }
+
+    size_t sphere_count = desc->sphere_count;
+
+    memset(scene, 0, sizeof(rt_scene_t));
+    scene->sphere_count = sphere_count;
+    scene->material_count = desc->material_count;
+    scene->accel = accel;
+    scene->spheres = malloc(((sphere_count > 0) ? sphere_count : 1) * sizeof(sphere_t));
+    scene->materials = malloc(((desc->material_count > 0) ? desc->material_count : 1) * sizeof(material_t));
+
+    if ((scene->spheres == NULL) || (scene->materials == NULL)) {
+        rt_scene_free(scene);
+        return -1;
+    }
+
+    if (desc->material_count > 0) {
+        memcpy(scene->materials, desc->materials, desc->material_count * sizeof(material_t));
+    }
+
+    // Spheres point into the material copy owned by the scene
+    for (size_t i = 0; i < sphere_count; i++) {
+        size_t material = desc->sphere_materials[i];
+
+        if ((material != SCENE_DEFAULT_MATERIAL) && (material >= desc->material_count)) {
+            rt_scene_free(scene);
+            return -1;
+        }
+
+        scene->spheres[i] = desc->spheres[i];
+        scene->spheres[i].material = (material == SCENE_DEFAULT_MATERIAL) ? NULL : &scene->materials[material];
+    }
+
+    if (((accel == RT_ACCEL_COMPACT) || (accel == RT_ACCEL_COMPACT_21)) && (rt_scene_compact(scene) != 0)) {
+        rt_scene_free(scene);
+        return -1;
+    }
+
+    if (light_set_build(&scene->lights, scene->spheres, scene->sphere_count) != 0) {
+        rt_scene_free(scene);
+        return -1;
+    }
+
+    if ((accel == RT_ACCEL_COMPACT) || (accel == RT_ACCEL_COMPACT_21)) {
+        scene->hittables = malloc((scene->sphere_count + 1) * sizeof(hittable_t));
+
+        if (scene->hittables == NULL) {
+            rt_scene_free(scene);
+            return -1;
+        }
+
+        scene->hittables[0] = compact_to_hittable(&scene->compact);
+
+        for (size_t i = 0; i < scene->sphere_count; i++) {
+            scene->hittables[i + 1] = sphere_to_hittable(&scene->spheres[i]);
+        }
+
+        scene->list = (hittable_list_t) { .hittables = scene->hittables, .amount = scene->sphere_count + 1 };
+        scene->world = hittable_list_to_hittable(&scene->list);
+    } else if (accel == RT_ACCEL_NONE) {
+        scene->hittables = malloc(((sphere_count > 0) ? sphere_count : 1) * sizeof(hittable_t));
+
+        if (scene->hittables == NULL) {
+            rt_scene_free(scene);
+            return -1;
+        }
+
+        for (size_t i = 0; i < sphere_count; i++) {
+            scene->hittables[i] = sphere_to_hittable(&scene->spheres[i]);
+        }
+
+        scene->list = (hittable_list_t) { .hittables = scene->hittables, .amount = sphere_count };
+        scene->world = hittable_list_to_hittable(&scene->list);
+    } else if (accel == RT_ACCEL_BVH) {
+        bvh_build_settings_t bvh_settings;
+        bvh_default_build_settings(&bvh_settings);
+
+        if (bvh_build_linear(&scene->bvh, scene->spheres, sphere_count, &bvh_settings) != 0) {
+            rt_scene_free(scene);
+            return -1;
+        }
+
+        scene->world = bvh_to_hittable(&scene->bvh);
+    } else {
+        if (grid_build(&scene->grid, scene->spheres, sphere_count, (accel == RT_ACCEL_HASHGRID) ? GRID_HASHED : GRID_UNIFORM) != 0) {
+            rt_scene_free(scene);
+            return -1;
+        }
+
+        scene->world = grid_to_hittable(&scene->grid);
+    }
+
+    return 0;
+}
+
+void rt_scene_free(rt_scene_t *scene) {
+    if (scene == NULL) {
+        return;
+    }
+
+    if (scene->accel == RT_ACCEL_BVH) {
+        bvh_free(&scene->bvh);
+    } else if ((scene->accel == RT_ACCEL_COMPACT) || (scene->accel == RT_ACCEL_COMPACT_21)) {
+        compact_free(&scene->compact);
+    } else if (scene->accel != RT_ACCEL_NONE) {
+        grid_free(&scene->grid);
+    }
+
+    for (int i = 0; (scene->replicas != NULL) && (i < scene->replica_count); i++) {
+        rt_scene_free(&scene->replicas[i]);
+    }
+
+    free(scene->replicas);
+    light_set_free(&scene->lights);
+    free(scene->hittables);
+    free(scene->spheres);
+    free(scene->materials);
+
+    scene->hittables = NULL;
+    scene->spheres = NULL;
+    scene->sphere_count = 0;
+    scene->materials = NULL;
+    scene->material_count = 0;
+    scene->replicas = NULL;
+    scene->replica_count = 0;
+}
+
+// A scene copy being built by a thread on its node
+typedef struct {
+    const rt_scene_t *source;
+    rt_scene_t *replica;
+    const numa_topology_t *topology;
+    int node;
+    int retval;
+} rt_replica_job_t;
+
+static void *rt_build_replica(void *arg) {
+    rt_replica_job_t *job = (rt_replica_job_t*) arg;
+    const rt_scene_t *source = job->source;
+    scene_desc_t desc = {
+        .spheres = source->spheres,
+        .sphere_count = source->sphere_count,
+        .sphere_materials = malloc(((source->sphere_count > 0) ? source->sphere_count : 1) * sizeof(size_t)),
+        .materials = source->materials,
+        .material_count = source->material_count
+    };
+
+    job->retval = -1;
+
+    if (desc.sphere_materials == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < source->sphere_count; i++) {
+        const material_t *material = source->spheres[i].material;
+        desc.sphere_materials[i] = (material == NULL) ? SCENE_DEFAULT_MATERIAL : (size_t) (material - source->materials);
+    }
+
+    // Everything the replica allocates is first touched here, on the node it is for
+    if (numa_bind_thread(job->topology, job->node) == 0) {
+        job->retval = rt_scene_init(job->replica, &desc, source->accel);
+    }
+
+    free(desc.sphere_materials);
+    return NULL;
+}
+
+/**
+ * @brief Give a scene a copy of its spheres, materials, lights and acceleration structure on
+ * every node of a topology, each built by a thread pinned to the node. Renders with the same
+ * topology in their settings then trace the copy local to each thread.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument, including a scene that
+ * already has replicas and a compact scene, which is compact so that one copy fits. On error,
+ * the scene is left without replicas.
+ */
+int rt_scene_replicate(rt_scene_t *scene, const numa_topology_t *topology) {
+    if ((scene == NULL) || (topology == NULL) || (topology->node_count < 1) || (scene->replicas != NULL) ||
+        (scene->accel == RT_ACCEL_COMPACT) || (scene->accel == RT_ACCEL_COMPACT_21)) {
+        return -1;
+    }
+
+    int node_count = topology->node_count;
+    rt_scene_t *replicas = calloc((size_t) node_count, sizeof(rt_scene_t));
+    rt_replica_job_t *jobs = calloc((size_t) node_count, sizeof(rt_replica_job_t));
+    pthread_t *handles = malloc((size_t) node_count * sizeof(pthread_t));
+    int retval = ((replicas == NULL) || (jobs == NULL) || (handles == NULL)) ? -1 : 0;
+    int started = 0;
+
+    for (int node = 0; (retval == 0) && (node < node_count); node++) {
+        jobs[node] = (rt_replica_job_t) { .source = scene, .replica = &replicas[node], .topology = topology, .node = node, .retval = -1 };
+
+        if (pthread_create(&handles[node], NULL, rt_build_replica, &jobs[node]) != 0) {
+            retval = -1;
+            break;
+        }
+        started++;
+    }
+
+    for (int node = 0; node < started; node++) {
+        pthread_join(handles[node], NULL);
+        retval = (jobs[node].retval != 0) ? -1 : retval;
+    }
+
+    if (retval == 0) {
+        scene->replicas = replicas;
+        scene->replica_count = node_count;
+    } else {
+        for (int node = 0; node < started; node++) {
+            if (jobs[node].retval == 0) {
+                rt_scene_free(&replicas[node]);
+            }
+        }
+        free(replicas);
+    }
+
+    free(jobs);
+    free(handles);
+
+    return retval;
+}
+
+void rt_camera_default(rt_camera_t *camera) {
+    if (camera == NULL) {
+        return;
+    }
+
+    camera->origin = (point3_t) { 0, 0, 0 };
+    camera->viewport_height = 2.0;
+    camera->focal_len = 1.0;
+    camera->aspect_ratio = 0.0;
+}
+
+void rt_default_settings(rt_settings_t *settings) {
+    if (settings == NULL) {
+        return;
+    }
+
+    memset(settings, 0, sizeof(rt_settings_t));
+    settings->samples_per_pixel = 1;
+    settings->integrator = RT_INTEGRATOR_NORMALS;
+    settings->max_depth = RT_DEFAULT_MAX_DEPTH;
+    settings->rr_depth = RT_DEFAULT_RR_DEPTH;
+    settings->light_sampling = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    settings->threads = (cpus > 0) ? (int) cpus : 1;
+#else
+    settings->threads = 1;
+#endif
+}
+
+/**
+ * @brief Render a frame of a scene, adding settings->samples_per_pixel samples to every pixel
+ * of the crop window, by default the whole framebuffer, and to its sample count. Rows are
+ * handed out to settings->threads threads. All state lives in the arguments and on the stack,
+ * so any amount of renders may run at once as long as they write to different framebuffers.
+ * 
+ * @param scene The scene to render.
+ * @param camera The camera to render with.
+ * @param settings The render settings.
+ * @param fb The framebuffer to accumulate into. Its size sets the image resolution, unless
+ * settings->frame_width is set, in which case it holds only the crop window.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int rt_render(const rt_scene_t *scene, const rt_camera_t *camera, const rt_settings_t *settings, framebuffer_t *fb) {
+    if ((scene == NULL) || (camera == NULL) || (settings == NULL) || (fb == NULL) || (fb->rgb == NULL) ||
+        (fb->width < 1) || (fb->height < 1) || (settings->samples_per_pixel < 1) ||
+        ((settings->integrator != RT_INTEGRATOR_NORMALS) && ((settings->max_depth < 1) || (settings->rr_depth < 0))) ||
+        ((settings->aov != NULL) && ((settings->aov->width != fb->width) || (settings->aov->height != fb->height))) ||
+        ((settings->cost != NULL) && ((settings->cost->width != fb->width) || (settings->cost->height != fb->height) ||
+                                      (settings->integrator == RT_INTEGRATOR_WAVEFRONT))) ||
+        ((settings->live != NULL) && (settings->live->rgb != fb->rgb))) {
+        return -1;
+    }
+
+    int cropped_fb = settings->frame_width > 0;
+    int frame_width = cropped_fb ? settings->frame_width : fb->width;
+    int frame_height = cropped_fb ? settings->frame_height : fb->height;
+    rt_window_t window = settings->crop;
+
+    if ((window.x1 <= window.x0) || (window.y1 <= window.y0)) {
+        window = (rt_window_t) { .x0 = 0, .y0 = 0, .x1 = frame_width, .y1 = frame_height };
+    }
+
+    if ((frame_width < 2) || (frame_height < 2) || (window.x0 < 0) || (window.y0 < 0) ||
+        (window.x1 > frame_width) || (window.y1 > frame_height) ||
+        (cropped_fb && ((fb->width != window.x1 - window.x0) || (fb->height != window.y1 - window.y0)))) {
+        return -1;
+    }
+
+    rt_settings_t run_settings = *settings;
+    run_settings.threads = (settings->threads < 1) ? 1 : settings->threads;
+
+    camera_t cam;
+    cam.aspect_ratio = (camera->aspect_ratio > 0.0) ? camera->aspect_ratio : ((double) frame_width / frame_height);
+    cam.viewport_height = camera->viewport_height;
+    cam.viewport_width = cam.aspect_ratio * cam.viewport_height;
+    cam.focal_len = camera->focal_len;
+    cam.origin = camera->origin;
+    cam.horizontal = (vec3_t) { .x = cam.viewport_width, .y = 0, .z = 0 };
+    cam.vertical = (vec3_t) { .x = 0, .y = cam.viewport_height, .z = 0 };
+    cam.lower_left_corner = calculate_lower_left_corner(cam.origin, cam.horizontal, cam.vertical, cam.focal_len);
+
+    uint64_t setup = trace_begin();
+    tile_bins_t bins;
+
+    // Tile bins hold exact spheres, which compact scenes do not have
+    int binned = (settings->tile_size > 0) && (scene->accel != RT_ACCEL_COMPACT) && (scene->accel != RT_ACCEL_COMPACT_21);
+
+    if (binned) {
+        if (tile_bins_build(&bins, cam, frame_width, frame_height, settings->tile_size, scene->spheres, scene->sphere_count) != 0) {
+            return -1;
+        }
+
+        if ((scene->accel != RT_ACCEL_NONE) && (tile_bins_set_fallback(&bins, scene->world, cam) != 0)) {
+            tile_bins_free(&bins);
+            return -1;
+        }
+    }
+
+    pthread_t *handles = malloc((size_t) run_settings.threads * sizeof(pthread_t));
+    rt_worker_t *workers = calloc((size_t) run_settings.threads, sizeof(rt_worker_t));
+    atomic_int *row_block = NULL;
+    framebuffer_t preview = { .rgb = NULL };
+    int retval = ((handles == NULL) || (workers == NULL)) ? -1 : 0;
+
+    if (settings->progressive) {
+        row_block = malloc((size_t) (window.y1 - window.y0) * sizeof(atomic_int));
+
+        if ((row_block == NULL) || ((settings->snapshot != NULL) && (framebuffer_init(&preview, fb->width, fb->height) != 0))) {
+            retval = -1;
+        } else {
+            for (int row = 0; row < window.y1 - window.y0; row++) {
+                atomic_init(&row_block[row], INT_MAX);
+            }
+        }
+    }
+
+    rt_job_t job = {
+        .scene = scene,
+        .camera = cam,
+        .bins = binned ? &bins : NULL,
+        .samples_per_pixel = settings->samples_per_pixel,
+        .sample_offset = settings->sample_offset,
+        .jitter = (settings->sample_offset > 0) || (settings->samples_per_pixel > 1),
+        .frame_width = frame_width,
+        .frame_height = frame_height,
+        .x0 = window.x0,
+        .y0 = window.y0,
+        .width = window.x1 - window.x0,
+        .height = window.y1 - window.y0,
+        .fb_x = cropped_fb ? 0 : window.x0,
+        .fb_y = cropped_fb ? 0 : window.y0,
+        .fb = fb,
+        .aov = settings->aov,
+        .cost = settings->cost,
+        .live = settings->live,
+        .rows_done_callback = settings->rows_done,
+        .rows_done_user = settings->rows_done_user,
+        .integrator = settings->integrator,
+        .max_depth = settings->max_depth,
+        .rr_depth = settings->rr_depth,
+        .light_sampling = settings->light_sampling,
+        .perf_counters = settings->perf_counters,
+        .numa = settings->numa,
+        .caller = pthread_self(),
+        .progressive = settings->progressive,
+        .row_block = row_block,
+        .wavefront = {
+            .camera = cam,
+            .world = scene->world,
+            .bins = binned ? &bins : NULL,
+            .lights = settings->light_sampling ? &scene->lights : NULL,
+            .frame_width = frame_width,
+            .frame_height = frame_height,
+            .samples_per_pixel = settings->samples_per_pixel,
+            .sample_offset = settings->sample_offset,
+            .jitter = (settings->sample_offset > 0) || (settings->samples_per_pixel > 1),
+            .max_depth = settings->max_depth,
+            .rr_depth = settings->rr_depth
+        }
+    };
+
+    // A wavefront worker gathers up to a queue worth of paths, but at least a full row
+    size_t max_pixels = ((size_t) job.width > RT_WAVEFRONT_CAPACITY) ? (size_t) job.width : RT_WAVEFRONT_CAPACITY;
+
+    for (int t = 0; (retval == 0) && (t < run_settings.threads); t++) {
+        char lane_name[32];
+        snprintf(lane_name, sizeof(lane_name), "worker %d", t);
+
+        workers[t].job = &job;
+        workers[t].lane = trace_get_lane(settings->trace, t + 1, lane_name);
+        workers[t].node = (job.numa != NULL) ? numa_node_of_thread(job.numa, t, run_settings.threads) : 0;
+        workers[t].scene = ((job.numa != NULL) && (workers[t].node < scene->replica_count)) ? &scene->replicas[workers[t].node] : scene;
+        workers[t].lights = settings->light_sampling ? &workers[t].scene->lights : NULL;
+        workers[t].wavefront = job.wavefront;
+        workers[t].wavefront.world = workers[t].scene->world;
+        workers[t].wavefront.lights = workers[t].lights;
+
+        if (job.integrator == RT_INTEGRATOR_WAVEFRONT) {
+            workers[t].pixels = malloc(max_pixels * sizeof(wavefront_pixel_t));
+
+            if ((workers[t].pixels == NULL) || (wavefront_init(&workers[t].wf, RT_WAVEFRONT_CAPACITY) != 0)) {
+                retval = -1;
+            }
+        }
+    }
+
+    trace_end("render", "render setup", setup, 0);
+
+    double start = cost_seconds();
+
+    // Pages of the framebuffer are placed on the node that traces them before any are written
+    if ((retval == 0) && (job.numa != NULL)) {
+        job.touch = 1;
+        job.block = 1;
+        rt_run_level(&job, &run_settings, handles, workers, &preview);
+        job.touch = 0;
+    }
+
+    if (settings->progressive) {
+        for (job.block = RT_PROGRESSIVE_START_BLOCK; job.block >= 1; job.block /= 2) {
+            if (retval != 0) {
+                break;
+            }
+
+            rt_run_level(&job, &run_settings, handles, workers, &preview);
+
+            if ((settings->snapshot != NULL) && (settings->snapshot_interval <= 0.0) && (job.block > 1)) {
+                rt_preview(&job, &preview);
+                settings->snapshot(settings->snapshot_user, &preview);
+            }
+        }
+    } else if (retval == 0) {
+        job.block = 1;
+        rt_run_level(&job, &run_settings, handles, workers, &preview);
+    }
+
+    if (retval == 0) {
+        fb->samples += settings->samples_per_pixel;
+
+        if (settings->live != NULL) {
+            live_publish(settings->live, fb->samples, LIVE_RENDERING);
+        }
+    }
+
+    if ((retval == 0) && (settings->stats != NULL)) {
+        settings->stats->trace_seconds = cost_seconds() - start;
+        memset(&settings->stats->counters, 0, sizeof(perf_counts_t));
+
+        uint64_t primary_rays = 0;
+        uint64_t primary_tests = 0;
+
+        for (int t = 0; t < run_settings.threads; t++) {
+            perf_counts_add(&settings->stats->counters, &workers[t].counts);
+            primary_rays += workers[t].primary_rays + workers[t].wf.primary_rays;
+            primary_tests += workers[t].primary_tests + workers[t].wf.primary_tests;
+        }
+
+        settings->stats->mean_primary_tests = (primary_rays > 0) ? (double) primary_tests / (double) primary_rays : 0.0;
+    }
+
+    for (int t = 0; (workers != NULL) && (t < run_settings.threads); t++) {
+        wavefront_free(&workers[t].wf);
+        free(workers[t].pixels);
+    }
+
+    free(workers);
+    free(handles);
+    free(row_block);
+    framebuffer_free(&preview);
+    if (binned) {
+        tile_bins_free(&bins);
+    }
+
+    return retval;
+}
+
+/**
+ * @brief Render a frame in sample passes until a time budget runs out. The first pass traces
+ * a single sample so that there always is an image. Every following pass is sized from the
+ * mean cost of a sample so far to end before the deadline, and is at most as large as all
+ * earlier passes together, so that a bad estimate can only overshoot by a bounded amount.
+ * No pass is started once the next sample would not fit.
+ * 
+ * @param settings The render settings. samples_per_pixel caps the samples traced, and
+ * progressive rendering is not supported.
+ * @param budget_seconds The time from the call until rendering has to be done.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int rt_render_budget(const rt_scene_t *scene, const rt_camera_t *camera, const rt_settings_t *settings, framebuffer_t *fb, double budget_seconds) {
+    if ((settings == NULL) || settings->progressive || !(budget_seconds > 0.0)) {
+        return -1;
+    }
+
+    double start = cost_seconds();
+    double deadline = start + budget_seconds;
+    rt_settings_t pass = *settings;
+    rt_stats_t pass_stats;
+    perf_counts_t counters = { .available = 0 };
+    int done = 0;
+    int passes = 0;
+
+    pass.stats = &pass_stats;
+    pass.samples_per_pixel = 1;
+
+    for (;;) {
+        uint64_t pass_start = trace_begin();
+
+        if (rt_render(scene, camera, &pass, fb) != 0) {
+            return -1;
+        }
+
+        trace_end("render", "pass", pass_start, pass.samples_per_pixel);
+
+        done += pass.samples_per_pixel;
+        passes++;
+        perf_counts_add(&counters, &pass_stats.counters);
+
+        double now = cost_seconds();
+        double per_sample = (now - start) / done;
+        double fit = ((deadline - now) * RT_BUDGET_SAFETY) / per_sample;
+        int left = settings->samples_per_pixel - done;
+
+        if ((fit < 1.0) || (left < 1)) {
+            break;
+        }
+
+        pass.sample_offset = settings->sample_offset + (uint32_t) done;
+        pass.samples_per_pixel = (fit < done) ? (int) fit : done;
+
+        if (pass.samples_per_pixel > left) {
+            pass.samples_per_pixel = left;
+        }
+
+        // AOVs are written by the first sample only
+        pass.aov = NULL;
+    }
+
+    if (settings->stats != NULL) {
+        settings->stats->trace_seconds = cost_seconds() - start;
+        settings->stats->mean_primary_tests = pass_stats.mean_primary_tests;
+        settings->stats->samples_per_pixel = done;
+        settings->stats->passes = passes;
+        settings->stats->deadline_slack = deadline - cost_seconds();
+        settings->stats->counters = counters;
+    }
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+#ifndef RT_H
+#define RT_H
+
+#include "../vec3/vec3.h"
+#include "../sphere/sphere.h"
+#include "../hittable_list/hittable_list.h"
+#include "../grid/grid.h"
+#include "../bvh/bvh.h"
+#include "../compact/compact.h"
+#include "../framebuffer/framebuffer.h"
+#include "../aov/aov.h"
+#include "../cost/cost.h"
+#include "../material/material.h"
+#include "../scene/scene.h"
+#include "../light/light.h"
+#include "../perf/perf.h"
+#include "../trace/trace.h"
+#include "../numa/numa.h"
+#include "../live/live.h"
+
+#include <stdint.h>
+
+typedef enum {
+    RT_ACCEL_NONE,
+    RT_ACCEL_GRID,
+    RT_ACCEL_HASHGRID,
+
+    // Linear BVH built in parallel and refined by treelet restructuring
+    RT_ACCEL_BVH,
+
+    // Quantized sphere storage with 16 or 21 bits per axis, see compact.h. Emissive spheres
+    // stay exact, as lights are sampled by their geometry.
+    RT_ACCEL_COMPACT,
+    RT_ACCEL_COMPACT_21
+} rt_accel_t;
+
+// A scene ready for rendering. It owns copies of its spheres, their materials and any
+// acceleration structure, and is only read while rendering, so any amount of renders may share it.
+typedef struct rt_scene {
+    // All spheres, or only the emissive ones of compact scenes
+    sphere_t *spheres;
+    size_t sphere_count;
+    material_t *materials;
+    size_t material_count;
+    rt_accel_t accel;
+
+    // The emissive spheres, for light sampling
+    light_set_t lights;
+
+    hittable_t *hittables;
+    hittable_list_t list;
+    grid_t grid;
+    bvh_t bvh;
+    compact_t compact;
+    hittable_t world;
+
+    // Copies of the scene local to every node of a NUMA topology, see rt_scene_replicate
+    struct rt_scene *replicas;
+    int replica_count;
+} rt_scene_t;
+
+// A pinhole camera looking down -z. The viewport width follows from aspect_ratio, or from the
+// aspect ratio of the framebuffer being rendered if that is 0.
+typedef struct {
+    point3_t origin;
+    double viewport_height;
+    double focal_len;
+    double aspect_ratio;
+} rt_camera_t;
+
+typedef struct {
+    double trace_seconds;
+
+    // Sphere tests per primary ray, as counted by cost_counter while tracing
+    double mean_primary_tests;
+
+    // Filled by rt_render_budget: samples per pixel traced, the amount of passes they were
+    // traced in, and the time left before the deadline, negative if it was missed
+    int samples_per_pixel;
+    int passes;
+    double deadline_slack;
+
+    // Hardware counters summed over all render threads, if settings->perf_counters is set.
+    // No event is available if the counters could not be opened.
+    perf_counts_t counters;
+} rt_stats_t;
+
+typedef enum {
+    // Shade the first hit by its normal
+    RT_INTEGRATOR_NORMALS,
+
+    // Path tracing through the materials of the scene, one pixel at a time
+    RT_INTEGRATOR_PATH,
+
+    // The same paths traced breadth first with queued generate, intersect and shade stages
+    RT_INTEGRATOR_WAVEFRONT
+} rt_integrator_t;
+
+// A window of the frame spanning columns [x0, x1) and rows [y0, y1), with rows counted from
+// the top. An empty window stands for the whole frame.
+typedef struct {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} rt_window_t;
+
+typedef struct {
+    int samples_per_pixel;
+
+    // Index of the first sample, so that consecutive renders into one framebuffer trace new
+    // samples instead of repeating earlier ones
+    uint32_t sample_offset;
+
+    int threads;
+
+    rt_integrator_t integrator;
+
+    // Most bounces traced per path, and the bounces traced before Russian roulette may end
+    // paths early. An rr_depth of max_depth or more disables Russian roulette.
+    int max_depth;
+    int rr_depth;
+
+    // Sample lights at diffuse bounces with shadow rays, combined with the diffuse bounces
+    // through multiple importance sampling. Without it, paths only find lights by chance.
+    int light_sampling;
+
+    // Count hardware events with a perf_event_open counter group per render thread
+    int perf_counters;
+
+    // Spread render threads over the nodes of this topology and pin them there. Every node
+    // first touches a band of framebuffer rows and traces it before taking rows of other
+    // nodes, with the scene replica of the node if there is one. NULL for no placement.
+    const numa_topology_t *numa;
+
+    // Trace only this window of the frame. Rays follow the full frame mapping, so the window
+    // matches the same pixels of a full render.
+    rt_window_t crop;
+
+    // Size of the full frame if the framebuffer only holds the crop window, 0 if the
+    // framebuffer is the full frame
+    int frame_width;
+    int frame_height;
+
+    // Edge length of the tiles primary rays are binned into, 0 to disable binning
+    int tile_size;
+
+    // Trace coarse to fine, calling snapshot with an upsampled preview after every level, or
+    // every snapshot_interval seconds if that is positive
+    int progressive;
+    double snapshot_interval;
+    void (*snapshot) (void*, const framebuffer_t*);
+    void *snapshot_user;
+
+    // Called from the render threads with ranges of framebuffer rows [begin, end) that all
+    // samples of this render have been added to, in any order. Rows outside the crop window
+    // of a full size framebuffer are never reported.
+    void (*rows_done) (void*, int, int);
+    void *rows_done_user;
+
+    // Optional outputs. Cost maps need the framebuffer size and the per-pixel integrators,
+    // the wavefront integrator traces many pixels at once.
+    aov_buffers_t *aov;
+    cost_buffers_t *cost;
+    rt_stats_t *stats;
+
+    // Timeline to record passes, levels and row batches to. Worker t records to lane t + 1,
+    // and the calling thread to the lane it is attached to. Renders running at once need
+    // recorders of their own.
+    trace_recorder_t *trace;
+
+    // Live framebuffer the framebuffer being rendered lives in, see live_framebuffer. Rows are
+    // marked while render threads write to them, and the sample count is published after
+    // every render.
+    live_t *live;
+} rt_settings_t;
+
+#define RT_DEFAULT_MAX_DEPTH 50
+#define RT_DEFAULT_RR_DEPTH 3
+
+// Block size of the first, coarsest level of a progressive render
+#define RT_PROGRESSIVE_START_BLOCK 16
+
+int rt_scene_init(rt_scene_t *scene, const scene_desc_t *desc, rt_accel_t accel);
+
+void rt_scene_free(rt_scene_t *scene);
+
+int rt_scene_replicate(rt_scene_t *scene, const numa_topology_t *topology);
+
+void rt_camera_default(rt_camera_t *camera);
+
+void rt_default_settings(rt_settings_t *settings);
+
+int rt_render(const rt_scene_t *scene, const rt_camera_t *camera, const rt_settings_t *settings, framebuffer_t *fb);
+
+int rt_render_budget(const rt_scene_t *scene, const rt_camera_t *camera, const rt_settings_t *settings, framebuffer_t *fb, double budget_seconds);
+
+#endif
@@ -0,0 +1,351 @@
+#include "scene.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCENE_LINE_MAX 512
+#define SCENE_NAME_MAX 32
+
+void scene_desc_init(scene_desc_t *desc) {
+    if (desc == NULL) {
+        return;
+    }
+
+    desc->spheres = NULL;
+    desc->sphere_materials = NULL;
+    desc->sphere_count = 0;
+    desc->capacity = 0;
+
+    desc->materials = NULL;
+    desc->material_count = 0;
+    desc->material_capacity = 0;
+}
+
+void scene_desc_free(scene_desc_t *desc) {
+    if (desc == NULL) {
+        return;
+    }
+
+    free(desc->spheres);
+    free(desc->sphere_materials);
+    free(desc->materials);
+    scene_desc_init(desc);
+}
+
+/**
+ * @brief Append a sphere to a scene description, growing its storage as needed.
+ * 
+ * @param desc The scene description.
+ * @param sphere The sphere to append.
+ * @param material Index of the material of the sphere, or SCENE_DEFAULT_MATERIAL.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int scene_desc_add_sphere(scene_desc_t *desc, sphere_t sphere, size_t material) {
+    if ((desc == NULL) || ((material != SCENE_DEFAULT_MATERIAL) && (material >= desc->material_count))) {
+        return -1;
+    }
+
+    if (desc->sphere_count == desc->capacity) {
+        size_t capacity = (desc->capacity > 0) ? (2 * desc->capacity) : 16;
+        sphere_t *spheres = realloc(desc->spheres, capacity * sizeof(sphere_t));
+
+        if (spheres == NULL) {
+            return -1;
+        }
+
+        desc->spheres = spheres;
+
+        size_t *sphere_materials = realloc(desc->sphere_materials, capacity * sizeof(size_t));
+
+        if (sphere_materials == NULL) {
+            return -1;
+        }
+
+        desc->sphere_materials = sphere_materials;
+        desc->capacity = capacity;
+    }
+
+    sphere.material = NULL;
+    desc->spheres[desc->sphere_count] = sphere;
+    desc->sphere_materials[desc->sphere_count] = material;
+    desc->sphere_count++;
+
+    return 0;
+}
+
+/**
+ * @brief Append a material to a scene description, growing its storage as needed.
+ * 
+ * @param desc The scene description.
+ * @param material The material to append.
+ * @param index Receives the index of the material, may be NULL.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int scene_desc_add_material(scene_desc_t *desc, material_t material, size_t *index) {
+    if (desc == NULL) {
+        return -1;
+    }
+
+    if (desc->material_count == desc->material_capacity) {
+        size_t capacity = (desc->material_capacity > 0) ? (2 * desc->material_capacity) : 8;
+        material_t *materials = realloc(desc->materials, capacity * sizeof(material_t));
+
+        if (materials == NULL) {
+            return -1;
+        }
+
+        desc->materials = materials;
+        desc->material_capacity = capacity;
+    }
+
+    if (index != NULL) {
+        *index = desc->material_count;
+    }
+
+    desc->materials[desc->material_count++] = material;
+    return 0;
+}
+
+/**
+ * @brief Fill a scene description with the built-in scene, a small sphere resting on a large one.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int scene_desc_default(scene_desc_t *desc) {
+    if (desc == NULL) {
+        return -1;
+    }
+
+    scene_desc_init(desc);
+
+    if ((scene_desc_add_sphere(desc, sphere_init((point3_t) { 0, 0, -1 }, 0.5), SCENE_DEFAULT_MATERIAL) != 0) ||
+        (scene_desc_add_sphere(desc, sphere_init((point3_t) { 0, -100.5, -1 }, 100), SCENE_DEFAULT_MATERIAL) != 0)) {
+        scene_desc_free(desc);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse a material statement and add the material under its name.
+ * 
+ * @return Returns 0 on success, -1 on an invalid statement or error.
+ */
+static int scene_parse_material(scene_desc_t *desc, const char *line, char (**names)[SCENE_NAME_MAX]) {
+    char name[SCENE_NAME_MAX];
+    char type[16];
+    int offset = 0;
+
+    if (sscanf(line, "%*s %31s %15s %n", name, type, &offset) != 2) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < desc->material_count; i++) {
+        if (strcmp((*names)[i], name) == 0) {
+            return -1;
+        }
+    }
+
+    const char *args = line + offset;
+    material_t material;
+    color_t albedo;
+    double value;
+    char trailing;
+
+    if (strcmp(type, "diffuse") == 0) {
+        if (sscanf(args, "%lf %lf %lf %c", &albedo.r, &albedo.g, &albedo.b, &trailing) != 3) {
+            return -1;
+        }
+
+        material = material_diffuse(albedo);
+    } else if (strcmp(type, "metal") == 0) {
+        if ((sscanf(args, "%lf %lf %lf %lf %c", &albedo.r, &albedo.g, &albedo.b, &value, &trailing) != 4) || (value < 0.0)) {
+            return -1;
+        }
+
+        material = material_metal(albedo, value);
+    } else if (strcmp(type, "dielectric") == 0) {
+        if ((sscanf(args, "%lf %c", &value, &trailing) != 1) || !(value > 0.0)) {
+            return -1;
+        }
+
+        material = material_dielectric(value);
+    } else if (strcmp(type, "emissive") == 0) {
+        if ((sscanf(args, "%lf %lf %lf %c", &albedo.r, &albedo.g, &albedo.b, &trailing) != 3) ||
+            (albedo.r < 0.0) || (albedo.g < 0.0) || (albedo.b < 0.0)) {
+            return -1;
+        }
+
+        material = material_emissive(albedo);
+    } else {
+        return -1;
+    }
+
+    // Names grow alongside the materials of the description
+    char (*grown)[SCENE_NAME_MAX] = realloc(*names, (desc->material_count + 1) * sizeof(**names));
+
+    if (grown == NULL) {
+        return -1;
+    }
+
+    *names = grown;
+    strcpy((*names)[desc->material_count], name);
+
+    return scene_desc_add_material(desc, material, NULL);
+}
+
+/**
+ * @brief Parse a sphere statement and add the sphere with the named material, if any.
+ * 
+ * @return Returns 0 on success, -1 on an invalid statement or error.
+ */
+static int scene_parse_sphere(scene_desc_t *desc, const char *line, char (*names)[SCENE_NAME_MAX]) {
+    point3_t center;
+    double radius;
+    char name[SCENE_NAME_MAX];
+    char trailing;
+    size_t material = SCENE_DEFAULT_MATERIAL;
+
+    int fields = sscanf(line, "%*s %lf %lf %lf %lf %31s %c", &center.x, &center.y, &center.z, &radius, name, &trailing);
+
+    if (((fields != 4) && (fields != 5)) || !(radius > 0.0)) {
+        return -1;
+    }
+
+    if (fields == 5) {
+        for (material = 0; (material < desc->material_count) && (strcmp(names[material], name) != 0); material++);
+
+        if (material == desc->material_count) {
+            return -1;
+        }
+    }
+
+    return scene_desc_add_sphere(desc, sphere_init(center, radius), material);
+}
+
+/**
+ * @brief Load a scene description from a text file. Every line holds one statement, blank
+ * lines and lines starting with # are skipped. The statements are
+ * 
+ *     material NAME diffuse ALBEDO_R ALBEDO_G ALBEDO_B
+ *     material NAME metal ALBEDO_R ALBEDO_G ALBEDO_B FUZZ
+ *     material NAME dielectric INDEX_OF_REFRACTION
+ *     material NAME emissive RADIANCE_R RADIANCE_G RADIANCE_B
+ *     sphere CENTER_X CENTER_Y CENTER_Z RADIUS [MATERIAL]
+ * 
+ * Materials must be defined before the spheres using them. Spheres without one use a grey
+ * diffuse material.
+ * 
+ * @param desc The scene description to fill.
+ * @param filename The file to read.
+ * 
+ * @return Returns 0 on success, or -1 if the file cannot be read or holds an invalid statement.
+ */
+int scene_desc_load(scene_desc_t *desc, const char *filename) {
+    if ((desc == NULL) || (filename == NULL)) {
+        return -1;
+    }
+
+    FILE *file = fopen(filename, "r");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    char line[SCENE_LINE_MAX];
+    char (*names)[SCENE_NAME_MAX] = NULL;
+    int retval = 0;
+
+    scene_desc_init(desc);
+
+    while ((retval == 0) && (fgets(line, sizeof(line), file) != NULL)) {
+        char keyword[16];
+
+        if (sscanf(line, "%15s", keyword) != 1 || (keyword[0] == '#')) {
+            continue;
+        }
+
+        if (strcmp(keyword, "sphere") == 0) {
+            retval = scene_parse_sphere(desc, line, names);
+        } else if (strcmp(keyword, "material") == 0) {
+            retval = scene_parse_material(desc, line, &names);
+        } else {
+            retval = -1;
+        }
+    }
+
+    if (ferror(file)) {
+        retval = -1;
+    }
+
+    fclose(file);
+    free(names);
+
+    if (retval != 0) {
+        scene_desc_free(desc);
+    }
+
+    return retval;
+}
+
+/**
+ * @brief Write a scene description to a text file that scene_desc_load reads back exactly.
+ * Materials are named m0, m1 and so on after their index.
+ * 
+ * @param desc The scene description to write.
+ * @param filename The file to write.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int scene_desc_save(const scene_desc_t *desc, const char *filename) {
+    if ((desc == NULL) || (filename == NULL)) {
+        return -1;
+    }
+
+    FILE *file = fopen(filename, "w");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    int retval = 0;
+
+    for (size_t i = 0; (retval >= 0) && (i < desc->material_count); i++) {
+        const material_t *material = &desc->materials[i];
+
+        switch (material->type) {
+            case MATERIAL_DIFFUSE:
+                retval = fprintf(file, "material m%zu diffuse %.17g %.17g %.17g\n", i, material->albedo.r, material->albedo.g, material->albedo.b);
+                break;
+            case MATERIAL_METAL:
+                retval = fprintf(file, "material m%zu metal %.17g %.17g %.17g %.17g\n", i, material->albedo.r, material->albedo.g, material->albedo.b, material->fuzz);
+                break;
+            case MATERIAL_DIELECTRIC:
+                retval = fprintf(file, "material m%zu dielectric %.17g\n", i, material->ior);
+                break;
+            case MATERIAL_EMISSIVE:
+                retval = fprintf(file, "material m%zu emissive %.17g %.17g %.17g\n", i, material->emission.r, material->emission.g, material->emission.b);
+                break;
+        }
+    }
+
+    for (size_t i = 0; (retval >= 0) && (i < desc->sphere_count); i++) {
+        const sphere_t *sphere = &desc->spheres[i];
+
+        if (desc->sphere_materials[i] == SCENE_DEFAULT_MATERIAL) {
+            retval = fprintf(file, "sphere %.17g %.17g %.17g %.17g\n", sphere->center.x, sphere->center.y, sphere->center.z, sphere->radius);
+        } else {
+            retval = fprintf(file, "sphere %.17g %.17g %.17g %.17g m%zu\n", sphere->center.x, sphere->center.y, sphere->center.z, sphere->radius, desc->sphere_materials[i]);
+        }
+    }
+
+    if ((fclose(file) != 0) || (retval < 0)) {
+        remove(filename);
+        return -1;
+    }
+
+    return 0;
+}
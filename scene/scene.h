@@ -0,0 +1,39 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "../sphere/sphere.h"
+#include "../material/material.h"
+
+#include <stddef.h>
+
+// Material index of spheres using the default material
+#define SCENE_DEFAULT_MATERIAL ((size_t) -1)
+
+// The contents of a scene before it is built for rendering. Spheres refer to materials by
+// their index in sphere_materials, since the material array moves as it grows.
+typedef struct {
+    sphere_t *spheres;
+    size_t *sphere_materials;
+    size_t sphere_count;
+    size_t capacity;
+
+    material_t *materials;
+    size_t material_count;
+    size_t material_capacity;
+} scene_desc_t;
+
+void scene_desc_init(scene_desc_t *desc);
+
+void scene_desc_free(scene_desc_t *desc);
+
+int scene_desc_add_sphere(scene_desc_t *desc, sphere_t sphere, size_t material);
+
+int scene_desc_add_material(scene_desc_t *desc, material_t material, size_t *index);
+
+int scene_desc_default(scene_desc_t *desc);
+
+int scene_desc_load(scene_desc_t *desc, const char *filename);
+
+int scene_desc_save(const scene_desc_t *desc, const char *filename);
+
+#endif
@@ -0,0 +1,663 @@
+#include "serve.h"
+#include "../scene/scene.h"
+#include "../cost/cost.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVE_LISTEN_BACKLOG 64
+#define SERVE_POLL_MS 250
+#define SERVE_REQUEST_TIMEOUT_S 5
+
+// Most connections whose request line is still arriving. Further connections wait in the
+// listen backlog until one of them completes or times out.
+#define SERVE_MAX_PENDING 64
+#define SERVE_MAX_DIMENSION 16384
+#define SERVE_MAX_SAMPLES 65536
+
+// A built scene in the cache. Entries are only evicted while no job uses them.
+typedef struct serve_scene {
+    char id[sizeof(((serve_request_t*) 0)->scene)];
+    rt_scene_t scene;
+    int loading;
+    int users;
+    uint64_t last_used;
+    struct serve_scene *next;
+} serve_scene_t;
+
+// A queued job, owning the connection its result is sent to
+typedef struct serve_job {
+    int fd;
+    serve_request_t request;
+    struct serve_job *next;
+} serve_job_t;
+
+// A connection whose request line is still arriving, read without blocking by the accepting
+// thread so that a slow client never holds up the others
+typedef struct {
+    int fd;
+    size_t used;
+    double deadline;
+    char line[SERVE_REQUEST_MAX];
+} serve_pending_t;
+
+typedef struct {
+    const serve_settings_t *settings;
+    tonemap_t tonemap;
+
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_cond;
+    serve_job_t *queue_head;
+    serve_job_t *queue_tail;
+    int running;
+
+    pthread_mutex_t cache_lock;
+    pthread_cond_t cache_cond;
+    serve_scene_t *scenes;
+    size_t scene_count;
+    uint64_t use_clock;
+} serve_state_t;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_handle_signal(int signal) {
+    (void) signal;
+    serve_stop = 1;
+}
+
+/**
+ * @brief Write a render request as a single protocol line, including the newline.
+ * 
+ * @return Returns 0 on success, -1 if the request cannot be expressed or the line is too short.
+ */
+int serve_format_request(const serve_request_t *request, char *line, size_t len) {
+    if ((request == NULL) || (line == NULL) || (request->scene[0] == '\0') ||
+        (strpbrk(request->scene, " \t\r\n") != NULL) ||
+        ((request->format != IMAGE_FORMAT_PPM) && (request->format != IMAGE_FORMAT_QOI))) {
+        return -1;
+    }
+
+    int written = snprintf(line, len, "RENDER %s %d %d %d %s %.17g %.17g %.17g %.17g %.17g\n",
+        request->scene, request->width, request->height, request->samples,
+        (request->format == IMAGE_FORMAT_QOI) ? "qoi" : "ppm",
+        request->camera.origin.x, request->camera.origin.y, request->camera.origin.z,
+        request->camera.viewport_height, request->camera.focal_len);
+
+    if ((written < 0) || ((size_t) written >= len)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse and validate a protocol line into a render request.
+ * 
+ * @return Returns 0 on success, -1 on a malformed or out of range request.
+ */
+int serve_parse_request(const char *line, serve_request_t *request) {
+    if ((line == NULL) || (request == NULL)) {
+        return -1;
+    }
+
+    char format[8];
+    char trailing;
+
+    // The scene field width is SERVE_SCENE_ID_MAX - 1
+    int fields = sscanf(line, "RENDER %255s %d %d %d %7s %lf %lf %lf %lf %lf %c",
+        request->scene, &request->width, &request->height, &request->samples, format,
+        &request->camera.origin.x, &request->camera.origin.y, &request->camera.origin.z,
+        &request->camera.viewport_height, &request->camera.focal_len, &trailing);
+
+    if (fields != 10) {
+        return -1;
+    }
+
+    if (strcmp(format, "ppm") == 0) {
+        request->format = IMAGE_FORMAT_PPM;
+    } else if (strcmp(format, "qoi") == 0) {
+        request->format = IMAGE_FORMAT_QOI;
+    } else {
+        return -1;
+    }
+
+    request->camera.aspect_ratio = 0.0;
+
+    if ((request->width < 2) || (request->width > SERVE_MAX_DIMENSION) ||
+        (request->height < 2) || (request->height > SERVE_MAX_DIMENSION) ||
+        (request->samples < 1) || (request->samples > SERVE_MAX_SAMPLES) ||
+        !(request->camera.viewport_height > 0.0) || !(request->camera.focal_len > 0.0)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int serve_same_request(const serve_request_t *a, const serve_request_t *b) {
+    return (strcmp(a->scene, b->scene) == 0) && (a->width == b->width) && (a->height == b->height) &&
+        (a->samples == b->samples) && (a->format == b->format) &&
+        (a->camera.origin.x == b->camera.origin.x) && (a->camera.origin.y == b->camera.origin.y) &&
+        (a->camera.origin.z == b->camera.origin.z) && (a->camera.viewport_height == b->camera.viewport_height) &&
+        (a->camera.focal_len == b->camera.focal_len);
+}
+
+static void serve_send_error(int fd, const char *message) {
+    dprintf(fd, "ERR %s\n", message);
+    close(fd);
+}
+
+static int serve_build_scene(const serve_state_t *state, const char *id, rt_scene_t *scene) {
+    scene_desc_t desc;
+    int loaded = (strcmp(id, SERVE_DEFAULT_SCENE) == 0) ? scene_desc_default(&desc) : scene_desc_load(&desc, id);
+
+    if (loaded != 0) {
+        return -1;
+    }
+
+    int retval = rt_scene_init(scene, &desc, state->settings->accel);
+    scene_desc_free(&desc);
+
+    return retval;
+}
+
+// Drop least recently used scenes nobody is rendering until the cache fits. Called with cache_lock held.
+static void serve_evict_scenes(serve_state_t *state) {
+    while (state->scene_count > state->settings->scene_cache_size) {
+        serve_scene_t **victim = NULL;
+
+        for (serve_scene_t **it = &state->scenes; *it != NULL; it = &(*it)->next) {
+            if (((*it)->users == 0) && !(*it)->loading && ((victim == NULL) || ((*it)->last_used < (*victim)->last_used))) {
+                victim = it;
+            }
+        }
+
+        if (victim == NULL) {
+            return;
+        }
+
+        serve_scene_t *entry = *victim;
+        *victim = entry->next;
+        state->scene_count--;
+
+        rt_scene_free(&entry->scene);
+        free(entry);
+    }
+}
+
+/**
+ * @brief Get a built scene from the cache, loading and building it on a miss. Only the
+ * requesting worker waits for a scene being built, other workers keep using the cache.
+ * 
+ * @return Returns the cache entry, to be handed back with serve_release_scene, or NULL on error.
+ */
+static serve_scene_t *serve_acquire_scene(serve_state_t *state, const char *id) {
+    pthread_mutex_lock(&state->cache_lock);
+
+    for (;;) {
+        serve_scene_t *entry = state->scenes;
+
+        while ((entry != NULL) && (strcmp(entry->id, id) != 0)) {
+            entry = entry->next;
+        }
+
+        if ((entry != NULL) && entry->loading) {
+            pthread_cond_wait(&state->cache_cond, &state->cache_lock);
+            continue;
+        }
+
+        if (entry != NULL) {
+            entry->users++;
+            entry->last_used = ++state->use_clock;
+            pthread_mutex_unlock(&state->cache_lock);
+            return entry;
+        }
+
+        break;
+    }
+
+    serve_scene_t *entry = calloc(1, sizeof(serve_scene_t));
+
+    if (entry == NULL) {
+        pthread_mutex_unlock(&state->cache_lock);
+        return NULL;
+    }
+
+    // Never cache a scene under a truncated id, which another scene could share
+    int length = snprintf(entry->id, sizeof(entry->id), "%s", id);
+
+    if ((length < 0) || ((size_t) length >= sizeof(entry->id))) {
+        pthread_mutex_unlock(&state->cache_lock);
+        free(entry);
+        return NULL;
+    }
+
+    entry->loading = 1;
+    entry->users = 1;
+    entry->next = state->scenes;
+    state->scenes = entry;
+    state->scene_count++;
+
+    pthread_mutex_unlock(&state->cache_lock);
+
+    int built = serve_build_scene(state, id, &entry->scene);
+
+    pthread_mutex_lock(&state->cache_lock);
+
+    entry->loading = 0;
+    entry->last_used = ++state->use_clock;
+
+    if (built != 0) {
+        serve_scene_t **it = &state->scenes;
+
+        while (*it != entry) {
+            it = &(*it)->next;
+        }
+
+        *it = entry->next;
+        state->scene_count--;
+        free(entry);
+        entry = NULL;
+    }
+
+    pthread_cond_broadcast(&state->cache_cond);
+    pthread_mutex_unlock(&state->cache_lock);
+
+    return entry;
+}
+
+static void serve_release_scene(serve_state_t *state, serve_scene_t *entry) {
+    pthread_mutex_lock(&state->cache_lock);
+    entry->users--;
+    serve_evict_scenes(state);
+    pthread_mutex_unlock(&state->cache_lock);
+}
+
+/**
+ * @brief Render a batch of identical jobs once and send the encoded image to each of their
+ * connections, closing them.
+ */
+static void serve_render_batch(serve_state_t *state, serve_job_t *batch) {
+    serve_request_t request_copy = batch->request;
+    const serve_request_t *request = &request_copy;
+    serve_scene_t *entry = serve_acquire_scene(state, request->scene);
+    const char *error = NULL;
+    framebuffer_t fb = { .rgb = NULL };
+    uint8_t *image = NULL;
+    double start = cost_seconds();
+
+    if (entry == NULL) {
+        error = "could not load scene";
+    } else if ((framebuffer_init(&fb, request->width, request->height) != 0) ||
+               ((image = malloc((size_t) request->width * request->height * 3)) == NULL)) {
+        error = "out of memory";
+    } else {
+        rt_settings_t settings;
+
+        rt_default_settings(&settings);
+        settings.samples_per_pixel = request->samples;
+        settings.threads = 1;
+        settings.tile_size = state->settings->tile_size;
+
+        if (rt_render(&entry->scene, &request->camera, &settings, &fb) != 0) {
+            error = "render failed";
+        } else {
+            framebuffer_resolve(&fb, &state->tonemap, image, 0, fb.height);
+        }
+    }
+
+    if (entry != NULL) {
+        serve_release_scene(state, entry);
+    }
+
+    size_t clients = 0;
+
+    while (batch != NULL) {
+        serve_job_t *job = batch;
+        batch = batch->next;
+        clients++;
+
+        if (error != NULL) {
+            serve_send_error(job->fd, error);
+        } else {
+            FILE *stream = fdopen(job->fd, "w");
+
+            if (stream == NULL) {
+                close(job->fd);
+            } else {
+                fputs("OK\n", stream);
+                image_write(stream, request->format, image, request->width, request->height);
+                fclose(stream);
+            }
+        }
+
+        free(job);
+    }
+
+    printf("%s %dx%d, %d spp: %zu job(s) in %.2f ms%s%s\n", request->scene, request->width, request->height,
+        request->samples, clients, (cost_seconds() - start) * 1e3, (error != NULL) ? ", " : "", (error != NULL) ? error : "");
+    fflush(stdout);
+
+    framebuffer_free(&fb);
+    free(image);
+}
+
+static void *serve_worker(void *arg) {
+    serve_state_t *state = (serve_state_t*) arg;
+
+    for (;;) {
+        pthread_mutex_lock(&state->queue_lock);
+
+        while ((state->queue_head == NULL) && state->running) {
+            pthread_cond_wait(&state->queue_cond, &state->queue_lock);
+        }
+
+        if (state->queue_head == NULL) {
+            pthread_mutex_unlock(&state->queue_lock);
+            break;
+        }
+
+        serve_job_t *batch = state->queue_head;
+        serve_job_t *batch_tail = batch;
+        serve_job_t *last_kept = NULL;
+
+        state->queue_head = batch->next;
+        batch->next = NULL;
+
+        // Take every queued job asking for the same image along, it is only rendered once
+        for (serve_job_t **it = &state->queue_head; *it != NULL;) {
+            if (serve_same_request(&(*it)->request, &batch->request)) {
+                batch_tail->next = *it;
+                batch_tail = *it;
+                *it = (*it)->next;
+                batch_tail->next = NULL;
+            } else {
+                last_kept = *it;
+                it = &(*it)->next;
+            }
+        }
+
+        state->queue_tail = last_kept;
+
+        pthread_mutex_unlock(&state->queue_lock);
+
+        serve_render_batch(state, batch);
+    }
+
+    return NULL;
+}
+
+static void serve_queue_job(serve_state_t *state, int fd, const char *line) {
+    serve_job_t *job = malloc(sizeof(serve_job_t));
+
+    if (job == NULL) {
+        serve_send_error(fd, "out of memory");
+        return;
+    }
+
+    if (serve_parse_request(line, &job->request) != 0) {
+        free(job);
+        serve_send_error(fd, "malformed request");
+        return;
+    }
+
+    job->fd = fd;
+    job->next = NULL;
+
+    pthread_mutex_lock(&state->queue_lock);
+
+    if (state->queue_tail != NULL) {
+        state->queue_tail->next = job;
+    } else {
+        state->queue_head = job;
+    }
+    state->queue_tail = job;
+
+    pthread_cond_signal(&state->queue_cond);
+    pthread_mutex_unlock(&state->queue_lock);
+}
+
+/**
+ * @brief Read what has arrived of the request line of a pending connection, and queue its job
+ * once the line is complete. Workers write their results blocking, so the connection is
+ * switched back to blocking mode first.
+ * 
+ * @return Returns 1 once the connection is no longer pending, 0 while its line is incomplete.
+ */
+static int serve_read_pending(serve_state_t *state, serve_pending_t *pending) {
+    ssize_t got = recv(pending->fd, &pending->line[pending->used], sizeof(pending->line) - 1 - pending->used, 0);
+
+    if ((got < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+        return 0;
+    }
+
+    if (got <= 0) {
+        serve_send_error(pending->fd, "malformed request");
+        return 1;
+    }
+
+    pending->used += (size_t) got;
+    pending->line[pending->used] = '\0';
+
+    if (memchr(pending->line, '\n', pending->used) == NULL) {
+        if (pending->used + 1 < sizeof(pending->line)) {
+            return 0;
+        }
+
+        serve_send_error(pending->fd, "malformed request");
+        return 1;
+    }
+
+    fcntl(pending->fd, F_SETFL, fcntl(pending->fd, F_GETFL) & ~O_NONBLOCK);
+    serve_queue_job(state, pending->fd, pending->line);
+
+    return 1;
+}
+
+// Accept a connection as pending, its request line is read as it arrives
+static void serve_accept(int listen_fd, serve_pending_t *pending, size_t *pending_count) {
+    int fd = accept(listen_fd, NULL, NULL);
+
+    if (fd < 0) {
+        return;
+    }
+
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        serve_send_error(fd, "could not accept connection");
+        return;
+    }
+
+    serve_pending_t *entry = &pending[(*pending_count)++];
+    entry->fd = fd;
+    entry->used = 0;
+    entry->deadline = cost_seconds() + SERVE_REQUEST_TIMEOUT_S;
+    entry->line[0] = '\0';
+}
+
+static int serve_listen(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+
+    strcpy(addr.sun_path, path);
+
+    // Replace a stale socket left behind by an earlier server, but never any other file
+    if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if ((bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(fd, SERVE_LISTEN_BACKLOG) != 0)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Serve render jobs on a Unix domain socket until SIGINT or SIGTERM. A fixed pool of
+ * workers renders the queued jobs, batching jobs that ask for the same image, and built
+ * scenes stay cached between jobs.
+ * 
+ * @return Returns 0 after a clean shutdown, -1 if the server could not be started.
+ */
+int serve_run(const serve_settings_t *settings) {
+    if ((settings == NULL) || (settings->socket_path == NULL) || (settings->workers < 1)) {
+        return -1;
+    }
+
+    serve_state_t *state = calloc(1, sizeof(serve_state_t));
+    pthread_t *workers = malloc((size_t) settings->workers * sizeof(pthread_t));
+    serve_pending_t *pending = malloc(SERVE_MAX_PENDING * sizeof(serve_pending_t));
+    int listen_fd = serve_listen(settings->socket_path);
+
+    if ((state == NULL) || (workers == NULL) || (pending == NULL) || (listen_fd < 0)) {
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(settings->socket_path);
+        }
+        free(state);
+        free(workers);
+        free(pending);
+        return -1;
+    }
+
+    state->settings = settings;
+    state->running = 1;
+    tonemap_init(&state->tonemap, 1.0f, TONEMAP_CLAMP);
+    pthread_mutex_init(&state->queue_lock, NULL);
+    pthread_cond_init(&state->queue_cond, NULL);
+    pthread_mutex_init(&state->cache_lock, NULL);
+    pthread_cond_init(&state->cache_cond, NULL);
+
+    struct sigaction action = { .sa_handler = serve_handle_signal };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Workers inherit a mask without the shutdown signals, so only this thread handles them
+    sigset_t shutdown_signals, old_mask;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, &old_mask);
+
+    int started = 0;
+
+    for (int t = 0; t < settings->workers; t++) {
+        if (pthread_create(&workers[started], NULL, serve_worker, state) == 0) {
+            started++;
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    printf("Serving on %s with %d worker(s)\n", settings->socket_path, started);
+    fflush(stdout);
+
+    // The listening socket comes first in the poll set, followed by the pending connections.
+    // It is left out while the pending table is full.
+    struct pollfd pfds[SERVE_MAX_PENDING + 1];
+    size_t pending_count = 0;
+
+    while (!serve_stop && (started > 0)) {
+        int accepting = pending_count < SERVE_MAX_PENDING;
+
+        pfds[0] = (struct pollfd) { .fd = accepting ? listen_fd : -1, .events = POLLIN };
+
+        for (size_t i = 0; i < pending_count; i++) {
+            pfds[i + 1] = (struct pollfd) { .fd = pending[i].fd, .events = POLLIN };
+        }
+
+        if (poll(pfds, pending_count + 1, SERVE_POLL_MS) < 0) {
+            continue;
+        }
+
+        double now = cost_seconds();
+        size_t kept = 0;
+
+        // Finished and timed out connections are dropped from the table in place
+        for (size_t i = 0; i < pending_count; i++) {
+            int done = 0;
+
+            if (pfds[i + 1].revents != 0) {
+                done = serve_read_pending(state, &pending[i]);
+            } else if (now > pending[i].deadline) {
+                serve_send_error(pending[i].fd, "request timed out");
+                done = 1;
+            }
+
+            if (!done) {
+                pending[kept++] = pending[i];
+            }
+        }
+
+        pending_count = kept;
+
+        if (accepting && (pfds[0].revents & POLLIN)) {
+            serve_accept(listen_fd, pending, &pending_count);
+        }
+    }
+
+    close(listen_fd);
+
+    for (size_t i = 0; i < pending_count; i++) {
+        serve_send_error(pending[i].fd, "server shutting down");
+    }
+    unlink(settings->socket_path);
+
+    // Workers finish the queued jobs before exiting
+    pthread_mutex_lock(&state->queue_lock);
+    state->running = 0;
+    pthread_cond_broadcast(&state->queue_cond);
+    pthread_mutex_unlock(&state->queue_lock);
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+
+    while (state->queue_head != NULL) {
+        serve_job_t *job = state->queue_head;
+        state->queue_head = job->next;
+        serve_send_error(job->fd, "server shutting down");
+        free(job);
+    }
+
+    while (state->scenes != NULL) {
+        serve_scene_t *entry = state->scenes;
+        state->scenes = entry->next;
+        rt_scene_free(&entry->scene);
+        free(entry);
+    }
+
+    pthread_mutex_destroy(&state->queue_lock);
+    pthread_cond_destroy(&state->queue_cond);
+    pthread_mutex_destroy(&state->cache_lock);
+    pthread_cond_destroy(&state->cache_cond);
+    free(state);
+    free(workers);
+    free(pending);
+
+    printf("Server stopped\n");
+
+    return (started > 0) ? 0 : -1;
+}
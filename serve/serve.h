@@ -0,0 +1,52 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "../rt/rt.h"
+#include "../image/image.h"
+
+#include <stddef.h>
+
+// Longest scene ID, including the terminating null byte
+#define SERVE_SCENE_ID_MAX 256
+
+// Longest request line, including the newline
+#define SERVE_REQUEST_MAX 1024
+
+// Scene ID of the built-in scene, any other ID is the path of a scene file
+#define SERVE_DEFAULT_SCENE "default"
+
+// A render job. Clients send it as a single line
+// 
+//     RENDER SCENE WIDTH HEIGHT SAMPLES ppm|qoi ORIGIN_X ORIGIN_Y ORIGIN_Z VIEWPORT_HEIGHT FOCAL_LEN
+// 
+// and get back either "OK\n" followed by the encoded image up to the end of the connection,
+// or "ERR MESSAGE\n".
+typedef struct {
+    char scene[SERVE_SCENE_ID_MAX];
+    int width;
+    int height;
+    int samples;
+    image_format_t format;
+    rt_camera_t camera;
+} serve_request_t;
+
+typedef struct {
+    const char *socket_path;
+
+    // Resident render threads, each rendering one batch of jobs at a time
+    int workers;
+
+    // Most built scenes kept around after their jobs finished
+    size_t scene_cache_size;
+
+    rt_accel_t accel;
+    int tile_size;
+} serve_settings_t;
+
+int serve_format_request(const serve_request_t *request, char *line, size_t len);
+
+int serve_parse_request(const char *line, serve_request_t *request);
+
+int serve_run(const serve_settings_t *settings);
+
+#endif
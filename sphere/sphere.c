@@ -1,25 +1,23 @@
 #include "sphere.h"
 #include <math.h>
 
+sphere_t sphere_init(point3_t center, double radius) {
+    return (sphere_t) {
+        .center = center,
+        .radius = radius,
+        .inv_radius = 1.0 / radius,
+        .material = NULL
+    };
+}
+
 /**
- * @brief Check whether a given ray intersects a sphere with given min and max distance t. 
- * 
- * @param ptr A pointer to a valid sphere, cast to raw_hittable_data. 
- * @param r The ray to check with.
- * @param t_min The minimum distance from ray origin to check for.
- * @param t_max The maximum distance from ray origin to check for.
- * @param rec The structure to populate with hit data.
+ * @brief Find the nearest distance t within [t_min, t_max] at which a ray meets a sphere.
+ * Both roots are range-checked before dividing by a, so only an accepted root costs a
+ * division.
  * 
- * @return Returns 0 if the ray does not intersect the given sphere, 1 if it does, -1 on
- * error or invalid argument.
+ * @return Returns 1 and stores the distance in root if there is one, 0 otherwise.
  */
-int sphere_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
-    if ((ptr == NULL) || (rec == NULL)) {
-        return -1;
-    }
-
-    sphere_t *sphere_ptr = (sphere_t*) ptr;
-
+static int sphere_nearest_root(const sphere_t *sphere_ptr, ray_t r, double t_min, double t_max, double *root) {
     // A vector from the sphere center to the origin, or (A - C)
     vec3_t oc = vec3_sub(r.origin, sphere_ptr->center);
 
@@ -37,35 +35,107 @@ int sphere_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_r
 
     double sqrtd = sqrt(discriminant);
 
-    // Find the nearest root in the acceptable range
-    double root = (-half_b - sqrtd) / a;
+    // Find the nearest root in the acceptable range, comparing the numerators against the
+    // range scaled by a (which is positive)
+    double lo = t_min * a;
+    double hi = t_max * a;
+    double numerator = -half_b - sqrtd;
 
-    if ((root < t_min) || (t_max < root)) {
-        root = (-half_b + sqrtd) / a;
+    if ((numerator < lo) || (hi < numerator)) {
+        numerator = -half_b + sqrtd;
      
-        if ((root < t_min) || (t_max < root)) {
+        if ((numerator < lo) || (hi < numerator)) {
             return 0;
         }
     }
 
-    rec->t = root;
-    rec->p = ray_at(r, root);
-    rec->normal = vec3_scalar_div(vec3_sub(rec->p, sphere_ptr->center), sphere_ptr->radius);
+    *root = numerator / a;
+
+    return 1;
+}
+
+/**
+ * @brief Check whether a given ray intersects a sphere with given min and max distance t. 
+ * Only the distance and the sphere are recorded, the record is completed by sphere_finalize
+ * through hit_record_finalize. The record is left untouched if there is no hit.
+ * 
+ * @param ptr A pointer to a valid sphere, cast to raw_hittable_data. 
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * @param rec The structure to populate with hit data.
+ * 
+ * @return Returns 0 if the ray does not intersect the given sphere, 1 if it does, -1 on
+ * error or invalid argument.
+ */
+int sphere_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    if ((ptr == NULL) || (rec == NULL)) {
+        return -1;
+    }
+
+    sphere_t *sphere_ptr = (sphere_t*) ptr;
+    double root;
+
+    if (!sphere_nearest_root(sphere_ptr, r, t_min, t_max, &root)) {
+        return 0;
+    }
 
-    vec3_t outward_normal = vec3_scalar_div(vec3_sub(rec->p, sphere_ptr->center), sphere_ptr->radius);
-    hit_record_set_face_normal(&rec, r, outward_normal);
+    rec->t = root;
+    rec->prim = sphere_ptr;
+    rec->finalize = &sphere_finalize;
 
     return 1;
 }
 
+/**
+ * @brief Compute the hit point, normal, facing and material of a sphere hit recorded by sphere_hit.
+ * 
+ * @param prim A pointer to the sphere that was hit.
+ * @param r The ray the hit was found with.
+ * @param rec The hit record to complete, with t already set.
+ */
+void sphere_finalize(const void *prim, ray_t r, hit_record_t *rec) {
+    const sphere_t *sphere_ptr = (const sphere_t*) prim;
+
+    rec->p = ray_at(r, rec->t);
+
+    vec3_t outward_normal = vec3_scalar_mul(vec3_sub(rec->p, sphere_ptr->center), sphere_ptr->inv_radius);
+    hit_record_set_face_normal(rec, r, outward_normal);
+
+    rec->material = sphere_ptr->material;
+}
+
+/**
+ * @brief Check whether a given ray intersects a sphere anywhere between t_min and t_max,
+ * without computing any hit data.
+ * 
+ * @param ptr A pointer to a valid sphere, cast to raw_hittable_data. 
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * 
+ * @return Returns 0 if the ray does not intersect the given sphere, 1 if it does, -1 on
+ * error or invalid argument.
+ */
+int sphere_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max) {
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    double root;
+
+    return sphere_nearest_root((sphere_t*) ptr, r, t_min, t_max, &root);
+}
+
 hittable_t sphere_to_hittable(sphere_t *sphere) {
     if (sphere == NULL) {
-        return (hittable_t) { .ptr = NULL, .size = 0, .hit = NULL };
+        return (hittable_t) { .ptr = NULL, .size = 0, .hit = NULL, .occluded = NULL };
     }
 
     return (hittable_t) {
         .ptr = sphere,
         .size = sizeof(sphere_t),
-        .hit = &sphere_hit
+        .hit = &sphere_hit,
+        .occluded = &sphere_occluded
     };
 }
@@ -6,10 +6,22 @@
 typedef struct {
     point3_t center;
     double radius;
+
+    // Precomputed so that normals need no division, set by sphere_init
+    double inv_radius;
+
+    // NULL for the default material
+    const struct material *material;
 } sphere_t;
 
+sphere_t sphere_init(point3_t center, double radius);
+
 int sphere_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec);
 
+void sphere_finalize(const void *prim, ray_t r, hit_record_t *rec);
+
+int sphere_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max);
+
 hittable_t sphere_to_hittable(sphere_t *sphere);
 
 #endif
@@ -0,0 +1,392 @@
+#include "tile_bin.h"
+#include "../cost/cost.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Primary rays per tile edge traced through the fallback to estimate its cost in a tile
+#define TILE_BIN_FALLBACK_SAMPLES 3
+
+typedef struct {
+    int lo_i, hi_i;
+    int lo_j, hi_j;
+} tile_rect_t;
+
+/**
+ * @brief Project the bounds of a sphere along one image axis. The sphere's extent along the
+ * axis is found from the two tangent lines through the camera origin, measured in the plane
+ * spanned by the axis and the viewing direction, and converted into a pixel index range.
+ * 
+ * @return Returns 1 if the projected range overlaps the image, 0 otherwise.
+ */
+static int tile_bins_project_axis(vec3_t axis_vec, int pixels, vec3_t to_center, double radius, vec3_t forward, double focal_dist, vec3_t principal, int *lo, int *hi) {
+    double extent = vec3_len(axis_vec);
+    vec3_t e = vec3_scalar_div(axis_vec, extent);
+
+    double x = vec3_dot(to_center, e);
+    double z = vec3_dot(to_center, forward);
+
+    double theta = atan2(x, z);
+    double delta = asin(radius / sqrt((x * x) + (z * z)));
+
+    double offset = vec3_dot(principal, e);
+    double u_lo = ((focal_dist * tan(theta - delta)) + offset) / extent;
+    double u_hi = ((focal_dist * tan(theta + delta)) + offset) / extent;
+
+    // Pad by a pixel on each side so jittered sample positions stay inside the tile's bin
+    double p_lo = floor(u_lo * (pixels - 1)) - 1.0;
+    double p_hi = ceil(u_hi * (pixels - 1)) + 1.0;
+
+    if ((p_hi < 0.0) || (p_lo > (pixels - 1))) {
+        return 0;
+    }
+
+    *lo = (p_lo < 0.0) ? 0 : (int) p_lo;
+    *hi = (p_hi > (pixels - 1)) ? (pixels - 1) : (int) p_hi;
+
+    return 1;
+}
+
+/**
+ * @brief Find the pixel rectangle a sphere covers on the image plane of a pinhole camera.
+ * The camera's horizontal and vertical vectors are assumed to be orthogonal to each other
+ * and to the viewing direction, which holds for every camera built by this renderer.
+ * 
+ * @return Returns 1 if the rectangle is valid, 0 if the sphere cannot be seen by any primary
+ * ray, -1 if the sphere straddles the plane of the camera and has to go in every bin.
+ */
+static int tile_bins_project(camera_t camera, int image_width, int image_height, const sphere_t *sphere, tile_rect_t *rect) {
+    vec3_t to_plane_center = vec3_add(vec3_sub(camera.lower_left_corner, camera.origin),
+                                      vec3_add(vec3_scalar_mul(camera.horizontal, 0.5), vec3_scalar_mul(camera.vertical, 0.5)));
+    vec3_t forward = vec3_unit_vec(to_plane_center);
+    double focal_dist = vec3_dot(to_plane_center, forward);
+
+    vec3_t to_center = vec3_sub(sphere->center, camera.origin);
+    double depth = vec3_dot(to_center, forward);
+    double radius = fabs(sphere->radius);
+
+    if (depth < -radius) {
+        return 0;
+    }
+
+    if ((depth <= radius) || (focal_dist <= 0.0)) {
+        return -1;
+    }
+
+    // Offset of the point the viewing direction pierces, relative to the lower left corner
+    vec3_t principal = vec3_sub(vec3_add(camera.origin, vec3_scalar_mul(forward, focal_dist)), camera.lower_left_corner);
+
+    if (!tile_bins_project_axis(camera.horizontal, image_width, to_center, radius, forward, focal_dist, principal, &rect->lo_i, &rect->hi_i)) {
+        return 0;
+    }
+
+    if (!tile_bins_project_axis(camera.vertical, image_height, to_center, radius, forward, focal_dist, principal, &rect->lo_j, &rect->hi_j)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Bin the spheres of a scene into per-tile candidate lists by projecting their bounds
+ * onto the image plane. Only rays through the pixel grid of the given camera (primary rays)
+ * may be traced against the resulting bins. The bins only reference the sphere array, which
+ * has to outlive them.
+ * 
+ * @param bins The bins structure to initialize. Its fallback starts out disabled.
+ * @param camera The camera that primary rays are generated with.
+ * @param image_width The width of the image in pixels.
+ * @param image_height The height of the image in pixels.
+ * @param tile_size The edge length of a square tile in pixels.
+ * @param spheres The spheres to bin.
+ * @param sphere_count The amount of spheres in the array.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int tile_bins_build(tile_bins_t *bins, camera_t camera, int image_width, int image_height, int tile_size, sphere_t *spheres, size_t sphere_count) {
+    if ((bins == NULL) || ((spheres == NULL) && (sphere_count > 0)) || (sphere_count >= UINT32_MAX) ||
+        (image_width < 2) || (image_height < 2) || (tile_size < 1)) {
+        return -1;
+    }
+
+    memset(bins, 0, sizeof(tile_bins_t));
+    bins->spheres = spheres;
+    bins->sphere_count = sphere_count;
+    bins->image_width = image_width;
+    bins->image_height = image_height;
+    bins->tile_size = tile_size;
+    bins->tiles_x = (image_width + tile_size - 1) / tile_size;
+    bins->tiles_y = (image_height + tile_size - 1) / tile_size;
+
+    size_t tile_count = (size_t) bins->tiles_x * bins->tiles_y;
+    tile_rect_t *rects = malloc(((sphere_count > 0) ? sphere_count : 1) * sizeof(tile_rect_t));
+    bins->bin_start = calloc(tile_count + 1, sizeof(uint32_t));
+
+    if ((rects == NULL) || (bins->bin_start == NULL)) {
+        free(rects);
+        tile_bins_free(bins);
+        return -1;
+    }
+
+    // Convert every sphere's pixel rectangle into a tile rectangle and count references
+    size_t ref_count = 0;
+
+    for (size_t i = 0; i < sphere_count; i++) {
+        tile_rect_t *rect = &rects[i];
+        int visible = tile_bins_project(camera, image_width, image_height, &spheres[i], rect);
+
+        if (visible == 0) {
+            *rect = (tile_rect_t) { .lo_i = 0, .hi_i = -1, .lo_j = 0, .hi_j = -1 };
+            continue;
+        }
+
+        if (visible < 0) {
+            *rect = (tile_rect_t) { .lo_i = 0, .hi_i = bins->tiles_x - 1, .lo_j = 0, .hi_j = bins->tiles_y - 1 };
+        } else {
+            rect->lo_i /= tile_size;
+            rect->hi_i /= tile_size;
+            rect->lo_j /= tile_size;
+            rect->hi_j /= tile_size;
+        }
+
+        for (int ty = rect->lo_j; ty <= rect->hi_j; ty++) {
+            for (int tx = rect->lo_i; tx <= rect->hi_i; tx++) {
+                bins->bin_start[((size_t) ty * bins->tiles_x) + tx]++;
+                ref_count++;
+            }
+        }
+    }
+
+    if (ref_count >= UINT32_MAX) {
+        free(rects);
+        tile_bins_free(bins);
+        return -1;
+    }
+
+    for (size_t k = 1; k < tile_count; k++) {
+        bins->bin_start[k] += bins->bin_start[k - 1];
+    }
+    bins->bin_start[tile_count] = (uint32_t) ref_count;
+
+    bins->prim_indices = malloc(((ref_count > 0) ? ref_count : 1) * sizeof(uint32_t));
+    if (bins->prim_indices == NULL) {
+        free(rects);
+        tile_bins_free(bins);
+        return -1;
+    }
+
+    // Fill back to front, which turns every end offset into a start offset
+    for (size_t i = sphere_count; i-- > 0;) {
+        for (int ty = rects[i].lo_j; ty <= rects[i].hi_j; ty++) {
+            for (int tx = rects[i].lo_i; tx <= rects[i].hi_i; tx++) {
+                bins->prim_indices[--bins->bin_start[((size_t) ty * bins->tiles_x) + tx]] = (uint32_t) i;
+            }
+        }
+    }
+
+    free(rects);
+
+    return 0;
+}
+
+/**
+ * @brief Let the primary rays of every tile take whichever of its bin and a global
+ * accelerator tests fewer spheres. A bin costs every ray a test per candidate, while the
+ * accelerator's cost is measured by tracing a few primary rays spread over the tile through
+ * it, so empty and sparse bins are kept and crowded ones fall back.
+ * 
+ * @param bins The built bins to set the fallback of.
+ * @param fallback The accelerator holding the same spheres as the bins.
+ * @param camera The camera the bins were built with.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int tile_bins_set_fallback(tile_bins_t *bins, hittable_t fallback, camera_t camera) {
+    if ((bins == NULL) || (bins->bin_start == NULL) || (fallback.hit == NULL)) {
+        return -1;
+    }
+
+    size_t tile_count = (size_t) bins->tiles_x * bins->tiles_y;
+    uint8_t *use_fallback = malloc(tile_count);
+
+    if (use_fallback == NULL) {
+        return -1;
+    }
+
+    int samples = (bins->tile_size < TILE_BIN_FALLBACK_SAMPLES) ? bins->tile_size : TILE_BIN_FALLBACK_SAMPLES;
+
+    // The measurement is not part of any render, so leave no trace of it in the counters
+    cost_counter_t counted = cost_counter;
+    hit_record_t rec;
+
+    for (size_t k = 0; k < tile_count; k++) {
+        int x0 = (int) (k % bins->tiles_x) * bins->tile_size;
+        int y0 = (int) (k / bins->tiles_x) * bins->tile_size;
+        int w = ((x0 + bins->tile_size) > bins->image_width) ? (bins->image_width - x0) : bins->tile_size;
+        int h = ((y0 + bins->tile_size) > bins->image_height) ? (bins->image_height - y0) : bins->tile_size;
+
+        uint64_t candidates = bins->bin_start[k + 1] - bins->bin_start[k];
+
+        if (candidates == 0) {
+            use_fallback[k] = 0;
+            continue;
+        }
+
+        uint64_t budget = candidates * samples * samples;
+        uint64_t tests = cost_counter.tests;
+
+        // Stop as soon as the accelerator has used up what the bin would have cost the rays
+        for (int sy = 0; (sy < samples) && ((cost_counter.tests - tests) <= budget); sy++) {
+            for (int sx = 0; (sx < samples) && ((cost_counter.tests - tests) <= budget); sx++) {
+                int i = x0 + (((2 * sx) + 1) * w) / (2 * samples);
+                int j = y0 + (((2 * sy) + 1) * h) / (2 * samples);
+                ray_t r = get_ray(camera, (double) i / (bins->image_width - 1), (double) j / (bins->image_height - 1));
+
+                fallback.hit(fallback.ptr, r, 0, INFINITY, &rec);
+            }
+        }
+
+        use_fallback[k] = ((cost_counter.tests - tests) < budget);
+    }
+
+    cost_counter = counted;
+
+    free(bins->use_fallback);
+    bins->fallback = fallback;
+    bins->use_fallback = use_fallback;
+
+    return 0;
+}
+
+void tile_bins_free(tile_bins_t *bins) {
+    if (bins == NULL) {
+        return;
+    }
+
+    free(bins->bin_start);
+    free(bins->prim_indices);
+    free(bins->use_fallback);
+
+    bins->bin_start = NULL;
+    bins->prim_indices = NULL;
+    bins->use_fallback = NULL;
+}
+
+/**
+ * @brief Get the bin of the tile containing pixel (i, j), where i counts columns from the
+ * left and j counts rows from the bottom, matching the u/v components passed to get_ray.
+ */
+tile_bin_t tile_bins_lookup(const tile_bins_t *bins, int i, int j) {
+    if (bins == NULL) {
+        return (tile_bin_t) { .bins = NULL, .tile = 0 };
+    }
+
+    return (tile_bin_t) {
+        .bins = bins,
+        .tile = ((size_t) (j / bins->tile_size) * bins->tiles_x) + (i / bins->tile_size)
+    };
+}
+
+/**
+ * @brief Find the closest intersection of a primary ray with the candidate spheres of its
+ * tile, or with the global accelerator if that was found to be cheaper for the tile.
+ * 
+ * @param ptr A pointer to a valid tile bin, cast to raw_hittable_data.
+ * @param r The primary ray to check with. It has to pass through the tile's pixels.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * @param rec The structure to populate with data of the closest hit.
+ * 
+ * @return Returns 0 if the ray does not intersect any candidate sphere, 1 if it does, -1 on
+ * error or invalid argument.
+ */
+int tile_bin_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec) {
+    if ((ptr == NULL) || (rec == NULL)) {
+        return -1;
+    }
+
+    tile_bin_t *bin = (tile_bin_t*) ptr;
+    const tile_bins_t *bins = bin->bins;
+
+    if (bins == NULL) {
+        return -1;
+    }
+
+    uint32_t start = bins->bin_start[bin->tile];
+    uint32_t end = bins->bin_start[bin->tile + 1];
+
+    if ((bins->use_fallback != NULL) && bins->use_fallback[bin->tile]) {
+        return bins->fallback.hit(bins->fallback.ptr, r, t_min, t_max, rec);
+    }
+
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    cost_counter.steps++;
+    cost_counter.tests += end - start;
+
+    for (uint32_t i = start; i < end; i++) {
+        if (sphere_hit(&bins->spheres[bins->prim_indices[i]], r, t_min, closest_so_far, rec) == 1) {
+            hit_anything = 1;
+            closest_so_far = rec->t;
+        }
+    }
+
+    return hit_anything;
+}
+
+/**
+ * @brief Check whether any candidate sphere of a tile blocks a ray between t_min and t_max.
+ * Like tile_bin_hit, this is only valid for rays passing through the tile's pixels.
+ * 
+ * @param ptr A pointer to a valid tile bin, cast to raw_hittable_data.
+ * @param r The ray to check with.
+ * @param t_min The minimum distance from ray origin to check for.
+ * @param t_max The maximum distance from ray origin to check for.
+ * 
+ * @return Returns 0 if the ray is unobstructed, 1 if it is, -1 on error or invalid argument.
+ */
+int tile_bin_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max) {
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    tile_bin_t *bin = (tile_bin_t*) ptr;
+    const tile_bins_t *bins = bin->bins;
+
+    if (bins == NULL) {
+        return -1;
+    }
+
+    uint32_t start = bins->bin_start[bin->tile];
+    uint32_t end = bins->bin_start[bin->tile + 1];
+
+    if ((bins->use_fallback != NULL) && bins->use_fallback[bin->tile]) {
+        return hittable_occluded(&bins->fallback, r, t_min, t_max);
+    }
+
+    cost_counter.steps++;
+
+    for (uint32_t i = start; i < end; i++) {
+        if (sphere_occluded(&bins->spheres[bins->prim_indices[i]], r, t_min, t_max) == 1) {
+            cost_counter.tests += i - start + 1;
+            return 1;
+        }
+    }
+
+    cost_counter.tests += end - start;
+    return 0;
+}
+
+hittable_t tile_bin_to_hittable(tile_bin_t *bin) {
+    if (bin == NULL) {
+        return (hittable_t) { .ptr = NULL, .size = 0, .hit = NULL, .occluded = NULL };
+    }
+
+    return (hittable_t) {
+        .ptr = bin,
+        .size = sizeof(tile_bin_t),
+        .hit = &tile_bin_hit,
+        .occluded = &tile_bin_occluded
+    };
+}
@@ -0,0 +1,52 @@
+#ifndef TILE_BIN_H
+#define TILE_BIN_H
+
+#include "../hittable.h"
+#include "../sphere/sphere.h"
+#include "../camera/camera.h"
+
+#include <stdint.h>
+
+typedef struct {
+    sphere_t *spheres;
+    size_t sphere_count;
+
+    int image_width;
+    int image_height;
+    int tile_size;
+    int tiles_x;
+    int tiles_y;
+
+    // The candidate spheres of tile k are prim_indices[bin_start[k]] up to, but excluding,
+    // prim_indices[bin_start[k + 1]]
+    uint32_t *bin_start;
+    uint32_t *prim_indices;
+
+    // Optional global accelerator, traced instead of the bins of tiles flagged in
+    // use_fallback. Both are set by tile_bins_set_fallback, leave use_fallback NULL to
+    // always test the bin.
+    hittable_t fallback;
+    uint8_t *use_fallback;
+} tile_bins_t;
+
+// Handle to the bin of a single tile, which is what primary rays are traced against
+typedef struct {
+    const tile_bins_t *bins;
+    size_t tile;
+} tile_bin_t;
+
+int tile_bins_build(tile_bins_t *bins, camera_t camera, int image_width, int image_height, int tile_size, sphere_t *spheres, size_t sphere_count);
+
+int tile_bins_set_fallback(tile_bins_t *bins, hittable_t fallback, camera_t camera);
+
+void tile_bins_free(tile_bins_t *bins);
+
+tile_bin_t tile_bins_lookup(const tile_bins_t *bins, int i, int j);
+
+int tile_bin_hit(raw_hittable_data ptr, ray_t r, double t_min, double t_max, hit_record_t *rec);
+
+int tile_bin_occluded(raw_hittable_data ptr, ray_t r, double t_min, double t_max);
+
+hittable_t tile_bin_to_hittable(tile_bin_t *bin);
+
+#endif
@@ -0,0 +1,180 @@
+#include "trace.h"
+#include "../cost/cost.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local trace_lane_t *trace_lane;
+
+/**
+ * @brief Set up a recorder with a fixed amount of lanes, each holding a ring of events.
+ * Recording starts right away, and all timestamps are relative to this call.
+ * 
+ * @param recorder The recorder to initialize.
+ * @param lane_count The amount of timelines, usually one per thread.
+ * @param events_per_lane How many of the latest events every lane keeps.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int trace_init(trace_recorder_t *recorder, int lane_count, size_t events_per_lane) {
+    if ((recorder == NULL) || (lane_count < 1) || (events_per_lane < 1)) {
+        return -1;
+    }
+
+    recorder->lane_count = lane_count;
+    recorder->lanes = calloc((size_t) lane_count, sizeof(trace_lane_t));
+
+    if (recorder->lanes == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < lane_count; i++) {
+        recorder->lanes[i].capacity = events_per_lane;
+        recorder->lanes[i].events = malloc(events_per_lane * sizeof(trace_event_t));
+
+        if (recorder->lanes[i].events == NULL) {
+            trace_free(recorder);
+            return -1;
+        }
+
+        snprintf(recorder->lanes[i].name, sizeof(recorder->lanes[i].name), "thread %d", i);
+    }
+
+    recorder->start_ticks = cost_timestamp();
+    recorder->start_seconds = cost_seconds();
+
+    return 0;
+}
+
+void trace_free(trace_recorder_t *recorder) {
+    if ((recorder == NULL) || (recorder->lanes == NULL)) {
+        return;
+    }
+
+    for (int i = 0; i < recorder->lane_count; i++) {
+        free(recorder->lanes[i].events);
+    }
+
+    free(recorder->lanes);
+    recorder->lanes = NULL;
+    recorder->lane_count = 0;
+}
+
+/**
+ * @brief Look up a lane of a recorder and name it.
+ * 
+ * @param name The name the lane is shown with, may be NULL to keep the current one.
+ * 
+ * @return Returns the lane, or NULL if the recorder is NULL or has no such lane.
+ */
+trace_lane_t *trace_get_lane(trace_recorder_t *recorder, int lane, const char *name) {
+    if ((recorder == NULL) || (lane < 0) || (lane >= recorder->lane_count)) {
+        return NULL;
+    }
+
+    if (name != NULL) {
+        snprintf(recorder->lanes[lane].name, sizeof(recorder->lanes[lane].name), "%s", name);
+    }
+
+    return &recorder->lanes[lane];
+}
+
+/**
+ * @brief Send the events of the calling thread to a lane. Threads running one after another
+ * may share a lane, but no two threads may write to it at once.
+ * 
+ * @param lane The lane to record to, or NULL to stop recording.
+ * 
+ * @return Returns the lane the thread recorded to before, so that it can be restored.
+ */
+trace_lane_t *trace_attach(trace_lane_t *lane) {
+    trace_lane_t *previous = trace_lane;
+    trace_lane = lane;
+    return previous;
+}
+
+/**
+ * @brief Start a span on the calling thread.
+ * 
+ * @return Returns the timestamp to pass to trace_end, 0 if the thread is not traced.
+ */
+uint64_t trace_begin() {
+    return (trace_lane != NULL) ? cost_timestamp() : 0;
+}
+
+/**
+ * @brief End a span started with trace_begin and record it, overwriting the oldest event of
+ * the lane if it is full. Does nothing if the thread is not traced.
+ * 
+ * @param arg A number shown with the event, such as the first row of a batch.
+ */
+void trace_end(const char *category, const char *name, uint64_t begin, int64_t arg) {
+    trace_lane_t *lane = trace_lane;
+
+    if (lane == NULL) {
+        return;
+    }
+
+    lane->events[lane->written % lane->capacity] = (trace_event_t) {
+        .category = category,
+        .name = name,
+        .begin = begin,
+        .end = cost_timestamp(),
+        .arg = arg
+    };
+    lane->written++;
+}
+
+/**
+ * @brief Write all recorded events in the Chrome trace event format, which chrome://tracing
+ * and Perfetto open. Every lane becomes a thread of one process, and timestamp ticks are
+ * converted to microseconds with the tick rate measured between trace_init and this call.
+ * Must not be called while threads are recording.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int trace_write(const trace_recorder_t *recorder, const char *filename) {
+    if ((recorder == NULL) || (recorder->lanes == NULL) || (filename == NULL)) {
+        return -1;
+    }
+
+    double elapsed = cost_seconds() - recorder->start_seconds;
+    uint64_t ticks = cost_timestamp() - recorder->start_ticks;
+    double us_per_tick = ((elapsed > 0.0) && (ticks > 0)) ? ((elapsed * 1e6) / ticks) : 1e-3;
+
+    FILE *file = fopen(filename, "w");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"raytracer\"}}");
+
+    for (int i = 0; i < recorder->lane_count; i++) {
+        const trace_lane_t *lane = &recorder->lanes[i];
+        uint64_t kept = (lane->written < lane->capacity) ? lane->written : lane->capacity;
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i, lane->name);
+        fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", i, i);
+
+        // Oldest first, starting after the last overwritten event
+        for (uint64_t e = lane->written - kept; e < lane->written; e++) {
+            const trace_event_t *event = &lane->events[e % lane->capacity];
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%lld}}",
+                    event->name, event->category, i, (double) (event->begin - recorder->start_ticks) * us_per_tick,
+                    (double) (event->end - event->begin) * us_per_tick, (long long) event->arg);
+        }
+
+        if (lane->written > kept) {
+            fprintf(file, ",\n{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":0,\"args\":{\"count\":%llu}}",
+                    i, (unsigned long long) (lane->written - kept));
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    int retval = ferror(file) ? -1 : 0;
+    return (fclose(file) != 0) ? -1 : retval;
+}
@@ -0,0 +1,52 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A span of work on one thread. Name and category have to outlive the recorder, so they are
+// meant to be string literals.
+typedef struct {
+    const char *category;
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    int64_t arg;
+} trace_event_t;
+
+// Events of one timeline lane, written only by the thread attached to it. The ring keeps the
+// latest capacity events and counts the ones it overwrote, so it needs no locking.
+typedef struct {
+    char name[32];
+    trace_event_t *events;
+    size_t capacity;
+    uint64_t written;
+} trace_lane_t;
+
+// Timeline of a run, with timestamps converted to wall time against the monotonic clock the
+// recorder was started with
+typedef struct {
+    trace_lane_t *lanes;
+    int lane_count;
+    uint64_t start_ticks;
+    double start_seconds;
+} trace_recorder_t;
+
+// The lane events of the calling thread go to, or NULL if it is not traced
+extern _Thread_local trace_lane_t *trace_lane;
+
+int trace_init(trace_recorder_t *recorder, int lane_count, size_t events_per_lane);
+
+void trace_free(trace_recorder_t *recorder);
+
+trace_lane_t *trace_get_lane(trace_recorder_t *recorder, int lane, const char *name);
+
+trace_lane_t *trace_attach(trace_lane_t *lane);
+
+uint64_t trace_begin();
+
+void trace_end(const char *category, const char *name, uint64_t begin, int64_t arg);
+
+int trace_write(const trace_recorder_t *recorder, const char *filename);
+
+#endif
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+
+void print_usage() {
+    printf( "Usage:\n\t"
+            "raytracer [OPTIONS] [FILE]\n\t"
+            "Where FILE is a filename ending with .ppm or .qoi\n"
+            "Options:\n\t"
+            "--accel none|grid|hashgrid|bvh|compact|compact21\n\t\t\t\tSpatial structure used to intersect the scene, the compact ones storing\n\t\t\t\tspheres quantized to 16 or 21 bits per axis in about 10 bytes (default: none)\n\t"
+            "--integrator normals|path|wavefront\tShade by first-hit normal, or path trace per pixel or breadth first (default: normals)\n\t"
+            "--max-depth N\t\t\tMost bounces per path of the path tracing integrators (default: 50)\n\t"
+            "--rr-depth N\t\t\tBounces before Russian roulette may end paths, max depth or more to disable (default: 3)\n\t"
+            "--no-light-sampling\t\tOnly find emissive spheres by bouncing into them, without shadow rays\n\t"
+            "--tile-bins SIZE\t\tCull primary rays with per-tile candidate lists of SIZE x SIZE pixel tiles\n\t"
+            "--crop X0,Y0,X1,Y1\t\tTrace only columns X0 to X1 and rows Y0 to Y1 (exclusive, from the top)\n\t"
+            "--crop-full\t\t\tWrite the full image with everything outside the crop left black\n\t"
+            "--samples N\t\t\tTrace N jittered samples per pixel (default: 1)\n\t"
+            "--time-budget MS\t\tTrace as many samples as fit so the image is written within MS milliseconds\n\t"
+            "--exposure X\t\t\tScale pixel values by X before tone mapping (default: 1)\n\t"
+            "--tonemap clamp|reinhard|aces\tTone mapping operator applied before sRGB gamma (default: clamp)\n\t"
+            "--denoise\t\t\tFilter the image guided by first-hit normal, depth and object ID\n\t"
+            "--perf\t\t\t\tReport hardware counters of the setup, trace, post-process and output phases\n\t"
+            "--cost-map FILE.ppm\t\tWrite a heatmap of the cycles per pixel, with raw per-pixel costs in FILE.raw\n\t"
+            "--live /NAME\t\t\tAccumulate in POSIX shared memory /NAME, for watching with rtsnap\n\t"
+            "--sync-output\t\t\tWrite the image after rendering instead of streaming finished rows while rendering\n\t"
+            "--trace FILE.json\t\tRecord a timeline of the render threads, for chrome://tracing or Perfetto\n\t"
+            "--aovs PREFIX\t\t\tWrite PREFIX_normal.ppm, PREFIX_depth.ppm and PREFIX_id.ppm\n\t"
+            "--width N\t\t\tImage width in pixels (default: 1080)\n\t"
+            "--height N\t\t\tImage height in pixels (default: width / 16 * 9)\n\t"
+            "--threads N\t\t\tThreads for rendering and denoising (default: all CPUs)\n\t"
+            "--numa\t\t\t\tPin threads to NUMA nodes and trace rows whose memory is local first\n\t"
+            "--numa-replicate\t\tLike --numa, also copying the scene to every node\n\t"
+            "--progressive\t\t\tTrace coarse to fine from 16x16 blocks, writing a preview after every level\n\t"
+            "--snapshot-interval SECONDS\tWrite progressive previews every SECONDS instead of after every level\n\t"
+            "--scene FILE\t\t\tRender the spheres and materials listed in FILE instead of the built-in scene\n\t"
+            "--generate KIND,COUNT[,SEED]\tRender a generated scene of COUNT spheres instead, KIND being cover, cloud,\n\t\t\t\tclusters or huge (default seed: 1)\n\t"
+            "--serve SOCKET\t\t\tServe render jobs on a Unix domain socket instead of writing FILE\n\t"
+            "--scene-cache N\t\t\tBuilt scenes kept in memory while serving (default: 8)\n"
+          );
+}
+
+image_format_t validate_filename(const char *filename) {
+    if (filename == NULL) {
+        return IMAGE_FORMAT_INVALID;
+    }
+
+    size_t len = strlen(filename);
+    if ((len > FILENAME_MAX) || (len < 5)) {
+        return IMAGE_FORMAT_INVALID;
+    }
+
+    if (strcmp(&filename[len - 4 /* Length of .ppm extension */], ".ppm") == 0) {
+        return IMAGE_FORMAT_PPM;
+    }
+
+    if (strcmp(&filename[len - 4 /* Length of .qoi extension */], ".qoi") == 0) {
+        return IMAGE_FORMAT_QOI;
+    }
+
+    return IMAGE_FORMAT_INVALID;
+}
@@ -66,3 +66,24 @@ double vec3_len(vec3_t v) {
 double vec3_len_squared(vec3_t v) {
     return (v.x * v.x) + (v.y * v.y) + (v.z * v.z);
 }
+
+/**
+ * @brief Mirror a vector about a surface with unit normal n.
+ */
+vec3_t vec3_reflect(vec3_t v, vec3_t n) {
+    return vec3_sub(v, vec3_scalar_mul(n, 2.0 * vec3_dot(v, n)));
+}
+
+/**
+ * @brief Refract a unit vector through a surface with unit normal n, following Snell's law.
+ * 
+ * @param uv The unit direction arriving at the surface.
+ * @param n The unit normal, on the side uv arrives from.
+ * @param etai_over_etat The ratio of the refractive indices of both sides.
+ */
+vec3_t vec3_refract(vec3_t uv, vec3_t n, double etai_over_etat) {
+    double cos_theta = fmin(-vec3_dot(uv, n), 1.0);
+    vec3_t r_out_perp = vec3_scalar_mul(vec3_add(uv, vec3_scalar_mul(n, cos_theta)), etai_over_etat);
+    vec3_t r_out_parallel = vec3_scalar_mul(n, -sqrt(fabs(1.0 - vec3_len_squared(r_out_perp))));
+    return vec3_add(r_out_perp, r_out_parallel);
+}
@@ -21,4 +21,7 @@ vec3_t vec3_unit_vec(vec3_t v);
 double vec3_len(vec3_t v);
 double vec3_len_squared(vec3_t v);
 
+vec3_t vec3_reflect(vec3_t v, vec3_t n);
+vec3_t vec3_refract(vec3_t uv, vec3_t n, double etai_over_etat);
+
 #endif
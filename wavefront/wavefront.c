@@ -0,0 +1,444 @@
+#include "wavefront.h"
+#include "../integrator/integrator.h"
+#include "../cost/cost.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void queue_free(wavefront_queue_t *q) {
+    for (int axis = 0; axis < 3; axis++) {
+        free(q->origin[axis]);
+        free(q->direction[axis]);
+        free(q->throughput[axis]);
+    }
+
+    free(q->bsdf_pdf);
+    free(q->path);
+    free(q->rng);
+    memset(q, 0, sizeof(wavefront_queue_t));
+}
+
+static int queue_init(wavefront_queue_t *q, size_t capacity) {
+    int failed = 0;
+
+    memset(q, 0, sizeof(wavefront_queue_t));
+
+    for (int axis = 0; axis < 3; axis++) {
+        q->origin[axis] = malloc(capacity * sizeof(double));
+        q->direction[axis] = malloc(capacity * sizeof(double));
+        q->throughput[axis] = malloc(capacity * sizeof(double));
+        failed |= (q->origin[axis] == NULL) || (q->direction[axis] == NULL) || (q->throughput[axis] == NULL);
+    }
+
+    q->bsdf_pdf = malloc(capacity * sizeof(double));
+    q->path = malloc(capacity * sizeof(uint32_t));
+    q->rng = malloc(capacity * sizeof(rng_t));
+
+    if (failed || (q->bsdf_pdf == NULL) || (q->path == NULL) || (q->rng == NULL)) {
+        queue_free(q);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void shadow_queue_free(wavefront_shadow_queue_t *q) {
+    for (int axis = 0; axis < 3; axis++) {
+        free(q->origin[axis]);
+        free(q->direction[axis]);
+    }
+
+    free(q->t_max);
+    free(q->contribution);
+    free(q->path);
+    memset(q, 0, sizeof(wavefront_shadow_queue_t));
+}
+
+static int shadow_queue_init(wavefront_shadow_queue_t *q, size_t capacity) {
+    int failed = 0;
+
+    memset(q, 0, sizeof(wavefront_shadow_queue_t));
+
+    for (int axis = 0; axis < 3; axis++) {
+        q->origin[axis] = malloc(capacity * sizeof(double));
+        q->direction[axis] = malloc(capacity * sizeof(double));
+        failed |= (q->origin[axis] == NULL) || (q->direction[axis] == NULL);
+    }
+
+    q->t_max = malloc(capacity * sizeof(double));
+    q->contribution = malloc(capacity * sizeof(color_t));
+    q->path = malloc(capacity * sizeof(uint32_t));
+
+    if (failed || (q->t_max == NULL) || (q->contribution == NULL) || (q->path == NULL)) {
+        shadow_queue_free(q);
+        return -1;
+    }
+
+    return 0;
+}
+
+static ray_t queue_ray(const wavefront_queue_t *q, size_t i) {
+    return (ray_t) {
+        .origin = { q->origin[0][i], q->origin[1][i], q->origin[2][i] },
+        .direction = { q->direction[0][i], q->direction[1][i], q->direction[2][i] }
+    };
+}
+
+static size_t queue_push(wavefront_queue_t *q, ray_t r, const double throughput[3], double bsdf_pdf, uint32_t path, rng_t rng) {
+    size_t i = q->count++;
+
+    q->origin[0][i] = r.origin.x;
+    q->origin[1][i] = r.origin.y;
+    q->origin[2][i] = r.origin.z;
+    q->direction[0][i] = r.direction.x;
+    q->direction[1][i] = r.direction.y;
+    q->direction[2][i] = r.direction.z;
+    q->throughput[0][i] = throughput[0];
+    q->throughput[1][i] = throughput[1];
+    q->throughput[2][i] = throughput[2];
+    q->bsdf_pdf[i] = bsdf_pdf;
+    q->path[i] = path;
+    q->rng[i] = rng;
+
+    return i;
+}
+
+static void queue_move(wavefront_queue_t *dst, size_t d, const wavefront_queue_t *src, size_t s) {
+    for (int axis = 0; axis < 3; axis++) {
+        dst->origin[axis][d] = src->origin[axis][s];
+        dst->direction[axis][d] = src->direction[axis][s];
+        dst->throughput[axis][d] = src->throughput[axis][s];
+    }
+
+    dst->bsdf_pdf[d] = src->bsdf_pdf[s];
+    dst->path[d] = src->path[s];
+    dst->rng[d] = src->rng[s];
+}
+
+/**
+ * @brief Allocate the queues and result buffers of a wavefront integrator for up to capacity
+ * paths in flight.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int wavefront_init(wavefront_t *wf, size_t capacity) {
+    if ((wf == NULL) || (capacity == 0) || (capacity > UINT32_MAX)) {
+        return -1;
+    }
+
+    memset(wf, 0, sizeof(wavefront_t));
+    wf->capacity = capacity;
+
+    int failed = (queue_init(&wf->current, capacity) != 0) | (queue_init(&wf->next, capacity) != 0) |
+                 (shadow_queue_init(&wf->shadow, capacity) != 0);
+
+    wf->hit_t = malloc(capacity * sizeof(double));
+    wf->hit_prim = malloc(capacity * sizeof(const void*));
+    wf->hit_finalize = malloc(capacity * sizeof(*wf->hit_finalize));
+    wf->hits = malloc(capacity * sizeof(hit_record_t));
+    wf->miss_rays = malloc(capacity * sizeof(uint32_t));
+    wf->diffuse_rays = malloc(capacity * sizeof(uint32_t));
+    wf->metal_rays = malloc(capacity * sizeof(uint32_t));
+    wf->dielectric_rays = malloc(capacity * sizeof(uint32_t));
+    wf->octant = malloc(capacity);
+    wf->radiance = malloc(capacity * sizeof(color_t));
+    wf->aov = malloc(capacity * sizeof(aov_sample_t));
+
+    if (failed || (wf->hit_t == NULL) || (wf->hit_prim == NULL) || (wf->hit_finalize == NULL) || (wf->hits == NULL) ||
+        (wf->miss_rays == NULL) || (wf->diffuse_rays == NULL) || (wf->metal_rays == NULL) ||
+        (wf->dielectric_rays == NULL) || (wf->octant == NULL) ||
+        (wf->radiance == NULL) || (wf->aov == NULL)) {
+        wavefront_free(wf);
+        return -1;
+    }
+
+    return 0;
+}
+
+void wavefront_free(wavefront_t *wf) {
+    if (wf == NULL) {
+        return;
+    }
+
+    queue_free(&wf->current);
+    queue_free(&wf->next);
+    shadow_queue_free(&wf->shadow);
+
+    free(wf->hit_t);
+    free(wf->hit_prim);
+    free(wf->hit_finalize);
+    free(wf->hits);
+    free(wf->miss_rays);
+    free(wf->diffuse_rays);
+    free(wf->metal_rays);
+    free(wf->dielectric_rays);
+    free(wf->octant);
+    free(wf->radiance);
+    free(wf->aov);
+
+    memset(wf, 0, sizeof(wavefront_t));
+}
+
+// Camera kernel, fills the current queue with the primary rays of a range of paths
+static void wavefront_generate(wavefront_t *wf, const wavefront_params_t *params, const wavefront_pixel_t *pixels, size_t path_begin, size_t path_end) {
+    const double unit[3] = { 1.0, 1.0, 1.0 };
+    size_t spp = (size_t) params->samples_per_pixel;
+
+    wf->current.count = 0;
+
+    for (size_t p = path_begin; p < path_end; p++) {
+        const wavefront_pixel_t *pixel = &pixels[p / spp];
+        uint32_t sample = params->sample_offset + (uint32_t) (p % spp);
+        rng_t rng = rng_for_sample(((uint64_t) pixel->j * params->frame_width) + pixel->x, sample);
+
+        double du = params->jitter ? random_double(&rng) : 0.0;
+        double dv = params->jitter ? random_double(&rng) : 0.0;
+
+        double u = ((pixel->x + du) / (params->frame_width - 1));
+        double v = ((pixel->j + dv) / (params->frame_height - 1));
+
+        queue_push(&wf->current, get_ray(params->camera, u, v), unit, 0.0, (uint32_t) (p - path_begin), rng);
+
+        wf->radiance[p - path_begin] = (color_t) { 0, 0, 0 };
+        wf->aov[p - path_begin] = (aov_sample_t) { .normal = { 0, 0, 0 }, .depth = 0.0, .prim = NULL };
+    }
+}
+
+// Closest hit kernel over the whole current queue. Primary rays go through the bin of their tile.
+static void wavefront_intersect(wavefront_t *wf, const wavefront_params_t *params, const wavefront_pixel_t *pixels, size_t path_begin, int depth) {
+    const wavefront_queue_t *q = &wf->current;
+    int use_bins = (depth == 0) && (params->bins != NULL);
+    uint64_t tests = cost_counter.tests;
+
+    for (size_t i = 0; i < q->count; i++) {
+        hittable_t target = params->world;
+        tile_bin_t bin;
+        hit_record_t rec;
+
+        if (use_bins) {
+            const wavefront_pixel_t *pixel = &pixels[(path_begin + q->path[i]) / (size_t) params->samples_per_pixel];
+            bin = tile_bins_lookup(params->bins, pixel->x, pixel->j);
+            target = tile_bin_to_hittable(&bin);
+        }
+
+        if (target.hit(target.ptr, queue_ray(q, i), INTEGRATOR_T_MIN, INFINITY, &rec) == 1) {
+            wf->hit_t[i] = rec.t;
+            wf->hit_prim[i] = rec.prim;
+            wf->hit_finalize[i] = rec.finalize;
+        } else {
+            wf->hit_prim[i] = NULL;
+        }
+    }
+
+    if (depth == 0) {
+        wf->primary_rays += q->count;
+        wf->primary_tests += cost_counter.tests - tests;
+    }
+}
+
+// Sky kernel, ends the paths of rays that hit nothing
+static void wavefront_shade_miss(wavefront_t *wf, size_t count) {
+    const wavefront_queue_t *q = &wf->current;
+
+    for (size_t k = 0; k < count; k++) {
+        uint32_t i = wf->miss_rays[k];
+        color_t throughput = { q->throughput[0][i], q->throughput[1][i], q->throughput[2][i] };
+
+        wf->radiance[q->path[i]] = add_color(wf->radiance[q->path[i]], mul_color(throughput, integrator_sky(queue_ray(q, i))));
+    }
+}
+
+// Scatter function of one material type, as called by its shading kernel
+typedef int (*wavefront_scatter_t)(const material_t*, ray_t, const hit_record_t*, rng_t*, color_t*, ray_t*);
+
+// Shading kernel of one material type. Bounces the rays that hit it off their surfaces and
+// pushes the paths that are neither absorbed nor ended by Russian roulette into the next queue.
+static void wavefront_shade_material(wavefront_t *wf, const wavefront_params_t *params, const uint32_t *rays, size_t count, int depth, wavefront_scatter_t scatter) {
+    const wavefront_queue_t *q = &wf->current;
+
+    for (size_t k = 0; k < count; k++) {
+        uint32_t i = rays[k];
+        const hit_record_t *rec = &wf->hits[i];
+        rng_t rng = q->rng[i];
+        color_t attenuation;
+        ray_t scattered;
+
+        const material_t *material = material_or_default(rec->material);
+
+        if (scatter(material, queue_ray(q, i), rec, &rng, &attenuation, &scattered) == 0) {
+            continue;
+        }
+
+        double bsdf_pdf = integrator_bsdf_pdf(material, rec, scattered);
+        color_t throughput = mul_color((color_t) { q->throughput[0][i], q->throughput[1][i], q->throughput[2][i] }, attenuation);
+
+        if ((depth >= params->rr_depth) && (integrator_russian_roulette(&throughput, &rng) == 0)) {
+            continue;
+        }
+
+        size_t n = queue_push(&wf->next, scattered, (double[3]) { throughput.r, throughput.g, throughput.b }, bsdf_pdf, q->path[i], rng);
+        wf->octant[n] = (uint8_t) ((scattered.direction.x < 0.0) | ((scattered.direction.y < 0.0) << 1) | ((scattered.direction.z < 0.0) << 2));
+    }
+}
+
+// Finalizes the hits of the current bounce and groups the rays by the kernel shading them
+static void wavefront_classify(wavefront_t *wf, const wavefront_params_t *params, size_t path_begin, int depth, size_t counts[4]) {
+    const wavefront_queue_t *q = &wf->current;
+    size_t spp = (size_t) params->samples_per_pixel;
+    size_t misses = 0;
+    size_t diffuse = 0;
+    size_t metal = 0;
+    size_t dielectric = 0;
+
+    for (size_t i = 0; i < q->count; i++) {
+        if (wf->hit_prim[i] == NULL) {
+            wf->miss_rays[misses++] = (uint32_t) i;
+            continue;
+        }
+
+        ray_t r = queue_ray(q, i);
+        hit_record_t *rec = &wf->hits[i];
+
+        *rec = (hit_record_t) { .t = wf->hit_t[i], .prim = wf->hit_prim[i], .finalize = wf->hit_finalize[i] };
+        hit_record_finalize(rec, r);
+
+        // Auxiliary data holds the first hit of the first sample
+        if ((depth == 0) && (params->sample_offset + ((path_begin + q->path[i]) % spp) == 0)) {
+            wf->aov[q->path[i]] = (aov_sample_t) { .normal = rec->normal, .depth = rec->t * vec3_len(r.direction), .prim = rec->prim };
+        }
+
+        const material_t *material = material_or_default(rec->material);
+        color_t throughput = { q->throughput[0][i], q->throughput[1][i], q->throughput[2][i] };
+
+        switch (material->type) {
+            case MATERIAL_EMISSIVE:
+                // Paths end at lights
+                wf->radiance[q->path[i]] = add_color(wf->radiance[q->path[i]], mul_color(throughput, integrator_emission(params->lights, material, r, rec, q->bsdf_pdf[i])));
+                break;
+            case MATERIAL_METAL:
+                wf->metal_rays[metal++] = (uint32_t) i;
+                break;
+            case MATERIAL_DIELECTRIC:
+                wf->dielectric_rays[dielectric++] = (uint32_t) i;
+                break;
+            default:
+                wf->diffuse_rays[diffuse++] = (uint32_t) i;
+                break;
+        }
+    }
+
+    counts[0] = misses;
+    counts[1] = diffuse;
+    counts[2] = metal;
+    counts[3] = dielectric;
+}
+
+// Light sampling kernel over the rays that hit diffuse surfaces, queues a shadow ray for
+// every light sample that may contribute
+static void wavefront_sample_lights(wavefront_t *wf, const wavefront_params_t *params, size_t count) {
+    wavefront_queue_t *q = &wf->current;
+    wavefront_shadow_queue_t *sq = &wf->shadow;
+
+    sq->count = 0;
+
+    for (size_t k = 0; k < count; k++) {
+        uint32_t i = wf->diffuse_rays[k];
+        const hit_record_t *rec = &wf->hits[i];
+        ray_t shadow;
+        double t_max;
+        color_t contribution;
+
+        if (integrator_sample_light(params->lights, material_or_default(rec->material), rec, &q->rng[i], &shadow, &t_max, &contribution) == 0) {
+            continue;
+        }
+
+        size_t n = sq->count++;
+        color_t throughput = { q->throughput[0][i], q->throughput[1][i], q->throughput[2][i] };
+
+        sq->origin[0][n] = shadow.origin.x;
+        sq->origin[1][n] = shadow.origin.y;
+        sq->origin[2][n] = shadow.origin.z;
+        sq->direction[0][n] = shadow.direction.x;
+        sq->direction[1][n] = shadow.direction.y;
+        sq->direction[2][n] = shadow.direction.z;
+        sq->t_max[n] = t_max;
+        sq->contribution[n] = mul_color(throughput, contribution);
+        sq->path[n] = q->path[i];
+    }
+}
+
+// Any-hit kernel over the shadow queue, adds the light of unoccluded samples to their paths
+static void wavefront_trace_shadows(wavefront_t *wf, const wavefront_params_t *params) {
+    const wavefront_shadow_queue_t *sq = &wf->shadow;
+
+    for (size_t n = 0; n < sq->count; n++) {
+        ray_t shadow = {
+            .origin = { sq->origin[0][n], sq->origin[1][n], sq->origin[2][n] },
+            .direction = { sq->direction[0][n], sq->direction[1][n], sq->direction[2][n] }
+        };
+
+        if (hittable_occluded(&params->world, shadow, INTEGRATOR_T_MIN, sq->t_max[n]) == 0) {
+            wf->radiance[sq->path[n]] = add_color(wf->radiance[sq->path[n]], sq->contribution[n]);
+        }
+    }
+}
+
+// Counting sort of the next queue by direction octant into the current one, so that the rays
+// of a bounce traverse the scene in coherent groups
+static void wavefront_sort_next(wavefront_t *wf) {
+    size_t start[8] = { 0 };
+
+    for (size_t i = 0; i < wf->next.count; i++) {
+        start[wf->octant[i]]++;
+    }
+
+    size_t sum = 0;
+    for (int o = 0; o < 8; o++) {
+        size_t bucket = start[o];
+        start[o] = sum;
+        sum += bucket;
+    }
+
+    for (size_t i = 0; i < wf->next.count; i++) {
+        queue_move(&wf->current, start[wf->octant[i]]++, &wf->next, i);
+    }
+
+    wf->current.count = wf->next.count;
+    wf->next.count = 0;
+}
+
+/**
+ * @brief Trace a range of paths breadth first. Every bounce runs the closest hit kernel over
+ * all rays in flight, then the sky and per-material shading kernels over the rays grouped by
+ * what they hit. Light sampling at diffuse hits runs as its own pair of kernels, queueing
+ * shadow rays and then tracing them. Rays that survive are compacted into the next queue
+ * and sorted by direction octant. The results end up in wf->radiance and wf->aov.
+ * 
+ * @param wf The wavefront working set.
+ * @param params The camera, scene and sampling parameters.
+ * @param pixels The pixels the paths belong to, samples_per_pixel paths each.
+ * @param path_begin The first path to trace.
+ * @param path_end One past the last path to trace, at most wf->capacity paths after path_begin.
+ */
+void wavefront_trace(wavefront_t *wf, const wavefront_params_t *params, const wavefront_pixel_t *pixels, size_t path_begin, size_t path_end) {
+    if ((path_end <= path_begin) || (path_end - path_begin > wf->capacity)) {
+        return;
+    }
+
+    wavefront_generate(wf, params, pixels, path_begin, path_end);
+
+    for (int depth = 0; (depth < params->max_depth) && (wf->current.count > 0); depth++) {
+        size_t counts[4];
+
+        wavefront_intersect(wf, params, pixels, path_begin, depth);
+        wavefront_classify(wf, params, path_begin, depth, counts);
+
+        wavefront_shade_miss(wf, counts[0]);
+        wavefront_sample_lights(wf, params, counts[1]);
+        wavefront_trace_shadows(wf, params);
+        wavefront_shade_material(wf, params, wf->diffuse_rays, counts[1], depth, material_scatter_diffuse);
+        wavefront_shade_material(wf, params, wf->metal_rays, counts[2], depth, material_scatter_metal);
+        wavefront_shade_material(wf, params, wf->dielectric_rays, counts[3], depth, material_scatter_dielectric);
+        wavefront_sort_next(wf);
+    }
+}
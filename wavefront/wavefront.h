@@ -0,0 +1,106 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "../camera/camera.h"
+#include "../color/color.h"
+#include "../random/random.h"
+#include "../aov/aov.h"
+#include "../tile_bin/tile_bin.h"
+#include "../light/light.h"
+#include "../hittable.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A pixel of the frame, with rows counted from the bottom like the camera's v coordinate
+typedef struct {
+    int x;
+    int j;
+} wavefront_pixel_t;
+
+typedef struct {
+    camera_t camera;
+    hittable_t world;
+
+    // Optional per-tile candidate lists for primary rays, NULL to trace them against world
+    const tile_bins_t *bins;
+
+    // Lights sampled at diffuse bounces, NULL to disable light sampling
+    const light_set_t *lights;
+
+    int frame_width;
+    int frame_height;
+    int samples_per_pixel;
+    uint32_t sample_offset;
+    int jitter;
+    int max_depth;
+    int rr_depth;
+} wavefront_params_t;
+
+// A queue of in-flight rays, stored as a structure of arrays
+typedef struct {
+    size_t count;
+
+    double *origin[3];
+    double *direction[3];
+    double *throughput[3];
+
+    // Density the ray was scattered with, 0 for camera rays and specular bounces
+    double *bsdf_pdf;
+
+    uint32_t *path;
+    rng_t *rng;
+} wavefront_queue_t;
+
+// Shadow rays of light sampling, with the light each adds to its path if unoccluded
+typedef struct {
+    size_t count;
+
+    double *origin[3];
+    double *direction[3];
+    double *t_max;
+    color_t *contribution;
+    uint32_t *path;
+} wavefront_shadow_queue_t;
+
+// Working set of a wavefront integrator, used by one thread at a time. Paths are numbered
+// pixel * samples_per_pixel + sample over the pixel list they are traced for.
+typedef struct {
+    size_t capacity;
+
+    // Rays of the current bounce, and the survivors making up the next one
+    wavefront_queue_t current;
+    wavefront_queue_t next;
+    wavefront_shadow_queue_t shadow;
+
+    // Closest hit of every ray of the current bounce, prim is NULL for misses. Hits are
+    // finalized into hits before they are grouped by material.
+    double *hit_t;
+    const void **hit_prim;
+    void (**hit_finalize)(const void*, ray_t, hit_record_t*);
+    hit_record_t *hits;
+
+    // Queue indices of rays grouped by the kernel shading them
+    uint32_t *miss_rays;
+    uint32_t *diffuse_rays;
+    uint32_t *metal_rays;
+    uint32_t *dielectric_rays;
+    uint8_t *octant;
+
+    // Results per path of the last wavefront_trace, relative to path_begin. aov is only
+    // written for paths of sample 0.
+    color_t *radiance;
+    aov_sample_t *aov;
+
+    // Primary rays intersected since wavefront_init, and the sphere tests they took
+    uint64_t primary_rays;
+    uint64_t primary_tests;
+} wavefront_t;
+
+int wavefront_init(wavefront_t *wf, size_t capacity);
+
+void wavefront_free(wavefront_t *wf);
+
+void wavefront_trace(wavefront_t *wf, const wavefront_params_t *params, const wavefront_pixel_t *pixels, size_t path_begin, size_t path_end);
+
+#endif
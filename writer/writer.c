@@ -0,0 +1,190 @@
+#include "writer.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Rows quantized at once before they are encoded
+#define WRITER_BAND_ROWS 16
+
+// How long the writer sleeps when no rows have been finished
+#define WRITER_POLL_NS 200000L
+
+/**
+ * @brief Take every range of finished rows queued so far.
+ * 
+ * @return Returns the amount of ranges taken.
+ */
+static int image_writer_drain(image_writer_t *writer) {
+    int taken = 0;
+
+    for (;;) {
+        writer_slot_t *slot = &writer->slots[writer->tail % WRITER_QUEUE_SIZE];
+
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != writer->tail + 1) {
+            return taken;
+        }
+
+        memset(&writer->finished[slot->begin], 1, (size_t) (slot->end - slot->begin));
+
+        // Hand the slot back to producers one lap later
+        atomic_store_explicit(&slot->sequence, writer->tail + WRITER_QUEUE_SIZE, memory_order_release);
+        writer->tail++;
+        taken++;
+    }
+}
+
+// Encode the finished rows that continue the image, in bands
+static void image_writer_emit(image_writer_t *writer) {
+    int width = writer->view.width;
+
+    while ((writer->next_row < writer->view.height) && writer->finished[writer->next_row]) {
+        int end = writer->next_row;
+
+        while ((end < writer->view.height) && (end - writer->next_row < WRITER_BAND_ROWS) && writer->finished[end]) {
+            end++;
+        }
+
+        if (writer->retval == 0) {
+            framebuffer_resolve(&writer->view, writer->tonemap, writer->band, writer->next_row, end);
+            writer->retval = image_stream_write(&writer->stream, writer->band, (size_t) (end - writer->next_row) * width);
+        }
+
+        writer->next_row = end;
+    }
+}
+
+static void *image_writer_run(void *arg) {
+    image_writer_t *writer = (image_writer_t*) arg;
+    struct timespec poll = { .tv_sec = 0, .tv_nsec = WRITER_POLL_NS };
+
+    while (writer->next_row < writer->view.height) {
+        // Ranges pushed before closing was set are drained once more after seeing it
+        int closing = atomic_load_explicit(&writer->closing, memory_order_acquire);
+        int taken = image_writer_drain(writer);
+
+        image_writer_emit(writer);
+
+        if (closing) {
+            break;
+        }
+
+        if (taken == 0) {
+            nanosleep(&poll, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Write the header of an image and start a thread writing the rows of a framebuffer
+ * as they are reported finished. The framebuffer may be rendered into meanwhile, but every
+ * row has to be final once it is pushed.
+ * 
+ * @param file The open file to write to, which the caller closes after image_writer_finish.
+ * @param samples The sample count every pixel holds once it is finished, as the framebuffer
+ * sample count is only raised at the end of a render.
+ * @param tonemap The post-process settings, which have to stay valid until finishing.
+ * 
+ * @return Returns 0 on success, -1 on error or invalid argument.
+ */
+int image_writer_start(image_writer_t *writer, FILE *file, image_format_t format, const framebuffer_t *fb, uint32_t samples, const tonemap_t *tonemap) {
+    if ((writer == NULL) || (fb == NULL) || (fb->rgb == NULL) || (tonemap == NULL)) {
+        return -1;
+    }
+
+    writer->view = *fb;
+    writer->view.samples = samples;
+    writer->tonemap = tonemap;
+    writer->tail = 0;
+    writer->next_row = 0;
+    writer->retval = 0;
+    writer->finished = calloc((size_t) fb->height, 1);
+    writer->band = malloc((size_t) fb->width * WRITER_BAND_ROWS * 3);
+    atomic_init(&writer->head, 0);
+    atomic_init(&writer->closing, 0);
+
+    for (size_t i = 0; i < WRITER_QUEUE_SIZE; i++) {
+        atomic_init(&writer->slots[i].sequence, i);
+    }
+
+    if ((writer->finished == NULL) || (writer->band == NULL) ||
+        (image_stream_begin(&writer->stream, file, format, fb->width, fb->height) != 0)) {
+        free(writer->finished);
+        free(writer->band);
+        return -1;
+    }
+
+    if (pthread_create(&writer->thread, NULL, image_writer_run, writer) != 0) {
+        image_stream_end(&writer->stream);
+        free(writer->finished);
+        free(writer->band);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Report rows as finished. Safe to call from any amount of threads at once, and only
+ * waits if the writer is a full queue behind.
+ * 
+ * @param begin The first finished row.
+ * @param end The row after the last finished one.
+ */
+void image_writer_push(image_writer_t *writer, int begin, int end) {
+    size_t pos = atomic_load_explicit(&writer->head, memory_order_relaxed);
+
+    for (;;) {
+        writer_slot_t *slot = &writer->slots[pos % WRITER_QUEUE_SIZE];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+        if (sequence == pos) {
+            // The slot is free for this lap, claim it unless another producer was faster
+            if (atomic_compare_exchange_weak_explicit(&writer->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                slot->begin = begin;
+                slot->end = end;
+                atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+                return;
+            }
+        } else if (sequence < pos) {
+            // Full, the writer has not taken this slot's previous range yet
+            sched_yield();
+            pos = atomic_load_explicit(&writer->head, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&writer->head, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief image_writer_push in the form of the rows_done callback of render settings.
+ */
+void image_writer_rows_done(void *writer, int begin, int end) {
+    image_writer_push((image_writer_t*) writer, begin, end);
+}
+
+/**
+ * @brief Wait for the writer to write every row pushed so far and finish the image. Rows that
+ * were never pushed are left out, which makes the image incomplete.
+ * 
+ * @return Returns 0 if the whole image was written, -1 on error or if rows are missing.
+ */
+int image_writer_finish(image_writer_t *writer) {
+    atomic_store_explicit(&writer->closing, 1, memory_order_release);
+    pthread_join(writer->thread, NULL);
+
+    int retval = ((writer->retval != 0) || (writer->next_row < writer->view.height)) ? -1 : 0;
+
+    if (image_stream_end(&writer->stream) != 0) {
+        retval = -1;
+    }
+
+    free(writer->finished);
+    free(writer->band);
+    writer->finished = NULL;
+    writer->band = NULL;
+
+    return retval;
+}
@@ -0,0 +1,52 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include "../framebuffer/framebuffer.h"
+#include "../image/image.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Finished row ranges the writer can lag behind the render threads by before they wait
+#define WRITER_QUEUE_SIZE 1024
+
+// A range of finished rows, in a slot of the queue. sequence tells producers and the writer
+// whose turn it is to use the slot.
+typedef struct {
+    atomic_size_t sequence;
+    int begin;
+    int end;
+} writer_slot_t;
+
+// A thread that tone maps, quantizes, encodes and writes an image while it is being rendered.
+// Render threads push finished row ranges in any order through a bounded lock-free queue, and
+// the writer emits every contiguous run of finished rows from the top as soon as it has it.
+typedef struct {
+    framebuffer_t view;
+    const tonemap_t *tonemap;
+    image_stream_t stream;
+
+    writer_slot_t slots[WRITER_QUEUE_SIZE];
+    atomic_size_t head;
+    size_t tail;
+
+    uint8_t *finished;
+    uint8_t *band;
+    int next_row;
+
+    pthread_t thread;
+    atomic_int closing;
+    int retval;
+} image_writer_t;
+
+int image_writer_start(image_writer_t *writer, FILE *file, image_format_t format, const framebuffer_t *fb, uint32_t samples, const tonemap_t *tonemap);
+
+void image_writer_push(image_writer_t *writer, int begin, int end);
+
+void image_writer_rows_done(void *writer, int begin, int end);
+
+int image_writer_finish(image_writer_t *writer);
+
+#endif